@@ -42,6 +42,7 @@ my %cli_options = ();
         'no-plater'             => \$opt{no_plater},
         'gui-mode=s'            => \$opt{obsolete_ignore_this_option_gui_mode},
         'datadir=s'             => \$opt{datadir},
+        'slice-cache=s'         => \$opt{slice_cache},
         'export-svg'            => \$opt{export_svg},
         'merge|m'               => \$opt{merge},
         'repair'                => \$opt{repair},
@@ -101,6 +102,9 @@ if ($opt{save}) {
 my $config = Slic3r::Config::new_from_defaults;
 $config->apply($cli_config);
 
+# reuse the slices of the objects sliced before
+Slic3r::set_slice_cache_dir(Slic3r::decode_path($opt{slice_cache})) if $opt{slice_cache};
+
 # launch GUI
 my $gui;
 if ((!@ARGV || $opt{gui}) && !$opt{no_gui} && !$opt{save} && eval "require Slic3r::GUI; 1") {
@@ -265,6 +269,8 @@ Usage: slic3r.pl [ OPTIONS ] [ file.stl ] [ file2.stl ] ...
     --split             Split the shells contained in given STL file into several STL files
     --info              Output information about the supplied file(s) and exit
     -j, --threads <num> Number of threads to use (1+, default: $config->{threads})
+    --slice-cache <dir> Store the slices of the objects into the specified directory and reuse them
+                        when the same objects are sliced again with the same layer heights
 
   GUI options:
     --gui               Forces the GUI launch instead of command line slicing (if you
@@ -1,4 +1,4 @@
-use Test::More tests => 81;
+use Test::More tests => 84;
 use strict;
 use warnings;
 
@@ -76,6 +76,15 @@ use Slic3r::Test;
     is $parser->process('{min(13.4, -1238.1)}'), '-1238.1', 'math: min(13.4, -1238.1)';
     is $parser->process('{max(13.4, -1238.1)}'), '13.4', 'math: max(13.4, -1238.1)';
 
+    # The compiled templates are cached, the variables are resolved each time the template is processed.
+    my $templ = "G1 Z[bar]\n{if bar == 2}two{else}other {bar}{endif}";
+    is $parser->process($templ), "G1 Z2\ntwo", 'compiled template';
+    $parser->set('bar' => 3);
+    is $parser->process($templ), "G1 Z3\nother 3", 'compiled template with a variable changed';
+    $parser->set('bar' => 2);
+    eval { $parser->process("G1 Z[bar]\n[nonexistent]") };
+    like $@, qr/^Parsing error at line 2: Variable does not exist/, 'error reported at the position in the compiled template';
+
     # Test the boolean expression parser.
     is $parser->evaluate_boolean_expression('12 == 12'), 1, 'boolean expression parser: 12 == 12';
     is $parser->evaluate_boolean_expression('12 != 12'), 0, 'boolean expression parser: 12 != 12';
@@ -1,4 +1,4 @@
-use Test::More tests => 25;
+use Test::More tests => 27;
 use strict;
 use warnings;
 
@@ -191,6 +191,30 @@ use Slic3r::Test;
     }
 }
 
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('gcode_flavor', 'marlin');
+    $config->set('remaining_times', 1);
+    $config->set('silent_mode', 1);
+    my $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+    my $gcode = Slic3r::Test::gcode($print);
+
+    my (@normal, @silent);
+    my ($misplaced, $misordered) = (0, 0);
+    my $previous = '';
+    for my $line (split /\n/, $gcode) {
+        if ($line =~ /^M73 ([PQ])(\d+) [RS](\d+)/) {
+            push @{ ($1 eq 'P') ? \@normal : \@silent }, [ $2, $3 ];
+            # the remaining times follow an extruding move, the silent mode before the normal mode
+            $misplaced = 1 if $previous !~ /^M73 / && $previous !~ /^G1 .*E/;
+            $misordered = 1 if $1 eq 'Q' && $previous =~ /^M73 P/;
+        }
+        $previous = $line;
+    }
+    ok @normal && @silent, 'remaining times are exported for both the normal and the silent mode';
+    ok !$misplaced && !$misordered, 'remaining times of both modes are placed after the extruding moves, the silent mode first';
+}
+
 {
     my $config = Slic3r::Config::new_from_defaults;
     $config->set('start_gcode', 'START:[input_filename]');
@@ -0,0 +1,235 @@
+use Test::More tests => 12;
+use strict;
+use warnings;
+
+BEGIN {
+    use FindBin;
+    use lib "$FindBin::Bin/../lib";
+    use local::lib "$FindBin::Bin/../local-lib";
+}
+
+use Slic3r;
+use Slic3r::Test;
+
+# Nested array of coordinates as a string.
+sub pp_to_string {
+    my ($pp) = @_;
+    return join ',', map { ref($_) ? '[' . pp_to_string($_) . ']' : $_ } @$pp;
+}
+
+sub surfaces_to_string {
+    my ($surfaces) = @_;
+    return join ';', map { join ':', $_->surface_type, $_->extra_perimeters, pp_to_string($_->expolygon->pp) } @$surfaces;
+}
+
+sub extrusions_to_string {
+    my ($collection) = @_;
+    return join ';', map pp_to_string($_->pp), @{$collection->polygons_covered_by_width};
+}
+
+# Dump of the layers of the first object of a processed print: the layer and region slices,
+# the perimeters, the fill surfaces and the fills, to compare a modified print against a print sliced from scratch.
+sub dump_layers {
+    my ($print) = @_;
+    
+    my @layers = ();
+    foreach my $layer (@{$print->print->get_object(0)->layers}) {
+        my @regions = map {
+            my $layerm = $layer->get_region($_);
+            join '|',
+                surfaces_to_string($layerm->slices),
+                extrusions_to_string($layerm->perimeters),
+                surfaces_to_string($layerm->fill_surfaces),
+                extrusions_to_string($layerm->fills);
+        } 0..($layer->region_count - 1);
+        push @layers, join '#', $layer->print_z, $layer->height, pp_to_string($layer->slices->pp), @regions;
+    }
+    return \@layers;
+}
+
+# Append a copy of the first perimeter and of the first fill to the layers of the first object.
+# The copies are dropped from the layers, which are regenerated.
+sub add_sentinel_extrusions {
+    my ($print) = @_;
+    
+    foreach my $layer (@{$print->print->get_object(0)->layers}) {
+        foreach my $layerm (map $layer->get_region($_), 0..($layer->region_count - 1)) {
+            $_->append($_->[0]) for grep $_->count > 0, $layerm->perimeters, $layerm->fills;
+        }
+    }
+}
+
+# Number of the perimeters and of the fills of the layers of the first object.
+sub count_extrusions {
+    my ($print) = @_;
+    
+    return [ map {
+        my $layer = $_;
+        join ':', map {
+            my $layerm = $layer->get_region($_);
+            map $_->count, $layerm->perimeters, $layerm->fills;
+        } 0..($layer->region_count - 1);
+    } @{$print->print->get_object(0)->layers} ];
+}
+
+# Number of the layers, which differ.
+sub count_different_layers {
+    my ($layers1, $layers2) = @_;
+    
+    return scalar(@$layers1) != scalar(@$layers2) ? -1 :
+        scalar(grep { $layers1->[$_] ne $layers2->[$_] } 0..$#$layers1);
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.3);
+    $config->set('fill_density', '20%');
+    
+    # Layer height profile modified over a band by the layer height editing.
+    my $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+    $print->process;
+    my $layers_before = dump_layers($print);
+    my $object = $print->print->get_object(0);
+    $object->adjust_layer_height_profile(10, 0.1, 4, 1);
+    $print->apply_config($config);
+    $print->process;
+    my $layers_modified = dump_layers($print);
+    
+    my $model = Slic3r::Test::model('20mm_cube');
+    $model->objects->[0]->set_layer_height_profile($object->model_object->layer_height_profile);
+    my $print_from_scratch = Slic3r::Test::init_print($model, config => $config);
+    $print_from_scratch->process;
+    
+    isnt count_different_layers($layers_before, $layers_modified), 0, 'modified layer height profile changes the layers';
+    is count_different_layers($layers_modified, dump_layers($print_from_scratch)), 0,
+        'modified layer height profile: layers equal to the layers sliced from scratch';
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.3);
+    $config->set('fill_density', '20%');
+    my $modifier_config = Slic3r::Config->new;
+    $modifier_config->set('fill_density', '100%');
+    $modifier_config->set('perimeters', 4);
+    
+    my $model_with_modifier = sub {
+        my ($z) = @_;
+        my $model = Slic3r::Test::model('20mm_cube');
+        $model->objects->[0]->add_volume(
+            mesh        => Slic3r::Test::mesh('box', dim => [ 10, 10, 4 ], translate => [ 5, 5, $z ]),
+            modifier    => 1,
+            config      => $modifier_config,
+        );
+        return $model;
+    };
+    
+    # Modifier volume moved up.
+    my $print = Slic3r::Test::init_print($model_with_modifier->(4), config => $config);
+    $print->process;
+    my $layers_before = dump_layers($print);
+    my $volume = $print->models->[0]->objects->[0]->volumes->[1];
+    $volume->mesh->translate(0, 0, 8);
+    $print->print->reload_object(0);
+    $print->process;
+    my $layers_modified = dump_layers($print);
+    
+    my $print_from_scratch = Slic3r::Test::init_print($model_with_modifier->(12), config => $config);
+    $print_from_scratch->process;
+    
+    is $print->print->get_object(0)->region_count, 2, 'modifier volume creates a region';
+    isnt count_different_layers($layers_before, $layers_modified), 0, 'moved modifier volume changes the layers';
+    is count_different_layers($layers_modified, dump_layers($print_from_scratch)), 0,
+        'moved modifier volume: layers equal to the layers sliced from scratch';
+    
+    # The same model sliced twice from scratch, the dump is deterministic.
+    my $print_again = Slic3r::Test::init_print($model_with_modifier->(12), config => $config);
+    $print_again->process;
+    is count_different_layers(dump_layers($print_from_scratch), dump_layers($print_again)), 0,
+        'layers sliced from scratch are deterministic';
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.3);
+    my $ranges = [ [ 2, 10, 0.1 ] ];
+    
+    # Layer height ranges edited at the model object, then the object is reloaded.
+    my $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+    $print->process;
+    my $layer_count_before = $print->print->get_object(0)->layer_count;
+    $print->models->[0]->objects->[0]->set_layer_height_ranges($ranges);
+    $print->print->reload_object(0);
+    $print->process;
+    
+    my $model = Slic3r::Test::model('20mm_cube');
+    $model->objects->[0]->set_layer_height_ranges($ranges);
+    my $print_from_scratch = Slic3r::Test::init_print($model, config => $config);
+    $print_from_scratch->process;
+    
+    cmp_ok $print->print->get_object(0)->layer_count, '>', $layer_count_before, 'edited layer height ranges add layers';
+    is $print->print->get_object(0)->layer_count, $print_from_scratch->print->get_object(0)->layer_count,
+        'edited layer height ranges: layer count equal to the layer count sliced from scratch';
+}
+
+{
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set('layer_height', 0.3);
+    $config->set('fill_density', '20%');
+    $config->set('ensure_vertical_shell_thickness', 1);
+    my $modifier_config = Slic3r::Config->new;
+    $modifier_config->set('fill_density', '100%');
+    $modifier_config->set('perimeters', 4);
+    
+    my $model_with_modifier = sub {
+        my ($z) = @_;
+        my $model = Slic3r::Test::model('20mm_cube');
+        $model->objects->[0]->add_volume(
+            mesh        => Slic3r::Test::mesh('box', dim => [ 10, 10, 4 ], translate => [ 5, 5, $z ]),
+            modifier    => 1,
+            config      => $modifier_config,
+        );
+        return $model;
+    };
+    
+    # Modifier volume moved from 4-8mm to 6-10mm, only the layers around it are regenerated.
+    my $reload_moved = sub {
+        my ($print) = @_;
+        my $volume = $print->models->[0]->objects->[0]->volumes->[1];
+        $volume->mesh->translate(0, 0, 2);
+        $print->print->reload_object(0);
+        $print->process;
+    };
+    my $print_from_scratch = Slic3r::Test::init_print($model_with_modifier->(6), config => $config);
+    $print_from_scratch->process;
+    my $counts_from_scratch = count_extrusions($print_from_scratch);
+    my $print = Slic3r::Test::init_print($model_with_modifier->(4), config => $config);
+    $print->process;
+    my @layers_before = map $$_, @{$print->print->get_object(0)->layers};
+    add_sentinel_extrusions($print);
+    $reload_moved->($print);
+    my @layers_modified = map $$_, @{$print->print->get_object(0)->layers};
+    my $counts_modified = count_extrusions($print);
+    my @print_z = map $_->print_z, @{$print->print->get_object(0)->layers};
+    
+    # The perimeters and the fill surfaces of a layer depend on a few layers around it, the layers further
+    # than 2mm from the modified slices keep their extrusions including the sentinels.
+    my @far      = grep { $print_z[$_] < 4 - 2 || $print_z[$_] > 10 + 2 } 0..$#print_z;
+    # Layers covered by either the old or the new modifier volume, but not by both.
+    my @modified = grep { ($print_z[$_] > 4.5 && $print_z[$_] < 5.5) || ($print_z[$_] > 8.5 && $print_z[$_] < 9.5) } 0..$#print_z;
+    ok((grep $print_z[$_] < 4, @far) && (grep $print_z[$_] > 10, @far) && @modified, 'layers far from the modifier volume below and above');
+    my $with_sentinels = sub { join ':', map { $_ ? $_ + 1 : 0 } split /:/, $_[0] };
+    is scalar(grep { $counts_modified->[$_] ne $with_sentinels->($counts_from_scratch->[$_]) } @far), 0,
+        'moved modifier volume: layers far from the modifier volume are not regenerated';
+    is scalar(grep { $layers_before[$_] == $layers_modified[$_] || $counts_modified->[$_] ne $counts_from_scratch->[$_] } @modified), 0,
+        'moved modifier volume: layers of the modifier volume are sliced anew and regenerated';
+    
+    # The same modification without the sentinels is equal to the print sliced from scratch.
+    my $print_reloaded = Slic3r::Test::init_print($model_with_modifier->(4), config => $config);
+    $print_reloaded->process;
+    $reload_moved->($print_reloaded);
+    is count_different_layers(dump_layers($print_reloaded), dump_layers($print_from_scratch)), 0,
+        'moved modifier volume: regenerated layers equal to the layers sliced from scratch';
+}
+
+__END__
@@ -0,0 +1,92 @@
+use Test::More tests => 13;
+use strict;
+use warnings;
+
+BEGIN {
+    use FindBin;
+    use lib "$FindBin::Bin/../lib";
+    use local::lib "$FindBin::Bin/../local-lib";
+}
+
+use Cwd qw(abs_path);
+use File::Path qw(make_path remove_tree);
+use Slic3r;
+use Slic3r::Test;
+
+# Nested array of coordinates as a string.
+sub pp_to_string {
+    my ($pp) = @_;
+    return join ',', map { ref($_) ? '[' . pp_to_string($_) . ']' : $_ } @$pp;
+}
+
+# Layer and region slices of all layers of the first object of a processed print.
+sub dump_slices {
+    my ($print) = @_;
+    
+    my @layers = ();
+    foreach my $layer (@{$print->print->get_object(0)->layers}) {
+        my @regions = map {
+            join ';', map pp_to_string($_->expolygon->pp), @{$layer->get_region($_)->slices}
+        } 0..($layer->region_count - 1);
+        push @layers, join '#', $layer->id, $layer->print_z, $layer->height, pp_to_string($layer->slices->pp), @regions;
+    }
+    return join "\n", @layers;
+}
+
+my $cache_dir = abs_path($0) . '.slice_cache.temp';
+remove_tree($cache_dir);
+make_path($cache_dir);
+Slic3r::set_slice_cache_dir($cache_dir);
+
+sub cache_files { return [ sort glob("$cache_dir/*.slices") ]; }
+
+my $config = Slic3r::Config::new_from_defaults;
+$config->set('layer_height', 0.3);
+
+my $print = Slic3r::Test::init_print('20mm_cube', config => $config);
+$print->process;
+my $files = cache_files();
+is scalar(@$files), 1, 'slices are stored to the cache';
+my $inode = (stat($files->[0]))[1];
+
+{
+    # Round trip: the same object sliced again is loaded from the cache.
+    my $print_cached = Slic3r::Test::init_print('20mm_cube', config => $config);
+    $print_cached->process;
+    is scalar(@{cache_files()}), 1, 'no new slices are stored for the same object';
+    is +(stat($files->[0]))[1], $inode, 'cached slices are loaded, not stored again';
+    is dump_slices($print_cached), dump_slices($print), 'slices loaded from the cache equal the sliced ones';
+    ok Slic3r::Test::gcode($print_cached), 'object with the slices loaded from the cache is exported';
+}
+
+# A change of any keyed option or of the mesh misses the cache.
+my $num_files = 1;
+foreach my $change (
+    [ 'layer_height',               0.2  ],
+    [ 'first_layer_height',         0.25 ],
+    [ 'raft_layers',                2    ],
+    [ 'xy_size_compensation',       0.1  ],
+    [ 'elefant_foot_compensation',  0.2  ],
+    [ 'clip_multipart_objects',     1    ],
+) {
+    my ($opt_key, $value) = @$change;
+    my $config_changed = Slic3r::Config::new_from_defaults;
+    $config_changed->apply($config);
+    $config_changed->set($opt_key, $value);
+    my $print_changed = Slic3r::Test::init_print('20mm_cube', config => $config_changed);
+    $print_changed->process;
+    is scalar(@{cache_files()}), ++ $num_files, "modified $opt_key misses the cache";
+}
+
+{
+    # Same layers, different mesh.
+    my $print_changed = Slic3r::Test::init_print('20mm_cube', config => $config, scale_xyz => [ 1.1, 1, 1 ]);
+    $print_changed->process;
+    is scalar(@{cache_files()}), ++ $num_files, 'modified mesh misses the cache';
+    isnt dump_slices($print_changed), dump_slices($print), 'modified mesh is sliced again';
+}
+
+Slic3r::set_slice_cache_dir('');
+remove_tree($cache_dir);
+
+__END__
@@ -25,6 +25,15 @@
 #include <string.h>
 #include <math.h>
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+
 #include "stl.h"
 
 
@@ -34,10 +43,15 @@ static void stl_match_neighbors_nearby(stl_file *stl,
                                        stl_hash_edge *edge_a, stl_hash_edge *edge_b);
 static void stl_record_neighbors(stl_file *stl,
                                  stl_hash_edge *edge_a, stl_hash_edge *edge_b);
+static void stl_set_neighbors(stl_file *stl,
+                              const stl_hash_edge *edge_a, const stl_hash_edge *edge_b);
 static void stl_initialize_facet_check_exact(stl_file *stl);
+static void stl_match_edges_exact_sequential(stl_file *stl);
+static void stl_match_edges_exact_parallel(stl_file *stl);
 static void stl_initialize_facet_check_nearby(stl_file *stl);
-static void stl_load_edge_exact(stl_file *stl, stl_hash_edge *edge,
-                                stl_vertex *a, stl_vertex *b);
+static inline void stl_unify_zeros(stl_facet *facet);
+static float stl_load_edge_exact(stl_hash_edge *edge,
+                                 const stl_vertex *a, const stl_vertex *b);
 static int stl_load_edge_nearby(stl_file *stl, stl_hash_edge *edge,
                                 stl_vertex *a, stl_vertex *b, float tolerance);
 static void insert_hash_edge(stl_file *stl, stl_hash_edge edge,
@@ -64,12 +78,11 @@ stl_check_facets_exact(stl_file *stl) {
   /* This function builds the neighbors list.  No modifications are made
    *  to any of the facets.  The edges are said to match only if all six
    *  floats of the first edge matches all six floats of the second edge.
+   *  An edge is matched with the first preceding unmatched edge of another facet,
+   *  both the parallel and the sequential implementations produce the same neighbors.
    */
 
-  stl_hash_edge  edge;
-  stl_facet      facet;
   int            i;
-  int            j;
 
   if (stl->error) return;
 
@@ -80,20 +93,11 @@ stl_check_facets_exact(stl_file *stl) {
 
   stl_initialize_facet_check_exact(stl);
 
-  for(i = 0; i < stl->stats.number_of_facets; i++) {
-    facet = stl->facet_start[i];
-    // Positive and negative zeros are possible in the floats, which are considered equal by the FP unit.
-    // When using a memcmp on raw floats, those numbers report to be different.
-    // Unify all +0 and -0 to +0 to make the floats equal under memcmp.
-    {
-      uint32_t *f = (uint32_t*)&facet;
-      for (int j = 0; j < 12; ++ j, ++ f) // 3x vertex + normal: 4x3 = 12 floats
-        if (*f == 0x80000000)
-            // Negative zero, switch to positive zero.
-            *f = 0;
-    }
-
-    /* If any two of the three vertices are found to be exactally the same, call them degenerate and remove the facet. */
+  /* If any two of the three vertices are found to be exactally the same, call them degenerate and remove the facet.
+     A removed facet is replaced by the last facet, which is checked next. */
+  for(i = 0; i < (int)stl->stats.number_of_facets; i++) {
+    stl_facet facet = stl->facet_start[i];
+    stl_unify_zeros(&facet);
     if(   !memcmp(&facet.vertex[0], &facet.vertex[1],
                   sizeof(stl_vertex))
           || !memcmp(&facet.vertex[1], &facet.vertex[2],
@@ -103,19 +107,13 @@ stl_check_facets_exact(stl_file *stl) {
       stl->stats.degenerate_facets += 1;
       stl_remove_facet(stl, i);
       i--;
-      continue;
-
-    }
-    for(j = 0; j < 3; j++) {
-      edge.facet_number = i;
-      edge.which_edge = j;
-      stl_load_edge_exact(stl, &edge, &facet.vertex[j],
-                          &facet.vertex[(j + 1) % 3]);
-
-      insert_hash_edge(stl, edge, stl_match_neighbors_exact);
     }
   }
-  stl_free_edges(stl);
+
+  if (stl_parallel == stl_parallel_never)
+    stl_match_edges_exact_sequential(stl);
+  else
+    stl_match_edges_exact_parallel(stl);
 
 #if 0
   printf("Number of faces: %d, number of manifold edges: %d, number of connected edges: %d, number of unconnected edges: %d\r\n", 
@@ -124,19 +122,142 @@ stl_check_facets_exact(stl_file *stl) {
 #endif
 }
 
+/* Inserts the edges one by one into the chained hash table, an edge is matched when inserted. */
 static void
-stl_load_edge_exact(stl_file *stl, stl_hash_edge *edge,
-                    stl_vertex *a, stl_vertex *b) {
+stl_match_edges_exact_sequential(stl_file *stl) {
+  int i;
 
-  if (stl->error) return;
+  stl->M = 81397;
+
+  stl->heads = (stl_hash_edge**)calloc(stl->M, sizeof(*stl->heads));
+  if(stl->heads == NULL) perror("stl_match_edges_exact_sequential");
+
+  stl->tail = (stl_hash_edge*)malloc(sizeof(stl_hash_edge));
+  if(stl->tail == NULL) perror("stl_match_edges_exact_sequential");
+
+  stl->tail->next = stl->tail;
+
+  for(i = 0; i < stl->M; i++) {
+    stl->heads[i] = stl->tail;
+  }
 
+  for(i = 0; i < (int)stl->stats.number_of_facets; i++) {
+    stl_facet facet = stl->facet_start[i];
+    stl_unify_zeros(&facet);
+    for(int j = 0; j < 3; j++) {
+      stl_hash_edge edge;
+      edge.facet_number = i;
+      edge.which_edge = j;
+      stl->stats.shortest_edge = STL_MIN(stl->stats.shortest_edge,
+        stl_load_edge_exact(&edge, &facet.vertex[j], &facet.vertex[(j + 1) % 3]));
+      insert_hash_edge(stl, edge, stl_match_neighbors_exact);
+    }
+  }
+  stl_free_edges(stl);
+}
+
+/* Collects the edges of all facets into a flat array, which is sorted by the edge key in parallel.
+   Then each run of equal keys is matched in parallel the same way the hash table does. */
+static void
+stl_match_edges_exact_parallel(stl_file *stl) {
+  /* Load the edges, sorted by the facet and the edge index. */
+  std::vector<stl_hash_edge> edges(size_t(stl->stats.number_of_facets) * 3);
+  float shortest_edge = tbb::parallel_reduce(
+    tbb::blocked_range<int>(0, int(stl->stats.number_of_facets)), stl->stats.shortest_edge,
+    [stl, &edges](const tbb::blocked_range<int> &range, float shortest_edge) {
+      for (int i = range.begin(); i < range.end(); ++ i) {
+        stl_facet facet = stl->facet_start[i];
+        stl_unify_zeros(&facet);
+        for (int j = 0; j < 3; ++ j) {
+          stl_hash_edge &edge = edges[i * 3 + j];
+          edge.facet_number = i;
+          edge.which_edge = j;
+          edge.next = NULL;
+          shortest_edge = STL_MIN(shortest_edge, stl_load_edge_exact(&edge, &facet.vertex[j], &facet.vertex[(j + 1) % 3]));
+        }
+      }
+      return shortest_edge;
+    },
+    [](float a, float b) { return STL_MIN(a, b); });
+  stl->stats.shortest_edge = shortest_edge;
+
+  /* Sort the edges by their keys, keeping the order of loading for equal keys. */
+  tbb::parallel_sort(edges.begin(), edges.end(), [](const stl_hash_edge &edge_a, const stl_hash_edge &edge_b) {
+    int cmp = memcmp(edge_a.key, edge_b.key, SIZEOF_EDGE_SORT);
+    return (cmp != 0) ? (cmp < 0) :
+      ((edge_a.facet_number != edge_b.facet_number) ? (edge_a.facet_number < edge_b.facet_number) : (edge_a.which_edge % 3 < edge_b.which_edge % 3));
+  });
+
+  /* Match the runs of equal keys. A range processed by a task is extended to the whole runs it starts in.
+     Each edge is matched at most once, thus the tasks record the neighbors of distinct facet edges. */
+  std::atomic<int> num_matched(0);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, edges.size()),
+    [stl, &edges, &num_matched](const tbb::blocked_range<size_t> &range) {
+      auto same_key = [&edges](size_t a, size_t b) { return memcmp(edges[a].key, edges[b].key, SIZEOF_EDGE_SORT) == 0; };
+      size_t begin = range.begin();
+      while (begin > 0 && begin < range.end() && same_key(begin - 1, begin))
+        ++ begin;
+      std::vector<stl_hash_edge*> unmatched;
+      int matched = 0;
+      for (size_t run_begin = begin; run_begin < range.end();) {
+        size_t run_end = run_begin + 1;
+        while (run_end < edges.size() && same_key(run_begin, run_end))
+          ++ run_end;
+        unmatched.clear();
+        for (size_t k = run_begin; k < run_end; ++ k) {
+          stl_hash_edge *edge = &edges[k];
+          auto it = std::find_if(unmatched.begin(), unmatched.end(),
+            [edge](const stl_hash_edge *other) { return other->facet_number != edge->facet_number; });
+          if (it == unmatched.end())
+            unmatched.push_back(edge);
+          else {
+            stl_set_neighbors(stl, edge, *it);
+            unmatched.erase(it);
+            ++ matched;
+          }
+        }
+        run_begin = run_end;
+      }
+      num_matched += matched;
+    });
+
+  /* Count successful connects */
+  stl->stats.connected_edges = 2 * num_matched;
+  for(uint32_t i = 0; i < stl->stats.number_of_facets; i++) {
+    int num_connected = (stl->neighbors_start[i].neighbor[0] != -1) +
+                        (stl->neighbors_start[i].neighbor[1] != -1) +
+                        (stl->neighbors_start[i].neighbor[2] != -1);
+    if (num_connected >= 1)
+      stl->stats.connected_facets_1_edge += 1;
+    if (num_connected >= 2)
+      stl->stats.connected_facets_2_edge += 1;
+    if (num_connected == 3)
+      stl->stats.connected_facets_3_edge += 1;
+  }
+}
+
+/* Positive and negative zeros are possible in the floats, which are considered equal by the FP unit.
+   When using a memcmp on raw floats, those numbers report to be different.
+   Unify all +0 and -0 to +0 to make the floats equal under memcmp. */
+static inline void
+stl_unify_zeros(stl_facet *facet) {
+  uint32_t *f = (uint32_t*)facet;
+  for (int j = 0; j < 12; ++ j, ++ f) // 3x vertex + normal: 4x3 = 12 floats
+    if (*f == 0x80000000)
+        // Negative zero, switch to positive zero.
+        *f = 0;
+}
+
+/* Returns the length of the edge in the maximum norm. */
+static float
+stl_load_edge_exact(stl_hash_edge *edge, const stl_vertex *a, const stl_vertex *b) {
+  float max_diff;
   {
     float diff_x = ABS(a->x - b->x);
     float diff_y = ABS(a->y - b->y);
     float diff_z = ABS(a->z - b->z);
-    float max_diff = STL_MAX(diff_x, diff_y);
+    max_diff = STL_MAX(diff_x, diff_y);
     max_diff = STL_MAX(diff_z, max_diff);
-    stl->stats.shortest_edge = STL_MIN(max_diff, stl->stats.shortest_edge);
   }
 
   // Ensure identical vertex ordering of equal edges.
@@ -153,6 +274,7 @@ stl_load_edge_exact(stl_file *stl, stl_hash_edge *edge,
     memcpy(&edge->key[3], a, sizeof(stl_vertex));
     edge->which_edge += 3; /* this edge is loaded backwards */
   }
+  return max_diff;
 }
 
 static void
@@ -165,27 +287,12 @@ stl_initialize_facet_check_exact(stl_file *stl) {
   stl->stats.freed = 0;
   stl->stats.collisions = 0;
 
-
-  stl->M = 81397;
-
   for(i = 0; i < stl->stats.number_of_facets ; i++) {
     /* initialize neighbors list to -1 to mark unconnected edges */
     stl->neighbors_start[i].neighbor[0] = -1;
     stl->neighbors_start[i].neighbor[1] = -1;
     stl->neighbors_start[i].neighbor[2] = -1;
   }
-
-  stl->heads = (stl_hash_edge**)calloc(stl->M, sizeof(*stl->heads));
-  if(stl->heads == NULL) perror("stl_initialize_facet_check_exact");
-
-  stl->tail = (stl_hash_edge*)malloc(sizeof(stl_hash_edge));
-  if(stl->tail == NULL) perror("stl_initialize_facet_check_exact");
-
-  stl->tail->next = stl->tail;
-
-  for(i = 0; i < stl->M; i++) {
-    stl->heads[i] = stl->tail;
-  }
 }
 
 static void
@@ -406,14 +513,10 @@ stl_initialize_facet_check_nearby(stl_file *stl) {
 
 
 
+/* Sets the neighbors of two matching edges. Only touches the neighbor slots of these two edges. */
 static void
-stl_record_neighbors(stl_file *stl,
-                     stl_hash_edge *edge_a, stl_hash_edge *edge_b) {
-  int i;
-  int j;
-
-  if (stl->error) return;
-
+stl_set_neighbors(stl_file *stl,
+                  const stl_hash_edge *edge_a, const stl_hash_edge *edge_b) {
   /* Facet a's neighbor is facet b */
   stl->neighbors_start[edge_a->facet_number].neighbor[edge_a->which_edge % 3] =
     edge_b->facet_number;	/* sets the .neighbor part */
@@ -439,7 +542,17 @@ stl_record_neighbors(stl_file *stl,
     stl->neighbors_start[edge_b->facet_number].
     which_vertex_not[edge_b->which_edge % 3] += 3;
   }
+}
+
+static void
+stl_record_neighbors(stl_file *stl,
+                     stl_hash_edge *edge_a, stl_hash_edge *edge_b) {
+  int i;
+  int j;
+
+  if (stl->error) return;
 
+  stl_set_neighbors(stl, edge_a, edge_b);
 
   /* Count successful connects */
   /* Total connects */
@@ -880,8 +993,8 @@ stl_fill_holes(stl_file *stl) {
       if(stl->neighbors_start[i].neighbor[j] != -1) continue;
       edge.facet_number = i;
       edge.which_edge = j;
-      stl_load_edge_exact(stl, &edge, &facet.vertex[j],
-                          &facet.vertex[(j + 1) % 3]);
+      stl->stats.shortest_edge = STL_MIN(stl->stats.shortest_edge,
+        stl_load_edge_exact(&edge, &facet.vertex[j], &facet.vertex[(j + 1) % 3]));
 
       insert_hash_edge(stl, edge, stl_match_neighbors_exact);
     }
@@ -936,8 +1049,8 @@ stl_fill_holes(stl_file *stl) {
           for(k = 0; k < 3; k++) {
             edge.facet_number = stl->stats.number_of_facets - 1;
             edge.which_edge = k;
-            stl_load_edge_exact(stl, &edge, &new_facet.vertex[k],
-                                &new_facet.vertex[(k + 1) % 3]);
+            stl->stats.shortest_edge = STL_MIN(stl->stats.shortest_edge,
+              stl_load_edge_exact(&edge, &new_facet.vertex[k], &new_facet.vertex[(k + 1) % 3]));
 
             insert_hash_edge(stl, edge, stl_match_neighbors_exact);
           }
@@ -25,6 +25,15 @@
 
 #include <boost/nowide/cstdio.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
 #include "stl.h"
 
 void
@@ -41,23 +50,69 @@ stl_invalidate_shared_vertices(stl_file *stl) {
   }
 }
 
-void
-stl_generate_shared_vertices(stl_file *stl) {
-  int i;
-  int j;
-  int first_facet;
-  int direction;
-  int facet_num;
-  int vnot;
+/* Walks the fan of facets around the vertex j of the facet first_facet through the neighbors,
+   calling visit(facet, vertex) for each facet vertex of the fan. A corner may be visited more than once.
+   The walk stops early if visit() returns false. */
+template<typename VisitFn>
+static inline void
+stl_walk_vertex_fan(const stl_file *stl, int first_facet, int j, VisitFn visit) {
+  int direction = 0;
+  int reversed = 0;
+  int facet_num = first_facet;
+  int vnot = (j + 2) % 3;
   int next_edge;
   int pivot_vertex;
   int next_facet;
-  int reversed;
 
-  if (stl->error) return;
+  for(;;) {
+    if(vnot > 2) {
+      if(direction == 0) {
+        pivot_vertex = (vnot + 2) % 3;
+        next_edge = pivot_vertex;
+        direction = 1;
+      } else {
+        pivot_vertex = (vnot + 1) % 3;
+        next_edge = vnot % 3;
+        direction = 0;
+      }
+    } else {
+      if(direction == 0) {
+        pivot_vertex = (vnot + 1) % 3;
+        next_edge = vnot;
+      } else {
+        pivot_vertex = (vnot + 2) % 3;
+        next_edge = pivot_vertex;
+      }
+    }
+    if (! visit(facet_num, pivot_vertex))
+      break;
+
+    next_facet = stl->neighbors_start[facet_num].neighbor[next_edge];
+    if(next_facet == -1) {
+      if(reversed) {
+        break;
+      } else {
+        direction = 1;
+        vnot = (j + 1) % 3;
+        reversed = 1;
+        facet_num = first_facet;
+      }
+    } else if(next_facet != first_facet) {
+      vnot = stl->neighbors_start[facet_num].
+             which_vertex_not[next_edge];
+      facet_num = next_facet;
+    } else {
+      break;
+    }
+  }
+}
 
-  /* make sure this function is idempotent and does not leak memory */
-  stl_invalidate_shared_vertices(stl);
+/* The original sequential algorithm: the facet vertices are visited in order, each facet vertex
+   not yet assigned starts a new shared vertex, which is assigned to the whole fan around it. */
+static void
+stl_generate_shared_vertices_sequential(stl_file *stl) {
+  int i;
+  int j;
 
   stl->v_indices = (v_indices_struct*)
                    calloc(stl->stats.number_of_facets, sizeof(v_indices_struct));
@@ -74,9 +129,7 @@ stl_generate_shared_vertices(stl_file *stl) {
     stl->v_indices[i].vertex[2] = -1;
   }
 
-
   for(i = 0; i < stl->stats.number_of_facets; i++) {
-    first_facet = i;
     for(j = 0; j < 3; j++) {
       if(stl->v_indices[i].vertex[j] != -1) {
         continue;
@@ -91,55 +144,165 @@ stl_generate_shared_vertices(stl_file *stl) {
       stl->v_shared[stl->stats.shared_vertices] =
         stl->facet_start[i].vertex[j];
 
-      direction = 0;
-      reversed = 0;
-      facet_num = i;
-      vnot = (j + 2) % 3;
-
-      for(;;) {
-        if(vnot > 2) {
-          if(direction == 0) {
-            pivot_vertex = (vnot + 2) % 3;
-            next_edge = pivot_vertex;
-            direction = 1;
-          } else {
-            pivot_vertex = (vnot + 1) % 3;
-            next_edge = vnot % 3;
-            direction = 0;
-          }
-        } else {
-          if(direction == 0) {
-            pivot_vertex = (vnot + 1) % 3;
-            next_edge = vnot;
-          } else {
-            pivot_vertex = (vnot + 2) % 3;
-            next_edge = pivot_vertex;
-          }
-        }
-        stl->v_indices[facet_num].vertex[pivot_vertex] =
-          stl->stats.shared_vertices;
+      int shared_vertex = stl->stats.shared_vertices;
+      stl_walk_vertex_fan(stl, i, j, [stl, shared_vertex](int facet_num, int pivot_vertex) {
+        stl->v_indices[facet_num].vertex[pivot_vertex] = shared_vertex;
+        return true;
+      });
+      stl->stats.shared_vertices += 1;
+    }
+  }
+}
 
-        next_facet = stl->neighbors_start[facet_num].neighbor[next_edge];
-        if(next_facet == -1) {
-          if(reversed) {
-            break;
+/* Parallel version of stl_generate_shared_vertices_sequential(), producing the same result.
+   The facet vertices (the corners) sharing a vertex over the neighbor links are joined by a lock free union-find,
+   which always links the root with the higher index below the root with the lower index, therefore the root of each set
+   is its lowest corner, which starts the shared vertex. The fan of each starting corner is then walked once to assign
+   the shared vertices. If the fans are not symmetric (a fan walked from another corner would differ, which is only possible
+   with inconsistent neighbors), the fans do not match the sets and false is returned. */
+static bool
+stl_generate_shared_vertices_parallel(stl_file *stl) {
+  const int num_corners = stl->stats.number_of_facets * 3;
+
+  std::unique_ptr<std::atomic<int>[]> parent(new std::atomic<int>[num_corners]);
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_corners),
+    [&parent](const tbb::blocked_range<int> &range) {
+      for (int corner = range.begin(); corner < range.end(); ++ corner)
+        parent[corner].store(corner, std::memory_order_relaxed);
+    });
+  auto find = [&parent](int corner) {
+    for (;;) {
+      int p = parent[corner].load(std::memory_order_relaxed);
+      if (p == corner)
+        return corner;
+      // Path halving, a concurrent update of the parent only makes the path shorter.
+      int gp = parent[p].load(std::memory_order_relaxed);
+      if (gp != p)
+        parent[corner].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+      corner = gp;
+    }
+  };
+  auto unite = [&parent, &find](int a, int b) {
+    for (;;) {
+      a = find(a);
+      b = find(b);
+      if (a == b)
+        return;
+      if (a < b)
+        std::swap(a, b);
+      // Link the higher root below the lower one, unless another thread has linked it meanwhile.
+      int expected = a;
+      if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+        return;
+    }
+  };
+  // The vertices e and e + 1 of the edge e of a facet are shared with the vertices of the neighbor facet
+  // next to the vertex not on the edge, the order depends on the orientation of the neighbor.
+  tbb::parallel_for(tbb::blocked_range<int>(0, stl->stats.number_of_facets),
+    [stl, &unite](const tbb::blocked_range<int> &range) {
+      for (int facet = range.begin(); facet < range.end(); ++ facet)
+        for (int edge = 0; edge < 3; ++ edge) {
+          int neighbor = stl->neighbors_start[facet].neighbor[edge];
+          if (neighbor == -1)
+            continue;
+          int vnot = stl->neighbors_start[facet].which_vertex_not[edge];
+          int first, second;
+          if (vnot > 2) {
+            first  = neighbor * 3 + (vnot + 1) % 3;
+            second = neighbor * 3 + (vnot + 2) % 3;
           } else {
-            direction = 1;
-            vnot = (j + 1) % 3;
-            reversed = 1;
-            facet_num = first_facet;
+            first  = neighbor * 3 + (vnot + 2) % 3;
+            second = neighbor * 3 + (vnot + 1) % 3;
           }
-        } else if(next_facet != first_facet) {
-          vnot = stl->neighbors_start[facet_num].
-                 which_vertex_not[next_edge];
-          facet_num = next_facet;
-        } else {
-          break;
+          unite(facet * 3 + edge, first);
+          unite(facet * 3 + (edge + 1) % 3, second);
         }
+    });
+
+  // Point each corner to the root of its set. Index of the shared vertex started by a corner, or -1.
+  std::vector<int> shared_vertex_of_corner(num_corners, -1);
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_corners),
+    [&parent, &find, &shared_vertex_of_corner](const tbb::blocked_range<int> &range) {
+      for (int corner = range.begin(); corner < range.end(); ++ corner) {
+        int root = find(corner);
+        parent[corner].store(root, std::memory_order_relaxed);
+        if (root == corner)
+          shared_vertex_of_corner[corner] = 1;
       }
-      stl->stats.shared_vertices += 1;
-    }
-  }
+    });
+
+  int num_shared = 0;
+  for (int corner = 0; corner < num_corners; ++ corner)
+    if (shared_vertex_of_corner[corner] != -1)
+      shared_vertex_of_corner[corner] = num_shared ++;
+
+  // Assign the fans to the shared vertices, detecting fans overlapping or not covering all the corners.
+  std::unique_ptr<std::atomic<int>[]> corner_to_shared(new std::atomic<int>[num_corners]);
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_corners),
+    [&corner_to_shared](const tbb::blocked_range<int> &range) {
+      for (int corner = range.begin(); corner < range.end(); ++ corner)
+        corner_to_shared[corner].store(-1, std::memory_order_relaxed);
+    });
+  std::atomic<bool> valid(true);
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_corners),
+    [stl, &parent, &shared_vertex_of_corner, &corner_to_shared, &valid](const tbb::blocked_range<int> &range) {
+      for (int corner = range.begin(); corner < range.end() && valid.load(std::memory_order_relaxed); ++ corner) {
+        int shared_vertex = shared_vertex_of_corner[corner];
+        if (shared_vertex == -1)
+          continue;
+        stl_walk_vertex_fan(stl, corner / 3, corner % 3, [corner, shared_vertex, &parent, &corner_to_shared, &valid](int facet_num, int pivot_vertex) {
+          int expected = -1;
+          // The union-find is complete, the parent of each corner is the root of its set.
+          if (parent[facet_num * 3 + pivot_vertex].load(std::memory_order_relaxed) != corner ||
+              (! corner_to_shared[facet_num * 3 + pivot_vertex].compare_exchange_strong(expected, shared_vertex, std::memory_order_relaxed) &&
+               expected != shared_vertex)) {
+            valid.store(false, std::memory_order_relaxed);
+            return false;
+          }
+          return true;
+        });
+      }
+    });
+  for (int corner = 0; corner < num_corners && valid; ++ corner)
+    if (corner_to_shared[corner].load(std::memory_order_relaxed) == -1)
+      valid = false;
+  if (! valid)
+    return false;
+
+  stl->v_indices = (v_indices_struct*)
+                   malloc(stl->stats.number_of_facets * sizeof(v_indices_struct));
+  if(stl->v_indices == NULL) perror("stl_generate_shared_vertices");
+  stl->v_shared = (stl_vertex*)
+                  malloc(std::max(1, num_shared) * sizeof(stl_vertex));
+  if(stl->v_shared == NULL) perror("stl_generate_shared_vertices");
+  stl->stats.shared_malloced = std::max(1, num_shared);
+  stl->stats.shared_vertices = num_shared;
+  tbb::parallel_for(tbb::blocked_range<int>(0, num_corners),
+    [stl, &shared_vertex_of_corner, &corner_to_shared](const tbb::blocked_range<int> &range) {
+      for (int corner = range.begin(); corner < range.end(); ++ corner) {
+        int shared_vertex = corner_to_shared[corner].load(std::memory_order_relaxed);
+        stl->v_indices[corner / 3].vertex[corner % 3] = shared_vertex;
+        if (shared_vertex_of_corner[corner] != -1)
+          stl->v_shared[shared_vertex] = stl->facet_start[corner / 3].vertex[corner % 3];
+      }
+    });
+  return true;
+}
+
+void
+stl_generate_shared_vertices(stl_file *stl) {
+  if (stl->error) return;
+
+  /* make sure this function is idempotent and does not leak memory */
+  stl_invalidate_shared_vertices(stl);
+
+  /* The parallel version joins the corners and then walks the fans, doing about three times the work
+     of the sequential one, it only pays off for large meshes and with enough worker threads. */
+  bool parallel = (stl_parallel == stl_parallel_auto) ?
+    (stl->stats.number_of_facets >= 65536 && tbb::this_task_arena::max_concurrency() >= 4) :
+    (stl_parallel == stl_parallel_always);
+  if (! parallel || ! stl_generate_shared_vertices_parallel(stl))
+    stl_generate_shared_vertices_sequential(stl);
 }
 
 void
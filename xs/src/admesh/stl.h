@@ -74,6 +74,12 @@ static_assert(sizeof(stl_facet) >= SIZEOF_STL_FACET, "size of stl_facet incorrec
 
 typedef enum {binary, ascii, inmemory} stl_type;
 
+/* Selects between the parallel and the sequential implementations of the ASCII STL parser, of stl_check_facets_exact()
+   and of stl_generate_shared_vertices(), which produce the same results. By default the parallel implementations are used
+   where they pay off, the tests force either of them to compare the results. */
+typedef enum {stl_parallel_auto, stl_parallel_never, stl_parallel_always} stl_parallel_mode;
+extern stl_parallel_mode stl_parallel;
+
 typedef struct {
   stl_vertex p1;
   stl_vertex p2;
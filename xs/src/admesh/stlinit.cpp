@@ -25,16 +25,26 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#include <float.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #include <boost/nowide/cstdio.hpp>
 #include <boost/detail/endian.hpp>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 #include "stl.h"
 
 #ifndef SEEK_SET
 #error "SEEK_SET not defined"
 #endif
 
+stl_parallel_mode stl_parallel = stl_parallel_auto;
+
 void
 stl_open(stl_file *stl, const char *file) {
   stl_initialize(stl);
@@ -252,74 +262,281 @@ stl_reallocate(stl_file *stl) {
 }
 
 
+// Number of facets read from a binary STL file by a single fread().
+#define STL_BINARY_BLOCK_FACETS 65536
+// Size of a block of an ASCII STL file read by a single fread(), parsed in parallel.
+#define STL_ASCII_BLOCK_SIZE    (64 * 1024 * 1024)
+// Minimum size of a piece of an ASCII block parsed by a single task.
+#define STL_ASCII_CHUNK_SIZE    (1024 * 1024)
+
+/* Reads the facets of a binary STL file in blocks, starting at facet first_facet.
+   Returns false if the file is shorter than expected. */
+static bool
+stl_read_binary_facets(stl_file *stl, uint32_t first_facet) {
+  fseek(stl->fp, HEADER_SIZE, SEEK_SET);
+  std::vector<char> buffer(STL_BINARY_BLOCK_FACETS * SIZEOF_STL_FACET);
+  for (uint32_t i = first_facet; i < stl->stats.number_of_facets; ) {
+    size_t num_facets = std::min<size_t>(STL_BINARY_BLOCK_FACETS, stl->stats.number_of_facets - i);
+    if (fread(buffer.data(), SIZEOF_STL_FACET, num_facets, stl->fp) != num_facets)
+      return false;
+    const char *src = buffer.data();
+    for (size_t j = 0; j < num_facets; ++ j, ++ i, src += SIZEOF_STL_FACET) {
+      /* The facets are packed by 50 bytes in the file, while stl_facet is padded. */
+      memcpy(stl->facet_start + i, src, SIZEOF_STL_FACET);
+#ifndef BOOST_LITTLE_ENDIAN
+      // Convert the loaded little endian data to big endian.
+      stl_internal_reverse_quads((char*)(stl->facet_start + i), 48);
+#endif /* BOOST_LITTLE_ENDIAN */
+    }
+  }
+  return true;
+}
+
+static inline bool
+stl_ascii_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline const char*
+stl_ascii_skip_spaces(const char *p, const char *end) {
+  while (p < end && stl_ascii_is_space(*p))
+    ++ p;
+  return p;
+}
+
+static inline const char*
+stl_ascii_token_end(const char *p, const char *end) {
+  while (p < end && ! stl_ascii_is_space(*p))
+    ++ p;
+  return p;
+}
+
+/* Skips white spaces and a keyword. Like the fscanf() literals, the keyword does not need to be followed by a white space. */
+static inline bool
+stl_ascii_match(const char *&p, const char *end, const char *keyword) {
+  const char *q = stl_ascii_skip_spaces(p, end);
+  for (; *keyword != 0; ++ keyword, ++ q)
+    if (q == end || *q != *keyword)
+      return false;
+  p = q;
+  return true;
+}
+
+/* Skips white spaces and parses a white space delimited number, producing the same value as strtof().
+   Decimal numbers of up to 19 digits are converted by a single exact floating point operation,
+   anything else (too many digits, NaN, infinity, hexadecimal numbers, results close to
+   a float rounding tie or subnormal) is passed to strtof(). Returns false if the token is not a number as a whole. */
+static bool
+stl_ascii_parse_float(const char *&p, const char *end, float &out) {
+  static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  const char *begin     = stl_ascii_skip_spaces(p, end);
+  const char *token_end = stl_ascii_token_end(begin, end);
+  if (begin == token_end)
+    return false;
+  const char *q         = begin;
+  bool        negative  = false;
+  if (*q == '-' || *q == '+')
+    negative = *q ++ == '-';
+  uint64_t    mantissa  = 0;
+  int         num_digits = 0;
+  int         exponent  = 0;
+  bool        fast      = true;
+  for (; q < token_end && *q >= '0' && *q <= '9'; ++ q, ++ num_digits)
+    mantissa = mantissa * 10 + (*q - '0');
+  if (q < token_end && *q == '.') {
+    ++ q;
+    for (; q < token_end && *q >= '0' && *q <= '9'; ++ q, ++ num_digits, -- exponent)
+      mantissa = mantissa * 10 + (*q - '0');
+  }
+  if (num_digits == 0 || num_digits > 19)
+    fast = false;
+  else if (q < token_end && (*q == 'e' || *q == 'E')) {
+    ++ q;
+    bool exp_negative = false;
+    if (q < token_end && (*q == '-' || *q == '+'))
+      exp_negative = *q ++ == '-';
+    int exp_value = 0;
+    int exp_digits = 0;
+    for (; q < token_end && *q >= '0' && *q <= '9' && exp_value < 10000; ++ q, ++ exp_digits)
+      exp_value = exp_value * 10 + (*q - '0');
+    if (exp_digits == 0)
+      fast = false;
+    exponent += exp_negative ? - exp_value : exp_value;
+  }
+  if (fast && q == token_end && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+    // Both the mantissa and the power of ten are exact, the result is the correctly rounded double.
+    double value = (exponent < 0) ? double(mantissa) / pow10[- exponent] : double(mantissa) * pow10[exponent];
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // Rounding the double to float gives the correctly rounded float unless the double lies exactly
+    // in the middle between two floats. Subnormal floats have less precision, leave them to strtof() as well.
+    if ((bits & 0x1fffffffULL) != 0x10000000ULL && (value == 0. || value >= double(FLT_MIN))) {
+      out = negative ? - float(value) : float(value);
+      p   = token_end;
+      return true;
+    }
+  }
+  // strtof() has to consume the whole token, so that a number followed by garbage ("1.5abc") is rejected.
+  std::string token(begin, token_end);
+  char *parsed_end = nullptr;
+  out = strtof(token.c_str(), &parsed_end);
+  if (parsed_end != token.c_str() + token.size())
+    return false;
+  p = token_end;
+  return true;
+}
+
+/* Returns the start of the first line after pos starting with the "facet" keyword, or end if there is none. */
+static const char*
+stl_ascii_next_facet_line(const char *pos, const char *end) {
+  for (;;) {
+    pos = (const char*)memchr(pos, '\n', end - pos);
+    if (pos == nullptr)
+      return end;
+    const char *line = ++ pos;
+    const char *q = line;
+    if (stl_ascii_match(q, end, "facet"))
+      return line;
+  }
+}
+
+/* Returns the start of the last line of [begin, end) starting with the "facet" keyword, or begin if there is none. */
+static const char*
+stl_ascii_last_facet_line(const char *begin, const char *end) {
+  for (const char *pos = end; pos > begin; ) {
+    -- pos;
+    if (*pos == '\n') {
+      const char *line = pos + 1;
+      const char *q = line;
+      if (stl_ascii_match(q, end, "facet"))
+        return line;
+    }
+  }
+  return begin;
+}
+
+/* Parses the ASCII STL facets of [p, end) into facets.
+   Returns false on a syntax error, then facets contains the facets parsed before the error. */
+static bool
+stl_ascii_parse_facets(const char *p, const char *end, std::vector<stl_facet> &facets) {
+  for (;;) {
+    p = stl_ascii_skip_spaces(p, end);
+    if (p == end)
+      return true;
+    const char *q = p;
+    if (stl_ascii_match(q, end, "endsolid") || stl_ascii_match(q, end, "solid")) {
+      // Skip the solid / endsolid lines including the solid name, broken STL file generators may put several of them.
+      q = (const char*)memchr(q, '\n', end - q);
+      p = (q == nullptr) ? end : q + 1;
+      continue;
+    }
+    stl_facet facet;
+    memset(&facet, 0, sizeof(facet));
+    if (! stl_ascii_match(p, end, "facet") || ! stl_ascii_match(p, end, "normal"))
+      return false;
+    // A mangled normal (denormals or "not a number" stored) is reset and silently ignored.
+    // The vertices are required.
+    for (int j = 0; j < 3; ++ j) {
+      if (! stl_ascii_parse_float(p, end, (&facet.normal.x)[j])) {
+        memset(&facet.normal, 0, sizeof(facet.normal));
+        for (; j < 3; ++ j)
+          p = stl_ascii_token_end(stl_ascii_skip_spaces(p, end), end);
+      }
+    }
+    if (! stl_ascii_match(p, end, "outer") || ! stl_ascii_match(p, end, "loop"))
+      return false;
+    for (int i = 0; i < 3; ++ i)
+      if (! stl_ascii_match(p, end, "vertex") ||
+          ! stl_ascii_parse_float(p, end, facet.vertex[i].x) ||
+          ! stl_ascii_parse_float(p, end, facet.vertex[i].y) ||
+          ! stl_ascii_parse_float(p, end, facet.vertex[i].z))
+        return false;
+    if (! stl_ascii_match(p, end, "endloop") || ! stl_ascii_match(p, end, "endfacet"))
+      return false;
+    facets.push_back(facet);
+  }
+}
+
+/* Reads the facets of an ASCII STL file starting at facet first_facet.
+   The file is read in large blocks, each block is split at the facet boundaries into chunks parsed in parallel.
+   Returns false on a syntax error or if the file contains less facets than counted by stl_count_facets(). */
+static bool
+stl_read_ascii_facets(stl_file *stl, uint32_t first_facet) {
+  rewind(stl->fp);
+  uint32_t          num_facets = first_facet;
+  std::vector<char> buffer;
+  size_t            buffer_used = 0;
+  bool              eof = false;
+  while (num_facets < stl->stats.number_of_facets && ! (eof && buffer_used == 0)) {
+    // Fill the buffer, keeping the unparsed tail of the previous block at its start.
+    if (buffer.size() < buffer_used + STL_ASCII_BLOCK_SIZE)
+      buffer.resize(buffer_used + STL_ASCII_BLOCK_SIZE);
+    if (! eof) {
+      size_t num_requested = buffer.size() - buffer_used;
+      size_t num_read      = fread(buffer.data() + buffer_used, 1, num_requested, stl->fp);
+      buffer_used += num_read;
+      eof = num_read < num_requested;
+    }
+    const char *begin = buffer.data();
+    const char *end   = begin + buffer_used;
+    // The last facet of the block may be incomplete, keep it for the next block.
+    const char *parse_end = end;
+    if (! eof) {
+      parse_end = stl_ascii_last_facet_line(begin, end);
+      if (parse_end == begin)
+        // A single facet longer than the block, read more.
+        continue;
+    }
+    // Split the block into chunks starting with a facet line.
+    size_t num_chunks = (stl_parallel == stl_parallel_never) ? 1 : std::max<size_t>(1, (parse_end - begin) / STL_ASCII_CHUNK_SIZE);
+    std::vector<const char*> chunk_starts(num_chunks + 1, parse_end);
+    chunk_starts.front() = begin;
+    for (size_t i = 1; i < num_chunks; ++ i)
+      chunk_starts[i] = stl_ascii_next_facet_line(std::max(chunk_starts[i - 1], begin + (parse_end - begin) * i / num_chunks), parse_end);
+    std::vector<std::vector<stl_facet>> chunk_facets(num_chunks);
+    std::vector<char>                   chunk_valid(num_chunks, false);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, num_chunks, 1),
+      [&chunk_starts, &chunk_facets, &chunk_valid](const tbb::blocked_range<size_t> &range) {
+        for (size_t i = range.begin(); i < range.end(); ++ i) {
+          chunk_facets[i].reserve((chunk_starts[i + 1] - chunk_starts[i]) / 256);
+          chunk_valid[i] = stl_ascii_parse_facets(chunk_starts[i], chunk_starts[i + 1], chunk_facets[i]);
+        }
+      });
+    // Copy the facets in order. A syntax error after the last counted facet is ignored, as such a tail would not have been read.
+    for (size_t i = 0; i < num_chunks && num_facets < stl->stats.number_of_facets; ++ i) {
+      size_t n = std::min<size_t>(chunk_facets[i].size(), stl->stats.number_of_facets - num_facets);
+      memcpy(stl->facet_start + num_facets, chunk_facets[i].data(), n * sizeof(stl_facet));
+      num_facets += uint32_t(n);
+      if (! chunk_valid[i] && num_facets < stl->stats.number_of_facets)
+        return false;
+    }
+    buffer_used = end - parse_end;
+    memmove(buffer.data(), parse_end, buffer_used);
+  }
+  return num_facets == stl->stats.number_of_facets;
+}
+
 /* Reads the contents of the file pointed to by stl->fp into the stl structure,
    starting at facet first_facet.  The second argument says if it's our first
    time running this for the stl and therefore we should reset our max and min stats. */
 void
 stl_read(stl_file *stl, int first_facet, int first) {
-  stl_facet facet;
-  int   i;
-
   if (stl->error) return;
 
-  if(stl->stats.type == binary) {
-    fseek(stl->fp, HEADER_SIZE, SEEK_SET);
-  } else {
-    rewind(stl->fp);
-  }
-
-  char normal_buf[3][32];
-  for(i = first_facet; i < stl->stats.number_of_facets; i++) {
-    if(stl->stats.type == binary)
-      /* Read a single facet from a binary .STL file */
-    {
-      /* we assume little-endian architecture! */
-      if (fread(&facet, 1, SIZEOF_STL_FACET, stl->fp) != SIZEOF_STL_FACET) {
-        stl->error = 1;
-        return;
-      }
-#ifndef BOOST_LITTLE_ENDIAN
-      // Convert the loaded little endian data to big endian.
-      stl_internal_reverse_quads((char*)&facet, 48);
-#endif /* BOOST_LITTLE_ENDIAN */
-    } else
-      /* Read a single facet from an ASCII .STL file */
-    {
-      // skip solid/endsolid
-      // (in this order, otherwise it won't work when they are paired in the middle of a file)
-      fscanf(stl->fp, "endsolid\n");
-      fscanf(stl->fp, "solid%*[^\n]\n");  // name might contain spaces so %*s doesn't work and it also can be empty (just "solid")
-      // Leading space in the fscanf format skips all leading white spaces including numerous new lines and tabs.
-      int res_normal     = fscanf(stl->fp, " facet normal %31s %31s %31s", normal_buf[0], normal_buf[1], normal_buf[2]);
-      assert(res_normal == 3);
-      int res_outer_loop = fscanf(stl->fp, " outer loop");
-      assert(res_outer_loop == 0);
-      int res_vertex1    = fscanf(stl->fp, " vertex %f %f %f", &facet.vertex[0].x, &facet.vertex[0].y, &facet.vertex[0].z);
-      assert(res_vertex1 == 3);
-      int res_vertex2    = fscanf(stl->fp, " vertex %f %f %f", &facet.vertex[1].x, &facet.vertex[1].y, &facet.vertex[1].z);
-      assert(res_vertex2 == 3);
-      int res_vertex3    = fscanf(stl->fp, " vertex %f %f %f", &facet.vertex[2].x, &facet.vertex[2].y, &facet.vertex[2].z);
-      assert(res_vertex3 == 3);
-      int res_endloop    = fscanf(stl->fp, " endloop");
-      assert(res_endloop == 0);
-      // There is a leading and trailing white space around endfacet to eat up all leading and trailing white spaces including numerous tabs and new lines.
-      int res_endfacet   = fscanf(stl->fp, " endfacet ");
-      if (res_normal != 3 || res_outer_loop != 0 || res_vertex1 != 3 || res_vertex2 != 3 || res_vertex3 != 3 || res_endloop != 0 || res_endfacet != 0) {
-        perror("Something is syntactically very wrong with this ASCII STL!");
-        stl->error = 1;
-        return;
-      }
-
-      // The facet normal has been parsed as a single string as to workaround for not a numbers in the normal definition.
-	  if (sscanf(normal_buf[0], "%f", &facet.normal.x) != 1 ||
-		  sscanf(normal_buf[1], "%f", &facet.normal.y) != 1 ||
-		  sscanf(normal_buf[2], "%f", &facet.normal.z) != 1) {
-		  // Normal was mangled. Maybe denormals or "not a number" were stored?
-		  // Just reset the normal and silently ignore it.
-		  memset(&facet.normal, 0, sizeof(facet.normal));
-	  }
+  if (stl->stats.type == binary) {
+    if (! stl_read_binary_facets(stl, uint32_t(first_facet))) {
+      stl->error = 1;
+      return;
     }
+  } else if (! stl_read_ascii_facets(stl, uint32_t(first_facet))) {
+    perror("Something is syntactically very wrong with this ASCII STL!");
+    stl->error = 1;
+    return;
+  }
 
+  for (uint32_t i = uint32_t(first_facet); i < stl->stats.number_of_facets; i++) {
+    stl_facet &facet = stl->facet_start[i];
 #if 0
       // Report close to zero vertex coordinates. Due to the nature of the floating point numbers,
       // close to zero values may be represented with singificantly higher precision than the rest of the vertices.
@@ -357,8 +574,6 @@ stl_read(stl_file *stl, int first_facet, int first) {
           *f = 0;
     }
 #endif
-    /* Write the facet into memory. */
-    memcpy(stl->facet_start+i, &facet, SIZEOF_STL_FACET);
     stl_facet_stats(stl, facet, first);
     first = 0;
   }
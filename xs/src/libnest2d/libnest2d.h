@@ -12,6 +12,7 @@
 #include <libnest2d/libnest2d.hpp>
 #include <libnest2d/placers/bottomleftplacer.hpp>
 #include <libnest2d/placers/nfpplacer.hpp>
+#include <libnest2d/lattice.hpp>
 #include <libnest2d/selections/firstfit.hpp>
 #include <libnest2d/selections/filler.hpp>
 #include <libnest2d/selections/djd_heuristic.hpp>
@@ -0,0 +1,343 @@
+#ifndef LATTICE_HPP
+#define LATTICE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "libnest2d.hpp"
+#include "geometry_traits_nfp.hpp"
+#include "placers/nfpplacer.hpp"
+
+namespace libnest2d {
+
+namespace __lattice {
+
+// Number of the sampled directions of the first lattice basis vector.
+static const size_t SAMPLES = 256;
+
+// Number of the tried shifts of the lattice along each basis vector.
+static const int PHASES = 4;
+
+// Tolerance of the overlap tests relative to the size of the no fit polygon.
+static const double TOLERANCE = 1e-7;
+
+struct Vec {
+    double x, y;
+};
+
+inline Vec operator+(const Vec& a, const Vec& b) { return {a.x + b.x, a.y + b.y}; }
+inline Vec operator-(const Vec& a, const Vec& b) { return {a.x - b.x, a.y - b.y}; }
+inline Vec operator*(const Vec& a, double s) { return {a.x * s, a.y * s}; }
+inline double cross(const Vec& a, const Vec& b) { return a.x * b.y - a.y * b.x; }
+inline double dot(const Vec& a, const Vec& b) { return a.x * b.x + a.y * b.y; }
+inline double norm2(const Vec& a) { return dot(a, a); }
+
+using Vecs = std::vector<Vec>;
+
+// Convert the contour of a shape into a counter-clockwise vector of points
+// relative to origin, without the closing point.
+template<class RawShape>
+Vecs toVecs(const RawShape& sh, const TPoint<RawShape>& origin)
+{
+    Vecs ret;
+    for(auto it = ShapeLike::cbegin(sh); it != ShapeLike::cend(sh); ++it)
+        ret.push_back({ double(getX(*it) - getX(origin)),
+                        double(getY(*it) - getY(origin)) });
+
+    if(ret.size() > 1 && ret.front().x == ret.back().x &&
+       ret.front().y == ret.back().y) ret.pop_back();
+
+    double area = 0;
+    for(size_t i = 0; i < ret.size(); ++i)
+        area += cross(ret[i], ret[(i + 1) % ret.size()]);
+
+    if(area < 0) std::reverse(ret.begin(), ret.end());
+
+    return ret;
+}
+
+// Is the point inside the convex counter-clockwise polygon, farther than
+// tolerance from its boundary?
+inline bool insideConvex(const Vecs& poly, const Vec& p, double tolerance)
+{
+    for(size_t i = 0; i < poly.size(); ++i) {
+        const Vec& a = poly[i];
+        const Vec& b = poly[(i + 1) % poly.size()];
+        if(cross(b - a, p - a) <= tolerance * std::sqrt(norm2(b - a)))
+            return false;
+    }
+    return !poly.empty();
+}
+
+// The no fit polygon of a convex item with itself as the translations of a
+// copy which make it touch the item. The item is expected to have zero
+// translation.
+template<class RawShape>
+Vecs translationNfp(const _Item<RawShape>& item)
+{
+    auto nfp = Nfp::noFitPolygon<NfpLevel::CONVEX_ONLY>(
+                item.transformedShape(), item.transformedShape());
+    strategies::correctNfpPosition(nfp, item, item);
+
+    // The no fit polygon is the path of the reference vertex of the copy.
+    return toVecs(nfp.first, item.rightmostTopVertex());
+}
+
+struct Lattice {
+    Vec a = {0, 0}, b = {0, 0};     // basis vectors
+    double area = 0;    // area of the fundamental cell, zero if none found
+};
+
+// Lagrange-Gauss reduction of the lattice basis to the shortest vectors.
+inline void reduceBasis(Vec& a, Vec& b)
+{
+    if(norm2(b) < norm2(a)) std::swap(a, b);
+    for(int i = 0; i < 64 && norm2(a) > 0; ++i) {
+        double mu = std::round(dot(a, b) / norm2(a));
+        if(mu == 0) break;
+        b = b - a * mu;
+        if(norm2(b) < norm2(a)) std::swap(a, b); else break;
+    }
+    if(cross(a, b) < 0) b = b * -1.;
+}
+
+// None of the small multiples of the basis may be inside the no fit polygon.
+inline bool isPackingLattice(const Vecs& nfp, const Vec& a, const Vec& b,
+                             double tolerance)
+{
+    for(int m = -2; m <= 2; ++m)
+        for(int n = -2; n <= 2; ++n)
+            if((m != 0 || n != 0) &&
+               insideConvex(nfp, a * m + b * n, tolerance))
+                return false;
+    return true;
+}
+
+/**
+ * \brief Find the densest lattice packing of the translates of a convex
+ * shape.
+ *
+ * The translates S + p of the shape for the points p of a lattice do not
+ * overlap if no lattice vector lies inside the no fit polygon N of the shape
+ * with itself. N is convex and centrally symmetric, and the densest such
+ * lattice has a basis a, b with a, b and b - a all on the boundary of N.
+ * For every sampled a on the boundary of N, b is the crossing of the
+ * boundaries of N and N + a on the left of a.
+ */
+inline Lattice packingLattice(const Vecs& nfp)
+{
+    Lattice ret;
+    const size_t n = nfp.size();
+    if(n < 3) return ret;
+
+    const size_t samples = std::max<size_t>(1, (SAMPLES + n - 1) / n);
+
+    double size = 0;
+    for(auto& v : nfp) size = std::max(size, std::sqrt(norm2(v)));
+    const double tolerance = TOLERANCE * size;
+
+    Vecs chain;
+    chain.reserve(n + 2);
+
+    for(size_t i = 0; i < n; ++i) for(size_t k = 0; k < samples; ++k) {
+        const Vec& v = nfp[i];
+        Vec a = v + (nfp[(i + 1) % n] - v) * (double(k) / samples);
+
+        // The boundary of N from a to -a on the left of a. It starts inside
+        // N + a and ends outside of it.
+        chain.clear();
+        chain.emplace_back(a);
+        for(size_t j = 1; j < n && cross(a, nfp[(i + j) % n]) > 0; ++j)
+            chain.emplace_back(nfp[(i + j) % n]);
+        chain.emplace_back(a * -1.);
+
+        auto inside = [&nfp, &a, tolerance](const Vec& p) {
+            return insideConvex(nfp, p - a, tolerance);
+        };
+
+        if(!inside(chain.front())) continue;
+
+        size_t lo = 0, hi = chain.size() - 1;
+        while(hi - lo > 1) {
+            size_t mid = (lo + hi) / 2;
+            if(inside(chain[mid])) lo = mid; else hi = mid;
+        }
+
+        Vec pin = chain[lo], pout = chain[hi];
+        for(int it = 0; it < 40; ++it) {
+            Vec mid = (pin + pout) * 0.5;
+            if(inside(mid)) pin = mid; else pout = mid;
+        }
+
+        Vec b = pout;
+        double area = cross(a, b);
+        if(area <= 0) continue;
+
+        // Out of the lattices of the same density prefer the ones with
+        // shorter basis vectors, they are less sheared.
+        reduceBasis(a, b);
+        bool better = ret.area == 0 || area < ret.area * (1 - 1e-9) ||
+                (area < ret.area * (1 + 1e-9) &&
+                 norm2(a) + norm2(b) < norm2(ret.a) + norm2(ret.b));
+
+        if(better && isPackingLattice(nfp, a, b, tolerance)) {
+            ret.a = a;
+            ret.b = b;
+            ret.area = area;
+        }
+    }
+
+    return ret;
+}
+
+template<class P>
+inline _Box<P> binBoundingBox(const _Box<P>& bin) { return bin; }
+
+template<class RawShape>
+inline _Box<TPoint<RawShape>> binBoundingBox(const RawShape& bin) {
+    return ShapeLike::boundingBox(bin);
+}
+
+}
+
+/**
+ * \brief Arrange the copies of a single shape on a lattice.
+ *
+ * If all the items have the same shape and rotation, they are placed onto
+ * the densest packing lattice of the convex hull of the shape instead of
+ * being nested one by one. The lattice is filled from the center of the bin,
+ * the items which do not fit are put into the next bins the same way.
+ *
+ * The items keep their rotations, only their translations are changed.
+ *
+ * \param from, to The items, the value type has to be convertible to
+ * _Item<RawShape>&.
+ * \param min_obj_distance The minimum distance of the items.
+ * \param bin The bin, either a box or a shape.
+ * \param result The items grouped into bins with their indices in the input
+ * sequence, as Arranger::arrangeIndexed() returns them.
+ *
+ * \return false if the items differ or none of them fits into the bin, the
+ * result is not touched then.
+ */
+template<class TIterator, class TBin, class RawShape>
+bool arrangeOnLattice(TIterator from, TIterator to,
+                      TCoord<TPoint<RawShape>> min_obj_distance,
+                      const TBin& bin,
+                      _IndexedPackGroup<RawShape>& result)
+{
+    using namespace __lattice;
+    using Item = _Item<RawShape>;
+    using Vertex = TPoint<RawShape>;
+    using Coord = TCoord<Vertex>;
+    using sl = ShapeLike;
+
+    if(std::distance(from, to) < 2) return false;
+
+    const Item& first = *from;
+    for(auto it = from; it != to; ++it) {
+        const Item& item = *it;
+        if(item.rotation() != first.rotation() ||
+           sl::getContour(item.rawShape()) != sl::getContour(first.rawShape())
+           || sl::holes(item.rawShape()) != sl::holes(first.rawShape()))
+            return false;
+    }
+
+    // The convex hull of the shape inflated by half of the minimum distance,
+    // as in the nester. The hull has zero translation and rotation, it is in
+    // the position of the rotated item with zero translation.
+    Item inflated = first;
+    inflated.translation({0, 0});
+    if(min_obj_distance > 0)
+        inflated.addOffset(static_cast<Coord>(std::ceil(min_obj_distance/2.0)));
+    Item shape(sl::convexHull(inflated.transformedShape()));
+
+    Lattice lattice = packingLattice(translationNfp(shape));
+    if(lattice.area == 0) return false;
+
+    auto binbb = binBoundingBox(bin);
+    auto center = binbb.center();
+    auto sbb = shape.boundingBox().center();
+    double det = cross(lattice.a, lattice.b);
+
+    struct Position {
+        Vertex translation;
+        double distance;
+    };
+
+    // The positions on the lattice points inside the bin for a lattice point
+    // at origin.
+    auto latticePositions = [&](const Vec& origin) {
+        // The range of the lattice coordinates covering the bin
+        double mmin = std::numeric_limits<double>::max(), mmax = -mmin;
+        double nmin = mmin, nmax = mmax;
+        for(auto& corner : { binbb.minCorner(), binbb.maxCorner(),
+                             Vertex{getX(binbb.minCorner()),
+                                    getY(binbb.maxCorner())},
+                             Vertex{getX(binbb.maxCorner()),
+                                    getY(binbb.minCorner())} })
+        {
+            Vec d = Vec{double(getX(corner)), double(getY(corner))} - origin;
+            double m = cross(d, lattice.b) / det;
+            double n = cross(lattice.a, d) / det;
+            mmin = std::min(mmin, m); mmax = std::max(mmax, m);
+            nmin = std::min(nmin, n); nmax = std::max(nmax, n);
+        }
+
+        std::vector<Position> ret;
+        Item probe = shape;
+        for(long m = long(std::floor(mmin)) - 2;
+            m <= long(std::ceil(mmax)) + 2; ++m)
+        for(long k = long(std::floor(nmin)) - 2;
+            k <= long(std::ceil(nmax)) + 2; ++k)
+        {
+            Vec p = origin + lattice.a * double(m) + lattice.b * double(k);
+            probe.translation({ static_cast<Coord>(std::round(p.x)),
+                                static_cast<Coord>(std::round(p.y)) });
+            if(probe.isInside(bin)) ret.push_back({
+                probe.translation(),
+                PointLike::distance(probe.boundingBox().center(), center)
+            });
+        }
+        return ret;
+    };
+
+    // Shift the lattice within its cell to fit the most items into the bin,
+    // starting with a lattice point in the center of the bin.
+    std::vector<Position> positions;
+    for(int u = 0; u < PHASES; ++u)
+        for(int v = 0; v < PHASES; ++v) {
+            Vec origin = Vec{ double(getX(center) - getX(sbb)),
+                              double(getY(center) - getY(sbb)) } +
+                    lattice.a * (double(u) / PHASES) +
+                    lattice.b * (double(v) / PHASES);
+            auto candidates = latticePositions(origin);
+            if(candidates.size() > positions.size())
+                positions = std::move(candidates);
+        }
+
+    if(positions.empty()) return false;
+
+    std::stable_sort(positions.begin(), positions.end(),
+                     [](const Position& p1, const Position& p2) {
+        return p1.distance < p2.distance;
+    });
+
+    result.clear();
+    unsigned idx = 0;
+    for(auto it = from; it != to; ++it, ++idx) {
+        if(idx % positions.size() == 0) result.emplace_back();
+
+        Item& item = *it;
+        item.translation(positions[idx % positions.size()].translation);
+        result.back().emplace_back(idx, std::ref(item));
+    }
+
+    return true;
+}
+
+}
+
+#endif // LATTICE_HPP
@@ -0,0 +1,38 @@
+#ifndef LIBNEST2D_PARALLEL_HPP
+#define LIBNEST2D_PARALLEL_HPP
+
+#include <cstddef>
+
+#ifdef LIBNEST2D_THREADING_TBB
+#include <tbb/parallel_for.h>
+#endif
+
+namespace libnest2d { namespace __parallel {
+
+/**
+ * @brief Call fn(i) for each i in [0, N).
+ *
+ * The calls are made concurrently if libnest2d is compiled with a threading
+ * backend (define LIBNEST2D_THREADING_TBB to use the Intel TBB) and if
+ * parallel is set, otherwise they are made one after the other in order.
+ * The function object must not modify any state shared between the calls
+ * except its own slot of a preallocated result container.
+ */
+template<class Fn>
+inline void enumerate(std::size_t N, Fn&& fn, bool parallel = true)
+{
+#ifdef LIBNEST2D_THREADING_TBB
+    if(parallel && N > 1) {
+        tbb::parallel_for(std::size_t(0), N, [&fn](std::size_t i) { fn(i); });
+        return;
+    }
+#else
+    (void)parallel;
+#endif
+    for(std::size_t i = 0; i < N; ++i) fn(i);
+}
+
+}
+}
+
+#endif // LIBNEST2D_PARALLEL_HPP
@@ -6,8 +6,11 @@
 #endif
 #include "placer_boilerplate.hpp"
 #include "../geometry_traits_nfp.hpp"
+#include "../parallel.hpp"
 #include "libnest2d/optimizer.hpp"
 #include <cassert>
+#include <map>
+#include <mutex>
 
 #include "tools/svgtools.hpp"
 
@@ -80,6 +83,24 @@ struct NfpPConfig {
                          double, double, double)>
     object_function;
 
+    /**
+     * @brief A function object called before the placement of a new item is
+     * optimized. (Optional)
+     *
+     * The object function is evaluated concurrently from multiple threads if
+     * the parallel switch is on, therefore it must not modify any state
+     * shared between the calls. If the object function needs some cached
+     * data derived from the already placed items, the cache can be filled
+     * here.
+     *
+     * \param pile The first parameter is the container with all the placed
+     * polygons, the same as the first parameter of the object function.
+     *
+     * \param norm The second parameter is the norming factor of the object
+     * function.
+     */
+    std::function<void(const Nfp::Shapes<RawShape>&, double)> before_packing;
+
     /**
      * @brief The quality of search for an optimal placement.
      * This is a compromise slider between quality and speed. Zero is the
@@ -96,6 +117,16 @@ struct NfpPConfig {
      */
     bool explore_holes = false;
 
+    /**
+     * @brief Evaluate the rotations, the no fit polygons and the starting
+     * points of the placement optimization in parallel.
+     *
+     * This only has an effect if libnest2d is compiled with a threading
+     * backend, see parallel.hpp. Turn it off if your object function can not
+     * be called concurrently.
+     */
+    bool parallel = true;
+
     NfpPConfig(): rotations({0.0, Pi/2.0, Pi, 3*Pi/2}),
         alignment(Alignment::CENTER), starting_point(Alignment::CENTER) {}
 };
@@ -441,6 +472,138 @@ Nfp::Shapes<RawShape> nfp( const Container& polygons,
 //    return nfps;
 }
 
+/**
+ * A cache of the no fit polygons of pairs of shapes.
+ *
+ * The no fit polygon of two shapes only depends on their contours and
+ * rotations, a translation of the stationary shape just moves it along. The
+ * polygons are stored relative to the translation of the stationary shape,
+ * so they can be reused for all the pairs of identical shapes, which is the
+ * common case when arranging many copies of the same object.
+ *
+ * The cache may be accessed from multiple threads.
+ */
+template<class RawShape> class NfpCache {
+    using Vertex = TPoint<RawShape>;
+    using Coord = TCoord<Vertex>;
+public:
+
+    /// Vertices of a transformed shape without its translation.
+    using Key = std::vector<Coord>;
+
+    static Key key(const _Item<RawShape>& item) {
+        auto& sh = item.transformedShape();
+        auto tr = item.translation();
+
+        Key ret;
+        ret.reserve(2*ShapeLike::contourVertexCount(sh) + 1);
+
+        auto append = [&ret, &tr](const Vertex& v) {
+            ret.emplace_back(getX(v) - getX(tr));
+            ret.emplace_back(getY(v) - getY(tr));
+        };
+
+        // The vertex counts separate the contour and the holes.
+        ret.emplace_back(static_cast<Coord>(
+                             ShapeLike::contourVertexCount(sh)));
+        std::for_each(ShapeLike::cbegin(sh), ShapeLike::cend(sh), append);
+
+        for(auto& h : ShapeLike::holes(sh)) {
+            ret.emplace_back(static_cast<Coord>(h.end() - h.begin()));
+            std::for_each(h.begin(), h.end(), append);
+        }
+
+        return ret;
+    }
+
+    inline NfpCache() = default;
+
+    inline NfpCache(const NfpCache& other) {
+        std::lock_guard<std::mutex> lock(other.mutex_);
+        nfps_ = other.nfps_;
+    }
+
+    inline NfpCache(NfpCache&& other) BP2D_NOEXCEPT:
+        nfps_(std::move(other.nfps_)) {}
+
+    inline NfpCache& operator=(const NfpCache& other) {
+        if(this != &other) {
+            std::lock(mutex_, other.mutex_);
+            std::lock_guard<std::mutex> lock1(mutex_, std::adopt_lock);
+            std::lock_guard<std::mutex> lock2(other.mutex_, std::adopt_lock);
+            nfps_ = other.nfps_;
+        }
+        return *this;
+    }
+
+    inline NfpCache& operator=(NfpCache&& other) BP2D_NOEXCEPT {
+        nfps_ = std::move(other.nfps_);
+        return *this;
+    }
+
+    /// Get the no fit polygon of the stationary and the orbiting shapes
+    /// relative to the translation of the stationary shape.
+    bool find(const Key& stationary, const Key& orbiter, RawShape& nfp) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = nfps_.find(orbiter);
+        if(it == nfps_.end()) return false;
+        auto it2 = it->second.find(stationary);
+        if(it2 == it->second.end()) return false;
+        nfp = it2->second;
+        return true;
+    }
+
+    void insert(const Key& stationary, const Key& orbiter, const RawShape& nfp)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nfps_[orbiter].emplace(stationary, nfp);
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        nfps_.clear();
+    }
+
+private:
+    // The no fit polygons indexed by the orbiting and the stationary shapes.
+    std::map<Key, std::map<Key, RawShape>> nfps_;
+    mutable std::mutex mutex_;
+};
+
+template<class RawShape>
+Nfp::NfpResult<RawShape> subnfp(const RawShape& stationary,
+                                bool /*stationary_convex*/,
+                                const _Item<RawShape>& trsh,
+                                Lvl<NfpLevel::CONVEX_ONLY>)
+{
+    auto ret = Nfp::noFitPolygon<NfpLevel::CONVEX_ONLY>(
+                stationary, trsh.transformedShape());
+    correctNfpPosition(ret, stationary, trsh);
+    return ret;
+}
+
+template<class RawShape, class Level>
+Nfp::NfpResult<RawShape> subnfp(const RawShape& stationary,
+                                bool stationary_convex,
+                                const _Item<RawShape>& trsh,
+                                Level)
+{
+    Nfp::NfpResult<RawShape> ret;
+    auto& orb = trsh.transformedShape();
+    bool orbconvex = trsh.isContourConvex();
+
+    if(stationary_convex && orbconvex)
+        ret = Nfp::noFitPolygon<NfpLevel::CONVEX_ONLY>(stationary, orb);
+    else if(orbconvex)
+        ret = Nfp::noFitPolygon<NfpLevel::ONE_CONVEX>(stationary, orb);
+    else
+        ret = Nfp::noFitPolygon<Level::value>(stationary, orb);
+
+    correctNfpPosition(ret, stationary, trsh);
+    return ret;
+}
+
 template<class RawShape, class TBin = _Box<TPoint<RawShape>>>
 class _NofitPolyPlacer: public PlacerBoilerplate<_NofitPolyPlacer<RawShape, TBin>,
         RawShape, TBin, NfpPConfig<RawShape>> {
@@ -458,6 +621,31 @@ class _NofitPolyPlacer: public PlacerBoilerplate<_NofitPolyPlacer<RawShape, TBin
     using MaxNfpLevel = Nfp::MaxNfpLevel<RawShape>;
     using sl = ShapeLike;
 
+    // The placed items grouped by their shapes for the no fit polygon
+    // calculation. All the data is collected before the placement is
+    // optimized, as the items calculate their transformed shapes lazily
+    // and can not be shared between threads.
+    struct Stationaries {
+        struct Shape {
+            typename NfpCache<RawShape>::Key key;
+            // Transformed shape and translation of the first item.
+            RawShape shape;
+            Vertex translation;
+            bool convex;
+        };
+        std::vector<Shape> shapes;
+        // Index of the shape and the translation of each placed item.
+        std::vector<size_t> item_shapes;
+        std::vector<Vertex> item_translations;
+    };
+
+    struct Placement {
+        double score;
+        Vertex translation;
+    };
+
+    NfpCache<RawShape> nfpcache_;
+
 public:
 
     using Pile = Nfp::Shapes<RawShape>;
@@ -531,202 +719,59 @@ public:
             auto initial_rot = item.rotation();
             Vertex final_tr = {0, 0};
             Radians final_rot = initial_rot;
-            Nfp::Shapes<RawShape> nfps;
-
-            for(auto rot : config_.rotations) {
 
-                item.translation(initial_tr);
-                item.rotation(initial_rot + rot);
-
-                // place the new item outside of the print bed to make sure
-                // it is disjuct from the current merged pile
-                placeOutsideOfBin(item);
+            Stationaries stationaries;
+            std::map<typename NfpCache<RawShape>::Key, size_t> shape_indices;
+
+            Nfp::Shapes<RawShape> pile;
+            pile.reserve(items_.size()+1);
+            double pile_area = 0;
+            for(Item& mitem : items_) {
+                pile.emplace_back(mitem.transformedShape());
+                pile_area += mitem.area();
+
+                auto key = NfpCache<RawShape>::key(mitem);
+                auto it = shape_indices.find(key);
+                if(it == shape_indices.end()) {
+                    it = shape_indices.emplace(key,
+                                        stationaries.shapes.size()).first;
+                    stationaries.shapes.push_back({
+                        std::move(key), mitem.transformedShape(),
+                        mitem.translation(), mitem.isContourConvex()
+                    });
+                }
+                stationaries.item_shapes.emplace_back(it->second);
+                stationaries.item_translations.emplace_back(
+                            mitem.translation());
+            }
 
-                auto trsh = item.transformedShape();
+            auto merged_pile = Nfp::merge(pile);
 
-                nfps = nfp(items_, item, Lvl<MaxNfpLevel::value>());
-                auto iv = Nfp::referenceVertex(trsh);
+            if(config_.before_packing) config_.before_packing(pile, norm_);
 
-                auto startpos = item.translation();
+            // The rotations are evaluated independently, each with its own
+            // copy of the item.
+            std::vector<Placement> placements(config_.rotations.size());
 
-                std::vector<EdgeCache<RawShape>> ecache;
-                ecache.reserve(nfps.size());
+            __parallel::enumerate(config_.rotations.size(), [&](size_t ri) {
+                Item itm = item;
+                itm.translation(initial_tr);
+                itm.rotation(initial_rot + config_.rotations[ri]);
 
-                for(auto& nfp : nfps ) {
-                    ecache.emplace_back(nfp);
-                    ecache.back().accuracy(config_.accuracy);
-                }
-
-                struct Optimum {
-                    double relpos;
-                    unsigned nfpidx;
-                    int hidx;
-                    Optimum(double pos, unsigned nidx):
-                        relpos(pos), nfpidx(nidx), hidx(-1) {}
-                    Optimum(double pos, unsigned nidx, int holeidx):
-                        relpos(pos), nfpidx(nidx), hidx(holeidx) {}
-                };
-
-                auto getNfpPoint = [&ecache](const Optimum& opt)
-                {
-                    return opt.hidx < 0? ecache[opt.nfpidx].coords(opt.relpos) :
-                            ecache[opt.nfpidx].coords(opt.hidx, opt.relpos);
-                };
-
-                Nfp::Shapes<RawShape> pile;
-                pile.reserve(items_.size()+1);
-                double pile_area = 0;
-                for(Item& mitem : items_) {
-                    pile.emplace_back(mitem.transformedShape());
-                    pile_area += mitem.area();
-                }
+                // place the new item outside of the print bed to make sure
+                // it is disjuct from the current merged pile
+                placeOutsideOfBin(itm);
 
-                auto merged_pile = Nfp::merge(pile);
-
-                // This is the kernel part of the object function that is
-                // customizable by the library client
-                auto _objfunc = config_.object_function?
-                            config_.object_function :
-                [this, &merged_pile](
-                            Nfp::Shapes<RawShape>& /*pile*/,
-                            const Item& item,
-                            double occupied_area,
-                            double norm,
-                            double /*penality*/)
-                {
-                    merged_pile.emplace_back(item.transformedShape());
-                    auto ch = sl::convexHull(merged_pile);
-                    merged_pile.pop_back();
-
-                    // The pack ratio -- how much is the convex hull occupied
-                    double pack_rate = occupied_area/sl::area(ch);
-
-                    // ratio of waste
-                    double waste = 1.0 - pack_rate;
-
-                    // Score is the square root of waste. This will extend the
-                    // range of good (lower) values and shring the range of bad
-                    // (larger) values.
-                    auto score = std::sqrt(waste);
-
-                    if(!wouldFit(ch, bin_)) score += norm;
-
-                    return score;
-                };
-
-                // Our object function for placement
-                auto rawobjfunc = [&] (Vertex v)
-                {
-                    auto d = v - iv;
-                    d += startpos;
-                    item.translation(d);
-
-                    double occupied_area = pile_area + item.area();
-
-                    double score = _objfunc(pile, item, occupied_area,
-                                            norm_, penality_);
-
-                    return score;
-                };
-
-                auto boundaryCheck = [&](const Optimum& o) {
-                    auto v = getNfpPoint(o);
-                    auto d = v - iv;
-                    d += startpos;
-                    item.translation(d);
-
-                    merged_pile.emplace_back(item.transformedShape());
-                    auto chull = sl::convexHull(merged_pile);
-                    merged_pile.pop_back();
-
-                    return wouldFit(chull, bin_);
-                };
-
-                opt::StopCriteria stopcr;
-                stopcr.max_iterations = 100;
-                stopcr.relative_score_difference = 1e-6;
-                opt::TOptimizer<opt::Method::L_SUBPLEX> solver(stopcr);
-
-                Optimum optimum(0, 0);
-                double best_score = penality_;
-
-                // Local optimization with the four polygon corners as
-                // starting points
-                for(unsigned ch = 0; ch < ecache.size(); ch++) {
-                    auto& cache = ecache[ch];
-
-                    auto contour_ofn = [&rawobjfunc, &getNfpPoint, ch]
-                            (double relpos)
-                    {
-                        return rawobjfunc(getNfpPoint(Optimum(relpos, ch)));
-                    };
-
-                    std::for_each(cache.corners().begin(),
-                                  cache.corners().end(),
-                                  [ch, &contour_ofn, &solver, &best_score,
-                                  &optimum, &boundaryCheck] (double pos)
-                    {
-                        try {
-                            auto result = solver.optimize_min(contour_ofn,
-                                            opt::initvals<double>(pos),
-                                            opt::bound<double>(0, 1.0)
-                                            );
-
-                            if(result.score < best_score) {
-                                Optimum o(std::get<0>(result.optimum), ch, -1);
-                                if(boundaryCheck(o)) {
-                                    best_score = result.score;
-                                    optimum = o;
-                                }
-                            }
-                        } catch(std::exception& e) {
-                            derr() << "ERROR: " << e.what() << "\n";
-                        }
-                    });
+                placements[ri] = optimizePlacement(itm, stationaries, pile,
+                                                   pile_area, merged_pile);
+            }, config_.parallel);
 
-                    for(unsigned hidx = 0; hidx < cache.holeCount(); ++hidx) {
-                        auto hole_ofn =
-                                [&rawobjfunc, &getNfpPoint, ch, hidx]
-                                (double pos)
-                        {
-                            Optimum opt(pos, ch, hidx);
-                            return rawobjfunc(getNfpPoint(opt));
-                        };
-
-                        std::for_each(cache.corners(hidx).begin(),
-                                      cache.corners(hidx).end(),
-                                      [&hole_ofn, &solver, &best_score,
-                                       &optimum, ch, hidx, &boundaryCheck]
-                                      (double pos)
-                        {
-                            try {
-                                auto result = solver.optimize_min(hole_ofn,
-                                                opt::initvals<double>(pos),
-                                                opt::bound<double>(0, 1.0)
-                                                );
-
-                                if(result.score < best_score) {
-                                    Optimum o(std::get<0>(result.optimum),
-                                              ch, hidx);
-                                    if(boundaryCheck(o)) {
-                                        best_score = result.score;
-                                        optimum = o;
-                                    }
-                                }
-                            } catch(std::exception& e) {
-                                derr() << "ERROR: " << e.what() << "\n";
-                            }
-                        });
-                    }
-                }
-
-                if( best_score < global_score ) {
-                    auto d = getNfpPoint(optimum) - iv;
-                    d += startpos;
-                    final_tr = d;
-                    final_rot = initial_rot + rot;
+            for(size_t ri = 0; ri < placements.size(); ++ri) {
+                if( placements[ri].score < global_score ) {
+                    final_tr = placements[ri].translation;
+                    final_rot = initial_rot + config_.rotations[ri];
                     can_pack = true;
-                    global_score = best_score;
+                    global_score = placements[ri].score;
                 }
             }
 
@@ -791,6 +836,228 @@ public:
 
 private:
 
+    // Calculate the no fit polygons of the placed items and the orbiting item
+    // and merge them. The no fit polygons of the shapes not seen yet are
+    // calculated in parallel and stored into the cache.
+    Nfp::Shapes<RawShape> calcnfp(const Item& trsh,
+                                  const Stationaries& stationaries)
+    {
+        auto orbkey = NfpCache<RawShape>::key(trsh);
+
+        // Fill the lazily calculated data of the orbiting item, which is
+        // read from multiple threads below.
+        trsh.isContourConvex();
+        trsh.rightmostTopVertex();
+        trsh.leftmostBottomVertex();
+
+        auto& shapes = stationaries.shapes;
+        std::vector<RawShape> subnfps(shapes.size());
+        std::vector<size_t> missing;
+        for(size_t i = 0; i < shapes.size(); ++i)
+            if(!nfpcache_.find(shapes[i].key, orbkey, subnfps[i]))
+                missing.emplace_back(i);
+
+        __parallel::enumerate(missing.size(), [&](size_t i) {
+            auto& sh = shapes[missing[i]];
+            auto subnfp_r = subnfp(sh.shape, sh.convex, trsh,
+                                   Lvl<MaxNfpLevel::value>());
+
+            auto& nfp = subnfps[missing[i]];
+            nfp = std::move(subnfp_r.first);
+            sl::translate(nfp, Vertex(-getX(sh.translation),
+                                      -getY(sh.translation)));
+        }, config_.parallel);
+
+        for(size_t i : missing)
+            nfpcache_.insert(shapes[i].key, orbkey, subnfps[i]);
+
+        Nfp::Shapes<RawShape> nfps;
+        nfps.reserve(stationaries.item_shapes.size());
+        for(size_t i = 0; i < stationaries.item_shapes.size(); ++i) {
+            nfps.emplace_back(subnfps[stationaries.item_shapes[i]]);
+            sl::translate(nfps.back(), stationaries.item_translations[i]);
+        }
+
+        return Nfp::merge(nfps);
+    }
+
+    // Find the best position of the item along the no fit polygons of the
+    // placed items. Returns a score of penality_ if there is none.
+    Placement optimizePlacement(Item& item,
+                                const Stationaries& stationaries,
+                                const Nfp::Shapes<RawShape>& pile,
+                                double pile_area,
+                                const Nfp::Shapes<RawShape>& merged_pile)
+    {
+        auto trsh = item.transformedShape();
+
+        auto nfps = calcnfp(item, stationaries);
+        auto iv = Nfp::referenceVertex(trsh);
+
+        auto startpos = item.translation();
+
+        std::vector<EdgeCache<RawShape>> ecache;
+        ecache.reserve(nfps.size());
+
+        for(auto& nfp : nfps ) {
+            ecache.emplace_back(nfp);
+            ecache.back().accuracy(config_.accuracy);
+        }
+
+        struct Optimum {
+            double relpos;
+            unsigned nfpidx;
+            int hidx;
+            Optimum(double pos, unsigned nidx):
+                relpos(pos), nfpidx(nidx), hidx(-1) {}
+            Optimum(double pos, unsigned nidx, int holeidx):
+                relpos(pos), nfpidx(nidx), hidx(holeidx) {}
+        };
+
+        auto getNfpPoint = [&ecache](const Optimum& opt)
+        {
+            return opt.hidx < 0? ecache[opt.nfpidx].coords(opt.relpos) :
+                    ecache[opt.nfpidx].coords(opt.hidx, opt.relpos);
+        };
+
+        // The convex hull of the pile with the candidate item is the convex
+        // hull of the pile's convex hull with the candidate item.
+        auto pile_hull = sl::convexHull(merged_pile);
+
+        // This is the kernel part of the object function that is
+        // customizable by the library client
+        auto _objfunc = config_.object_function?
+                    config_.object_function :
+        [this, &pile_hull](
+                    Nfp::Shapes<RawShape>& /*pile*/,
+                    const Item& item,
+                    double occupied_area,
+                    double norm,
+                    double /*penality*/)
+        {
+            auto ch = sl::convexHull(Nfp::Shapes<RawShape>{
+                                         pile_hull, item.transformedShape()});
+
+            // The pack ratio -- how much is the convex hull occupied
+            double pack_rate = occupied_area/sl::area(ch);
+
+            // ratio of waste
+            double waste = 1.0 - pack_rate;
+
+            // Score is the square root of waste. This will extend the
+            // range of good (lower) values and shring the range of bad
+            // (larger) values.
+            auto score = std::sqrt(waste);
+
+            if(!wouldFit(ch, bin_)) score += norm;
+
+            return score;
+        };
+
+        // Local optimization with the polygon corners as starting points.
+        // The corners are fetched here, the edge caches calculate them lazily.
+        std::vector<Optimum> starts;
+        for(unsigned ch = 0; ch < ecache.size(); ch++) {
+            auto& cache = ecache[ch];
+
+            for(double pos : cache.corners()) starts.emplace_back(pos, ch);
+
+            for(unsigned hidx = 0; hidx < cache.holeCount(); ++hidx)
+                for(double pos : cache.corners(hidx))
+                    starts.emplace_back(pos, ch, int(hidx));
+        }
+
+        // The best score and position found from each starting point.
+        std::vector<std::pair<double, Optimum>> results(
+                    starts.size(), std::make_pair(penality_, Optimum(0, 0)));
+
+        __parallel::enumerate(starts.size(), [&](size_t si) {
+            const Optimum& start = starts[si];
+
+            // Each optimization moves its own copy of the item around and
+            // hands its own copy of the pile to the object function.
+            Item itm = item;
+            Nfp::Shapes<RawShape> itm_pile = pile;
+
+            // Our object function for placement
+            auto rawobjfunc = [&] (Vertex v)
+            {
+                auto d = v - iv;
+                d += startpos;
+                itm.translation(d);
+
+                double occupied_area = pile_area + itm.area();
+
+                double score = _objfunc(itm_pile, itm, occupied_area,
+                                        norm_, penality_);
+
+                return score;
+            };
+
+            auto boundaryCheck = [&](const Optimum& o) {
+                auto v = getNfpPoint(o);
+                auto d = v - iv;
+                d += startpos;
+                itm.translation(d);
+
+                auto chull = sl::convexHull(Nfp::Shapes<RawShape>{
+                                                pile_hull,
+                                                itm.transformedShape()});
+
+                return wouldFit(chull, bin_);
+            };
+
+            auto contour_ofn = [&rawobjfunc, &getNfpPoint, &start]
+                    (double relpos)
+            {
+                return rawobjfunc(getNfpPoint(
+                                      Optimum(relpos, start.nfpidx,
+                                              start.hidx)));
+            };
+
+            opt::StopCriteria stopcr;
+            stopcr.max_iterations = 100;
+            stopcr.relative_score_difference = 1e-6;
+            opt::TOptimizer<opt::Method::L_SUBPLEX> solver(stopcr);
+
+            try {
+                auto result = solver.optimize_min(contour_ofn,
+                                opt::initvals<double>(start.relpos),
+                                opt::bound<double>(0, 1.0)
+                                );
+
+                if(result.score < penality_) {
+                    Optimum o(std::get<0>(result.optimum), start.nfpidx,
+                              start.hidx);
+                    if(boundaryCheck(o)) results[si] = {result.score, o};
+                }
+            } catch(std::exception& e) {
+                derr() << "ERROR: " << e.what() << "\n";
+            }
+        }, config_.parallel);
+
+        // Pick the first best result, the same as if the starting points
+        // were evaluated one after the other.
+        Optimum optimum(0, 0);
+        double best_score = penality_;
+        for(auto& r : results) {
+            if(r.first < best_score) {
+                best_score = r.first;
+                optimum = r.second;
+            }
+        }
+
+        Placement ret { penality_, {0, 0} };
+        if(best_score < penality_) {
+            auto d = getNfpPoint(optimum) - iv;
+            d += startpos;
+            ret.score = best_score;
+            ret.translation = d;
+        }
+
+        return ret;
+    }
+
     void setInitialPosition(Item& item) {
         Box&& bb = item.boundingBox();
         Vertex ci, cb;
@@ -774,6 +774,121 @@ TEST(GeometryAlgorithms, pointOnPolygonContour) {
     }
 }
 
+TEST(GeometryAlgorithms, NfpPlacerParallel)
+{
+    using namespace libnest2d;
+
+    const Coord SCALE = 1000000;
+    Box bin({0, 0}, {250*SCALE, 210*SCALE});
+
+    // Copies of the same shape share their cached no fit polygons, the
+    // convex hulls of the printer parts are all different.
+    std::vector<Item> identical(20, prusaParts()[0]);
+    std::vector<Item> mixed;
+    for(size_t i = 0; i < 20; ++i)
+        mixed.emplace_back(ShapeLike::convexHull(prusaParts()[i].rawShape()));
+
+    // The bin index of each item after the arrangement.
+    auto pack = [&bin](std::vector<Item>& items, bool parallel) {
+        NfpPlacer::Config pconf;
+        pconf.parallel = parallel;
+        Arranger<NfpPlacer, FirstFitSelection> arrange(bin, 6*SCALE, pconf);
+        auto groups = arrange.arrangeIndexed(items.begin(), items.end());
+
+        std::vector<size_t> binidx(items.size());
+        for(size_t b = 0; b < groups.size(); ++b)
+            for(auto& r : groups[b]) binidx[r.first] = b;
+        return binidx;
+    };
+
+    for(auto& input : { identical, mixed }) {
+        auto serial = input, parallel = input;
+        auto serial_bins = pack(serial, false);
+        auto parallel_bins = pack(parallel, true);
+
+        ASSERT_EQ(serial_bins, parallel_bins);
+        for(size_t i = 0; i < serial.size(); ++i) {
+            ASSERT_EQ(getX(serial[i].translation()),
+                      getX(parallel[i].translation()));
+            ASSERT_EQ(getY(serial[i].translation()),
+                      getY(parallel[i].translation()));
+            ASSERT_DOUBLE_EQ(serial[i].rotation(), parallel[i].rotation());
+        }
+
+        // The items of a bin fit into it without overlaps.
+        for(size_t i = 0; i < parallel.size(); ++i) {
+            ASSERT_TRUE(parallel[i].isInside(bin));
+            for(size_t j = i + 1; j < parallel.size(); ++j)
+                if(parallel_bins[i] == parallel_bins[j])
+                    ASSERT_FALSE(Item::intersects(parallel[i], parallel[j]));
+        }
+    }
+}
+
+TEST(GeometryAlgorithms, arrangeOnLattice)
+{
+    using namespace libnest2d;
+
+    const Coord SCALE = 1000000;
+    const Coord DIST = 6*SCALE;
+    Box bin({0, 0}, {250*SCALE, 210*SCALE});
+
+    auto triangle = [SCALE]() {
+        return Item({ {0, 0}, {7*SCALE, 15*SCALE}, {20*SCALE, 0}, {0, 0} });
+    };
+
+    auto lshape = [SCALE]() {
+        return Item({ {0, 0}, {0, 30*SCALE}, {10*SCALE, 30*SCALE},
+                      {10*SCALE, 10*SCALE}, {25*SCALE, 10*SCALE},
+                      {25*SCALE, 0}, {0, 0} });
+    };
+
+    for(auto mkitem : { std::function<Item()>(triangle),
+                        std::function<Item()>(lshape) })
+    {
+        std::vector<Item> items(300, mkitem());
+        for(Item& itm : items) itm.rotation(0.3);
+
+        IndexedPackGroup result;
+        ASSERT_TRUE(arrangeOnLattice(items.begin(), items.end(), DIST, bin,
+                                     result));
+
+        // All the items are placed, the overflowing ones into the next bins.
+        ASSERT_GT(result.size(), 1u);
+        size_t count = 0;
+        for(auto& group : result) count += group.size();
+        ASSERT_EQ(count, items.size());
+
+        for(auto& group : result) {
+            std::vector<Item> hulls;
+            for(auto& r : group) {
+                Item& itm = r.second;
+                ASSERT_DOUBLE_EQ(itm.rotation(), 0.3);
+                hulls.emplace_back(ShapeLike::convexHull(itm.transformedShape()));
+                ASSERT_TRUE(hulls.back().isInside(bin));
+            }
+
+            for(size_t i = 0; i < hulls.size(); ++i) {
+                Item inflated = hulls[i];
+                inflated.addOffset(DIST/2 - 1000);
+                for(size_t j = i + 1; j < hulls.size(); ++j) {
+                    ASSERT_FALSE(Item::intersects(hulls[i], hulls[j]));
+                    Item other = hulls[j];
+                    other.addOffset(DIST/2 - 1000);
+                    ASSERT_FALSE(Item::intersects(inflated, other));
+                }
+            }
+        }
+    }
+
+    // Different shapes are left to the nester.
+    std::vector<Item> mixed = { triangle(), triangle(), lshape() };
+    IndexedPackGroup result;
+    ASSERT_FALSE(arrangeOnLattice(mixed.begin(), mixed.end(), DIST, bin,
+                                  result));
+    ASSERT_TRUE(result.empty());
+}
+
 TEST(GeometryAlgorithms, mergePileWithPolygon) {
     using namespace libnest2d;
 
@@ -404,7 +404,6 @@ void EdgeGrid::Grid::create_from_m_contours(coord_t resolution)
 	}
 }
 
-#if 0
 // Divide, round to a grid coordinate.
 // Divide x/y, round down. y is expected to be positive.
 static inline coord_t div_floor(coord_t x, coord_t y)
@@ -413,6 +412,194 @@ static inline coord_t div_floor(coord_t x, coord_t y)
 	return ((x < 0) ? (x - y + 1) : x) / y;
 }
 
+// Bounding box of a line segment. BoundingBox(p1, p2) would not be defined for a horizontal or a vertical segment.
+static inline BoundingBox segment_bbox(const Point &p1, const Point &p2)
+{
+	return BoundingBox(
+		Point(std::min(p1.x, p2.x), std::min(p1.y, p2.y)),
+		Point(std::max(p1.x, p2.x), std::max(p1.y, p2.y)));
+}
+
+// Walk the cells crossed by the line segment, test whether the line segment intersects or touches
+// any line stored into the grid. The cells outside of the grid are skipped.
+bool EdgeGrid::Grid::intersect(const Point &p1src, const Point &p2src) const
+{
+	if (! segment_bbox(p1src, p2src).overlap(m_bbox))
+		return false;
+	auto cell_intersect = [this, &p1src, &p2src](coord_t ix, coord_t iy) {
+		return ix >= 0 && iy >= 0 && size_t(ix) < m_cols && size_t(iy) < m_rows && 
+			line_cell_intersect(p1src, p2src, m_cells[iy*m_cols + ix]);
+	};
+	// Discretize the line segment p1, p2.
+	Point p1 = p1src;
+	Point p2 = p2src;
+	p1.x -= m_bbox.min.x;
+	p1.y -= m_bbox.min.y;
+	p2.x -= m_bbox.min.x;
+	p2.y -= m_bbox.min.y;
+	// Get the cells of the end points.
+	coord_t ix  = div_floor(p1.x, m_resolution);
+	coord_t iy  = div_floor(p1.y, m_resolution);
+	coord_t ixb = div_floor(p2.x, m_resolution);
+	coord_t iyb = div_floor(p2.y, m_resolution);
+	// Account for the end points.
+	if (cell_intersect(ix, iy))
+		return true;
+	if (ix == ixb && iy == iyb)
+		// Both ends fall into the same cell.
+		return false;
+	// Raster the central part of the line.
+	coord_t dx = std::abs(p2.x - p1.x);
+	coord_t dy = std::abs(p2.y - p1.y);
+	if (p1.x < p2.x) {
+		int64_t ex = int64_t((ix + 1)*m_resolution - p1.x) * int64_t(dy);
+		if (p1.y < p2.y) {
+			int64_t ey = int64_t((iy + 1)*m_resolution - p1.y) * int64_t(dx);
+			do {
+				assert(ix <= ixb && iy <= iyb);
+				if (ex < ey) {
+					ey -= ex;
+					ex = int64_t(dy) * m_resolution;
+					ix += 1;
+				}
+				else if (ex == ey) {
+					ex = int64_t(dy) * m_resolution;
+					ey = int64_t(dx) * m_resolution;
+					ix += 1;
+					iy += 1;
+				}
+				else {
+					assert(ex > ey);
+					ex -= ey;
+					ey = int64_t(dx) * m_resolution;
+					iy += 1;
+				}
+				if (cell_intersect(ix, iy))
+					return true;
+			} while (ix != ixb || iy != iyb);
+		}
+		else {
+			int64_t ey = int64_t(p1.y - iy*m_resolution) * int64_t(dx);
+			do {
+				assert(ix <= ixb && iy >= iyb);
+				if (ex <= ey) {
+					ey -= ex;
+					ex = int64_t(dy) * m_resolution;
+					ix += 1;
+				}
+				else {
+					ex -= ey;
+					ey = int64_t(dx) * m_resolution;
+					iy -= 1;
+				}
+				if (cell_intersect(ix, iy))
+					return true;
+			} while (ix != ixb || iy != iyb);
+		}
+	}
+	else {
+		int64_t ex = int64_t(p1.x - ix*m_resolution) * int64_t(dy);
+		if (p1.y < p2.y) {
+			int64_t ey = int64_t((iy + 1)*m_resolution - p1.y) * int64_t(dx);
+			do {
+				assert(ix >= ixb && iy <= iyb);
+				if (ex < ey) {
+					ey -= ex;
+					ex = int64_t(dy) * m_resolution;
+					ix -= 1;
+				}
+				else {
+					assert(ex >= ey);
+					ex -= ey;
+					ey = int64_t(dx) * m_resolution;
+					iy += 1;
+				}
+				if (cell_intersect(ix, iy))
+					return true;
+			} while (ix != ixb || iy != iyb);
+		}
+		else {
+			int64_t ey = int64_t(p1.y - iy*m_resolution) * int64_t(dx);
+			do {
+				assert(ix >= ixb && iy >= iyb);
+				if (ex < ey) {
+					ey -= ex;
+					ex = int64_t(dy) * m_resolution;
+					ix -= 1;
+				}
+				else if (ex == ey) {
+					if (dx > 0) {
+						ex = int64_t(dy) * m_resolution;
+						ix -= 1;
+					}
+					if (dy > 0) {
+						ey = int64_t(dx) * m_resolution;
+						iy -= 1;
+					}
+				}
+				else {
+					assert(ex > ey);
+					ex -= ey;
+					ey = int64_t(dx) * m_resolution;
+					iy -= 1;
+				}
+				if (cell_intersect(ix, iy))
+					return true;
+			} while (ix != ixb || iy != iyb);
+		}
+	}
+	return false;
+}
+
+bool EdgeGrid::Grid::line_cell_intersect(const Point &p1a, const Point &p2a, const Cell &cell) const
+{
+	BoundingBox bbox = segment_bbox(p1a, p2a);
+	int64_t va_x = p2a.x - p1a.x;
+	int64_t va_y = p2a.y - p1a.y;
+	for (size_t i = cell.begin; i != cell.end; ++ i) {
+		const std::pair<size_t, size_t> &cell_data = m_cell_data[i];
+		// Contour indexed by the ith line of this cell.
+		const Slic3r::Points &contour = *m_contours[cell_data.first];
+		// Point indices in contour indexed by the ith line of this cell.
+		size_t idx1 = cell_data.second;
+		size_t idx2 = idx1 + 1;
+		if (idx2 == contour.size())
+			idx2 = 0;
+		// The points of the ith line of this cell and its bounding box.
+		const Point &p1b = contour[idx1];
+		const Point &p2b = contour[idx2];
+		// Do the bounding boxes intersect?
+		if (! bbox.overlap(segment_bbox(p1b, p2b)))
+			continue;
+		// Now intersect the two line segments using exact arithmetics.
+		int64_t w1_x = p1b.x - p1a.x;
+		int64_t w1_y = p1b.y - p1a.y;
+		int64_t w2_x = p2b.x - p1a.x;
+		int64_t w2_y = p2b.y - p1a.y;
+		int64_t side1 = va_x * w1_y - va_y * w1_x;
+		int64_t side2 = va_x * w2_y - va_y * w2_x;
+		if ((side1 > 0 && side2 > 0) || (side1 < 0 && side2 < 0))
+			// The line segments don't intersect.
+			continue;
+		w1_x = p1a.x - p1b.x;
+		w1_y = p1a.y - p1b.y;
+		w2_x = p2a.x - p1b.x;
+		w2_y = p2a.y - p1b.y;
+		int64_t vb_x = p2b.x - p1b.x;
+		int64_t vb_y = p2b.y - p1b.y;
+		side1 = vb_x * w1_y - vb_y * w1_x;
+		side2 = vb_x * w2_y - vb_y * w2_x;
+		if ((side1 > 0 && side2 > 0) || (side1 < 0 && side2 < 0))
+			// The line segments don't intersect.
+			continue;
+		// The line segments intersect.
+		return true;
+	}
+	// The line segment (p1a, p2a) does not intersect any of the line segments inside this cell.
+	return false;
+}
+
+#if 0
 // Walk the polyline, test whether any lines of this polyline does not intersect
 // any line stored into the grid.
 bool EdgeGrid::Grid::intersect(const MultiPoint &polyline, bool closed)
@@ -552,57 +739,6 @@ bool EdgeGrid::Grid::intersect(const MultiPoint &polyline, bool closed)
 	return false;
 }
 
-bool EdgeGrid::Grid::line_cell_intersect(const Point &p1a, const Point &p2a, const Cell &cell)
-{
-	BoundingBox bbox(p1a, p1a);
-	bbox.merge(p2a);
-	int64_t va_x = p2a.x - p1a.x;
-	int64_t va_y = p2a.y - p1a.y;
-	for (size_t i = cell.begin; i != cell.end; ++ i) {
-		const std::pair<size_t, size_t> &cell_data = m_cell_data[i];
-		// Contour indexed by the ith line of this cell.
-		const Slic3r::Points &contour = *m_contours[cell_data.first];
-		// Point indices in contour indexed by the ith line of this cell.
-		size_t idx1 = cell_data.second;
-		size_t idx2 = idx1 + 1;
-		if (idx2 == contour.size())
-			idx2 = 0;
-		// The points of the ith line of this cell and its bounding box.
-		const Point &p1b = contour[idx1];
-		const Point &p2b = contour[idx2];
-		BoundingBox bbox2(p1b, p1b);
-		bbox2.merge(p2b);
-		// Do the bounding boxes intersect?
-		if (! bbox.overlap(bbox2))
-			continue;
-		// Now intersect the two line segments using exact arithmetics.
-		int64_t w1_x = p1b.x - p1a.x;
-		int64_t w1_y = p1b.y - p1a.y;
-		int64_t w2_x = p2b.x - p1a.x;
-		int64_t w2_y = p2b.y - p1a.y;
-		int64_t side1 = va_x * w1_y - va_y * w1_x;
-		int64_t side2 = va_x * w2_y - va_y * w2_x;
-		if (side1 == side2 && side1 != 0)
-			// The line segments don't intersect.
-			continue;
-		w1_x = p1a.x - p1b.x;
-		w1_y = p1a.y - p1b.y;
-		w2_x = p2a.x - p1b.x;
-		w2_y = p2a.y - p1b.y;
-		int64_t vb_x = p2b.x - p1b.x;
-		int64_t vb_y = p2b.y - p1b.y;
-		side1 = vb_x * w1_y - vb_y * w1_x;
-		side2 = vb_x * w2_y - vb_y * w2_x;
-		if (side1 == side2 && side1 != 0)
-			// The line segments don't intersect.
-			continue;
-		// The line segments intersect.
-		return true;
-	}
-	// The line segment (p1a, p2a) does not intersect any of the line segments inside this cell.
-	return false;
-}
-
 // Test, whether a point is inside a contour.
 bool EdgeGrid::Grid::inside(const Point &pt_src)
 {
@@ -25,6 +25,9 @@ public:
 	void create(const ExPolygons &expolygons, coord_t resolution);
 	void create(const ExPolygonCollection &expolygons, coord_t resolution);
 
+	// Test, whether the line segment intersects or touches any of the edges inside the grid.
+	bool intersect(const Point &p1, const Point &p2) const;
+
 #if 0
 	// Test, whether the edges inside the grid intersect with the polygons provided.
 	bool intersect(const MultiPoint &polyline, bool closed);
@@ -68,9 +71,7 @@ protected:
 	};
 
 	void create_from_m_contours(coord_t resolution);
-#if 0
-	bool line_cell_intersect(const Point &p1, const Point &p2, const Cell &cell);
-#endif
+	bool line_cell_intersect(const Point &p1, const Point &p2, const Cell &cell) const;
 	bool cell_inside_or_crossing(int r, int c) const
 	{
 		if (r < 0 || r >= m_rows ||
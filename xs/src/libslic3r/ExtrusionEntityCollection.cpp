@@ -1,4 +1,5 @@
 #include "ExtrusionEntityCollection.hpp"
+#include "ShortestPath.hpp"
 #include <algorithm>
 #include <cmath>
 #include <map>
@@ -102,7 +103,7 @@ ExtrusionEntityCollection ExtrusionEntityCollection::chained_path_from(Point sta
     return coll;
 }
 
-void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEntityCollection* retval, bool no_reverse, ExtrusionRole role, std::vector<size_t>* orig_indices) const
+void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEntityCollection* retval, bool no_reverse, ExtrusionRole role, std::vector<size_t>* orig_indices, double improve_time_limit) const
 {
     if (this->no_sort) {
         *retval = *this;
@@ -111,8 +112,8 @@ void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEnt
     retval->entities.reserve(this->entities.size());
     retval->orig_indices.reserve(this->entities.size());
     
-    // if we're asked to return the original indices, build a map
-    std::map<ExtrusionEntity*,size_t> indices_map;
+    // original indices of the entities to be sorted
+    std::vector<size_t> indices;
     
     ExtrusionEntitiesPtr my_paths;
     for (ExtrusionEntitiesPtr::const_iterator it = this->entities.begin(); it != this->entities.end(); ++it) {
@@ -126,12 +127,12 @@ void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEnt
             }
         }
 
-        ExtrusionEntity* entity = (*it)->clone();
-        my_paths.push_back(entity);
-        if (orig_indices != NULL) indices_map[entity] = it - this->entities.begin();
+        my_paths.push_back((*it)->clone());
+        indices.push_back(it - this->entities.begin());
     }
     
     Points endpoints;
+    endpoints.reserve(my_paths.size() * 2);
     for (ExtrusionEntitiesPtr::iterator it = my_paths.begin(); it != my_paths.end(); ++it) {
         endpoints.push_back((*it)->first_point());
         if (no_reverse || !(*it)->can_reverse()) {
@@ -141,20 +142,42 @@ void ExtrusionEntityCollection::chained_path_from(Point start_near, ExtrusionEnt
         }
     }
     
-    while (!my_paths.empty()) {
+    // indices of my_paths in the order of printing
+    std::vector<size_t> order;
+    order.reserve(my_paths.size());
+    Point start_point = start_near;
+    NearestEndPointLookup lookup(endpoints, 2);
+    while (! lookup.empty()) {
         // find nearest point
-        int start_index = start_near.nearest_point_index(endpoints);
-        int path_index = start_index/2;
-        ExtrusionEntity* entity = my_paths.at(path_index);
+        size_t start_index = lookup.pop_nearest(start_near);
+        size_t path_index = start_index/2;
+        ExtrusionEntity* entity = my_paths[path_index];
         // never reverse loops, since it's pointless for chained path and callers might depend on orientation
         if (start_index % 2 && !no_reverse && entity->can_reverse()) {
             entity->reverse();
         }
-        retval->entities.push_back(my_paths.at(path_index));
-        if (orig_indices != NULL) orig_indices->push_back(indices_map[entity]);
-        my_paths.erase(my_paths.begin() + path_index);
-        endpoints.erase(endpoints.begin() + 2*path_index, endpoints.begin() + 2*path_index + 2);
-        start_near = retval->entities.back()->last_point();
+        order.push_back(path_index);
+        start_near = entity->last_point();
+    }
+    
+    if (improve_time_limit > 0.) {
+        std::vector<ChainItem> chain;
+        chain.reserve(order.size());
+        for (size_t path_index : order) {
+            const ExtrusionEntity* entity = my_paths[path_index];
+            chain.emplace_back(entity->first_point(), entity->last_point(), !no_reverse && entity->can_reverse(), path_index);
+        }
+        improve_chain_2opt(chain, start_point, improve_time_limit);
+        for (size_t i = 0; i < chain.size(); ++i) {
+            order[i] = chain[i].idx;
+            if (chain[i].reversed)
+                my_paths[order[i]]->reverse();
+        }
+    }
+    
+    for (size_t path_index : order) {
+        retval->entities.push_back(my_paths[path_index]);
+        if (orig_indices != NULL) orig_indices->push_back(indices[path_index]);
     }
 }
 
@@ -5,12 +5,16 @@
 #include "../slic3r/GUI/PresetBundle.hpp"
 
 #include "3mf.hpp"
+#include "ParallelFormat.hpp"
 
 #include <boost/algorithm/string/classification.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/nowide/fstream.hpp>
+#include <boost/log/trivial.hpp>
+
+#include <chrono>
 
 #include <expat.h>
 #include <Eigen/Dense>
@@ -324,6 +328,16 @@ namespace Slic3r {
         typedef std::map<int, Geometry> IdToGeometryMap;
         typedef std::map<int, std::vector<coordf_t>> IdToLayerHeightsProfileMap;
 
+        // State of the model xml parsing while the model data is being inflated.
+        struct ModelXmlStreamingData
+        {
+            _3MF_Importer& importer;
+            mz_uint64 parsed_size;
+            bool parse_error;
+
+            explicit ModelXmlStreamingData(_3MF_Importer& importer) : importer(importer), parsed_size(0), parse_error(false) {}
+        };
+
         // Version of the 3mf file
         unsigned int m_version;
 
@@ -353,6 +367,10 @@ namespace Slic3r {
 
         bool _load_model_from_file(const std::string& filename, Model& model, PresetBundle& bundle);
         bool _extract_model_from_archive(mz_zip_archive& archive, const mz_zip_archive_file_stat& stat);
+        // Receives the model data being inflated by miniz, pOpaque is a ModelXmlStreamingData.
+        static size_t _parse_model_xml_chunk(void* pOpaque, mz_uint64 file_ofs, const void* pBuf, size_t n);
+        // Adds the expat error to the errors list if parse_result signals a failure, returns false in that case.
+        bool _report_xml_parse_error(int parse_result);
         void _extract_layer_heights_profile_config_from_archive(mz_zip_archive& archive, const mz_zip_archive_file_stat& stat);
         void _extract_print_config_from_archive(mz_zip_archive& archive, const mz_zip_archive_file_stat& stat, PresetBundle& bundle, const std::string& archive_filename);
         bool _extract_model_config_from_archive(mz_zip_archive& archive, const mz_zip_archive_file_stat& stat, Model& model);
@@ -632,21 +650,49 @@ namespace Slic3r {
         XML_SetElementHandler(m_xml_parser, _3MF_Importer::_handle_start_model_xml_element, _3MF_Importer::_handle_end_model_xml_element);
         XML_SetCharacterDataHandler(m_xml_parser, _3MF_Importer::_handle_model_xml_characters);
 
-        void* parser_buffer = XML_GetBuffer(m_xml_parser, (int)stat.m_uncomp_size);
-        if (parser_buffer == nullptr)
+        // The model data is inflated in chunks and each chunk is handed to expat as soon as it is available,
+        // so the uncompressed model is never held in memory as a whole.
+        ModelXmlStreamingData data(*this);
+        auto t_start = std::chrono::steady_clock::now();
+        mz_bool res = mz_zip_reader_extract_to_callback(&archive, stat.m_file_index, _3MF_Importer::_parse_model_xml_chunk, (void*)&data, 0);
+        if (res == 0 || data.parsed_size != stat.m_uncomp_size)
         {
-            add_error("Unable to create buffer");
+            if (! data.parse_error)
+                add_error("Error while reading model data to buffer");
             return false;
         }
 
-        mz_bool res = mz_zip_reader_extract_file_to_mem(&archive, stat.m_filename, parser_buffer, (size_t)stat.m_uncomp_size, 0);
-        if (res == 0)
-        {
-            add_error("Error while reading model data to buffer");
+        if (! _report_xml_parse_error(XML_Parse(m_xml_parser, nullptr, 0, 1)))
             return false;
+
+        double t_elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+        BOOST_LOG_TRIVIAL(debug) << "3MF model " << stat.m_filename << ": parsed " << stat.m_uncomp_size << " bytes in " << t_elapsed << " s ("
+            << ((t_elapsed > 0.) ? double(stat.m_uncomp_size) / (1024. * 1024. * t_elapsed) : 0.) << " MB/s)";
+
+        return true;
+    }
+
+    size_t _3MF_Importer::_parse_model_xml_chunk(void* pOpaque, mz_uint64 file_ofs, const void* pBuf, size_t n)
+    {
+        ModelXmlStreamingData* data = (ModelXmlStreamingData*)pOpaque;
+        // miniz delivers the inflated data in order, any gap means corrupted data.
+        if (data->parse_error || (file_ofs != data->parsed_size))
+            return 0;
+
+        if (! data->importer._report_xml_parse_error(XML_Parse(data->importer.m_xml_parser, (const char*)pBuf, (int)n, 0)))
+        {
+            data->parse_error = true;
+            // Returning less than n stops the extraction.
+            return 0;
         }
 
-        if (!XML_ParseBuffer(m_xml_parser, (int)stat.m_uncomp_size, 1))
+        data->parsed_size += n;
+        return n;
+    }
+
+    bool _3MF_Importer::_report_xml_parse_error(int parse_result)
+    {
+        if (parse_result == XML_STATUS_ERROR)
         {
             char error_buf[1024];
             ::sprintf(error_buf, "Error (%s) while parsing xml file at line %d", XML_ErrorString(XML_GetErrorCode(m_xml_parser)), XML_GetCurrentLineNumber(m_xml_parser));
@@ -1490,6 +1536,7 @@ namespace Slic3r {
             }
 
             stl_get_size(&stl);
+            volume->mesh.invalidate_z_index();
             volume->mesh.repair();
 
             // apply volume's name and config data
@@ -1841,13 +1888,18 @@ namespace Slic3r {
 
             vertices_count += stl.stats.shared_vertices;
 
-            for (int i = 0; i < stl.stats.shared_vertices; ++i)
+            write_formatted_in_parallel(stream, (size_t)stl.stats.shared_vertices, 64, [&stl](size_t i, std::string& out)
             {
-                stream << "     <" << VERTEX_TAG << " ";
-                stream << "x=\"" << stl.v_shared[i].x << "\" ";
-                stream << "y=\"" << stl.v_shared[i].y << "\" ";
-                stream << "z=\"" << stl.v_shared[i].z << "\" />\n";
-            }
+                out += "     <";
+                out += VERTEX_TAG;
+                out += " x=\"";
+                append_float_xml(out, stl.v_shared[i].x);
+                out += "\" y=\"";
+                append_float_xml(out, stl.v_shared[i].y);
+                out += "\" z=\"";
+                append_float_xml(out, stl.v_shared[i].z);
+                out += "\" />\n";
+            });
         }
 
         stream << "    </" << VERTICES_TAG << ">\n";
@@ -1869,15 +1921,22 @@ namespace Slic3r {
             triangles_count += stl.stats.number_of_facets;
             volume_it->second.last_triangle_id = triangles_count - 1;
 
-            for (uint32_t i = 0; i < stl.stats.number_of_facets; ++i)
+            unsigned int first_vertex_id = volume_it->second.first_vertex_id;
+            write_formatted_in_parallel(stream, (size_t)stl.stats.number_of_facets, 48, [&stl, first_vertex_id](size_t i, std::string& out)
             {
-                stream << "     <" << TRIANGLE_TAG << " ";
+                out += "     <";
+                out += TRIANGLE_TAG;
+                out += " ";
                 for (int j = 0; j < 3; ++j)
                 {
-                    stream << "v" << j + 1 << "=\"" << stl.v_indices[i].vertex[j] + volume_it->second.first_vertex_id << "\" ";
+                    out += 'v';
+                    out += char('1' + j);
+                    out += "=\"";
+                    append_uint_xml(out, stl.v_indices[i].vertex[j] + first_vertex_id);
+                    out += "\" ";
                 }
-                stream << "/>\n";
-            }
+                out += "/>\n";
+            });
         }
 
         stream << "    </" << TRIANGLES_TAG << ">\n";
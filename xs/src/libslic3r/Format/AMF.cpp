@@ -11,6 +11,7 @@
 #include "../Utils.hpp"
 #include "../slic3r/GUI/PresetBundle.hpp"
 #include "AMF.hpp"
+#include "ParallelFormat.hpp"
 
 #include <boost/filesystem/operations.hpp>
 #include <boost/algorithm/string.hpp>
@@ -405,6 +406,7 @@ void AMFParserContext::endElement(const char * /* name */)
                 memcpy(&facet.vertex[v].x, &m_object_vertices[m_volume_facets[i ++] * 3], 3 * sizeof(float));
         }
         stl_get_size(&stl);
+        m_volume->mesh.invalidate_z_index();
         m_volume->mesh.repair();
         m_volume_facets.clear();
         m_volume = nullptr;
@@ -757,15 +759,21 @@ bool store_amf(const char *path, Model *model, Print* print, bool export_print_c
             auto &stl = volume->mesh.stl;
             if (stl.v_shared == nullptr)
                 stl_generate_shared_vertices(&stl);
-            for (size_t i = 0; i < stl.stats.shared_vertices; ++ i) {
-                stream << "         <vertex>\n";
-                stream << "           <coordinates>\n";
-                stream << "             <x>" << stl.v_shared[i].x << "</x>\n";
-                stream << "             <y>" << stl.v_shared[i].y << "</y>\n";
-                stream << "             <z>" << stl.v_shared[i].z << "</z>\n";
-                stream << "           </coordinates>\n";
-                stream << "         </vertex>\n";
-            }
+            write_formatted_in_parallel(stream, stl.stats.shared_vertices, 160, [&stl](size_t i, std::string &out) {
+                out += "         <vertex>\n"
+                       "           <coordinates>\n"
+                       "             <x>";
+                append_float_xml(out, stl.v_shared[i].x);
+                out += "</x>\n"
+                       "             <y>";
+                append_float_xml(out, stl.v_shared[i].y);
+                out += "</y>\n"
+                       "             <z>";
+                append_float_xml(out, stl.v_shared[i].z);
+                out += "</z>\n"
+                       "           </coordinates>\n"
+                       "         </vertex>\n";
+            });
             num_vertices += stl.stats.shared_vertices;
         }
         stream << "      </vertices>\n";
@@ -782,12 +790,20 @@ bool store_amf(const char *path, Model *model, Print* print, bool export_print_c
                 stream << "        <metadata type=\"name\">" << xml_escape(volume->name) << "</metadata>\n";
             if (volume->modifier)
                 stream << "        <metadata type=\"slic3r.modifier\">1</metadata>\n";
-            for (int i = 0; i < volume->mesh.stl.stats.number_of_facets; ++i) {
-                stream << "        <triangle>\n";
-                for (int j = 0; j < 3; ++j)
-                stream << "          <v" << j + 1 << ">" << volume->mesh.stl.v_indices[i].vertex[j] + vertices_offset << "</v" << j + 1 << ">\n";
-                stream << "        </triangle>\n";
-            }
+            const stl_file &stl = volume->mesh.stl;
+            write_formatted_in_parallel(stream, stl.stats.number_of_facets, 128, [&stl, vertices_offset](size_t i, std::string &out) {
+                out += "        <triangle>\n";
+                for (int j = 0; j < 3; ++j) {
+                    out += "          <v";
+                    out += char('1' + j);
+                    out += '>';
+                    append_uint_xml(out, (unsigned int)(stl.v_indices[i].vertex[j] + vertices_offset));
+                    out += "</v";
+                    out += char('1' + j);
+                    out += ">\n";
+                }
+                out += "        </triangle>\n";
+            });
             stream << "      </volume>\n";
         }
         stream << "    </mesh>\n";
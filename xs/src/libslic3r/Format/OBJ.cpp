@@ -104,6 +104,7 @@ bool load_obj(const char *path, Model *model, const char *object_name_in)
         }
 	}
     stl_get_size(&stl);
+    mesh.invalidate_z_index();
     mesh.repair();
     if (mesh.facets_count() == 0) {
         // die "This STL file couldn't be read because it's empty.\n"
@@ -260,6 +260,7 @@ bool load_prus(const char *path, Model *model)
 							mesh.repair();
 							// Transform the model.
 							stl_transform(&stl, &trafo[0][0]);
+							mesh.invalidate_z_index();
 							if (std::abs(stl.stats.min.z) < EPSILON)
 								stl.stats.min.z = 0.;
 							// Add a mesh to a model.
@@ -344,6 +345,7 @@ bool load_prus(const char *path, Model *model)
                         mesh.repair();
                         // Transform the model.
                         stl_transform(&stl, &trafo[0][0]);
+                        mesh.invalidate_z_index();
                         // Add a mesh to a model.
                         if (mesh.facets_count() > 0)
                             mesh_valid = true;
@@ -0,0 +1,65 @@
+#ifndef slic3r_Format_ParallelFormat_hpp_
+#define slic3r_Format_ParallelFormat_hpp_
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+namespace Slic3r {
+
+// Append a float formatted the same way as std::ostream << value with the default formatting.
+inline void append_float_xml(std::string &out, float value)
+{
+    char buf[64];
+    int  len = ::snprintf(buf, sizeof(buf), "%g", double(value));
+    out.append(buf, std::min<size_t>(len, sizeof(buf) - 1));
+}
+
+// Append an unsigned integer in decimal.
+inline void append_uint_xml(std::string &out, unsigned int value)
+{
+    char  buf[16];
+    char *end = buf + sizeof(buf);
+    char *p   = end;
+    do {
+        *-- p = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(p, end - p);
+}
+
+// Format count elements of a mesh by format(idx, std::string &out) in chunks processed in parallel,
+// then write the chunks to the stream in order. The output is the same as if the elements were formatted sequentially.
+// estimated_element_size is used to pre-size the chunk buffers.
+template<typename FormatFn>
+void write_formatted_in_parallel(std::ostream &stream, size_t count, size_t estimated_element_size, FormatFn format)
+{
+    // Number of elements formatted by a single task.
+    static const size_t chunk_size = 16384;
+    std::vector<std::string> chunks((count + chunk_size - 1) / chunk_size);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks.size()),
+        [count, estimated_element_size, &chunks, &format](const tbb::blocked_range<size_t> &range) {
+            for (size_t idx_chunk = range.begin(); idx_chunk < range.end(); ++ idx_chunk) {
+                std::string &out   = chunks[idx_chunk];
+                size_t       begin = idx_chunk * chunk_size;
+                size_t       end   = std::min(count, begin + chunk_size);
+                out.reserve((end - begin) * estimated_element_size);
+                for (size_t idx = begin; idx < end; ++ idx)
+                    format(idx, out);
+            }
+        });
+    for (std::string &chunk : chunks) {
+        stream.write(chunk.data(), chunk.size());
+        // Release the memory early, the formatted mesh may be huge.
+        std::string().swap(chunk);
+    }
+}
+
+} // namespace Slic3r
+
+#endif /* slic3r_Format_ParallelFormat_hpp_ */
@@ -19,6 +19,9 @@
 #include <boost/nowide/cstdio.hpp>
 #include <boost/nowide/cstdlib.hpp>
 
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+
 #include "SVG.hpp"
 
 #include <Shiny/Shiny.h>
@@ -431,7 +434,15 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
         throw std::runtime_error(std::string("G-code export to ") + path + " failed.\nCannot open the file for writing.\n");
 
     this->m_placeholder_parser_failed_templates.clear();
-    this->_do_export(*print, file, preview_data);
+    try {
+        this->_do_export(*print, file, preview_data);
+    } catch (...) {
+        // Stop the post-processing and the output threads before closing the file.
+        m_post_process_queue.reset();
+        m_output.reset();
+        fclose(file);
+        throw;
+    }
     fflush(file);
     if (ferror(file)) {
         fclose(file);
@@ -442,9 +453,13 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
 
     if (print->config.remaining_times.value)
     {
-        m_normal_time_estimator.post_process_remaining_times(path_tmp, 60.0f);
+        // Place the remaining times of both the normal and the silent mode in a single pass over the file.
+        // The silent mode lines precede the normal mode lines, as when the file was processed once per mode.
+        std::vector<const GCodeTimeEstimator*> time_estimators;
         if (m_silent_time_estimator_enabled)
-            m_silent_time_estimator.post_process_remaining_times(path_tmp, 60.0f);
+            time_estimators.emplace_back(&m_silent_time_estimator);
+        time_estimators.emplace_back(&m_normal_time_estimator);
+        GCodeTimeEstimator::post_process_remaining_times(path_tmp, 60.0f, time_estimators);
     }
 
     if (! this->m_placeholder_parser_failed_templates.empty()) {
@@ -472,6 +487,78 @@ void GCode::do_export(Print *print, const char *path, GCodePreviewData *preview_
     PROFILE_OUTPUT(debug_out_path("gcode-export-profile.txt").c_str());
 }
 
+// Constructs the motion planners of the layers for avoid_crossing_perimeters ahead of process_layer().
+// The layers are printed in steps (print_z levels, or the layers of a single object with complete_objects),
+// while the G-code of a batch of steps is generated, the planners of the next batch are constructed by TBB tasks.
+// The planners of the current batch are published into planners, process_layer() constructs the missing ones itself.
+// Consecutive layers of an object with the same islands share a single planner, so that its graphs are constructed once.
+class LayerMotionPlannersPrefetch
+{
+public:
+    LayerMotionPlannersPrefetch(std::vector<std::vector<const Layer*>> &&layers_per_step, std::map<const Layer*, std::shared_ptr<MotionPlanner>> &planners) :
+        m_layers_per_step(std::move(layers_per_step)), m_planners(planners)
+        { this->start_batch(0); }
+    ~LayerMotionPlannersPrefetch()
+    {
+        try {
+            m_task_group.wait();
+        } catch (...) {
+        }
+        m_planners.clear();
+    }
+
+    // To be called before the G-code of the step is generated.
+    void prepare_step(size_t step)
+    {
+        if (step % BATCH_STEPS != 0)
+            return;
+        m_task_group.wait();
+        // Release the planners of the previous batch, the planner in use is shared with AvoidCrossingPerimeters.
+        m_planners.clear();
+        for (size_t i = 0; i < m_batch_layers.size(); ++ i)
+            m_planners[m_batch_layers[i]] = std::move(m_batch_planners[i]);
+        this->start_batch(step + BATCH_STEPS);
+    }
+
+private:
+    static const size_t BATCH_STEPS = 32;
+
+    void start_batch(size_t step_begin)
+    {
+        m_batch_layers.clear();
+        for (size_t step = step_begin; step < std::min(step_begin + BATCH_STEPS, m_layers_per_step.size()); ++ step)
+            for (const Layer *layer : m_layers_per_step[step])
+                if (layer != nullptr)
+                    m_batch_layers.emplace_back(layer);
+        m_batch_planners.assign(m_batch_layers.size(), nullptr);
+        if (! m_batch_layers.empty())
+            m_task_group.run([this]() {
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, m_batch_layers.size()),
+                    [this](const tbb::blocked_range<size_t> &range) {
+                        for (size_t i = range.begin(); i < range.end(); ++ i)
+                            m_batch_planners[i] = std::make_shared<MotionPlanner>(union_ex(m_batch_layers[i]->slices, true));
+                    });
+                for (size_t i = 0; i < m_batch_layers.size(); ++ i) {
+                    std::shared_ptr<MotionPlanner> &last = m_last_planners[m_batch_layers[i]->object()];
+                    if (last != nullptr && last->same_islands(*m_batch_planners[i]))
+                        m_batch_planners[i] = last;
+                    else
+                        last = m_batch_planners[i];
+                }
+            });
+    }
+
+    std::vector<std::vector<const Layer*>>                      m_layers_per_step;
+    std::map<const Layer*, std::shared_ptr<MotionPlanner>>     &m_planners;
+    // Layers of the batch being constructed and their planners.
+    std::vector<const Layer*>                                   m_batch_layers;
+    std::vector<std::shared_ptr<MotionPlanner>>                 m_batch_planners;
+    // Planner of the last layer of each object constructed so far, possibly still in use by the G-code generator.
+    // Only its islands are accessed by the TBB task, which are not modified after construction.
+    std::map<const PrintObject*, std::shared_ptr<MotionPlanner>> m_last_planners;
+    tbb::task_group                                             m_task_group;
+};
+
 void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
 {
     PROFILE_FUNC();
@@ -542,6 +629,13 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
 
     // resets analyzer
     m_analyzer.reset();
+
+    // The G-code is written into the file and parsed by the time estimators on separate threads.
+    m_output.reset(new GCodeOutputStream());
+    m_output->add_consumer([file](const std::string &block, const GCodeReader::ParsedMoves&) { fwrite(block.data(), 1, block.size(), file); });
+    m_output->add_consumer([this](const std::string &block, const GCodeReader::ParsedMoves &moves) { m_normal_time_estimator.add_gcode_block(block, moves); });
+    if (m_silent_time_estimator_enabled)
+        m_output->add_consumer([this](const std::string &block, const GCodeReader::ParsedMoves &moves) { m_silent_time_estimator.add_gcode_block(block, moves); });
     m_enable_analyzer = preview_data != nullptr;
 
     // resets analyzer's tracking data
@@ -809,6 +903,10 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
         _write(file, this->set_extruder(initial_extruder_id));
     }
 
+    // From now on the G-code of the layers is post-processed and written on a worker thread, in the order of generation,
+    // while the next layers are being generated. The post-processors are only touched by the worker thread.
+    m_post_process_queue.reset(new OrderedTaskQueue());
+
     // Do all objects for each layer.
     if (print.config.complete_objects.value) {
         // Print objects from the smallest to the tallest to avoid collisions
@@ -853,17 +951,29 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
                     _writeln(file, between_objects_gcode);
                 }
                 // Reset the cooling buffer internal state (the current position, feed rate, accelerations).
-                m_cooling_buffer->reset();
-                m_cooling_buffer->set_current_extruder(initial_extruder_id);
+                Pointf3 position = m_writer.get_position();
+                m_post_process_queue->push([this, position, initial_extruder_id]() {
+                    m_cooling_buffer->reset(position);
+                    m_cooling_buffer->set_current_extruder(initial_extruder_id);
+                });
                 // Pair the object layers with the support layers by z, extrude them.
                 std::vector<LayerToPrint> layers_to_print = collect_layers_to_print(object);
+                std::unique_ptr<LayerMotionPlannersPrefetch> motion_planners;
+                if (print.config.avoid_crossing_perimeters.value) {
+                    std::vector<std::vector<const Layer*>> layers_per_step;
+                    for (const LayerToPrint &ltp : layers_to_print)
+                        layers_per_step.emplace_back(1, ltp.layer());
+                    motion_planners.reset(new LayerMotionPlannersPrefetch(std::move(layers_per_step), m_layer_motion_planners));
+                }
                 for (const LayerToPrint &ltp : layers_to_print) {
+                    if (motion_planners)
+                        motion_planners->prepare_step(&ltp - layers_to_print.data());
                     std::vector<LayerToPrint> lrs;
                     lrs.emplace_back(std::move(ltp));
                     this->process_layer(file, print, lrs, tool_ordering.tools_for_layer(ltp.print_z()), &copy - object._shifted_copies.data());
                 }
-                if (m_pressure_equalizer)
-                    _write(file, m_pressure_equalizer->process("", true));
+                motion_planners.reset();
+                this->flush_pressure_equalizer();
                 ++ finished_objects;
                 // Flag indicating whether the nozzle temperature changes from 1st to 2nd layer were performed.
                 // Reset it when starting another object from 1st layer.
@@ -911,19 +1021,35 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
             }
         }
         // Extrude the layers.
+        std::unique_ptr<LayerMotionPlannersPrefetch> motion_planners;
+        if (print.config.avoid_crossing_perimeters.value) {
+            std::vector<std::vector<const Layer*>> layers_per_step;
+            for (const auto &layer : layers_to_print) {
+                layers_per_step.emplace_back();
+                for (const LayerToPrint &ltp : layer.second)
+                    layers_per_step.back().emplace_back(ltp.layer());
+            }
+            motion_planners.reset(new LayerMotionPlannersPrefetch(std::move(layers_per_step), m_layer_motion_planners));
+        }
         for (auto &layer : layers_to_print) {
+            if (motion_planners)
+                motion_planners->prepare_step(&layer - layers_to_print.data());
             const LayerTools &layer_tools = tool_ordering.tools_for_layer(layer.first);
             if (m_wipe_tower && layer_tools.has_wipe_tower)
                 m_wipe_tower->next_layer();
             this->process_layer(file, print, layer.second, layer_tools, size_t(-1));
         }
-        if (m_pressure_equalizer)
-            _write(file, m_pressure_equalizer->process("", true));
+        motion_planners.reset();
+        this->flush_pressure_equalizer();
         if (m_wipe_tower)
             // Purge the extruder, pull out the active filament.
             _write(file, m_wipe_tower->finalize(*this));
     }
 
+    // The cooling buffer of the worker thread modifies the fan state of m_writer, wait for it.
+    m_post_process_queue->flush();
+    m_post_process_queue.reset();
+
     // Write end commands to file.
     _write(file, this->retract());
     _write(file, m_writer.set_fan(false));
@@ -954,6 +1080,7 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
     _write(file, m_writer.postamble());
 
     // calculates estimated printing time
+    m_output->flush();
     m_normal_time_estimator.calculate_time(false);
     if (m_silent_time_estimator_enabled)
         m_silent_time_estimator.calculate_time(false);
@@ -998,6 +1125,10 @@ void GCode::_do_export(Print &print, FILE *file, GCodePreviewData *preview_data)
             _write(file, full_config);
     }
 
+    // Wait for the output threads to process the rest of the G-code.
+    m_output->flush();
+    m_output.reset();
+
     // starts analizer calculations
     if (preview_data != nullptr)
         m_analyzer.calc_gcode_preview_data(*preview_data);
@@ -1236,10 +1367,10 @@ void GCode::process_layer(
                     break;
                 }
         }
-        m_spiral_vase->enable = enable;
+        m_spiral_vase_enabled = enable;
     }
     // If we're going to apply spiralvase to this layer, disable loop clipping
-    m_enable_loop_clipping = ! m_spiral_vase || ! m_spiral_vase->enable;
+    m_enable_loop_clipping = ! m_spiral_vase || ! m_spiral_vase_enabled;
     
     std::string gcode;
 
@@ -1531,8 +1662,13 @@ void GCode::process_layer(
 
                 m_config.apply(print_object->config, true);
                 m_layer = layers[layer_id].layer();
-                if (m_config.avoid_crossing_perimeters)
-                    m_avoid_crossing_perimeters.init_layer_mp(union_ex(m_layer->slices, true));
+                if (m_config.avoid_crossing_perimeters) {
+                    auto it_mp = m_layer_motion_planners.find(m_layer);
+                    if (it_mp == m_layer_motion_planners.end())
+                        m_avoid_crossing_perimeters.init_layer_mp(union_ex(m_layer->slices, true));
+                    else
+                        m_avoid_crossing_perimeters.init_layer_mp(it_mp->second);
+                }
                 Points copies;
                 if (single_object_idx == size_t(-1))
                     copies = print_object->_shifted_copies;
@@ -1572,25 +1708,59 @@ void GCode::process_layer(
         }
     }
 
-    // Apply spiral vase post-processing if this layer contains suitable geometry
-    // (we must feed all the G-code into the post-processor, including the first 
-    // bottom non-spiral layers otherwise it will mess with positions)
-    // we apply spiral vase at this stage because it requires a full layer.
-    // Just a reminder: A spiral vase mode is allowed for a single object per layer, single material print only.
-    if (m_spiral_vase)
-        gcode = m_spiral_vase->process_layer(gcode);
+    // The post-processing of the layer only depends on the state of the post-processors and on the G-code of the preceding layers,
+    // therefore it runs on the m_post_process_queue worker thread, if active, while the next layers are being generated.
+    bool   spiral_vase_enabled = m_spiral_vase_enabled;
+    size_t layer_id            = layer.id();
+    bool   collect_moves       = m_config.get_extrusion_axis() == "E" && ! m_pressure_equalizer;
+    auto   post_process        = [this, spiral_vase_enabled, layer_id, collect_moves](std::string &gcode) {
+        // Apply spiral vase post-processing if this layer contains suitable geometry
+        // (we must feed all the G-code into the post-processor, including the first 
+        // bottom non-spiral layers otherwise it will mess with positions)
+        // we apply spiral vase at this stage because it requires a full layer.
+        // Just a reminder: A spiral vase mode is allowed for a single object per layer, single material print only.
+        if (m_spiral_vase) {
+            m_spiral_vase->enable = spiral_vase_enabled;
+            gcode = m_spiral_vase->process_layer(gcode);
+        }
 
-    // Apply cooling logic; this may alter speeds.
-    if (m_cooling_buffer)
-        gcode = m_cooling_buffer->process_layer(gcode, layer.id());
+        // Apply cooling logic; this may alter speeds.
+        // The cooling buffer parses all the moves of the layer, pass them to the analyzer and the time estimators,
+        // if they parse the extrusion axis the same way, and if the G-code is not modified any further.
+        GCodeReader::ParsedMoves moves;
+        if (m_cooling_buffer)
+            gcode = m_cooling_buffer->process_layer(gcode, layer_id, collect_moves ? &moves : nullptr);
 
-    // Apply pressure equalization if enabled;
-    // printf("G-code before filter:\n%s\n", gcode.c_str());
-    if (m_pressure_equalizer)
-        gcode = m_pressure_equalizer->process(gcode.c_str(), false);
-    // printf("G-code after filter:\n%s\n", out.c_str());
-    
-    _write(file, gcode);
+        // Apply pressure equalization if enabled;
+        // printf("G-code before filter:\n%s\n", gcode.c_str());
+        if (m_pressure_equalizer)
+            gcode = m_pressure_equalizer->process(gcode.c_str(), false);
+        // printf("G-code after filter:\n%s\n", out.c_str());
+
+        this->_write_gcode(gcode, &moves);
+    };
+
+    if (m_post_process_queue) {
+        auto layer_gcode = std::make_shared<std::string>(std::move(gcode));
+        m_post_process_queue->push([post_process, layer_gcode]() { post_process(*layer_gcode); });
+    } else
+        post_process(gcode);
+}
+
+void GCode::flush_pressure_equalizer()
+{
+    if (! m_pressure_equalizer)
+        return;
+    auto flush = [this]() {
+        const char *gcode = m_pressure_equalizer->process("", true);
+        if (gcode != nullptr)
+            this->_write_gcode(gcode, nullptr);
+    };
+    // The pressure equalizer is owned by the thread post-processing the layers.
+    if (m_post_process_queue)
+        m_post_process_queue->push(flush);
+    else
+        flush();
 }
 
 void GCode::apply_print_config(const PrintConfig &print_config)
@@ -2250,18 +2420,39 @@ std::string GCode::extrude_support(const ExtrusionEntityCollection &support_fill
 void GCode::_write(FILE* file, const char *what)
 {
     if (what != nullptr) {
-        // apply analyzer, if enabled
-        const char* gcode = m_enable_analyzer ? m_analyzer.process_gcode(what).c_str() : what;
-
-        // writes string to file
-        fwrite(gcode, 1, ::strlen(gcode), file);
-        // updates time estimator and gcode lines vector
-        m_normal_time_estimator.add_gcode_block(gcode);
-        if (m_silent_time_estimator_enabled)
-            m_silent_time_estimator.add_gcode_block(gcode);
+        if (m_post_process_queue) {
+            // Keep the order with the layers being post-processed.
+            if (*what != 0) {
+                auto gcode = std::make_shared<std::string>(what);
+                m_post_process_queue->push([this, gcode]() { this->_write_gcode(*gcode, nullptr); });
+            }
+        } else
+            this->_write_gcode(what, nullptr);
     }
 }
 
+void GCode::_write(FILE* file, const std::string &what, const GCodeReader::ParsedMoves &moves)
+{
+    if (m_post_process_queue) {
+        auto gcode       = std::make_shared<std::string>(what);
+        auto gcode_moves = std::make_shared<GCodeReader::ParsedMoves>(moves);
+        m_post_process_queue->push([this, gcode, gcode_moves]() { this->_write_gcode(*gcode, gcode_moves.get()); });
+    } else
+        this->_write_gcode(what, &moves);
+}
+
+void GCode::_write_gcode(const std::string &what, const GCodeReader::ParsedMoves *moves)
+{
+    if (m_enable_analyzer) {
+        // apply analyzer, it removes its tags and it passes the moves it parsed to the time estimators,
+        // or it takes the moves already parsed
+        const std::string &gcode = (moves == nullptr) ? m_analyzer.process_gcode(what) : m_analyzer.process_gcode(what, *moves);
+        m_output->write(gcode.data(), gcode.size(), &m_analyzer.process_moves());
+    } else
+        // passes the string to the file writer and to the time estimators, see _do_export()
+        m_output->write(what.data(), what.size(), moves);
+}
+
 void GCode::_writeln(FILE* file, const std::string &what)
 {
     if (! what.empty())
@@ -11,14 +11,17 @@
 #include "Print.hpp"
 #include "PrintConfig.hpp"
 #include "GCode/CoolingBuffer.hpp"
+#include "GCode/OutputStream.hpp"
 #include "GCode/PressureEqualizer.hpp"
 #include "GCode/SpiralVase.hpp"
+#include "GCode/TaskQueue.hpp"
 #include "GCode/ToolOrdering.hpp"
 #include "GCode/WipeTower.hpp"
 #include "GCodeTimeEstimator.hpp"
 #include "EdgeGrid.hpp"
 #include "GCode/Analyzer.hpp"
 
+#include <map>
 #include <memory>
 #include <string>
 
@@ -43,13 +46,19 @@ public:
     ~AvoidCrossingPerimeters() {}
 
     void init_external_mp(const ExPolygons &islands) { m_external_mp = Slic3r::make_unique<MotionPlanner>(islands); }
-    void init_layer_mp(const ExPolygons &islands) { m_layer_mp = Slic3r::make_unique<MotionPlanner>(islands); }
+    void init_layer_mp(const ExPolygons &islands) { this->init_layer_mp(std::make_shared<MotionPlanner>(islands)); }
+    // Use a motion planner constructed in advance, see GCode::m_layer_motion_planners.
+    // The current planner is kept if it was constructed for the same islands, so that its graphs are reused.
+    void init_layer_mp(std::shared_ptr<MotionPlanner> layer_mp) {
+        if (m_layer_mp == nullptr || (m_layer_mp != layer_mp && ! m_layer_mp->same_islands(*layer_mp)))
+            m_layer_mp = std::move(layer_mp);
+    }
 
     Polyline travel_to(const GCode &gcodegen, const Point &point);
 
 private:
     std::unique_ptr<MotionPlanner> m_external_mp;
-    std::unique_ptr<MotionPlanner> m_layer_mp;
+    std::shared_ptr<MotionPlanner> m_layer_mp;
 };
 
 class OozePrevention {
@@ -139,6 +148,7 @@ public:
         m_last_mm3_per_mm(GCodeAnalyzer::Default_mm3_per_mm),
         m_last_width(GCodeAnalyzer::Default_Width),
         m_last_height(GCodeAnalyzer::Default_Height),
+        m_spiral_vase_enabled(false),
         m_brim_done(false),
         m_second_layer_things_done(false),
         m_normal_time_estimator(GCodeTimeEstimator::Normal),
@@ -200,6 +210,8 @@ protected:
         // If set to size_t(-1), then print all copies of all objects.
         // Otherwise print a single copy of a single object.
         const size_t                     single_object_idx = size_t(-1));
+    // Write the G-code held back by the pressure equalizer, after the last layer of an object or of the print.
+    void            flush_pressure_equalizer();
 
     void            set_last_pos(const Point &pos) { m_last_pos = pos; m_last_pos_defined = true; }
     bool            last_pos_defined() const { return m_last_pos_defined; }
@@ -302,6 +314,8 @@ protected:
 
     std::unique_ptr<CoolingBuffer>      m_cooling_buffer;
     std::unique_ptr<SpiralVase>         m_spiral_vase;
+    // Spiral vase is applied to the layer being extruded. SpiralVase::enable is set by the post-processing of the layer.
+    bool                                m_spiral_vase_enabled;
     std::unique_ptr<PressureEqualizer>  m_pressure_equalizer;
     std::unique_ptr<WipeTowerIntegration> m_wipe_tower;
 
@@ -322,9 +336,22 @@ protected:
     // Analyzer
     GCodeAnalyzer m_analyzer;
 
+    // Passes the G-code to the output file and to the time estimators, active during _do_export().
+    std::unique_ptr<GCodeOutputStream> m_output;
+    // Post-processes the G-code of the layers (spiral vase, cooling, pressure equalizer) and passes it to m_output
+    // on a worker thread, while the following layers are generated. Active while the layers are being extruded
+    // by _do_export(), then all the writes go through it to keep the order of the G-code.
+    std::unique_ptr<OrderedTaskQueue>  m_post_process_queue;
+    // Motion planners of the layers for avoid_crossing_perimeters, constructed in parallel ahead of process_layer().
+    std::map<const Layer*, std::shared_ptr<MotionPlanner>> m_layer_motion_planners;
+
     // Write a string into a file.
     void _write(FILE* file, const std::string& what) { this->_write(file, what.c_str()); }
     void _write(FILE* file, const char *what);
+    // Write a string, the G0 / G1 / G92 lines of which were already parsed into moves.
+    void _write(FILE* file, const std::string &what, const GCodeReader::ParsedMoves &moves);
+    // Pass a string to the analyzer and to m_output, called by _write() directly or from m_post_process_queue.
+    void _write_gcode(const std::string &what, const GCodeReader::ParsedMoves *moves);
 
     // Write a string into a file. 
     // Add a newline, if the string does not end with a newline already.
@@ -115,6 +115,7 @@ void GCodeAnalyzer::reset()
 const std::string& GCodeAnalyzer::process_gcode(const std::string& gcode)
 {
     m_process_output = "";
+    m_process_moves.clear();
 
     m_parser.parse_buffer(gcode,
         [this](GCodeReader& reader, const GCodeReader::GCodeLine& line)
@@ -123,6 +124,18 @@ const std::string& GCodeAnalyzer::process_gcode(const std::string& gcode)
     return m_process_output;
 }
 
+const std::string& GCodeAnalyzer::process_gcode(const std::string& gcode, const GCodeReader::ParsedMoves& moves)
+{
+    m_process_output = "";
+    m_process_moves.clear();
+
+    m_parser.parse_buffer(gcode, moves,
+        [this](GCodeReader& reader, const GCodeReader::GCodeLine& line)
+    { this->_process_gcode_line(reader, line); });
+
+    return m_process_output;
+}
+
 void GCodeAnalyzer::calc_gcode_preview_data(GCodePreviewData& preview_data)
 {
     // resets preview data
@@ -242,6 +255,13 @@ void GCodeAnalyzer::_process_gcode_line(GCodeReader&, const GCodeReader::GCodeLi
         }
     }
 
+    // passes the parsed move to the next consumer of the gcode
+    if ((cmd == "G0") || (cmd == "G1") || (cmd == "G92"))
+    {
+        m_process_moves.emplace_back();
+        line.export_move(m_process_output.size(), m_process_moves.back());
+    }
+
     // puts the line back into the gcode
     m_process_output += line.raw() + "\n";
 }
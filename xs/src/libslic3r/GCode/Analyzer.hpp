@@ -105,6 +105,8 @@ private:
 
     // The output of process_layer()
     std::string m_process_output;
+    // The moves of m_process_output
+    GCodeReader::ParsedMoves m_process_moves;
 
 public:
     GCodeAnalyzer();
@@ -114,6 +116,10 @@ public:
 
     // Adds the gcode contained in the given string to the analysis and returns it after removing the workcodes
     const std::string& process_gcode(const std::string& gcode);
+    // Same as above, taking the moves already parsed by the producer of the gcode from moves
+    const std::string& process_gcode(const std::string& gcode, const GCodeReader::ParsedMoves& moves);
+    // Returns the moves of the gcode returned by the last call to process_gcode(), to be passed to the next consumer of the gcode
+    const GCodeReader::ParsedMoves& process_moves() const { return m_process_moves; }
 
     // Calculates all data needed for gcode visualization
     void calc_gcode_preview_data(GCodePreviewData& preview_data);
@@ -21,9 +21,13 @@ CoolingBuffer::CoolingBuffer(GCode &gcodegen) : m_gcodegen(gcodegen), m_current_
 }
 
 void CoolingBuffer::reset()
+{
+    this->reset(m_gcodegen.writer().get_position());
+}
+
+void CoolingBuffer::reset(const Pointf3 &pos)
 {
     m_current_pos.assign(5, 0.f);
-    Pointf3 pos = m_gcodegen.writer().get_position();
     m_current_pos[0] = float(pos.x);
     m_current_pos[1] = float(pos.y);
     m_current_pos[2] = float(pos.z);
@@ -221,16 +225,17 @@ struct PerExtruderAdjustments
     size_t                      idx_line_end        = 0;
 };
 
-std::string CoolingBuffer::process_layer(const std::string &gcode, size_t layer_id)
+std::string CoolingBuffer::process_layer(const std::string &gcode, size_t layer_id, GCodeReader::ParsedMoves *moves)
 {
-    std::vector<PerExtruderAdjustments> per_extruder_adjustments = this->parse_layer_gcode(gcode, m_current_pos);
+    std::vector<PerExtruderAdjustments> per_extruder_adjustments = this->parse_layer_gcode(gcode, m_current_pos, moves);
     float layer_time_stretched = this->calculate_layer_slowdown(per_extruder_adjustments);
-    return this->apply_layer_cooldown(gcode, layer_id, layer_time_stretched, per_extruder_adjustments);
+    return this->apply_layer_cooldown(gcode, layer_id, layer_time_stretched, per_extruder_adjustments, moves);
 }
 
 // Parse the layer G-code for the moves, which could be adjusted.
 // Return the list of parsed lines, bucketed by an extruder.
-std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos) const
+// If moves is not null, all the G0 / G1 / G92 lines are stored there, as parsed by the GCodeReader.
+std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos, GCodeReader::ParsedMoves *moves) const
 {
     const FullPrintConfig       &config        = m_gcodegen.config();
     const std::vector<Extruder> &extruders     = m_gcodegen.writer().extruders();
@@ -259,6 +264,8 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
     // Index of an existing CoolingLine of the current adjustment, which holds the feedrate setting command
     // for a sequence of extrusion moves.
     size_t            active_speed_modifier = size_t(-1);
+    if (moves != nullptr)
+        moves->clear();
 
     for (; *line_start != 0; line_start = line_end) 
     {
@@ -280,6 +287,12 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
             // G0, G1 or G92
             // Parse the G-code line.
             std::vector<float> new_pos(current_pos);
+            GCodeReader::ParsedMove move;
+            move.offset = line.line_start;
+            move.mask   = 0;
+            memset(move.axis, 0, sizeof(move.axis));
+            // The GCodeReader stops at the first comment, even if it is glued to a word.
+            bool move_end = false;
             const char *c = sline.data() + 3;
             for (;;) {
                 // Skip whitespaces.
@@ -290,7 +303,13 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
                 size_t axis = (*c >= 'X' && *c <= 'Z') ? (*c - 'X') :
                               (*c == extrusion_axis) ? 3 : (*c == 'F') ? 4 : size_t(-1);
                 if (axis != size_t(-1)) {
-                    new_pos[axis] = float(atof(++c));
+                    char *pend = nullptr;
+                    new_pos[axis] = float(strtod(++c, &pend));
+                    if (! move_end && (*pend == ' ' || *pend == '\t' || *pend == ';' || *pend == '\r' || *pend == 0)) {
+                        // The same value, as parsed by the GCodeReader. The axis indices match Slic3r::Axis.
+                        move.axis[axis] = new_pos[axis];
+                        move.mask |= 1 << int(axis);
+                    }
                     if (axis == 4) {
                         // Convert mm/min to mm/sec.
                         new_pos[4] /= 60.f;
@@ -300,8 +319,12 @@ std::vector<PerExtruderAdjustments> CoolingBuffer::parse_layer_gcode(const std::
                     }
                 }
                 // Skip this word.
-                for (; *c != ' ' && *c != '\t' && *c != 0; ++ c);
+                for (; *c != ' ' && *c != '\t' && *c != 0; ++ c)
+                    if (*c == ';' || *c == '\r')
+                        move_end = true;
             }
+            if (moves != nullptr)
+                moves->emplace_back(move);
             bool external_perimeter = boost::contains(sline, ";_EXTERNAL_PERIMETER");
             bool wipe               = boost::contains(sline, ";_WIPE");
             if (external_perimeter)
@@ -590,7 +613,9 @@ std::string CoolingBuffer::apply_layer_cooldown(
     // Total time of this layer after slow down, used to control the fan.
     float                                   layer_time,
     // Per extruder list of G-code lines and their cool down attributes.
-    std::vector<PerExtruderAdjustments>    &per_extruder_adjustments)
+    std::vector<PerExtruderAdjustments>    &per_extruder_adjustments,
+    // Parsed G0 / G1 / G92 lines of the source G-code, to be updated to match the adjusted G-code. May be null.
+    GCodeReader::ParsedMoves               *moves)
 {
     // First sort the adjustment lines by of multiple extruders by their position in the source G-code.
     std::vector<const CoolingLine*> lines;
@@ -644,6 +669,23 @@ std::string CoolingBuffer::apply_layer_cooldown(
         }
     };
 
+    // The moves are filtered in place, the moves of the dropped lines are removed, the offsets are updated.
+    GCodeReader::ParsedMove *move_in  = (moves == nullptr) ? nullptr : moves->data();
+    GCodeReader::ParsedMove *move_out = move_in;
+    GCodeReader::ParsedMove *move_end = (moves == nullptr) ? nullptr : moves->data() + moves->size();
+    // Append a part of the source G-code unmodified, together with its moves.
+    auto append_source = [&gcode, &new_gcode, &move_in, &move_out, move_end](const char *begin, const char *end) {
+        size_t offset     = begin - gcode.c_str();
+        size_t offset_end = end   - gcode.c_str();
+        for (; move_in != move_end && move_in->offset < offset_end; ++ move_in)
+            if (move_in->offset >= offset) {
+                *move_out = *move_in;
+                move_out->offset = move_in->offset - offset + new_gcode.size();
+                ++ move_out;
+            }
+        new_gcode.append(begin, end - begin);
+    };
+
     const char         *pos               = gcode.c_str();
     int                 current_feedrate  = 0;
     const std::string   toolchange_prefix = m_gcodegen.writer().toolchange_prefix();
@@ -652,14 +694,14 @@ std::string CoolingBuffer::apply_layer_cooldown(
         const char *line_start  = gcode.c_str() + line->line_start;
         const char *line_end    = gcode.c_str() + line->line_end;
         if (line_start > pos)
-            new_gcode.append(pos, line_start - pos);
+            append_source(pos, line_start);
         if (line->type & CoolingLine::TYPE_SET_TOOL) {
             unsigned int new_extruder = (unsigned int)atoi(line_start + toolchange_prefix.size());
             if (new_extruder != m_current_extruder) {
                 m_current_extruder = new_extruder;
                 change_extruder_set_fan();
             }
-            new_gcode.append(line_start, line_end - line_start);
+            append_source(line_start, line_end);
         } else if (line->type & CoolingLine::TYPE_BRIDGE_FAN_START) {
             if (bridge_fan_control)
                 new_gcode += m_gcodegen.writer().set_fan(bridge_fan_speed, true);
@@ -669,6 +711,10 @@ std::string CoolingBuffer::apply_layer_cooldown(
         } else if (line->type & CoolingLine::TYPE_EXTRUDE_END) {
             // Just remove this comment.
         } else if (line->type & (CoolingLine::TYPE_ADJUSTABLE | CoolingLine::TYPE_EXTERNAL_PERIMETER | CoolingLine::TYPE_WIPE | CoolingLine::TYPE_HAS_F)) {
+            // Move parsed from this line, if any. Its feedrate is updated below.
+            for (; move_in != move_end && move_in->offset < line->line_start; ++ move_in) ;
+            GCodeReader::ParsedMove *move = (move_in != move_end && move_in->offset == line->line_start) ? move_in ++ : nullptr;
+            size_t      line_start_new = new_gcode.size();
             // Find the start of a comment, or roll to the end of line.
             const char *end = line_start;
             for (; end < line_end && *end != ';'; ++ end);
@@ -702,6 +748,8 @@ std::string CoolingBuffer::apply_layer_cooldown(
                     char buf[64];
                     sprintf(buf, "%d", int(current_feedrate));
                     new_gcode += buf;
+                    if (move != nullptr)
+                        move->axis[F] = float(current_feedrate);
                 } else {
                     // Remove the feedrate word.
                     const char *f = fpos;
@@ -709,6 +757,8 @@ std::string CoolingBuffer::apply_layer_cooldown(
                     for (f -= 2; f > line_start && (*f == ' ' || *f == '\t'); -- f);
                     // Append up to the F word, without the trailing whitespace.
                     new_gcode.append(line_start, f - line_start + 1);
+                    if (move != nullptr)
+                        move->mask &= ~(1 << F);
                 }
                 // Skip the non-whitespaces of the F parameter up the comment or end of line.
                 for (; fpos != end && *fpos != ' ' && *fpos != ';' && *fpos != '\n'; ++fpos);
@@ -734,14 +784,22 @@ std::string CoolingBuffer::apply_layer_cooldown(
                     new_gcode.append(end, line_end - end);
                 }
             }
+            if (move != nullptr && new_gcode.size() > line_start_new) {
+                // The line was not removed, pass its move.
+                *move_out = *move;
+                move_out->offset = line_start_new;
+                ++ move_out;
+            }
         } else {
-            new_gcode.append(line_start, line_end - line_start);
+            append_source(line_start, line_end);
         }
         pos = line_end;
     }
     const char *gcode_end = gcode.c_str() + gcode.size();
     if (pos < gcode_end)
-        new_gcode.append(pos, gcode_end - pos);
+        append_source(pos, gcode_end);
+    if (moves != nullptr)
+        moves->erase(moves->begin() + (move_out - moves->data()), moves->end());
 
     return new_gcode;
 }
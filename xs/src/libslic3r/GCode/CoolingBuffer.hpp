@@ -2,6 +2,8 @@
 #define slic3r_CoolingBuffer_hpp_
 
 #include "libslic3r.h"
+#include "GCodeReader.hpp"
+#include "Point.hpp"
 #include <map>
 #include <string>
 
@@ -24,17 +26,21 @@ class CoolingBuffer {
 public:
     CoolingBuffer(GCode &gcodegen);
     void        reset();
+    // Reset to the given position, if the position of the G-code writer is already ahead of the G-code being processed.
+    void        reset(const Pointf3 &position);
     void        set_current_extruder(unsigned int extruder_id) { m_current_extruder = extruder_id; }
-    std::string process_layer(const std::string &gcode, size_t layer_id);
+    // If moves is not null, the G0 / G1 / G92 lines of the returned G-code are stored into moves,
+    // so that the consumers of the G-code do not need to parse them again.
+    std::string process_layer(const std::string &gcode, size_t layer_id, GCodeReader::ParsedMoves *moves = nullptr);
     GCode* 	    gcodegen() { return &m_gcodegen; }
 
 private:
 	CoolingBuffer& operator=(const CoolingBuffer&) = delete;
-    std::vector<PerExtruderAdjustments> parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos) const;
+    std::vector<PerExtruderAdjustments> parse_layer_gcode(const std::string &gcode, std::vector<float> &current_pos, GCodeReader::ParsedMoves *moves) const;
     float       calculate_layer_slowdown(std::vector<PerExtruderAdjustments> &per_extruder_adjustments);
     // Apply slow down over G-code lines stored in per_extruder_adjustments, enable fan if needed.
-    // Returns the adjusted G-code.
-    std::string apply_layer_cooldown(const std::string &gcode, size_t layer_id, float layer_time, std::vector<PerExtruderAdjustments> &per_extruder_adjustments);
+    // Returns the adjusted G-code, moves are updated in place to match the adjusted G-code.
+    std::string apply_layer_cooldown(const std::string &gcode, size_t layer_id, float layer_time, std::vector<PerExtruderAdjustments> &per_extruder_adjustments, GCodeReader::ParsedMoves *moves);
 
     GCode&              m_gcodegen;
     std::string         m_gcode;
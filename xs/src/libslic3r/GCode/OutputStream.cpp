@@ -0,0 +1,141 @@
+#include "OutputStream.hpp"
+
+#include <algorithm>
+#include <assert.h>
+
+namespace Slic3r {
+
+GCodeOutputStream::GCodeOutputStream(size_t block_size, size_t num_blocks) :
+    m_block_size(block_size),
+    m_blocks(std::max<size_t>(2, num_blocks)),
+    m_submitted(0),
+    m_stop(false)
+{
+}
+
+void GCodeOutputStream::add_consumer(Consumer consumer)
+{
+    assert(m_threads.empty() && m_submitted == 0);
+    m_consumers.emplace_back(std::move(consumer));
+}
+
+void GCodeOutputStream::write(const char *data, size_t len, const GCodeReader::ParsedMoves *moves)
+{
+    Block       &block = m_blocks[m_submitted % m_blocks.size()];
+    std::string &text  = block.text;
+    if (text.capacity() < m_block_size)
+        text.reserve(m_block_size + 64 * 1024);
+    if (moves != nullptr)
+        for (const GCodeReader::ParsedMove &move : *moves) {
+            block.moves.emplace_back(move);
+            block.moves.back().offset += text.size();
+        }
+    text.append(data, len);
+    if (text.size() >= m_block_size)
+        this->submit(false);
+}
+
+void GCodeOutputStream::flush()
+{
+    this->submit(true);
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() {
+        for (size_t consumed : m_consumed)
+            if (consumed < m_submitted)
+                return false;
+        return true;
+    });
+    if (m_exception) {
+        std::exception_ptr exception = m_exception;
+        m_exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void GCodeOutputStream::start()
+{
+    m_consumed.assign(m_consumers.size(), 0);
+    for (size_t i = 0; i < m_consumers.size(); ++ i)
+        m_threads.emplace_back([this, i]() { this->run_consumer(i); });
+}
+
+void GCodeOutputStream::stop()
+{
+    if (m_threads.empty())
+        return;
+    this->submit(true);
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (boost::thread &thread : m_threads)
+        thread.join();
+    m_threads.clear();
+}
+
+void GCodeOutputStream::submit(bool partial_line)
+{
+    Block &block = m_blocks[m_submitted % m_blocks.size()];
+    if (block.text.empty())
+        return;
+    if (m_threads.empty() && ! m_consumers.empty())
+        this->start();
+    // Split the block after the last full line.
+    size_t end = block.text.size();
+    if (! partial_line) {
+        size_t pos = block.text.rfind('\n');
+        if (pos != std::string::npos)
+            end = pos + 1;
+    }
+    // Wait for all the consumers to release the block to be filled next.
+    Block &next = m_blocks[(m_submitted + 1) % m_blocks.size()];
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+        m_condition.wait(lock, [&next]() { return next.pending == 0; });
+    }
+    next.text.clear();
+    next.text.append(block.text, end, std::string::npos);
+    block.text.erase(end);
+    next.moves.clear();
+    auto it_move = std::lower_bound(block.moves.begin(), block.moves.end(), end,
+        [](const GCodeReader::ParsedMove &move, size_t offset) { return move.offset < offset; });
+    for (auto it = it_move; it != block.moves.end(); ++ it) {
+        next.moves.emplace_back(*it);
+        next.moves.back().offset -= end;
+    }
+    block.moves.erase(it_move, block.moves.end());
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        block.pending = m_consumers.size();
+        ++ m_submitted;
+    }
+    m_condition.notify_all();
+}
+
+void GCodeOutputStream::run_consumer(size_t idx)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    for (;;) {
+        m_condition.wait(lock, [this, idx]() { return m_consumed[idx] < m_submitted || m_stop; });
+        if (m_consumed[idx] == m_submitted)
+            // Stopped and all the blocks were processed.
+            break;
+        Block &block = m_blocks[m_consumed[idx] % m_blocks.size()];
+        lock.unlock();
+        std::exception_ptr exception;
+        try {
+            m_consumers[idx](block.text, block.moves);
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        lock.lock();
+        if (exception && ! m_exception)
+            m_exception = exception;
+        ++ m_consumed[idx];
+        -- block.pending;
+        m_condition.notify_all();
+    }
+}
+
+} // namespace Slic3r
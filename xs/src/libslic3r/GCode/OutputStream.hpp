@@ -0,0 +1,76 @@
+#ifndef slic3r_GCode_OutputStream_hpp_
+#define slic3r_GCode_OutputStream_hpp_
+
+#include "../libslic3r.h"
+#include "../GCodeReader.hpp"
+
+#include <exception>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+// Output stage of the G-code export.
+// The G-code text is collected into large blocks ending with a full line. Each block is handed over
+// to all the consumers (the file writer, the time estimators), each consumer running on its own thread
+// and receiving the blocks in the order they were written. The blocks are recycled through a fixed ring,
+// therefore the G-code generator waits if the slowest consumer lags behind by the whole ring.
+// The moves already parsed by the G-code generator travel with the text, so that the consumers do not parse them again.
+class GCodeOutputStream
+{
+public:
+    typedef std::function<void(const std::string &block, const GCodeReader::ParsedMoves &moves)> Consumer;
+
+    GCodeOutputStream(size_t block_size = 4 * 1024 * 1024, size_t num_blocks = 4);
+    // Processes the pending G-code and stops the consumer threads.
+    ~GCodeOutputStream() { this->stop(); }
+
+    // Register a consumer, before the first write().
+    void add_consumer(Consumer consumer);
+
+    // The offsets of the moves are relative to data.
+    void write(const char *data, size_t len, const GCodeReader::ParsedMoves *moves = nullptr);
+    void write(const std::string &data) { this->write(data.data(), data.size()); }
+
+    // Pass the pending G-code to the consumers and wait until all of them processed it.
+    // Rethrows the first exception thrown by a consumer.
+    void flush();
+
+private:
+    GCodeOutputStream(const GCodeOutputStream&) = delete;
+    GCodeOutputStream& operator=(const GCodeOutputStream&) = delete;
+
+    struct Block {
+        Block() : pending(0) {}
+        std::string                 text;
+        GCodeReader::ParsedMoves    moves;
+        // Number of consumers, which did not process this block yet.
+        size_t                      pending;
+    };
+
+    void start();
+    void stop();
+    // Hand over the current block up to its last full line, carry the rest over to the next block.
+    void submit(bool partial_line);
+    void run_consumer(size_t idx);
+
+    size_t                      m_block_size;
+    std::vector<Block>          m_blocks;
+    std::vector<Consumer>       m_consumers;
+    std::vector<boost::thread>  m_threads;
+    // Number of blocks handed over to the consumers. The block being filled is m_blocks[m_submitted % m_blocks.size()].
+    size_t                      m_submitted;
+    // Number of blocks processed by each consumer.
+    std::vector<size_t>         m_consumed;
+    bool                        m_stop;
+    std::exception_ptr          m_exception;
+    boost::mutex                m_mutex;
+    boost::condition_variable   m_condition;
+};
+
+} // namespace Slic3r
+
+#endif /* slic3r_GCode_OutputStream_hpp_ */
@@ -0,0 +1,82 @@
+#include "TaskQueue.hpp"
+
+#include <algorithm>
+
+namespace Slic3r {
+
+OrderedTaskQueue::OrderedTaskQueue(size_t max_pending) :
+    m_max_pending(std::max<size_t>(1, max_pending)),
+    m_busy(false),
+    m_stop(false)
+{
+    m_thread = boost::thread([this]() { this->run(); });
+}
+
+OrderedTaskQueue::~OrderedTaskQueue()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+        m_tasks.clear();
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    m_thread.join();
+}
+
+void OrderedTaskQueue::push(Task task)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return m_tasks.size() < m_max_pending || m_exception; });
+    this->rethrow();
+    m_tasks.emplace_back(std::move(task));
+    lock.unlock();
+    m_condition.notify_all();
+}
+
+void OrderedTaskQueue::flush()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    m_condition.wait(lock, [this]() { return (m_tasks.empty() && ! m_busy) || m_exception; });
+    this->rethrow();
+}
+
+void OrderedTaskQueue::rethrow()
+{
+    if (m_exception) {
+        std::exception_ptr exception = m_exception;
+        m_exception = nullptr;
+        std::rethrow_exception(exception);
+    }
+}
+
+void OrderedTaskQueue::run()
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+    for (;;) {
+        m_condition.wait(lock, [this]() { return ! m_tasks.empty() || m_stop; });
+        if (m_tasks.empty())
+            // Stopped and all the tasks were processed.
+            break;
+        Task task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        m_busy = true;
+        lock.unlock();
+        std::exception_ptr exception;
+        try {
+            task();
+        } catch (...) {
+            exception = std::current_exception();
+        }
+        lock.lock();
+        m_busy = false;
+        if (exception) {
+            // Drop the tasks depending on the failed one.
+            m_tasks.clear();
+            if (! m_exception)
+                m_exception = exception;
+        }
+        m_condition.notify_all();
+    }
+}
+
+} // namespace Slic3r
@@ -0,0 +1,54 @@
+#ifndef slic3r_GCode_TaskQueue_hpp_
+#define slic3r_GCode_TaskQueue_hpp_
+
+#include "../libslic3r.h"
+
+#include <deque>
+#include <exception>
+#include <functional>
+
+#include <boost/thread.hpp>
+
+namespace Slic3r {
+
+// Runs the tasks on a single worker thread, one by one, in the order they were pushed.
+// The G-code export pushes the post-processing of the layers (spiral vase, cooling, pressure equalization)
+// and all the writes to the output, so that the post-processing of a layer runs concurrently
+// with the generation of the following layers, while the output keeps its order.
+// If a task throws, the tasks pushed after it are dropped and the exception is rethrown by the next push() or flush().
+class OrderedTaskQueue
+{
+public:
+    typedef std::function<void()> Task;
+
+    // push() waits while max_pending tasks are queued, to bound the memory held by the pending tasks.
+    OrderedTaskQueue(size_t max_pending = 16);
+    // Drops the tasks not started yet and stops the worker thread. Call flush() first to finish all the tasks.
+    ~OrderedTaskQueue();
+
+    void push(Task task);
+    // Wait until all the tasks pushed are finished. Rethrows the first exception thrown by a task.
+    void flush();
+
+private:
+    OrderedTaskQueue(const OrderedTaskQueue&) = delete;
+    OrderedTaskQueue& operator=(const OrderedTaskQueue&) = delete;
+
+    void run();
+    // Called with m_mutex locked.
+    void rethrow();
+
+    size_t                      m_max_pending;
+    std::deque<Task>            m_tasks;
+    // A task is being executed by the worker thread.
+    bool                        m_busy;
+    bool                        m_stop;
+    std::exception_ptr          m_exception;
+    boost::mutex                m_mutex;
+    boost::condition_variable   m_condition;
+    boost::thread               m_thread;
+};
+
+} // namespace Slic3r
+
+#endif /* slic3r_GCode_TaskQueue_hpp_ */
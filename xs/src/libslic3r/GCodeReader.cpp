@@ -71,6 +71,26 @@ const char* GCodeReader::parse_line_internal(const char *ptr, GCodeLine &gline,
     if (gline.has(E) && m_config.use_relative_e_distances)
         m_position[E] = 0;
 
+    return this->finish_line(ptr, c, gline);
+}
+
+const char* GCodeReader::parse_line_internal(const char *ptr, const ParsedMove &move, GCodeLine &gline, std::pair<const char*, const char*> &command)
+{
+    PROFILE_FUNC();
+
+    command.first  = skip_whitespaces(ptr);
+    command.second = skip_word(command.first);
+    gline.m_mask   = move.mask;
+    memcpy(gline.m_axis, move.axis, sizeof(gline.m_axis));
+
+    if (gline.has(E) && m_config.use_relative_e_distances)
+        m_position[E] = 0;
+
+    return this->finish_line(ptr, command.second, gline);
+}
+
+const char* GCodeReader::finish_line(const char *ptr, const char *c, GCodeLine &gline)
+{
     // Skip the rest of the line.
     for (; ! is_end_of_line(*c); ++ c);
 
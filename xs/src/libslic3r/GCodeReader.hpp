@@ -12,6 +12,16 @@ namespace Slic3r {
 
 class GCodeReader {
 public:
+    // A G0 / G1 / G92 line, which has already been parsed by the producer of the G-code (see CoolingBuffer).
+    // The consumers of the G-code take the axis values from here instead of parsing the numbers again.
+    struct ParsedMove {
+        // Offset of the start of the line in the G-code block.
+        size_t   offset;
+        uint32_t mask;
+        float    axis[NUM_AXES];
+    };
+    typedef std::vector<ParsedMove> ParsedMoves;
+
     class GCodeLine {
     public:
         GCodeLine() { reset(); }
@@ -62,6 +72,10 @@ public:
         float e() const { return m_axis[E]; }
         float f() const { return m_axis[F]; }
 
+        // Export the parsed axis values of this line, to be passed to the next consumer of the G-code.
+        void  export_move(size_t offset, ParsedMove &move) const 
+            { move.offset = offset; move.mask = m_mask; memcpy(move.axis, m_axis, sizeof(m_axis)); }
+
     private:
         std::string      m_raw;
         float            m_axis[NUM_AXES];
@@ -89,6 +103,25 @@ public:
     void parse_buffer(const std::string &buffer)
         { this->parse_buffer(buffer, [](GCodeReader&, const GCodeReader::GCodeLine&){}); }
 
+    // Parse the buffer, taking the axis values of the lines starting at ParsedMove::offset from moves.
+    // The moves are expected to be sorted by their offsets.
+    template<typename Callback>
+    void parse_buffer(const std::string &buffer, const ParsedMoves &moves, Callback callback)
+    {
+        const char *ptr     = buffer.c_str();
+        auto        it_move = moves.begin();
+        GCodeLine   gline;
+        while (*ptr != 0) {
+            gline.reset();
+            size_t offset = ptr - buffer.c_str();
+            for (; it_move != moves.end() && it_move->offset < offset; ++ it_move) ;
+            if (it_move != moves.end() && it_move->offset == offset)
+                ptr = this->parse_line(ptr, *it_move ++, gline, callback);
+            else
+                ptr = this->parse_line(ptr, gline, callback);
+        }
+    }
+
     template<typename Callback>
     const char* parse_line(const char *ptr, GCodeLine &gline, Callback &callback)
     {
@@ -99,6 +132,17 @@ public:
         return end;
     }
 
+    // Fill in gline from an already parsed move, see ParsedMove.
+    template<typename Callback>
+    const char* parse_line(const char *ptr, const ParsedMove &move, GCodeLine &gline, Callback &callback)
+    {
+        std::pair<const char*, const char*> cmd;
+        const char *end = parse_line_internal(ptr, move, gline, cmd);
+        callback(*this, gline);
+        update_coordinates(gline, cmd);
+        return end;
+    }
+
     template<typename Callback>
     void parse_line(const std::string &line, Callback callback)
         { GCodeLine gline; this->parse_line(line.c_str(), gline, callback); }
@@ -120,6 +164,9 @@ public:
 
 private:
     const char* parse_line_internal(const char *ptr, GCodeLine &gline, std::pair<const char*, const char*> &command);
+    const char* parse_line_internal(const char *ptr, const ParsedMove &move, GCodeLine &gline, std::pair<const char*, const char*> &command);
+    // Copy the raw line into gline, skip the trailing newlines.
+    const char* finish_line(const char *ptr, const char *c, GCodeLine &gline);
     void        update_coordinates(GCodeLine &gline, std::pair<const char*, const char*> &command);
 
     static bool         is_whitespace(char c)           { return c == ' ' || c == '\t'; }
@@ -1,10 +1,12 @@
 #include "GCodeTimeEstimator.hpp"
 #include <boost/bind.hpp>
+#include <tbb/parallel_for.h>
+#include <algorithm>
 #include <cmath>
+#include <iterator>
 
 #include <Shiny/Shiny.h>
 
-#include <boost/nowide/fstream.hpp>
 #include <boost/nowide/cstdio.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -24,6 +26,9 @@ static const float DEFAULT_EXTRUDE_FACTOR_OVERRIDE_PERCENTAGE = 1.0f; // 100 per
 
 static const float PREVIOUS_FEEDRATE_THRESHOLD = 0.0001f;
 
+// Minimum number of blocks to be planned by a single thread.
+static const size_t PLANNER_RANGE_MIN_BLOCKS = 4096;
+
 #if ENABLE_MOVE_STATS
 static const std::string MOVE_TYPE_STR[Slic3r::GCodeTimeEstimator::Block::Num_Types] =
 {
@@ -170,6 +175,7 @@ namespace Slic3r {
 
     GCodeTimeEstimator::GCodeTimeEstimator(EMode mode)
         : _mode(mode)
+        , _parallel_planner(true)
     {
         reset();
         set_default();
@@ -195,6 +201,14 @@ namespace Slic3r {
         }
     }
 
+    void GCodeTimeEstimator::add_gcode_block(const std::string &str, const GCodeReader::ParsedMoves &moves)
+    {
+        PROFILE_FUNC();
+        _parser.parse_buffer(str, moves,
+            [this](GCodeReader &reader, const GCodeReader::GCodeLine &line)
+        { this->_process_gcode_line(reader, line); });
+    }
+
     void GCodeTimeEstimator::calculate_time(bool start_from_beginning)
     {
         PROFILE_FUNC();
@@ -252,109 +266,129 @@ namespace Slic3r {
 #endif // ENABLE_MOVE_STATS
     }
 
-    bool GCodeTimeEstimator::post_process_remaining_times(const std::string& filename, float interval)
+    bool GCodeTimeEstimator::post_process_remaining_times(const std::string& filename, float interval, const std::vector<const GCodeTimeEstimator*>& estimators)
     {
-        boost::nowide::ifstream in(filename);
-        if (!in.good())
+        typedef std::pair<unsigned int, std::string> TimeLine;
+
+        // collects the lines to be placed, sorted by the g1 line id, keeping the order of the estimators for the same g1 line
+        std::vector<TimeLine> time_lines;
+        for (const GCodeTimeEstimator* estimator : estimators)
+        {
+            std::vector<TimeLine> estimator_lines = estimator->_get_remaining_times_lines(interval);
+            std::vector<TimeLine> merged;
+            merged.reserve(time_lines.size() + estimator_lines.size());
+            std::merge(std::make_move_iterator(time_lines.begin()), std::make_move_iterator(time_lines.end()),
+                std::make_move_iterator(estimator_lines.begin()), std::make_move_iterator(estimator_lines.end()),
+                std::back_inserter(merged), [](const TimeLine& l1, const TimeLine& l2) { return l1.first < l2.first; });
+            time_lines = std::move(merged);
+        }
+
+        if (time_lines.empty())
+            return true;
+
+        FILE* in = boost::nowide::fopen(filename.c_str(), "rb");
+        if (in == nullptr)
             throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for reading.\n"));
 
         std::string path_tmp = filename + ".times";
 
         FILE* out = boost::nowide::fopen(path_tmp.c_str(), "wb");
         if (out == nullptr)
-            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for writing.\n"));
-
-        std::string time_mask;
-        switch (_mode)
-        {
-        default:
-        case Normal:
         {
-            time_mask = "M73 P%s R%s\n";
-            break;
+            fclose(in);
+            throw std::runtime_error(std::string("Remaining times export failed.\nCannot open file for writing.\n"));
         }
-        case Silent:
+
+        auto close_and_throw = [in, out, &path_tmp](const char* message)
         {
-            time_mask = "M73 Q%s S%s\n";
-            break;
-        }
-        }
+            fclose(in);
+            fclose(out);
+            boost::nowide::remove(path_tmp.c_str());
+            throw std::runtime_error(std::string("Remaining times export failed.\n") + message);
+        };
 
         unsigned int g1_lines_count = 0;
-        float last_recorded_time = 0.0f;
-        std::string gcode_line;
-        // buffer line to export only when greater than 64K to reduce writing calls
-        std::string export_line;
-        char time_line[64];
-        while (std::getline(in, gcode_line))
+        std::vector<TimeLine>::const_iterator it_time_line = time_lines.begin();
+        // buffer lines to export only when greater than 64K to reduce writing calls
+        std::string export_lines;
+        export_lines.reserve(65536 + 4096);
+        auto process_line = [&g1_lines_count, &it_time_line, &time_lines, &export_lines](const char* begin, const char* end)
         {
-            if (!in.good())
+            export_lines.append(begin, end);
+
+            // only the G1 lines are counted, as done by the GCodeReader when calculating the time estimate
+            const char* c = begin;
+            for (; (c != end) && ((*c == ' ') || (*c == '\t')); ++c);
+            if ((end - c < 2) || (c[0] != 'G') || (c[1] != '1') ||
+                ((c + 2 != end) && (c[2] != ' ') && (c[2] != '\t') && (c[2] != ';') && (c[2] != '\r') && (c[2] != '\n')))
+                return;
+
+            ++g1_lines_count;
+            for (; (it_time_line != time_lines.end()) && (it_time_line->first < g1_lines_count); ++it_time_line);
+            if ((it_time_line != time_lines.end()) && (it_time_line->first == g1_lines_count))
             {
-                fclose(out);
-                throw std::runtime_error(std::string("Remaining times export failed.\nError while reading from file.\n"));
+                // add remaining time lines after this line
+                if (end[-1] != '\n')
+                    export_lines += "\n";
+                for (; (it_time_line != time_lines.end()) && (it_time_line->first == g1_lines_count); ++it_time_line)
+                {
+                    export_lines += it_time_line->second;
+                }
             }
+        };
 
-            gcode_line += "\n";
-
-            // add remaining time lines where needed
-            _parser.parse_line(gcode_line,
-                [this, &g1_lines_count, &last_recorded_time, &time_line, &gcode_line, time_mask, interval](GCodeReader& reader, const GCodeReader::GCodeLine& line)
+        // reads the file in large chunks, the incomplete last line of a chunk is moved to the start of the buffer
+        std::vector<char> buffer(1024 * 1024);
+        size_t buffer_len = 0;
+        for (;;)
+        {
+            if (buffer_len == buffer.size())
+                // a line longer than the buffer
+                buffer.resize(buffer.size() * 2);
+
+            size_t read_len = ::fread(buffer.data() + buffer_len, 1, buffer.size() - buffer_len, in);
+            if (::ferror(in))
+                close_and_throw("Error while reading from file.\n");
+            buffer_len += read_len;
+
+            const char* line_begin = buffer.data();
+            const char* buffer_end = buffer.data() + buffer_len;
+            for (;;)
             {
-                if (line.cmd_is("G1"))
-                {
-                    ++g1_lines_count;
-
-                    if (!line.has_e())
-                        return;
-
-                    G1LineIdToBlockIdMap::const_iterator it = _g1_line_ids.find(g1_lines_count);
-                    if ((it != _g1_line_ids.end()) && (it->second < (unsigned int)_blocks.size()))
-                    {
-                        const Block& block = _blocks[it->second];
-                        if (block.elapsed_time != -1.0f)
-                        {
-                            float block_remaining_time = _time - block.elapsed_time;
-                            if (std::abs(last_recorded_time - block_remaining_time) > interval)
-                            {
-                                sprintf(time_line, time_mask.c_str(), std::to_string((int)(100.0f * block.elapsed_time / _time)).c_str(), _get_time_minutes(block_remaining_time).c_str());
-                                gcode_line += time_line;
-
-                                last_recorded_time = block_remaining_time;
-                            }
-                        }
-                    }
-                }
-            });
+                const char* line_end = (const char*)::memchr(line_begin, '\n', buffer_end - line_begin);
+                if (line_end == nullptr)
+                    break;
+                process_line(line_begin, ++line_end);
+                line_begin = line_end;
+            }
 
-            export_line += gcode_line;
-            if (export_line.length() > 65535)
+            if (read_len == 0)
             {
-                fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
-                if (ferror(out))
-                {
-                    in.close();
-                    fclose(out);
-                    boost::nowide::remove(path_tmp.c_str());
-                    throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
-                }
-                export_line.clear();
+                // end of file, processes the last line not terminated by a newline
+                if (line_begin != buffer_end)
+                    process_line(line_begin, buffer_end);
+                buffer_len = 0;
+            }
+            else
+            {
+                buffer_len = buffer_end - line_begin;
+                ::memmove(buffer.data(), line_begin, buffer_len);
             }
-        }
 
-        if (export_line.length() > 0)
-        {
-            fwrite((const void*)export_line.c_str(), 1, export_line.length(), out);
-            if (ferror(out))
+            if ((export_lines.length() > 65535) || ((read_len == 0) && !export_lines.empty()))
             {
-                in.close();
-                fclose(out);
-                boost::nowide::remove(path_tmp.c_str());
-                throw std::runtime_error(std::string("Remaining times export failed.\nIs the disk full?\n"));
+                fwrite((const void*)export_lines.c_str(), 1, export_lines.length(), out);
+                if (ferror(out))
+                    close_and_throw("Is the disk full?\n");
+                export_lines.clear();
             }
+
+            if (read_len == 0)
+                break;
         }
 
         fclose(out);
-        in.close();
+        fclose(in);
 
         boost::nowide::remove(filename.c_str());
         if (boost::nowide::rename(path_tmp.c_str(), filename.c_str()) != 0)
@@ -364,6 +398,25 @@ namespace Slic3r {
         return true;
     }
 
+    float GCodeTimeEstimator::get_elapsed_time(unsigned int g1_line_id) const
+    {
+        G1LineIdToBlockIdMap::const_iterator it = _g1_line_ids.find(g1_line_id);
+        if ((it == _g1_line_ids.end()) || (it->second >= (unsigned int)_blocks.size()))
+            return -1.0f;
+
+        return _blocks[it->second].elapsed_time;
+    }
+
+    void GCodeTimeEstimator::set_parallel_planner(bool parallel)
+    {
+        _parallel_planner = parallel;
+    }
+
+    bool GCodeTimeEstimator::get_parallel_planner() const
+    {
+        return _parallel_planner;
+    }
+
     void GCodeTimeEstimator::set_axis_position(EAxis axis, float position)
     {
         _state.axis[axis].position = position;
@@ -688,21 +741,50 @@ namespace Slic3r {
     void GCodeTimeEstimator::_calculate_time()
     {
         PROFILE_FUNC();
-        _forward_pass();
-        _reverse_pass();
+        size_t begin = (size_t)(_last_st_synchronized_block_id + 1);
+        size_t end = _blocks.size();
+
+        // The planner passes do not propagate the feedrates across a block of nominal length,
+        // therefore the blocks are split after such blocks into ranges, which are planned in parallel
+        std::vector<size_t> ranges = _parallel_planner ? _split_planner_ranges(begin, end) : std::vector<size_t>{ begin, end };
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, ranges.size() - 1, 1),
+            [this, &ranges](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t i = range.begin(); i < range.end(); ++i)
+            {
+                _forward_pass(ranges[i], ranges[i + 1]);
+                _reverse_pass(ranges[i], ranges[i + 1]);
+            }
+        });
         _recalculate_trapezoids();
 
         _time += get_additional_time();
 
-        for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size(); ++i)
+        // calculates the blocks times in parallel, they are accumulated in order below to keep the rounding of the sum
+        std::vector<float> times(3 * (end - begin), 0.0f);
+        tbb::parallel_for(tbb::blocked_range<size_t>(begin, end, PLANNER_RANGE_MIN_BLOCKS),
+            [this, begin, &times](const tbb::blocked_range<size_t>& range)
+        {
+            for (size_t i = range.begin(); i < range.end(); ++i)
+            {
+                const Block& block = _blocks[i];
+                float* block_times = &times[3 * (i - begin)];
+                block_times[0] = block.acceleration_time();
+                block_times[1] = block.cruise_time();
+                block_times[2] = block.deceleration_time();
+            }
+        });
+
+        for (size_t i = begin; i < end; ++i)
         {
             Block& block = _blocks[i];
+            const float* block_times = &times[3 * (i - begin)];
 
 #if ENABLE_MOVE_STATS
             float block_time = 0.0f;
-            block_time += block.acceleration_time();
-            block_time += block.cruise_time();
-            block_time += block.deceleration_time();
+            block_time += block_times[0];
+            block_time += block_times[1];
+            block_time += block_times[2];
             _time += block_time;
             block.elapsed_time = _time;
 
@@ -713,9 +795,9 @@ namespace Slic3r {
             it->second.count += 1;
             it->second.time += block_time;
 #else
-            _time += block.acceleration_time();
-            _time += block.cruise_time();
-            _time += block.deceleration_time();
+            _time += block_times[0];
+            _time += block_times[1];
+            _time += block_times[2];
             block.elapsed_time = _time;
 #endif // ENABLE_MOVE_STATS
         }
@@ -1061,7 +1143,9 @@ namespace Slic3r {
 
         // adds block to blocks list
         _blocks.emplace_back(block);
-        _g1_line_ids.insert(G1LineIdToBlockIdMap::value_type(get_g1_line_id(), (unsigned int)_blocks.size() - 1));
+        // only the extruding lines receive the remaining times, see post_process_remaining_times()
+        if (line.has_e())
+            _g1_line_ids.insert(G1LineIdToBlockIdMap::value_type(get_g1_line_id(), (unsigned int)_blocks.size() - 1));
     }
 
     void GCodeTimeEstimator::_processG4(const GCodeReader::GCodeLine& line)
@@ -1341,27 +1425,43 @@ namespace Slic3r {
         _calculate_time();
     }
 
-    void GCodeTimeEstimator::_forward_pass()
+    std::vector<size_t> GCodeTimeEstimator::_split_planner_ranges(size_t begin, size_t end) const
     {
-        PROFILE_FUNC();
-        if (_blocks.size() > 1)
+        std::vector<size_t> ranges(1, begin);
+        if (end > begin)
         {
-            for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size() - 1; ++i)
+            size_t range_size = std::max(PLANNER_RANGE_MIN_BLOCKS, (end - begin) / 256);
+            for (size_t i = begin + range_size; i + range_size < end; i += range_size)
             {
-                _planner_forward_pass_kernel(_blocks[i], _blocks[i + 1]);
+                // the range ends with a block of nominal length
+                for (; (i < end) && !_blocks[i - 1].flags.nominal_length; ++i);
+                if (i + range_size >= end)
+                    break;
+                ranges.push_back(i);
             }
         }
+        ranges.push_back(end);
+        return ranges;
     }
 
-    void GCodeTimeEstimator::_reverse_pass()
+    void GCodeTimeEstimator::_forward_pass(size_t begin, size_t end)
     {
         PROFILE_FUNC();
-        if (_blocks.size() > 1)
+        // the last block of the range is of nominal length (or it is the last block), it does not affect the next block
+        for (size_t i = begin; i + 1 < end; ++i)
         {
-            for (int i = (int)_blocks.size() - 1; i >= _last_st_synchronized_block_id + 2; --i)
-            {
-                _planner_reverse_pass_kernel(_blocks[i - 1], _blocks[i]);
-            }
+            _planner_forward_pass_kernel(_blocks[i], _blocks[i + 1]);
+        }
+    }
+
+    void GCodeTimeEstimator::_reverse_pass(size_t begin, size_t end)
+    {
+        PROFILE_FUNC();
+        // the last block of the range is of nominal length, therefore it does not depend on the next block,
+        // the last block of all is not planned
+        for (size_t i = std::min(end, _blocks.size() - 1); i > begin; --i)
+        {
+            _planner_reverse_pass_kernel(_blocks[i - 1], _blocks[i]);
         }
     }
 
@@ -1409,39 +1509,41 @@ namespace Slic3r {
     void GCodeTimeEstimator::_recalculate_trapezoids()
     {
         PROFILE_FUNC();
-        Block* curr = nullptr;
-        Block* next = nullptr;
+        size_t begin = (size_t)(_last_st_synchronized_block_id + 1);
+        size_t end = _blocks.size();
+        if (begin >= end)
+            return;
 
-        for (int i = _last_st_synchronized_block_id + 1; i < (int)_blocks.size(); ++i)
+        tbb::parallel_for(tbb::blocked_range<size_t>(begin, end - 1, PLANNER_RANGE_MIN_BLOCKS),
+            [this](const tbb::blocked_range<size_t>& range)
         {
-            Block& b = _blocks[i];
-
-            curr = next;
-            next = &b;
-
-            if (curr != nullptr)
+            for (size_t i = range.begin(); i < range.end(); ++i)
             {
+                Block& curr = _blocks[i];
+                const Block& next = _blocks[i + 1];
                 // Recalculate if current block entry or exit junction speed has changed.
-                if (curr->flags.recalculate || next->flags.recalculate)
+                if (curr.flags.recalculate || next.flags.recalculate)
                 {
                     // NOTE: Entry and exit factors always > 0 by all previous logic operations.
-                    Block block = *curr;
-                    block.feedrate.exit = next->feedrate.entry;
+                    Block block = curr;
+                    block.feedrate.exit = next.feedrate.entry;
                     block.calculate_trapezoid();
-                    curr->trapezoid = block.trapezoid;
-                    curr->flags.recalculate = false; // Reset current only to ensure next trapezoid is computed
+                    curr.trapezoid = block.trapezoid;
                 }
             }
-        }
+        });
 
         // Last/newest block in buffer. Always recalculated.
-        if (next != nullptr)
+        Block& last = _blocks[end - 1];
+        Block block = last;
+        block.feedrate.exit = last.safe_feedrate;
+        block.calculate_trapezoid();
+        last.trapezoid = block.trapezoid;
+
+        // The flags are reset after all the trapezoids were recalculated, as the flag of the next block is tested above.
+        for (size_t i = begin; i < end; ++i)
         {
-            Block block = *next;
-            block.feedrate.exit = next->safe_feedrate;
-            block.calculate_trapezoid();
-            next->trapezoid = block.trapezoid;
-            next->flags.recalculate = false;
+            _blocks[i].flags.recalculate = false;
         }
     }
 
@@ -1472,6 +1574,35 @@ namespace Slic3r {
         return std::to_string((int)(::roundf(time_in_secs / 60.0f)));
     }
 
+    std::vector<std::pair<unsigned int, std::string>> GCodeTimeEstimator::_get_remaining_times_lines(float interval) const
+    {
+        const char* time_mask = (_mode == Silent) ? "M73 Q%s S%s\n" : "M73 P%s R%s\n";
+
+        std::vector<std::pair<unsigned int, std::string>> lines;
+        float last_recorded_time = 0.0f;
+        char time_line[64];
+        for (const G1LineIdToBlockIdMap::value_type& g1_line_id : _g1_line_ids)
+        {
+            if (g1_line_id.second >= (unsigned int)_blocks.size())
+                continue;
+
+            const Block& block = _blocks[g1_line_id.second];
+            if (block.elapsed_time != -1.0f)
+            {
+                float block_remaining_time = _time - block.elapsed_time;
+                if (std::abs(last_recorded_time - block_remaining_time) > interval)
+                {
+                    sprintf(time_line, time_mask, std::to_string((int)(100.0f * block.elapsed_time / _time)).c_str(), _get_time_minutes(block_remaining_time).c_str());
+                    lines.emplace_back(g1_line_id.first, time_line);
+
+                    last_recorded_time = block_remaining_time;
+                }
+            }
+        }
+
+        return lines;
+    }
+
 #if ENABLE_MOVE_STATS
     void GCodeTimeEstimator::_log_moves_stats() const
     {
@@ -215,11 +215,13 @@ namespace Slic3r {
         Feedrates _curr;
         Feedrates _prev;
         BlocksList _blocks;
-        // Map between g1 line id and blocks id, used to speed up export of remaining times
+        // Map between g1 line id and blocks id of the G1 lines with an E axis, used to speed up export of remaining times
         G1LineIdToBlockIdMap _g1_line_ids;
         // Index of the last block already st_synchronized
         int _last_st_synchronized_block_id;
         float _time; // s
+        // Plan the blocks in ranges split after the blocks of nominal length in parallel, or all the blocks at once
+        bool _parallel_planner;
 
 #if ENABLE_MOVE_STATS
         MovesStatsMap _moves_stats;
@@ -233,6 +235,8 @@ namespace Slic3r {
 
         void add_gcode_block(const char *ptr);
         void add_gcode_block(const std::string &str) { this->add_gcode_block(str.c_str()); }
+        // Adds the given gcode, taking the moves already parsed by the producer of the gcode from moves
+        void add_gcode_block(const std::string &str, const GCodeReader::ParsedMoves &moves);
 
         // Calculates the time estimate from the gcode lines added using add_gcode_line() or add_gcode_block()
         // start_from_beginning:
@@ -252,9 +256,19 @@ namespace Slic3r {
         // Process the gcode contained in the file with the given filename, 
         // placing in it new lines (M73) containing the remaining time, at the given interval in seconds
         // and saving the result back in the same file
-        // This time estimator should have been already used to calculate the time estimate for the gcode
+        // The lines of all the given time estimators (normal and silent mode) are placed in a single pass over the file,
+        // after a G1 line in the order of the estimators
+        // The time estimators should have been already used to calculate the time estimate for the gcode
         // contained in the given file before to call this method
-        bool post_process_remaining_times(const std::string& filename, float interval_sec);
+        static bool post_process_remaining_times(const std::string& filename, float interval_sec, const std::vector<const GCodeTimeEstimator*>& estimators);
+
+        // Returns the time elapsed from the start of the gcode to the end of the move of the given extruding G1 line,
+        // or -1 if the G1 line is not an extruding move or its time has not been calculated yet
+        float get_elapsed_time(unsigned int g1_line_id) const;
+
+        // The results are the same in both modes, the single threaded planner is kept for testing
+        void set_parallel_planner(bool parallel);
+        bool get_parallel_planner() const;
 
         // Set current position on the given axis with the given value
         void set_axis_position(EAxis axis, float position);
@@ -409,8 +423,13 @@ namespace Slic3r {
         // Simulates firmware st_synchronize() call
         void _simulate_st_synchronize();
 
-        void _forward_pass();
-        void _reverse_pass();
+        // Splits the blocks in [begin, end) into ranges, which may be planned independently.
+        // Returns the boundaries of the ranges, starting with begin and ending with end.
+        std::vector<size_t> _split_planner_ranges(size_t begin, size_t end) const;
+
+        // Planner passes over the blocks in [begin, end)
+        void _forward_pass(size_t begin, size_t end);
+        void _reverse_pass(size_t begin, size_t end);
 
         void _planner_forward_pass_kernel(Block& prev, Block& curr);
         void _planner_reverse_pass_kernel(Block& curr, Block& next);
@@ -423,6 +442,9 @@ namespace Slic3r {
         // Returns the given, in minutes (integer)
         static std::string _get_time_minutes(float time_in_secs);
 
+        // Returns the remaining times lines (M73) to be placed after the G1 lines with the given ids, at the given interval in seconds
+        std::vector<std::pair<unsigned int, std::string>> _get_remaining_times_lines(float interval_sec) const;
+
 #if ENABLE_MOVE_STATS
         void _log_moves_stats() const;
 #endif // ENABLE_MOVE_STATS
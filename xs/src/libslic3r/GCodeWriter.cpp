@@ -1,5 +1,7 @@
 #include "GCodeWriter.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <iomanip>
 #include <iostream>
 #include <map>
@@ -7,13 +9,90 @@
 
 #define FLAVOR_IS(val) this->config.gcode_flavor == val
 #define FLAVOR_IS_NOT(val) this->config.gcode_flavor != val
-#define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) gcode << " ; " << comment;
-#define PRECISION(val, precision) std::fixed << std::setprecision(precision) << val
-#define XYZF_NUM(val) PRECISION(val, 3)
-#define E_NUM(val) PRECISION(val, 5)
+#define COMMENT(comment) if (this->config.gcode_comments && !comment.empty()) { gcode += " ; "; gcode += comment; }
 
 namespace Slic3r {
 
+// Fast formatting of the numbers of the G1 lines, producing the same text as the iostreams.
+// A number is scaled and rounded to an integer, its digits are emitted directly. Only the numbers too large
+// or too close to a rounding tie to be rounded correctly this way are formatted by snprintf().
+
+// Append the decimal digits of an integer.
+static inline void append_uint(std::string &out, uint64_t value)
+{
+    char  buf[24];
+    char *end = buf + sizeof(buf);
+    char *p   = end;
+    do {
+        *-- p = char('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(p, end - p);
+}
+
+// Append the value formatted as std::fixed << std::setprecision(precision) << value,
+// which is printf("%.<precision>f", value).
+void append_fixed(std::string &out, double value, int precision)
+{
+    static const uint64_t pow10[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+    assert(precision >= 0 && precision <= 6);
+    double abs_value = std::abs(value);
+    double scaled    = abs_value * double(pow10[precision]);
+    // The error of scaled is below 1e-4 up to 1e12, a fraction at least 1e-3 away from 0.5 rounds the same way as the exact decimal value.
+    if (! (scaled < 1e12) || std::abs(scaled - std::floor(scaled) - 0.5) < 1e-3) {
+        // A huge value may have hundreds of digits.
+        int    len = ::snprintf(nullptr, 0, "%.*f", precision, value);
+        size_t pos = out.size();
+        out.resize(pos + len + 1);
+        ::snprintf(&out[pos], len + 1, "%.*f", precision, value);
+        out.resize(pos + len);
+        return;
+    }
+    uint64_t rounded = uint64_t(std::floor(scaled + 0.5));
+    // printf() emits the sign of a negative value rounded to zero, and of a negative zero.
+    if (std::signbit(value))
+        out += '-';
+    append_uint(out, rounded / pow10[precision]);
+    if (precision > 0) {
+        out += '.';
+        uint64_t fraction = rounded % pow10[precision];
+        char     buf[8];
+        for (int i = precision - 1; i >= 0; -- i) {
+            buf[i] = char('0' + fraction % 10);
+            fraction /= 10;
+        }
+        out.append(buf, precision);
+    }
+}
+
+// Append the value formatted as std::ostream << value with the default formatting,
+// which is printf("%g", value): 6 significant digits, the trailing zeros removed.
+void append_general(std::string &out, double value)
+{
+    double abs_value = std::abs(value);
+    if (abs_value >= 1. && abs_value < 999999.5) {
+        // Number of digits in front of the decimal point.
+        int num_digits = 1;
+        for (double limit = 10.; abs_value >= limit; limit *= 10.)
+            ++ num_digits;
+        // A value rounding to 1000000 would be printed in the exponential format, it is excluded above.
+        append_fixed(out, value, 6 - num_digits);
+        if (num_digits < 6) {
+            // Remove the trailing zeros of the fraction, and the decimal point if the fraction is all zeros.
+            size_t end = out.size();
+            while (out[end - 1] == '0')
+                -- end;
+            if (out[end - 1] == '.')
+                -- end;
+            out.erase(end);
+        }
+        return;
+    }
+    char buf[64];
+    int  len = ::snprintf(buf, sizeof(buf), "%g", value);
+    out.append(buf, std::min<size_t>(len, sizeof(buf) - 1));
+}
+
 void GCodeWriter::apply_print_config(const PrintConfig &print_config)
 {
     this->config.apply(print_config, true);
@@ -268,12 +347,14 @@ std::string GCodeWriter::set_speed(double F, const std::string &comment, const s
 {
     assert(F > 0.);
     assert(F < 100000.);
-    std::ostringstream gcode;
-    gcode << "G1 F" << F;
+    std::string gcode;
+    gcode.reserve(32 + comment.size() + cooling_marker.size());
+    gcode += "G1 F";
+    append_general(gcode, F);
     COMMENT(comment);
-    gcode << cooling_marker;
-    gcode << "\n";
-    return gcode.str();
+    gcode += cooling_marker;
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::travel_to_xy(const Pointf &point, const std::string &comment)
@@ -281,13 +362,17 @@ std::string GCodeWriter::travel_to_xy(const Pointf &point, const std::string &co
     m_pos.x = point.x;
     m_pos.y = point.y;
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode.reserve(64 + comment.size());
+    gcode += "G1 X";
+    append_fixed(gcode, point.x, 3);
+    gcode += " Y";
+    append_fixed(gcode, point.y, 3);
+    gcode += " F";
+    append_fixed(gcode, this->config.travel_speed.value * 60.0, 3);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &comment)
@@ -307,14 +392,19 @@ std::string GCodeWriter::travel_to_xyz(const Pointf3 &point, const std::string &
     m_lifted = 0;
     m_pos = point;
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<   " Z" << XYZF_NUM(point.z)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode.reserve(64 + comment.size());
+    gcode += "G1 X";
+    append_fixed(gcode, point.x, 3);
+    gcode += " Y";
+    append_fixed(gcode, point.y, 3);
+    gcode += " Z";
+    append_fixed(gcode, point.z, 3);
+    gcode += " F";
+    append_fixed(gcode, this->config.travel_speed.value * 60.0, 3);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::travel_to_z(double z, const std::string &comment)
@@ -338,12 +428,15 @@ std::string GCodeWriter::_travel_to_z(double z, const std::string &comment)
 {
     m_pos.z = z;
     
-    std::ostringstream gcode;
-    gcode << "G1 Z" << XYZF_NUM(z)
-          <<   " F" << XYZF_NUM(this->config.travel_speed.value * 60.0);
+    std::string gcode;
+    gcode.reserve(32 + comment.size());
+    gcode += "G1 Z";
+    append_fixed(gcode, z, 3);
+    gcode += " F";
+    append_fixed(gcode, this->config.travel_speed.value * 60.0, 3);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 bool GCodeWriter::will_move_z(double z) const
@@ -364,13 +457,18 @@ std::string GCodeWriter::extrude_to_xy(const Pointf &point, double dE, const std
     m_pos.y = point.y;
     m_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<    " " << m_extrusion_axis << E_NUM(m_extruder->E());
+    std::string gcode;
+    gcode.reserve(64 + comment.size());
+    gcode += "G1 X";
+    append_fixed(gcode, point.x, 3);
+    gcode += " Y";
+    append_fixed(gcode, point.y, 3);
+    gcode += ' ';
+    gcode += m_extrusion_axis;
+    append_fixed(gcode, m_extruder->E(), 5);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::extrude_to_xyz(const Pointf3 &point, double dE, const std::string &comment)
@@ -379,14 +477,20 @@ std::string GCodeWriter::extrude_to_xyz(const Pointf3 &point, double dE, const s
     m_lifted = 0;
     m_extruder->extrude(dE);
     
-    std::ostringstream gcode;
-    gcode << "G1 X" << XYZF_NUM(point.x)
-          <<   " Y" << XYZF_NUM(point.y)
-          <<   " Z" << XYZF_NUM(point.z)
-          <<    " " << m_extrusion_axis << E_NUM(m_extruder->E());
+    std::string gcode;
+    gcode.reserve(64 + comment.size());
+    gcode += "G1 X";
+    append_fixed(gcode, point.x, 3);
+    gcode += " Y";
+    append_fixed(gcode, point.y, 3);
+    gcode += " Z";
+    append_fixed(gcode, point.z, 3);
+    gcode += ' ';
+    gcode += m_extrusion_axis;
+    append_fixed(gcode, m_extruder->E(), 5);
     COMMENT(comment);
-    gcode << "\n";
-    return gcode.str();
+    gcode += '\n';
+    return gcode;
 }
 
 std::string GCodeWriter::retract(bool before_wipe)
@@ -413,7 +517,7 @@ std::string GCodeWriter::retract_for_toolchange(bool before_wipe)
 
 std::string GCodeWriter::_retract(double length, double restart_extra, const std::string &comment)
 {
-    std::ostringstream gcode;
+    std::string gcode;
     
     /*  If firmware retraction is enabled, we use a fake value of 1
         since we ignore the actual configured retract_length which 
@@ -432,48 +536,55 @@ std::string GCodeWriter::_retract(double length, double restart_extra, const std
     if (dE != 0) {
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
-                gcode << "G22 ; retract\n";
+                gcode += "G22 ; retract\n";
             else
-                gcode << "G10 ; retract\n";
+                gcode += "G10 ; retract\n";
         } else {
-            gcode << "G1 " << m_extrusion_axis << E_NUM(m_extruder->E())
-                           << " F" << float(m_extruder->retract_speed() * 60.);
+            gcode += "G1 ";
+            gcode += m_extrusion_axis;
+            append_fixed(gcode, m_extruder->E(), 5);
+            gcode += " F";
+            // The feed rate is formatted with the precision of the E value, as it used to be by the iostreams.
+            append_fixed(gcode, float(m_extruder->retract_speed() * 60.), 5);
             COMMENT(comment);
-            gcode << "\n";
+            gcode += '\n';
         }
     }
     
     if (FLAVOR_IS(gcfMakerWare))
-        gcode << "M103 ; extruder off\n";
+        gcode += "M103 ; extruder off\n";
     
-    return gcode.str();
+    return gcode;
 }
 
 std::string GCodeWriter::unretract()
 {
-    std::ostringstream gcode;
+    std::string gcode;
     
     if (FLAVOR_IS(gcfMakerWare))
-        gcode << "M101 ; extruder on\n";
+        gcode += "M101 ; extruder on\n";
     
     double dE = m_extruder->unretract();
     if (dE != 0) {
         if (this->config.use_firmware_retraction) {
             if (FLAVOR_IS(gcfMachinekit))
-                 gcode << "G23 ; unretract\n";
+                 gcode += "G23 ; unretract\n";
             else
-                 gcode << "G11 ; unretract\n";
-            gcode << this->reset_e();
+                 gcode += "G11 ; unretract\n";
+            gcode += this->reset_e();
         } else {
             // use G1 instead of G0 because G0 will blend the restart with the previous travel move
-            gcode << "G1 " << m_extrusion_axis << E_NUM(m_extruder->E())
-                           << " F" << float(m_extruder->deretract_speed() * 60.);
-            if (this->config.gcode_comments) gcode << " ; unretract";
-            gcode << "\n";
+            gcode += "G1 ";
+            gcode += m_extrusion_axis;
+            append_fixed(gcode, m_extruder->E(), 5);
+            gcode += " F";
+            append_fixed(gcode, float(m_extruder->deretract_speed() * 60.), 5);
+            if (this->config.gcode_comments) gcode += " ; unretract";
+            gcode += '\n';
         }
     }
     
-    return gcode.str();
+    return gcode;
 }
 
 /*  If this method is called more than once before calling unlift(),
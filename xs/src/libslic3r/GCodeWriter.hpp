@@ -10,6 +10,12 @@
 
 namespace Slic3r {
 
+// Fast formatting of the numbers of the G-code lines, producing the same text as the iostreams.
+// Append the value formatted as std::fixed << std::setprecision(precision) << value, precision <= 6.
+void append_fixed(std::string &out, double value, int precision);
+// Append the value formatted as std::ostream << value with the default formatting.
+void append_general(std::string &out, double value);
+
 class GCodeWriter {
 public:
     GCodeConfig config;
@@ -3,6 +3,7 @@
 #include "ExPolygon.hpp"
 #include "Line.hpp"
 #include "PolylineCollection.hpp"
+#include "ShortestPath.hpp"
 #include "clipper.hpp"
 #include <algorithm>
 #include <cassert>
@@ -247,24 +248,29 @@ convex_hull(const Polygons &polygons)
 }
 
 /* accepts an arrayref of points and returns a list of indices
-   according to a nearest-neighbor walk */
+   according to a nearest-neighbor walk, optionally improved by 2-opt moves for up to improve_time_limit seconds */
 void
-chained_path(const Points &points, std::vector<Points::size_type> &retval, Point start_near)
+chained_path(const Points &points, std::vector<Points::size_type> &retval, Point start_near, double improve_time_limit)
 {
-    PointConstPtrs my_points;
-    std::map<const Point*,Points::size_type> indices;
-    my_points.reserve(points.size());
-    for (Points::const_iterator it = points.begin(); it != points.end(); ++it) {
-        my_points.push_back(&*it);
-        indices[&*it] = it - points.begin();
-    }
-    
-    retval.reserve(points.size());
-    while (!my_points.empty()) {
-        Points::size_type idx = start_near.nearest_point_index(my_points);
-        start_near = *my_points[idx];
-        retval.push_back(indices[ my_points[idx] ]);
-        my_points.erase(my_points.begin() + idx);
+    retval.reserve(retval.size() + points.size());
+    NearestEndPointLookup lookup(points, 1);
+    if (improve_time_limit > 0.) {
+        std::vector<ChainItem> chain;
+        chain.reserve(points.size());
+        for (Point pt = start_near; ! lookup.empty(); ) {
+            size_t idx = lookup.pop_nearest(pt);
+            pt = points[idx];
+            chain.emplace_back(pt, pt, true, idx);
+        }
+        improve_chain_2opt(chain, start_near, improve_time_limit);
+        for (const ChainItem &item : chain)
+            retval.push_back(item.idx);
+    } else {
+        while (! lookup.empty()) {
+            Points::size_type idx = lookup.pop_nearest(start_near);
+            start_near = points[idx];
+            retval.push_back(idx);
+        }
     }
 }
 
@@ -110,7 +110,7 @@ inline bool segment_segment_intersection(const Pointf &p1, const Vectorf &v1, co
 
 Polygon convex_hull(Points points);
 Polygon convex_hull(const Polygons &polygons);
-void chained_path(const Points &points, std::vector<Points::size_type> &retval, Point start_near);
+void chained_path(const Points &points, std::vector<Points::size_type> &retval, Point start_near, double improve_time_limit = 0.);
 void chained_path(const Points &points, std::vector<Points::size_type> &retval);
 template<class T> void chained_path_items(Points &points, T &items, T &retval);
 bool directions_parallel(double angle1, double angle2, double max_diff = 0);
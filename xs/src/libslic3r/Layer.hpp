@@ -60,7 +60,12 @@ public:
     // ordered collection of extrusion paths to fill surfaces
     // (this collection contains only ExtrusionEntityCollection objects)
     ExtrusionEntityCollection fills;
-    
+
+    // Copies of the slices (with the extra perimeters assigned) and of the fill surfaces as left by the perimeter generator,
+    // before they are split by type. PrintObject::_prepare_infill() restores them to recalculate a part of the object only.
+    SurfaceCollection saved_slices;
+    SurfaceCollection saved_fill_surfaces;
+
     Flow flow(FlowRole role, bool bridge = false, double width = -1) const;
     void slices_to_fill_surfaces_clipped();
     void prepare_fill_surfaces();
@@ -0,0 +1,195 @@
+#include "LayerStream.hpp"
+#include "Layer.hpp"
+#include "Print.hpp"
+#include "Serialize.hpp"
+
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace Slic3r {
+
+static const char     LAYER_STREAM_MAGIC[8] = { 'S', 'L', 'I', 'C', '3', 'R', 'L', 'Y' };
+static const uint32_t LAYER_STREAM_VERSION  = 2;
+static const size_t   LAYER_STREAM_HEADER_SIZE = sizeof(LAYER_STREAM_MAGIC) + sizeof(uint32_t) + SliceCacheKey::DIGEST_SIZE;
+
+enum LayerStreamRecord {
+    lsrEnd,
+    lsrLayer,
+    lsrSupportLayer,
+};
+
+// Data shared by the object layers and the support layers.
+static void write_layer(BinaryWriter &writer, const Layer &layer)
+{
+    writer.write_varuint(layer.id());
+    writer.write_double(layer.height);
+    writer.write_double(layer.print_z);
+    writer.write_double(layer.slice_z);
+    writer.write_uint8(layer.slicing_errors ? 1 : 0);
+    writer.write(layer.slices.expolygons);
+    writer.write_varuint(layer.regions.size());
+    for (const LayerRegion *layerm : layer.regions) {
+        writer.write(layerm->slices.surfaces);
+        writer.write(layerm->fill_surfaces.surfaces);
+        writer.write(layerm->perimeter_surfaces.surfaces);
+        writer.write(layerm->fill_expolygons);
+        writer.write(layerm->bridged);
+        writer.write(layerm->unsupported_bridge_edges.polylines);
+        writer.write(layerm->perimeters);
+        writer.write(layerm->thin_fills);
+        writer.write(layerm->fills);
+    }
+}
+
+// Reads the data written by write_layer() past the layer ID, height and Z coordinates.
+// The object layers contain a LayerRegion for each PrintRegion, the support layers contain none.
+static void read_layer(BinaryReader &reader, Layer &layer, const PrintRegionPtrs &regions)
+{
+    layer.slicing_errors = reader.read_uint8() != 0;
+    reader.read(layer.slices.expolygons);
+    if (reader.read_varuint() != regions.size())
+        throw std::runtime_error("The number of regions of a layer does not match the print");
+    for (size_t region_id = 0; region_id < regions.size(); ++ region_id) {
+        LayerRegion *layerm = layer.add_region(regions[region_id]);
+        reader.read(layerm->slices.surfaces);
+        reader.read(layerm->fill_surfaces.surfaces);
+        reader.read(layerm->perimeter_surfaces.surfaces);
+        reader.read(layerm->fill_expolygons);
+        reader.read(layerm->bridged);
+        reader.read(layerm->unsupported_bridge_edges.polylines);
+        reader.read(layerm->perimeters);
+        reader.read(layerm->thin_fills);
+        reader.read(layerm->fills);
+    }
+}
+
+LayerStreamWriter::LayerStreamWriter(std::ostream &out, const SliceCacheKey &key) : m_out(out)
+{
+    std::string digest = key.digest();
+    m_out.write(LAYER_STREAM_MAGIC, sizeof(LAYER_STREAM_MAGIC));
+    m_out.write((const char*)&LAYER_STREAM_VERSION, sizeof(LAYER_STREAM_VERSION));
+    m_out.write(digest.data(), digest.size());
+}
+
+void LayerStreamWriter::write(const Layer &layer)
+{
+    m_buffer.clear();
+    BinaryWriter writer(m_buffer);
+    write_layer(writer, layer);
+    this->write_record(lsrLayer);
+}
+
+void LayerStreamWriter::write(const SupportLayer &layer)
+{
+    m_buffer.clear();
+    BinaryWriter writer(m_buffer);
+    write_layer(writer, layer);
+    writer.write(layer.support_islands.expolygons);
+    writer.write(layer.support_fills);
+    this->write_record(lsrSupportLayer);
+}
+
+void LayerStreamWriter::finish()
+{
+    m_buffer.clear();
+    this->write_record(lsrEnd);
+}
+
+void LayerStreamWriter::write_record(uint8_t type)
+{
+    std::string  header;
+    BinaryWriter writer(header);
+    writer.write_uint8(type);
+    writer.write_varuint(m_buffer.size());
+    m_out.write(header.data(), header.size());
+    m_out.write(m_buffer.data(), m_buffer.size());
+    m_out.flush();
+    if (m_out.fail())
+        throw std::runtime_error("Failed writing the layer stream");
+}
+
+LayerStreamReader::LayerStreamReader(const char *begin, const char *end) : m_begin(nullptr), m_end(end)
+{
+    // Validate the size before pointing past the header.
+    if (end < begin || size_t(end - begin) < LAYER_STREAM_HEADER_SIZE || memcmp(begin, LAYER_STREAM_MAGIC, sizeof(LAYER_STREAM_MAGIC)) != 0)
+        throw std::runtime_error("Not a layer stream");
+    uint32_t version = 0;
+    memcpy(&version, begin + sizeof(LAYER_STREAM_MAGIC), sizeof(version));
+    if (version != LAYER_STREAM_VERSION)
+        throw std::runtime_error("Unsupported version of a layer stream");
+    m_key.assign(begin + sizeof(LAYER_STREAM_MAGIC) + sizeof(version), SliceCacheKey::DIGEST_SIZE);
+    m_begin = begin + LAYER_STREAM_HEADER_SIZE;
+}
+
+void LayerStreamReader::read(PrintObject &object)
+{
+    object.clear_layers();
+    object.clear_support_layers();
+    try {
+        BinaryReader reader(m_begin, m_end);
+        for (;;) {
+            uint8_t type = reader.read_uint8();
+            size_t  size = reader.read_count();
+            BinaryReader record(reader.position(), reader.position() + size);
+            reader.skip(size);
+            if (type == lsrEnd)
+                break;
+            if (type != lsrLayer && type != lsrSupportLayer)
+                throw std::runtime_error("Unknown record of a layer stream");
+            size_t   id      = size_t(record.read_varuint());
+            coordf_t height  = record.read_double();
+            coordf_t print_z = record.read_double();
+            coordf_t slice_z = record.read_double();
+            if (type == lsrLayer) {
+                read_layer(record, *object.add_layer(int(id), height, print_z, slice_z), object.print()->regions);
+            } else {
+                SupportLayer *layer = object.add_support_layer(int(id), height, print_z);
+                layer->slice_z = slice_z;
+                read_layer(record, *layer, PrintRegionPtrs());
+                record.read(layer->support_islands.expolygons);
+                record.read(layer->support_fills);
+            }
+            if (! record.eof())
+                throw std::runtime_error("Unexpected data in a record of a layer stream");
+        }
+    } catch (...) {
+        object.clear_layers();
+        object.clear_support_layers();
+        throw;
+    }
+    for (size_t i_layer = 0; i_layer < object.layers.size(); ++ i_layer) {
+        object.layers[i_layer]->lower_layer = (i_layer == 0) ? nullptr : object.layers[i_layer - 1];
+        object.layers[i_layer]->upper_layer = (i_layer + 1 == object.layers.size()) ? nullptr : object.layers[i_layer + 1];
+    }
+}
+
+struct MappedFile::Impl
+{
+    boost::interprocess::file_mapping  mapping;
+    boost::interprocess::mapped_region region;
+};
+
+MappedFile::MappedFile(const std::string &path) : m_impl(nullptr), m_data(nullptr), m_size(0)
+{
+    try {
+        m_impl = new Impl;
+        m_impl->mapping = boost::interprocess::file_mapping(path.c_str(), boost::interprocess::read_only);
+        m_impl->region  = boost::interprocess::mapped_region(m_impl->mapping, boost::interprocess::read_only);
+    } catch (const std::exception &ex) {
+        delete m_impl;
+        throw std::runtime_error("Cannot map the file " + path + ": " + ex.what());
+    }
+    m_data = (const char*)m_impl->region.get_address();
+    m_size = m_impl->region.get_size();
+}
+
+MappedFile::~MappedFile()
+{
+    delete m_impl;
+}
+
+} // namespace Slic3r
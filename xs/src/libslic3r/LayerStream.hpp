@@ -0,0 +1,86 @@
+#ifndef slic3r_LayerStream_hpp_
+#define slic3r_LayerStream_hpp_
+
+#include "libslic3r.h"
+#include "SliceCache.hpp"
+#include <iosfwd>
+#include <string>
+
+namespace Slic3r {
+
+class Layer;
+class PrintObject;
+class SupportLayer;
+
+// Checkpoint of the processed layers of a PrintObject: the slices, the surfaces and the extrusions
+// of the object layers and of the support layers, so that a print may be reloaded for the G-code export
+// without running the slicing pipeline again, or processed by another process.
+//
+// The stream starts with a header (magic, format version, digest of the key of the object and of its configuration)
+// followed by a record per layer. Each record is prefixed with its type and size, the layer data is encoded
+// by BinaryWriter (see Serialize.hpp).
+// The stream is closed by an end record, so that a truncated stream is detected by the reader.
+class LayerStreamWriter
+{
+public:
+    // Writes the header with the key of the object and of its configuration.
+    LayerStreamWriter(std::ostream &out, const SliceCacheKey &key);
+
+    // Each layer is written and flushed as it comes, so that the layers of a large print are not kept in memory twice.
+    void write(const Layer &layer);
+    void write(const SupportLayer &layer);
+    // Write the end record.
+    void finish();
+
+private:
+    void write_record(uint8_t type);
+
+    std::ostream &m_out;
+    std::string   m_buffer;
+};
+
+// Reader of a stream written by LayerStreamWriter, from a memory block, possibly a memory mapped file.
+// Throws std::runtime_error if the data is not a layer stream, if it was written by an unsupported version
+// or if it is truncated or corrupted.
+class LayerStreamReader
+{
+public:
+    // Validates the header.
+    LayerStreamReader(const char *begin, const char *end);
+
+    // Digest of the key the stream was written with, to be compared with the key of the object to be loaded.
+    const std::string& key() const { return m_key; }
+
+    // Replace the layers and the support layers of the object with the layers of the stream.
+    // The number of regions of the object layers has to match the number of regions of the print.
+    // On failure the object is left without any layers.
+    void read(PrintObject &object);
+
+private:
+    const char *m_begin;
+    const char *m_end;
+    std::string m_key;
+};
+
+// Read only memory mapping of a whole file. Throws std::runtime_error if the file cannot be mapped.
+class MappedFile
+{
+public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return m_data; }
+    size_t      size() const { return m_size; }
+
+private:
+    struct Impl;
+    Impl       *m_impl;
+    const char *m_data;
+    size_t      m_size;
+};
+
+} // namespace Slic3r
+
+#endif /* slic3r_LayerStream_hpp_ */
@@ -100,26 +100,20 @@ namespace bgi = boost::geometry::index;
 using SpatElement = std::pair<Box, unsigned>;
 using SpatIndex = bgi::rtree< SpatElement, bgi::rstar<16, 4> >;
 
-std::tuple<double /*score*/, Box /*farthest point from bin center*/>
-objfunc(const PointImpl& bincenter,
-        double /*bin_area*/,
-        ShapeLike::Shapes<PolygonImpl>& pile,   // The currently arranged pile
-        double /*pile_area*/,
-        const Item &item,
-        double norm,            // A norming factor for physical dimensions
-        std::vector<double>& areacache, // pile item areas will be cached
-        // a spatial index to quickly get neighbors of the candidate item
-        SpatIndex& spatindex
-        )
+// We will treat big items (compared to the print bed) differently
+static const double BIG_ITEM_TRESHOLD = 0.2;
+
+// Fill the caches of the object function with the items of the pile placed
+// since the last call. This is called before the placement of every item,
+// the object function itself only reads the caches, because it is evaluated
+// from multiple threads.
+void fillCaches(const ShapeLike::Shapes<PolygonImpl>& pile,
+                double norm,
+                std::vector<double>& areacache,
+                SpatIndex& spatindex)
 {
-    using pl = PointLike;
     using sl = ShapeLike;
 
-    static const double BIG_ITEM_TRESHOLD = 0.2;
-    static const double ROUNDNESS_RATIO = 0.5;
-    static const double DENSITY_RATIO = 1.0 - ROUNDNESS_RATIO;
-
-    // We will treat big items (compared to the print bed) differently
     auto normarea = [norm](double area) { return std::sqrt(area)/norm; };
 
     // If a new bin has been created:
@@ -139,6 +133,29 @@ objfunc(const PointImpl& bincenter,
 
         idx++;
     }
+}
+
+std::tuple<double /*score*/, Box /*farthest point from bin center*/>
+objfunc(const PointImpl& bincenter,
+        double /*bin_area*/,
+        ShapeLike::Shapes<PolygonImpl>& pile,   // The currently arranged pile
+        double /*pile_area*/,
+        const Item &item,
+        double norm,            // A norming factor for physical dimensions
+        // pile item areas, see fillCaches()
+        const std::vector<double>& areacache,
+        // a spatial index to quickly get neighbors of the candidate item
+        const SpatIndex& spatindex
+        )
+{
+    using pl = PointLike;
+    using sl = ShapeLike;
+
+    static const double ROUNDNESS_RATIO = 0.5;
+    static const double DENSITY_RATIO = 1.0 - ROUNDNESS_RATIO;
+
+    // We will treat big items (compared to the print bed) differently
+    auto normarea = [norm](double area) { return std::sqrt(area)/norm; };
 
     // Candidate item bounding box
     auto ibb = item.boundingBox();
@@ -287,6 +304,9 @@ public:
        pck_(bin, dist), bin_area_(ShapeLike::area<PolygonImpl>(bin))
     {
         fillConfig(pconf_);
+        pconf_.before_packing = [this](const Pile& pile, double norm) {
+            fillCaches(pile, norm, areacache_, rtree_);
+        };
         pck_.progressIndicator(progressind);
     }
 
@@ -491,6 +511,9 @@ void applyResult(
  * pile of items on the print bed and some other piles outside the print
  * area that can be dragged later onto the print bed as a group.
  *
+ * If all the instances have the same shape and rotation, they are placed
+ * onto a lattice instead of being nested, see libnest2d::arrangeOnLattice().
+ *
  * \param model The model object with the 3D content.
  * \param dist The minimum distance which is allowed for any pair of items
  * on the print bed  in any direction.
@@ -539,6 +562,13 @@ bool arrange(Model &model, coordf_t min_obj_distance,
     switch(bedhint) {
     case BOX: {
 
+        // Copies of a single object are put onto a lattice, no need to nest
+        if(arrangeOnLattice(shapes.begin(), shapes.end(), min_obj_distance,
+                            binbb, result)) {
+            if(progressind) progressind(0);
+            break;
+        }
+
         // Create the arranger for the box shaped bed
         AutoArranger<Box> arrange(binbb, min_obj_distance, progressind);
 
@@ -558,6 +588,12 @@ bool arrange(Model &model, coordf_t min_obj_distance,
 
 //        std::cout << ShapeLike::toString(irrbed) << std::endl;
 
+        if(arrangeOnLattice(shapes.begin(), shapes.end(), min_obj_distance,
+                            irrbed, result)) {
+            if(progressind) progressind(0);
+            break;
+        }
+
         AutoArranger<P> arrange(irrbed, min_obj_distance, progressind);
 
         // Arrange and return the items with their respective indices within the
@@ -3,8 +3,11 @@
 #include "MutablePriorityQueue.hpp"
 #include "Utils.hpp"
 
+#include <algorithm>
 #include <limits> // for numeric_limits
 #include <assert.h>
+#include <cmath>
+#include <iterator>
 
 #include "boost/polygon/voronoi.hpp"
 using boost::polygon::voronoi_builder;
@@ -21,6 +24,40 @@ MotionPlanner::MotionPlanner(const ExPolygons &islands) : m_initialized(false)
             m_islands.emplace_back(MotionPlannerEnv(island));
         expp.clear();
     }
+    std::vector<RTreeIsland> boxes;
+    boxes.reserve(m_islands.size());
+    for (const MotionPlannerEnv &island : m_islands)
+        boxes.emplace_back(
+            MotionPlannerRTreeBox(
+                MotionPlannerRTreePoint(island.m_island_bbox.min.x, island.m_island_bbox.min.y),
+                MotionPlannerRTreePoint(island.m_island_bbox.max.x, island.m_island_bbox.max.y)),
+            &island - m_islands.data());
+    // Bulk loading creates a better balanced tree than inserting the boxes one by one.
+    m_islands_rtree = decltype(m_islands_rtree)(boxes);
+}
+
+bool MotionPlanner::same_islands(const MotionPlanner &rhs) const
+{
+    if (m_islands.size() != rhs.m_islands.size())
+        return false;
+    for (size_t i = 0; i < m_islands.size(); ++ i) {
+        const ExPolygon &island     = m_islands[i].m_island;
+        const ExPolygon &island_rhs = rhs.m_islands[i].m_island;
+        if (island.contour.points != island_rhs.contour.points || island.holes.size() != island_rhs.holes.size())
+            return false;
+        for (size_t j = 0; j < island.holes.size(); ++ j)
+            if (island.holes[j].points != island_rhs.holes[j].points)
+                return false;
+    }
+    return true;
+}
+
+int MotionPlanner::find_island(const Point &pt) const
+{
+    for (auto it = m_islands_rtree.qbegin(boost::geometry::index::intersects(MotionPlannerRTreePoint(pt.x, pt.y))); it != m_islands_rtree.qend(); ++ it)
+        if (m_islands[it->second].m_island.contains(pt))
+            return int(it->second);
+    return -1;
 }
 
 void MotionPlanner::initialize()
@@ -61,24 +98,16 @@ Polyline MotionPlanner::shortest_path(const Point &from, const Point &to)
         return Line(from, to);
     
     // Are both points in the same island?
-    int island_idx_from = -1;
-    int island_idx_to   = -1;
+    int island_idx_from = this->find_island(from);
+    int island_idx_to   = this->find_island(to);
     int island_idx      = -1;
-    for (MotionPlannerEnv &island : m_islands) {
-        int idx = &island - m_islands.data();
-        if (island.island_contains(from))
-            island_idx_from = idx;
-        if (island.island_contains(to))
-            island_idx_to   = idx;
-        if (island_idx_from == idx && island_idx_to == idx) {
-            // Since both points are in the same island, is a direct move possible?
-            // If so, we avoid generating the visibility environment.
-            if (island.m_island.contains(Line(from, to)))
-                return Line(from, to);
-            // Both points are inside a single island, but the straight line crosses the island boundary.
-            island_idx = idx;
-            break;
-        }
+    if (island_idx_from != -1 && island_idx_from == island_idx_to) {
+        // Since both points are in the same island, is a direct move possible?
+        // If so, we avoid generating the visibility environment.
+        if (m_islands[island_idx_from].island_contains_line(from, to))
+            return Line(from, to);
+        // Both points are inside a single island, but the straight line crosses the island boundary.
+        island_idx = island_idx_from;
     }
     
     // lazy generation of configuration space.
@@ -86,12 +115,20 @@ Polyline MotionPlanner::shortest_path(const Point &from, const Point &to)
 
     // Get environment. If the from / to points do not share an island, then they cross an open space,
     // therefore island_idx == -1 and env will be set to the environment of the empty space.
-    const MotionPlannerEnv &env = this->get_env(island_idx);
+    MotionPlannerEnv &env = this->get_env(island_idx);
     if (env.m_env.expolygons.empty()) {
         // if this environment is empty (probably because it's too small), perform straight move
         // and avoid running the algorithms on empty dataset
         return Line(from, to);
     }
+
+    // Was this travel planned already, for example for another copy of the object?
+    auto it_route = m_routes_map.find(std::make_pair(from, to));
+    if (it_route != m_routes_map.end()) {
+        // Move the route to the front of the list as the most recently used one.
+        m_routes.splice(m_routes.begin(), m_routes, it_route->second);
+        return it_route->second->second;
+    }
     
     // Now check whether points are inside the environment.
     Point inner_from = from;
@@ -100,11 +137,6 @@ Polyline MotionPlanner::shortest_path(const Point &from, const Point &to)
     if (island_idx == -1) {
         // The end points do not share the same island. In that case some of the travel
         // will be likely performed inside the empty space.
-        // TODO: instead of using the nearest_env_point() logic, we should
-        // create a temporary graph where we connect 'from' and 'to' to the
-        // nodes which don't require more than one crossing, and let Dijkstra
-        // figure out the entire path - this should also replace the call to
-        // find_node() below
         if (island_idx_from != -1)
             // The start point is inside some island. Find the closest point at the empty space to start from.
             inner_from = env.nearest_env_point(from, to);
@@ -115,20 +147,28 @@ Polyline MotionPlanner::shortest_path(const Point &from, const Point &to)
 
     // Perform a path search either in the open space, or in a common island of from/to.
     const MotionPlannerGraph &graph = this->init_graph(island_idx);
+    if (graph.empty())
+        return Line(from, to);
+    // The end points are connected into the graph through the nodes visible from them without crossing the environment boundaries,
+    // the nodes are visible from the end points inside the common island, or from the points found at the empty space.
     // If no path exists without crossing perimeters, returns a straight segment.
-    Polyline polyline = graph.shortest_path(inner_from, inner_to);
-    polyline.points.insert(polyline.points.begin(), from);
-    polyline.points.emplace_back(to);
+    Polyline polyline = graph.shortest_path(inner_from, inner_to, 
+        [&env](const Point &pt, const Point &node) { return env.island_contains_line(pt, node); });
+    if (inner_from != from)
+        polyline.points.insert(polyline.points.begin(), from);
+    if (inner_to != to)
+        polyline.points.emplace_back(to);
     
     {
-        // grow our environment slightly in order for simplify_by_visibility()
-        // to work best by considering moves on boundaries valid as well
-        ExPolygonCollection grown_env(offset_ex(env.m_env.expolygons, float(+SCALED_EPSILON)));
-        
         if (island_idx == -1) {
+            // grow our environment slightly in order for simplify_by_visibility()
+            // to work best by considering moves on boundaries valid as well
+            if (env.m_env_grown.expolygons.empty())
+                env.m_env_grown = ExPolygonCollection(offset_ex(env.m_env.expolygons, float(+SCALED_EPSILON)));
+            const ExPolygonCollection &grown_env = env.m_env_grown;
             /*  If 'from' or 'to' are not inside our env, they were connected using the 
                 nearest_env_point() search which maybe produce ugly paths since it does not
-                include the endpoint in the Dijkstra search; the simplify_by_visibility() 
+                include the endpoint in the graph search; the simplify_by_visibility() 
                 call below will not work in many cases where the endpoint is not contained in
                 grown_env (whose contour was arbitrarily constructed with MP_OUTER_MARGIN,
                 which may not be enough for, say, including a skirt point). So we prune
@@ -174,7 +214,13 @@ Polyline MotionPlanner::shortest_path(const Point &from, const Point &to)
         svg.Close();
         */
     }
-    
+
+    if (m_routes.size() >= MAX_CACHED_ROUTES) {
+        m_routes_map.erase(m_routes.back().first);
+        m_routes.pop_back();
+    }
+    m_routes.emplace_front(std::make_pair(from, to), polyline);
+    m_routes_map.emplace(m_routes.front().first, m_routes.begin());
     return polyline;
 }
 
@@ -198,6 +244,13 @@ const MotionPlannerGraph& MotionPlanner::init_graph(int island_idx)
         const MotionPlannerEnv &env = this->get_env(island_idx);
         Lines lines = env.m_env.lines();
         boost::polygon::construct_voronoi(lines.begin(), lines.end(), &vd);
+        // Is the Voronoi vertex inside the island? A vertex is shared by several edges, therefore the result
+        // is cached in the color of the vertex: 0 - not tested yet, 1 - inside, 2 - outside.
+        auto vertex_inside = [&env](const VD::vertex_type *v, const Point &p) {
+            if (v->color() == 0)
+                v->color(env.island_contains_b(p) ? 1 : 2);
+            return v->color() == 1;
+        };
         // traverse the Voronoi diagram and generate graph nodes and edges
         for (const VD::edge_type &edge : vd.edges()) {
             if (edge.is_infinite())
@@ -208,7 +261,7 @@ const MotionPlannerGraph& MotionPlanner::init_graph(int island_idx)
             Point p1(v1->x(), v1->y());
             // Insert only Voronoi edges fully contained in the island.
             //FIXME This test has a terrible O(n^2) time complexity.
-            if (env.island_contains_b(p0) && env.island_contains_b(p1)) {
+            if (vertex_inside(v0, p0) && vertex_inside(v1, p1)) {
                 // Find v0 in the graph, allocate a new node if v0 does not exist in the graph yet.
                 auto i_v0 = vd_vertices.find(v0);
                 size_t v0_idx;
@@ -227,11 +280,28 @@ const MotionPlannerGraph& MotionPlanner::init_graph(int island_idx)
                 graph->add_edge(v0_idx, v1_idx, p0.distance_to(p1));
             }
         }
+        graph->build_index();
     }
 
     return *graph;
 }
 
+bool MotionPlannerEnv::island_contains_line(const Point &from, const Point &to)
+{
+    if (! m_island_grid) {
+        // Resolution of the grid for roughly a single edge per cell.
+        size_t num_edges = m_island.contour.points.size();
+        for (const Polygon &hole : m_island.holes)
+            num_edges += hole.points.size();
+        Point  size = m_island_bbox.size();
+        coord_t resolution = std::max<coord_t>(coord_t(scale_(0.1)), coord_t(std::sqrt(double(size.x) * double(size.y) / double(std::max<size_t>(num_edges, 1)))));
+        m_island_grid.reset(new EdgeGrid::Grid());
+        m_island_grid->create(m_island, resolution);
+    }
+    // Both points are inside the island. If the line does not cross the island boundary, the line is inside the island.
+    return ! m_island_grid->intersect(from, to);
+}
+
 // Find a middle point on the path from start_point to end_point with the shortest path.
 static inline size_t nearest_waypoint_index(const Point &start_point, const Points &middle_points, const Point &end_point)
 {
@@ -304,57 +374,125 @@ void MotionPlannerGraph::add_edge(size_t from, size_t to, double weight)
     m_adjacency_list[from].emplace_back(Neighbor(node_t(to), weight));
 }
 
-// Dijkstra's shortest path in a weighted graph from node_start to node_end.
-// The returned path contains the end points.
-// If no path exists from node_start to node_end, a straight segment is returned.
-Polyline MotionPlannerGraph::shortest_path(size_t node_start, size_t node_end) const
+void MotionPlannerGraph::build_index()
 {
-    // This prevents a crash in case for some reason we got here with an empty adjacency list.
-    if (this->empty())
-        return Polyline();
+    std::vector<RTreeNode> nodes;
+    nodes.reserve(m_nodes.size());
+    for (const Point &pt : m_nodes)
+        nodes.emplace_back(MotionPlannerRTreePoint(pt.x, pt.y), &pt - m_nodes.data());
+    // Bulk loading creates a better balanced tree than inserting the nodes one by one.
+    m_nodes_rtree = decltype(m_nodes_rtree)(nodes);
+}
 
-    // Dijkstra algorithm, previous node of the current node 'u' in the shortest path towards node_start.
-    std::vector<node_t>   previous(m_adjacency_list.size(), -1);
-    std::vector<weight_t> distance(m_adjacency_list.size(), std::numeric_limits<weight_t>::infinity());
-    std::vector<size_t>   map_node_to_queue_id(m_adjacency_list.size(), size_t(-1));
-    distance[node_start] = 0.;
+size_t MotionPlannerGraph::find_closest_node(const Point &point) const
+{
+    if (m_nodes_rtree.size() != m_nodes.size())
+        // The index was not built or it is not up to date.
+        return point.nearest_point_index(m_nodes);
+    std::vector<RTreeNode> closest;
+    m_nodes_rtree.query(boost::geometry::index::nearest(MotionPlannerRTreePoint(point.x, point.y), 1), std::back_inserter(closest));
+    return closest.empty() ? size_t(-1) : closest.front().second;
+}
+
+// Temporary edges connecting a point to its closest nodes, see MotionPlannerGraph::shortest_path().
+std::vector<MotionPlannerGraph::Neighbor> MotionPlannerGraph::connect_point(const Point &pt, const std::function<bool(const Point&, const Point&)> &connectable) const
+{
+    std::vector<Neighbor> edges;
+    std::vector<RTreeNode> closest;
+    if (m_nodes_rtree.size() == m_nodes.size())
+        m_nodes_rtree.query(boost::geometry::index::nearest(MotionPlannerRTreePoint(pt.x, pt.y), MAX_ENDPOINT_CONNECTIONS), std::back_inserter(closest));
+    for (const RTreeNode &node : closest)
+        if (connectable(pt, m_nodes[node.second]))
+            edges.emplace_back(node_t(node.second), pt.distance_to(m_nodes[node.second]));
+    if (edges.empty()) {
+        // No node is visible from pt, connect pt to the closest node.
+        size_t idx = this->find_closest_node(pt);
+        if (idx != size_t(-1))
+            edges.emplace_back(node_t(idx), pt.distance_to(m_nodes[idx]));
+    }
+    return edges;
+}
+
+// A* shortest path in a weighted graph from the point from to the point to, connected into the graph by temporary edges.
+// As the weights of the edges are their Euclidean lengths, the Euclidean distance to the end point is a consistent heuristic,
+// therefore a node is never visited twice and the search stops once the end point is reached.
+Polyline MotionPlannerGraph::shortest_path(const Point &from, const Point &to, const std::function<bool(const Point&, const Point&)> &connectable) const
+{
+    // The temporary nodes of the end points follow the nodes of the graph.
+    const node_t num_nodes  = node_t(m_nodes.size());
+    const node_t node_start = num_nodes;
+    const node_t node_end   = num_nodes + 1;
+    std::vector<Neighbor> edges_start = this->connect_point(from, connectable);
+    std::vector<Neighbor> edges_end   = this->connect_point(to,   connectable);
+    // Weight of the temporary edge from a graph node to the end point.
+    std::vector<std::pair<node_t, weight_t>> weights_to_end;
+    for (const Neighbor &edge : edges_end)
+        weights_to_end.emplace_back(edge.target, edge.weight);
+    std::sort(weights_to_end.begin(), weights_to_end.end());
+    auto position = [this, &from, &to, node_start, node_end](node_t node) -> const Point& 
+        { return (node == node_start) ? from : (node == node_end) ? to : m_nodes[node]; };
+
+    // Previous node of the current node 'u' in the shortest path towards node_start.
+    std::vector<node_t>   previous(num_nodes + 2, -1);
+    // Length of the shortest path from node_start found so far.
+    std::vector<weight_t> distance(num_nodes + 2, std::numeric_limits<weight_t>::infinity());
+    // distance + the estimate of the remaining distance to node_end.
+    std::vector<weight_t> estimate(num_nodes + 2, std::numeric_limits<weight_t>::infinity());
+    std::vector<size_t>   map_node_to_queue_id(num_nodes + 2, size_t(-1));
+    std::vector<char>     visited(num_nodes + 2, false);
 
     auto queue = make_mutable_priority_queue<node_t>(
         [&map_node_to_queue_id](const node_t node, size_t idx) { map_node_to_queue_id[node] = idx; },
-        [&distance](const node_t node1, const node_t node2) { return distance[node1] < distance[node2]; });
-    queue.reserve(m_adjacency_list.size());
-    for (size_t i = 0; i < m_adjacency_list.size(); ++ i)
-        queue.push(node_t(i));
+        [&estimate](const node_t node1, const node_t node2) { return estimate[node1] < estimate[node2]; });
+    auto relax = [&](node_t u, node_t v, weight_t weight) {
+        weight_t alt = distance[u] + weight;
+        // If total distance through u is shorter than the previous
+        // distance (if any) between node_start and v, replace it.
+        if (! visited[v] && alt < distance[v]) {
+            distance[v] = alt;
+            estimate[v] = alt + position(v).distance_to(to);
+            previous[v] = u;
+            if (map_node_to_queue_id[v] == size_t(-1))
+                queue.push(v);
+            else
+                queue.update(map_node_to_queue_id[v]);
+        }
+    };
 
+    distance[node_start] = 0.;
+    estimate[node_start] = from.distance_to(to);
+    queue.push(node_start);
     while (! queue.empty()) {
-        // Get the next node with the lowest distance to node_start.
+        // Get the next node with the lowest estimate of the path length through it.
         node_t u = node_t(queue.top());
         queue.pop();
         map_node_to_queue_id[u] = size_t(-1);
+        visited[u] = true;
         // Stop searching if we reached our destination.
         if (u == node_end)
             break;
+        if (u == node_start) {
+            for (const Neighbor &edge : edges_start)
+                relax(u, edge.target, edge.weight);
+            continue;
+        }
         // Visit each edge starting at node u.
-        for (const Neighbor& neighbor : m_adjacency_list[u])
-            if (map_node_to_queue_id[neighbor.target] != size_t(-1)) {
-                weight_t alt = distance[u] + neighbor.weight;
-                // If total distance through u is shorter than the previous
-                // distance (if any) between node_start and neighbor.target, replace it.
-                if (alt < distance[neighbor.target]) {
-                    distance[neighbor.target] = alt;
-                    previous[neighbor.target] = u;
-                    queue.update(map_node_to_queue_id[neighbor.target]);
-                }
-            }
+        if (size_t(u) < m_adjacency_list.size())
+            for (const Neighbor& neighbor : m_adjacency_list[u])
+                relax(u, neighbor.target, neighbor.weight);
+        auto it_end = std::lower_bound(weights_to_end.begin(), weights_to_end.end(), std::make_pair(u, weight_t(0)), 
+            [](const std::pair<node_t, weight_t> &l, const std::pair<node_t, weight_t> &r) { return l.first < r.first; });
+        if (it_end != weights_to_end.end() && it_end->first == u)
+            relax(u, node_end, it_end->second);
     }
 
     // In case the end point was not reached, previous[node_end] contains -1
     // and a straight line from node_start to node_end is returned.
     Polyline polyline;
-    polyline.points.reserve(m_adjacency_list.size());
-    for (node_t vertex = node_t(node_end); vertex != -1; vertex = previous[vertex])
-        polyline.points.emplace_back(m_nodes[vertex]);
-    polyline.points.emplace_back(m_nodes[node_start]);
+    for (node_t vertex = node_end; vertex != -1; vertex = previous[vertex])
+        polyline.points.emplace_back(position(vertex));
+    if (polyline.points.size() == 1)
+        polyline.points.emplace_back(from);
     polyline.reverse();
     return polyline;
 }
@@ -4,13 +4,20 @@
 #include "libslic3r.h"
 #include "BoundingBox.hpp"
 #include "ClipperUtils.hpp"
+#include "EdgeGrid.hpp"
 #include "ExPolygonCollection.hpp"
 #include "Polyline.hpp"
+#include <functional>
+#include <list>
 #include <map>
 #include <utility>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
 #define MP_INNER_MARGIN scale_(1.0)
 #define MP_OUTER_MARGIN scale_(2.0)
 
@@ -18,6 +25,10 @@ namespace Slic3r {
 
 class MotionPlanner;
 
+// Spatial indices of the islands and of the graph nodes.
+typedef boost::geometry::model::point<double, 2, boost::geometry::cs::cartesian>  MotionPlannerRTreePoint;
+typedef boost::geometry::model::box<MotionPlannerRTreePoint>                       MotionPlannerRTreeBox;
+
 class MotionPlannerEnv
 {
     friend class MotionPlanner;
@@ -30,27 +41,39 @@ public:
         { return m_island_bbox.contains(pt) && m_island.contains(pt); }
     bool  island_contains_b(const Point &pt) const
         { return m_island_bbox.contains(pt) && m_island.contains_b(pt); }
+    // Does a straight line between two points of the island stay inside the island?
+    // A line touching the island boundary is considered to leave the island.
+    bool  island_contains_line(const Point &from, const Point &to);
 
 private:
     ExPolygon           m_island;
     BoundingBox         m_island_bbox;
     // Region, where the travel is allowed.
     ExPolygonCollection m_env;
+    // m_env grown by SCALED_EPSILON, created on demand by MotionPlanner::shortest_path().
+    ExPolygonCollection m_env_grown;
+    // Edges of m_island for the visibility test, created on demand. It references m_island,
+    // therefore it is only created after the MotionPlannerEnv is stored at its final place.
+    std::unique_ptr<EdgeGrid::Grid> m_island_grid;
 };
 
-// A 2D directed graph for searching a shortest path using the famous Dijkstra algorithm.
+// A 2D directed graph for searching a shortest path using the A* algorithm with the Euclidean distance heuristic.
 class MotionPlannerGraph
 {    
 public:
     // Add a directed edge into the graph.
     size_t   add_node(const Point &p) { m_nodes.emplace_back(p); return m_nodes.size() - 1; }
     void     add_edge(size_t from, size_t to, double weight);
-    size_t   find_closest_node(const Point &point) const { return point.nearest_point_index(m_nodes); }
+    // Build a spatial index of the nodes for find_closest_node(), to be called once the graph is complete.
+    void     build_index();
+    size_t   find_closest_node(const Point &point) const;
 
     bool     empty() const { return m_adjacency_list.empty(); }
-    Polyline shortest_path(size_t from, size_t to) const;
-    Polyline shortest_path(const Point &from, const Point &to) const
-        { return this->shortest_path(this->find_closest_node(from), this->find_closest_node(to)); }
+    // Shortest path between two points, which are not nodes of the graph. Each point is connected into the graph
+    // by temporary edges to those of its closest nodes, for which connectable(point, node_position) returns true.
+    // A point not connectable to any of its closest nodes is connected to the closest node.
+    // The returned path starts with from and ends with to. If no path exists, a straight segment is returned.
+    Polyline shortest_path(const Point &from, const Point &to, const std::function<bool(const Point&, const Point&)> &connectable) const;
 
 private:
     typedef int     node_t;
@@ -60,8 +83,13 @@ private:
         node_t   target;
         weight_t weight;
     };
+    // Number of the closest nodes tested for the temporary edges of an end point.
+    static const size_t MAX_ENDPOINT_CONNECTIONS = 8;
+    std::vector<Neighbor> connect_point(const Point &pt, const std::function<bool(const Point&, const Point&)> &connectable) const;
+    typedef std::pair<MotionPlannerRTreePoint, size_t> RTreeNode;
     Points                              m_nodes;
     std::vector<std::vector<Neighbor>>  m_adjacency_list;
+    boost::geometry::index::rtree<RTreeNode, boost::geometry::index::rstar<16>> m_nodes_rtree;
 };
 
 class MotionPlanner
@@ -72,18 +100,44 @@ public:
 
     Polyline    shortest_path(const Point &from, const Point &to);
     size_t      islands_count() const { return m_islands.size(); }
+    // Are the islands of the two planners equal? Then the planner of the previous layer with its graphs
+    // may be used instead of this planner.
+    bool        same_islands(const MotionPlanner &rhs) const;
 
 private:
+    typedef std::pair<MotionPlannerRTreeBox, size_t> RTreeIsland;
+    struct RouteHash {
+        size_t operator()(const std::pair<Point, Point> &route) const {
+            return std::hash<int64_t>()((int64_t(route.first.x) << 32) ^ int64_t(uint32_t(route.first.y))) * 31 +
+                   std::hash<int64_t>()((int64_t(route.second.x) << 32) ^ int64_t(uint32_t(route.second.y)));
+        }
+    };
+    // Maximum number of the travels kept by m_routes.
+    static const size_t MAX_CACHED_ROUTES = 1024;
+
     bool                                m_initialized;
     std::vector<MotionPlannerEnv>       m_islands;
+    // Bounding boxes of m_islands.
+    boost::geometry::index::rtree<RTreeIsland, boost::geometry::index::rstar<16>> m_islands_rtree;
     MotionPlannerEnv                    m_outer;
     // 0th graph is the graph for m_outer. Other graphs are 1 indexed.
     std::vector<std::unique_ptr<MotionPlannerGraph>> m_graphs;
+    // Travels planned through the graphs. The planner of a layer plans the same travels for all the copies of an object,
+    // as the travels are planned in the coordinate system of the object.
+    // The routes are kept in the order of their last use, the least recently used route is evicted first,
+    // so that the travels of a layer revisited by the copies are not flushed together with the stale ones.
+    typedef std::list<std::pair<std::pair<Point, Point>, Polyline>> RouteList;
+    RouteList                           m_routes;
+    std::unordered_map<std::pair<Point, Point>, RouteList::iterator, RouteHash> m_routes_map;
     
     void                      initialize();
+    // Index of the island containing the point, -1 if the point is outside all the islands.
+    int                       find_island(const Point &pt) const;
     const MotionPlannerGraph& init_graph(int island_idx);
     const MotionPlannerEnv&   get_env(int island_idx) const
         { return (island_idx == -1) ? m_outer : m_islands[island_idx]; }
+    MotionPlannerEnv&         get_env(int island_idx)
+        { return (island_idx == -1) ? m_outer : m_islands[island_idx]; }
 };
 
 }
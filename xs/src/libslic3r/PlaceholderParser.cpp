@@ -4,6 +4,7 @@
 #include <iomanip>
 #include <sstream>
 #include <map>
+#include <mutex>
 #ifdef _MSC_VER
     #include <stdlib.h>  // provides **_environ
 #else
@@ -62,7 +63,7 @@
 
 namespace Slic3r {
 
-PlaceholderParser::PlaceholderParser()
+PlaceholderParser::PlaceholderParser() : m_templates(std::make_shared<TemplateCache>())
 {
     this->set("version", std::string(SLIC3R_VERSION));
     this->apply_env_variables();
@@ -1192,13 +1193,309 @@ static std::string process_macro(const std::string &templ, client::MyContext &co
     return output;
 }
 
+// Maximum number of compiled templates cached by a PlaceholderParser. There are just a few custom G-code templates
+// in a print, the limit only keeps the cache from growing without bounds if the templates are generated on the fly.
+static const size_t MAX_COMPILED_TEMPLATES = 256;
+
+// A template split into the items of its top level text block. The free-form text and the variable references
+// are resolved when the template is compiled, only the other macros are parsed by the macro_processor
+// each time the template is evaluated.
+class PlaceholderTemplate
+{
+public:
+    explicit PlaceholderTemplate(const std::string &templ);
+
+    // Throws std::runtime_error on a runtime error. The error message does not point to the right position
+    // in the template, the complete template has to be processed by process_macro() to report the error.
+    std::string evaluate(client::MyContext &context) const;
+
+private:
+    enum ItemType {
+        // Free-form text copied to the output.
+        itText,
+        // Legacy [variable] or [vector_variable_index].
+        itLegacyVariable,
+        // Legacy [vector_variable[index_variable]].
+        itLegacyVectorVariable,
+        // {variable}
+        itVariable,
+        // {vector_variable[index]} with a constant index.
+        itVectorVariable,
+        // Any other macro, parsed by the macro_processor.
+        itMacro,
+    };
+
+    struct Item {
+        Item(ItemType type, const std::string &text) : type(type), text(text), index(0) {}
+        ItemType    type;
+        // Free-form text of itText, source of itMacro, variable name otherwise.
+        std::string text;
+        // Name of the index variable of itLegacyVectorVariable.
+        std::string index_variable;
+        // Index of itVectorVariable.
+        int         index;
+    };
+
+    bool parse_legacy_variable(const std::string &templ, size_t &pos);
+    bool parse_variable(const std::string &templ, size_t &pos);
+
+    std::vector<Item> m_items;
+};
+
+// White space skipped by the spirit::ascii::space_type skipper.
+static inline bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+static inline size_t skip_spaces(const std::string &templ, size_t pos)
+{
+    while (pos < templ.size() && is_space(templ[pos]))
+        ++ pos;
+    return pos;
+}
+
+// Returns the end of an identifier starting at pos, or pos if there is no identifier or if the identifier is a keyword.
+static size_t parse_identifier(const std::string &templ, size_t pos)
+{
+    static const char *keywords[] = { "and", "if", "else", "elsif", "endif", "false", "min", "max", "not", "or", "true" };
+    auto is_alpha = [](char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'; };
+    if (pos == templ.size() || ! is_alpha(templ[pos]))
+        return pos;
+    size_t end = pos + 1;
+    while (end < templ.size() && (is_alpha(templ[end]) || (templ[end] >= '0' && templ[end] <= '9')))
+        ++ end;
+    for (const char *keyword : keywords)
+        if (templ.compare(pos, end - pos, keyword) == 0)
+            return pos;
+    return end;
+}
+
+// Validate the UTF-8 sequence the same way the utf8_char_skipper_parser does.
+static bool valid_utf8(const std::string &templ, size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end;) {
+        unsigned char c = static_cast<unsigned char>(templ[i ++]);
+        if ((c & 0xC0) == 0x80)
+            return false;
+        unsigned int cnt = 0;
+        for (unsigned char mask = 0x80u; c & mask; mask >>= 1)
+            ++ cnt;
+        cnt = (cnt == 0) ? 1 : ((cnt > 4) ? 4 : cnt);
+        for (-- cnt; cnt > 0; -- cnt) {
+            if (i == end)
+                return false;
+            c = static_cast<unsigned char>(templ[i ++]);
+            if (cnt > 1 && (c & 0xC0) != 0x80)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Returns the end of a macro starting with '{' at pos including the nested {if}..{endif} blocks, or std::string::npos
+// if the end could not be found. The macros containing string literals or regular expressions are not searched,
+// as these may contain braces.
+static size_t find_macro_end(const std::string &templ, size_t pos)
+{
+    int depth = 0;
+    for (;;) {
+        // pos points to '{'.
+        size_t begin = skip_spaces(templ, pos + 1);
+        size_t end   = begin;
+        while (end < templ.size() && (isalnum((unsigned char)templ[end]) || templ[end] == '_'))
+            ++ end;
+        if (templ.compare(begin, end - begin, "if") == 0)
+            ++ depth;
+        else if (templ.compare(begin, end - begin, "endif") == 0)
+            -- depth;
+        for (pos = end; pos < templ.size() && templ[pos] != '}'; ++ pos)
+            if (templ[pos] == '"' || templ[pos] == '/' || templ[pos] == '{')
+                return std::string::npos;
+        if (pos == templ.size() || depth < 0)
+            return std::string::npos;
+        if (depth == 0)
+            return pos + 1;
+        // Skip the text block of the {if}, {elsif} or {else}.
+        pos = templ.find('{', pos + 1);
+        if (pos == std::string::npos)
+            return std::string::npos;
+    }
+}
+
+PlaceholderTemplate::PlaceholderTemplate(const std::string &templ)
+{
+    // The leading white space is skipped by the macro_processor.
+    size_t pos = skip_spaces(templ, 0);
+    while (pos < templ.size()) {
+        size_t next = templ.find_first_of("[{", pos);
+        if (next != pos) {
+            if (next == std::string::npos)
+                next = templ.size();
+            if (! valid_utf8(templ, pos, next))
+                break;
+            m_items.emplace_back(itText, templ.substr(pos, next - pos));
+            pos = next;
+        } else if (templ[pos] == '[') {
+            if (! this->parse_legacy_variable(templ, pos))
+                break;
+        } else if (! this->parse_variable(templ, pos)) {
+            size_t end = find_macro_end(templ, pos);
+            if (end == std::string::npos)
+                break;
+            m_items.emplace_back(itMacro, templ.substr(pos, end - pos));
+            pos = end;
+        }
+    }
+    if (pos < templ.size())
+        // Leave the rest of the template to the macro_processor.
+        m_items.emplace_back(itMacro, templ.substr(pos));
+}
+
+// Parse [variable] or [vector_variable[index_variable]] at pos, advance pos behind the closing bracket.
+bool PlaceholderTemplate::parse_legacy_variable(const std::string &templ, size_t &pos)
+{
+    size_t begin = skip_spaces(templ, pos + 1);
+    size_t end   = parse_identifier(templ, begin);
+    if (end == begin)
+        return false;
+    size_t i = skip_spaces(templ, end);
+    if (i < templ.size() && templ[i] == ']') {
+        m_items.emplace_back(itLegacyVariable, templ.substr(begin, end - begin));
+        pos = i + 1;
+        return true;
+    }
+    if (i == templ.size() || templ[i] != '[')
+        return false;
+    size_t index_begin = skip_spaces(templ, i + 1);
+    size_t index_end   = parse_identifier(templ, index_begin);
+    if (index_end == index_begin)
+        return false;
+    i = skip_spaces(templ, index_end);
+    if (i == templ.size() || templ[i] != ']')
+        return false;
+    i = skip_spaces(templ, i + 1);
+    if (i == templ.size() || templ[i] != ']')
+        return false;
+    m_items.emplace_back(itLegacyVectorVariable, templ.substr(begin, end - begin));
+    m_items.back().index_variable = templ.substr(index_begin, index_end - index_begin);
+    pos = i + 1;
+    return true;
+}
+
+// Parse {variable} or {vector_variable[index]} at pos, advance pos behind the closing brace.
+bool PlaceholderTemplate::parse_variable(const std::string &templ, size_t &pos)
+{
+    size_t begin = skip_spaces(templ, pos + 1);
+    size_t end   = parse_identifier(templ, begin);
+    if (end == begin)
+        return false;
+    size_t i = skip_spaces(templ, end);
+    if (i < templ.size() && templ[i] == '}') {
+        m_items.emplace_back(itVariable, templ.substr(begin, end - begin));
+        pos = i + 1;
+        return true;
+    }
+    if (i == templ.size() || templ[i] != '[')
+        return false;
+    size_t index_begin = skip_spaces(templ, i + 1);
+    size_t index_end   = index_begin;
+    while (index_end < templ.size() && templ[index_end] >= '0' && templ[index_end] <= '9')
+        ++ index_end;
+    // Up to 9 digits always fit an int.
+    if (index_end == index_begin || index_end - index_begin > 9)
+        return false;
+    i = skip_spaces(templ, index_end);
+    if (i == templ.size() || templ[i] != ']')
+        return false;
+    i = skip_spaces(templ, i + 1);
+    if (i == templ.size() || templ[i] != '}')
+        return false;
+    m_items.emplace_back(itVectorVariable, templ.substr(begin, end - begin));
+    m_items.back().index = atoi(templ.c_str() + index_begin);
+    pos = i + 1;
+    return true;
+}
+
+std::string PlaceholderTemplate::evaluate(client::MyContext &context) const
+{
+    typedef std::string::const_iterator Iterator;
+    std::string output;
+    std::string value;
+    for (const Item &item : m_items) {
+        boost::iterator_range<Iterator> name(item.text.begin(), item.text.end());
+        switch (item.type) {
+        case itText:
+            output += item.text;
+            break;
+        case itLegacyVariable:
+            client::MyContext::legacy_variable_expansion<Iterator>(&context, name, value);
+            output += value;
+            break;
+        case itLegacyVectorVariable:
+        {
+            boost::iterator_range<Iterator> index_name(item.index_variable.begin(), item.index_variable.end());
+            client::MyContext::legacy_variable_expansion2<Iterator>(&context, name, index_name, value);
+            output += value;
+            break;
+        }
+        case itVariable:
+        case itVectorVariable:
+        {
+            client::OptWithPos<Iterator> opt;
+            client::expr<Iterator>       expr;
+            client::MyContext::resolve_variable<Iterator>(&context, name, opt);
+            if (item.type == itVariable)
+                client::MyContext::scalar_variable_reference<Iterator>(&context, opt, expr);
+            else {
+                int index = item.index;
+                client::MyContext::vector_variable_reference<Iterator>(&context, opt, index, name.end(), expr);
+            }
+            output += expr.to_string();
+            break;
+        }
+        case itMacro:
+            output += process_macro(item.text, context);
+            break;
+        }
+    }
+    return output;
+}
+
+struct PlaceholderParser::TemplateCache
+{
+    std::mutex                                                         mutex;
+    std::map<std::string, std::shared_ptr<const PlaceholderTemplate>>  templates;
+};
+
+std::shared_ptr<const PlaceholderTemplate> PlaceholderParser::compiled_template(const std::string &templ) const
+{
+    std::lock_guard<std::mutex> lock(m_templates->mutex);
+    auto &templates = m_templates->templates;
+    auto  it        = templates.find(templ);
+    if (it == templates.end()) {
+        // The templates being evaluated by other threads are kept alive by their shared pointers.
+        if (templates.size() >= MAX_COMPILED_TEMPLATES)
+            templates.clear();
+        it = templates.emplace(templ, std::make_shared<const PlaceholderTemplate>(templ)).first;
+    }
+    return it->second;
+}
+
 std::string PlaceholderParser::process(const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override) const
 {
     client::MyContext context;
     context.config              = &this->config();
     context.config_override     = config_override;
     context.current_extruder_id = current_extruder_id;
-    return process_macro(templ, context);
+    try {
+        return this->compiled_template(templ)->evaluate(context);
+    } catch (std::runtime_error &) {
+        // The items of the compiled template were evaluated out of the context of the complete template.
+        // Process the complete template to report the error at the right line and column.
+        context.error_message.clear();
+        return process_macro(templ, context);
+    }
 }
 
 // Evaluate a boolean expression using the full expressive power of the PlaceholderParser boolean expression syntax.
@@ -3,12 +3,16 @@
 
 #include "libslic3r.h"
 #include <map>
+#include <memory>
 #include <string>
 #include <vector>
 #include "PrintConfig.hpp"
 
 namespace Slic3r {
 
+// Template split into the items of its top level text block, see PlaceholderParser::process().
+class PlaceholderTemplate;
+
 class PlaceholderParser
 {
 public:    
@@ -30,6 +34,8 @@ public:
     const ConfigOption*     option(const std::string &key) const { return m_config.option(key); }
 
     // Fill in the template using a macro processing language.
+    // The template is compiled on its first use and the compiled template is cached, so that the per layer custom G-code
+    // is not parsed again for each layer. The variables are looked up in config_override first, then in m_config.
     // Throws std::runtime_error on syntax or runtime error.
     std::string process(const std::string &templ, unsigned int current_extruder_id, const DynamicConfig *config_override = nullptr) const;
     
@@ -38,7 +44,14 @@ public:
     static bool evaluate_boolean_expression(const std::string &templ, const DynamicConfig &config, const DynamicConfig *config_override = nullptr);
 
 private:
+    // Thread safe.
+    std::shared_ptr<const PlaceholderTemplate> compiled_template(const std::string &templ) const;
+
     DynamicConfig m_config;
+    // Compiled templates indexed by their source, guarded by a mutex, as process() may be called from multiple threads.
+    // The compiled templates do not refer to m_config, therefore the cache is shared by the copies of this PlaceholderParser.
+    struct TemplateCache;
+    std::shared_ptr<TemplateCache> m_templates;
 };
 
 }
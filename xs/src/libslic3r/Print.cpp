@@ -39,13 +39,15 @@ void Print::delete_object(size_t idx)
     // TODO: purge unused regions
 }
 
-void Print::reload_object(size_t /* idx */)
+void Print::reload_object(size_t idx)
 {
     /* TODO: this method should check whether the per-object config and per-material configs
         have changed in such a way that regions need to be rearranged or we can just apply
         the diff and invalidate something.  Same logic as apply_config()
-        For now we just re-add all objects since we haven't implemented this incremental logic yet.
-        This should also check whether object volumes (parts) have changed. */
+        For now we just re-add all objects since we haven't implemented this incremental logic yet,
+        unless only the meshes of the modifier volumes have changed. */
+    if (idx < this->objects.size() && this->reload_modified_modifiers(*this->objects[idx]))
+        return;
     
     // collect all current model objects
     ModelObjectPtrs model_objects;
@@ -59,6 +61,39 @@ void Print::reload_object(size_t /* idx */)
         this->add_model_object(mo);
 }
 
+// If only the meshes of the modifier volumes of an object were modified (a modifier was moved or scaled),
+// the object is kept and only its slicing is invalidated, so the unmodified volumes are not sliced again.
+// Returns false if anything else has changed, so the object has to be added again.
+bool Print::reload_modified_modifiers(PrintObject &object)
+{
+    const ModelObject &model_object = *object.model_object();
+    // The volumes must be assigned to the same regions.
+    size_t num_volumes = 0;
+    for (size_t region_id = 0; region_id < object.region_volumes.size(); ++ region_id)
+        for (int volume_id : object.region_volumes[region_id]) {
+            if (volume_id >= int(model_object.volumes.size()) || region_id >= this->regions.size() ||
+                ! this->_region_config_from_model_volume(*model_object.volumes[volume_id]).equals(this->regions[region_id]->config))
+                return false;
+            ++ num_volumes;
+        }
+    if (num_volumes != model_object.volumes.size())
+        return false;
+    // The layer height ranges and the layer height profile are copied to the object by its constructor only.
+    if (object.layer_height_ranges != model_object.layer_height_ranges ||
+        (model_object.layer_height_profile_valid && object.layer_height_profile != model_object.layer_height_profile))
+        return false;
+    // The object config and the object bounding box must not change.
+    PrintObjectConfig new_config = this->default_object_config;
+    normalize_and_apply_config(new_config, model_object.config);
+    if (! object.config.diff(new_config).empty())
+        return false;
+    BoundingBoxf3 bbox = model_object.raw_bounding_box();
+    if (! (object._copies_shift == Point::new_scale(bbox.min.x, bbox.min.y)) || 
+        ! (object.size == Point3::new_scale(bbox.size().x, bbox.size().y, bbox.size().z)))
+        return false;
+    return object.invalidate_modified_modifiers();
+}
+
 // Reloads the model instances into the print class.
 // The slicing shall not be running as the modified model instances at the print
 // are used for the brim & skirt calculation.
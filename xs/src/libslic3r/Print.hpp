@@ -2,6 +2,8 @@
 #define slic3r_Print_hpp_
 
 #include "libslic3r.h"
+#include <limits>
+#include <map>
 #include <set>
 #include <vector>
 #include <string>
@@ -12,6 +14,7 @@
 #include "Layer.hpp"
 #include "Model.hpp"
 #include "PlaceholderParser.hpp"
+#include "SliceCache.hpp"
 #include "Slicing.hpp"
 #include "GCode/ToolOrdering.hpp"
 #include "GCode/WipeTower.hpp"
@@ -92,6 +95,40 @@ private:
 
 typedef std::vector<Layer*> LayerPtrs;
 typedef std::vector<SupportLayer*> SupportLayerPtrs;
+
+// Range [first, last) of the indices of the layers of a PrintObject to be recalculated by a PrintObjectStep.
+struct LayerRange
+{
+    LayerRange() : first(0), last(0) {}
+    LayerRange(size_t first, size_t last) : first(first), last(last) {}
+    static LayerRange all() { return LayerRange(0, std::numeric_limits<size_t>::max()); }
+
+    bool empty() const { return this->first >= this->last; }
+    bool contains(size_t idx) const { return idx >= this->first && idx < this->last; }
+    bool covers(size_t num_layers) const { return this->first == 0 && this->last >= num_layers; }
+    void merge(const LayerRange &other) {
+        if (this->empty())
+            *this = other;
+        else if (! other.empty()) {
+            this->first = std::min(this->first, other.first);
+            this->last  = std::max(this->last,  other.last);
+        }
+    }
+    LayerRange clamped(size_t num_layers) const
+        { return LayerRange(std::min(this->first, num_layers), std::min(this->last, num_layers)); }
+    // Extended by num_around layers below and above, clamped to num_layers.
+    LayerRange extended(size_t num_around, size_t num_layers) const {
+        LayerRange out = this->clamped(num_layers);
+        if (! out.empty()) {
+            out.first = (out.first > num_around) ? out.first - num_around : 0;
+            out.last  = (num_layers - out.last > num_around) ? out.last + num_around : num_layers;
+        }
+        return out;
+    }
+
+    size_t first;
+    size_t last;
+};
 class BoundingBoxf3;        // TODO: for temporary constructor parameter
 
 class PrintObject
@@ -169,11 +206,23 @@ public:
     SupportLayer* get_support_layer(int idx) { return this->support_layers.at(idx); }
     SupportLayer* add_support_layer(int id, coordf_t height, coordf_t print_z);
     void delete_support_layer(int idx);
+
+    // Checkpoint of the processed layers and support layers, see LayerStream.hpp.
+    // Throws std::runtime_error on failure.
+    void save_layers(const std::string &path) const;
+    // Replace the layers with the layers saved by save_layers() and mark all the object steps as done.
+    // The layers are only loaded if they were saved for the same object meshes, layer heights and configuration.
+    // On failure the layers are cleared, all the object steps are invalidated and std::runtime_error is thrown.
+    void load_layers(const std::string &path);
     
     // methods for handling state
     bool invalidate_state_by_config_options(const std::vector<t_config_option_key> &opt_keys);
     bool invalidate_step(PrintObjectStep step);
-    bool invalidate_all_steps() { return this->state.invalidate_all(); }
+    bool invalidate_all_steps();
+    // Invalidate the slicing if only the meshes of the modifier volumes were modified. The slices of the other volumes
+    // are reused from the per-volume slice cache. Returns false if a non-modifier volume was modified or if the object
+    // was not sliced yet.
+    bool invalidate_modified_modifiers();
 
     // To be used over the layer_height_profile of both the PrintObject and ModelObject
     // to initialize the height profile with the height ranges.
@@ -198,14 +247,15 @@ public:
     void _simplify_slices(double distance);
     void _prepare_infill();
     bool has_support_material() const;
-    void detect_surfaces_type();
-    void process_external_surfaces();
-    void discover_vertical_shells();
-    void bridge_over_infill();
+    // The passes of _prepare_infill() process the layers of layer_range only, see _prepare_infill().
+    void detect_surfaces_type(const LayerRange &layer_range = LayerRange::all());
+    void process_external_surfaces(const LayerRange &layer_range = LayerRange::all());
+    void discover_vertical_shells(const LayerRange &layer_range = LayerRange::all());
+    void bridge_over_infill(const LayerRange &layer_range = LayerRange::all());
     void _make_perimeters();
     void _infill();
     void clip_fill_surfaces();
-    void discover_horizontal_shells();
+    void discover_horizontal_shells(const LayerRange &layer_range = LayerRange::all());
     void combine_infill();
     void _generate_support_material();
 
@@ -219,9 +269,48 @@ private:
     // TODO: call model_object->get_bounding_box() instead of accepting
         // parameter
     PrintObject(Print* print, ModelObject* model_object, const BoundingBoxf3 &modobj_bbox);
-    ~PrintObject() {}
+    ~PrintObject() { for (Layer *l : this->_previous_layers) delete l; }
+
+    // Invalidate a step and the steps depending on it, without marking their layers dirty.
+    bool _invalidate_step(PrintObjectStep step);
 
     std::vector<ExPolygons> _slice_region(size_t region_id, const std::vector<float> &z, bool modifier);
+    const std::vector<ExPolygons>& _slice_volume(const ModelVolume *volume, const std::vector<float> &z);
+    // Persistent cache of the slices of the whole object, see SliceCache.hpp.
+    SliceCacheKey _slice_cache_key(const std::vector<coordf_t> &object_layers) const;
+    bool _load_slices_from_cache(const SliceCacheKey &key);
+    void _store_slices_to_cache(const SliceCacheKey &key) const;
+    // Key of the layers saved by save_layers(), see LayerStream.hpp.
+    SliceCacheKey _layer_stream_key() const;
+
+    // Slices of a single ModelVolume in the coordinate system of the volume, kept between the calls of _slice()
+    // so that only the modified slicing planes are sliced again. The slices of a volume with a modified mesh
+    // are released by invalidate_modified_modifiers(),
+    // _slice_volume() compares the hash of the mesh before reusing the slices.
+    struct VolumeSlices
+    {
+        VolumeSlices() : mesh_hash(0) {}
+        // Copy of the mesh of the volume. The slicer repairs the mesh it slices, therefore the copy is sliced
+        // by the background thread instead of the ModelVolume owned by the main thread.
+        TriangleMesh            mesh;
+        // Hash of the facets of ModelVolume::mesh at the time it was copied.
+        uint64_t                mesh_hash;
+        // Slicing planes in the coordinate system of the volume.
+        std::vector<float>      z;
+        std::vector<ExPolygons> slices;
+    };
+    std::map<const ModelVolume*, VolumeSlices> _volume_slices;
+
+    // Layers to be recalculated by each step. An invalidated step recalculates all the layers, the steps depending on it
+    // only the layers modified by the steps they depend on, extended by the layers the step reads around them.
+    LayerRange  _dirty_layers[posCount];
+    // The layers replaced by _slice(), kept for _make_perimeters() to take over those with unmodified slices.
+    LayerPtrs   _previous_layers;
+    // LayerRegion::saved_slices and saved_fill_surfaces are valid for all the layers.
+    bool        _saved_surfaces_valid;
+    void        _keep_previous_layers();
+    LayerRange  _take_over_previous_layers();
+    bool        _prepare_infill_reach(size_t &reach_shells, size_t &reach_bridges) const;
 };
 
 typedef std::vector<PrintObject*> PrintObjectPtrs;
@@ -257,6 +346,7 @@ public:
 
     void delete_object(size_t idx);
     void reload_object(size_t idx);
+    bool reload_modified_modifiers(PrintObject &object);
     bool reload_model_instances();
 
     PrintObjectPtrs get_printable_objects() const;
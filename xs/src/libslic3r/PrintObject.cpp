@@ -2,12 +2,15 @@
 #include "BoundingBox.hpp"
 #include "ClipperUtils.hpp"
 #include "Geometry.hpp"
+#include "LayerStream.hpp"
+#include "Serialize.hpp"
 #include "SupportMaterial.hpp"
 #include "Surface.hpp"
 #include "Slicing.hpp"
 
 #include <utility>
 #include <boost/log/trivial.hpp>
+#include <boost/nowide/fstream.hpp>
 #include <float.h>
 
 #include <tbb/task_scheduler_init.h>
@@ -38,8 +41,11 @@ PrintObject::PrintObject(Print* print, ModelObject* model_object, const Bounding
     typed_slices(false),
     _print(print),
     _model_object(model_object),
-    layer_height_profile_valid(false)
+    layer_height_profile_valid(false),
+    _saved_surfaces_valid(false)
 {
+    for (LayerRange &range : this->_dirty_layers)
+        range = LayerRange::all();
     // Compute the translation to be applied to our meshes so that we work with smaller coordinates
     {
         // Translate meshes so that our toolpath generation algorithms work with smaller
@@ -116,6 +122,10 @@ void PrintObject::clear_layers()
     for (Layer *l : this->layers)
         delete l;
     this->layers.clear();
+    for (Layer *l : this->_previous_layers)
+        delete l;
+    this->_previous_layers.clear();
+    this->_saved_surfaces_valid = false;
 }
 
 Layer* PrintObject::add_layer(int id, coordf_t height, coordf_t print_z, coordf_t slice_z)
@@ -137,6 +147,44 @@ SupportLayer* PrintObject::add_support_layer(int id, coordf_t height, coordf_t p
     return support_layers.back();
 }
 
+void PrintObject::save_layers(const std::string &path) const
+{
+    boost::nowide::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (! file.good())
+        throw std::runtime_error("Cannot open " + path + " for writing");
+    LayerStreamWriter writer(file, this->_layer_stream_key());
+    for (const Layer *layer : this->layers)
+        writer.write(*layer);
+    for (const SupportLayer *layer : this->support_layers)
+        writer.write(*layer);
+    writer.finish();
+    BOOST_LOG_TRIVIAL(debug) << "Saved " << this->layers.size() << " layers and " << this->support_layers.size() << " support layers to " << path;
+}
+
+void PrintObject::load_layers(const std::string &path)
+{
+    // The skirt, the brim and the wipe tower depend on the layers.
+    this->_print->invalidate_step(psSkirt);
+    this->_print->invalidate_step(psBrim);
+    this->_print->invalidate_step(psWipeTower);
+    try {
+        MappedFile        file(path);
+        LayerStreamReader reader(file.data(), file.data() + file.size());
+        if (reader.key() != this->_layer_stream_key().digest())
+            throw std::runtime_error("The layers were saved for a different object or configuration");
+        reader.read(*this);
+    } catch (const std::exception &ex) {
+        this->clear_layers();
+        this->clear_support_layers();
+        this->invalidate_all_steps();
+        throw std::runtime_error("Failed loading the layers from " + path + ": " + ex.what());
+    }
+    for (int step = 0; step < posCount; ++ step)
+        this->state.set_done(PrintObjectStep(step));
+    this->typed_slices = true;
+    BOOST_LOG_TRIVIAL(debug) << "Loaded " << this->layers.size() << " layers and " << this->support_layers.size() << " support layers from " << path;
+}
+
 // Called by Print::apply_config().
 // This method only accepts PrintObjectConfig and PrintRegionConfig option keys.
 bool PrintObject::invalidate_state_by_config_options(const std::vector<t_config_option_key> &opt_keys)
@@ -258,22 +306,36 @@ bool PrintObject::invalidate_state_by_config_options(const std::vector<t_config_
 }
 
 bool PrintObject::invalidate_step(PrintObjectStep step)
+{
+    // The invalidated step recalculates all the layers, the steps depending on it only the layers modified by it.
+    this->_dirty_layers[step] = LayerRange::all();
+    return this->_invalidate_step(step);
+}
+
+bool PrintObject::invalidate_all_steps()
+{
+    for (LayerRange &range : this->_dirty_layers)
+        range = LayerRange::all();
+    return this->state.invalidate_all();
+}
+
+bool PrintObject::_invalidate_step(PrintObjectStep step)
 {
     bool invalidated = this->state.invalidate(step);
     
     // propagate to dependent steps
     if (step == posPerimeters) {
-        invalidated |= this->invalidate_step(posPrepareInfill);
+        invalidated |= this->_invalidate_step(posPrepareInfill);
         invalidated |= this->_print->invalidate_step(psSkirt);
         invalidated |= this->_print->invalidate_step(psBrim);
     } else if (step == posPrepareInfill) {
-        invalidated |= this->invalidate_step(posInfill);
+        invalidated |= this->_invalidate_step(posInfill);
     } else if (step == posInfill) {
         invalidated |= this->_print->invalidate_step(psSkirt);
         invalidated |= this->_print->invalidate_step(psBrim);
     } else if (step == posSlice) {
-        invalidated |= this->invalidate_step(posPerimeters);
-        invalidated |= this->invalidate_step(posSupportMaterial);
+        invalidated |= this->_invalidate_step(posPerimeters);
+        invalidated |= this->_invalidate_step(posSupportMaterial);
         invalidated |= this->_print->invalidate_step(psWipeTower);
     } else if (step == posSupportMaterial) {
         invalidated |= this->_print->invalidate_step(psSkirt);
@@ -287,6 +349,50 @@ bool PrintObject::invalidate_step(PrintObjectStep step)
     return invalidated;
 }
 
+// Hash of the facet vertices, to detect modifications of a mesh.
+static uint64_t mesh_hash(const TriangleMesh &mesh)
+{
+    // FNV-1a over the bit patterns of the vertex coordinates.
+    uint64_t hash = 14695981039346656037ull;
+    auto     mix  = [&hash](uint32_t v) { hash = (hash ^ v) * 1099511628211ull; };
+    mix(uint32_t(mesh.stl.stats.number_of_facets));
+    for (uint32_t i = 0; i < mesh.stl.stats.number_of_facets; ++ i)
+        for (const stl_vertex &v : mesh.stl.facet_start[i].vertex) {
+            uint32_t c[3];
+            memcpy(c, &v, sizeof(c));
+            mix(c[0]);
+            mix(c[1]);
+            mix(c[2]);
+        }
+    return hash;
+}
+
+bool PrintObject::invalidate_modified_modifiers()
+{
+    if (this->layers.empty())
+        return false;
+    std::vector<const ModelVolume*> modified;
+    for (const ModelVolume *volume : this->model_object()->volumes) {
+        auto it = this->_volume_slices.find(volume);
+        if (it == this->_volume_slices.end())
+            // A volume was added or it was never sliced.
+            return false;
+        if (it->second.mesh_hash == mesh_hash(volume->mesh))
+            continue;
+        if (! volume->modifier)
+            return false;
+        modified.push_back(volume);
+    }
+    if (! modified.empty()) {
+        BOOST_LOG_TRIVIAL(debug) << "Modified modifiers invalidate the slicing of object " << this->model_object()->name;
+        // The modified volumes will be copied, hashed and sliced again by _slice_volume().
+        for (const ModelVolume *volume : modified)
+            this->_volume_slices.erase(volume);
+        this->invalidate_step(posSlice);
+    }
+    return true;
+}
+
 bool PrintObject::has_support_material() const
 {
     return this->config.support_material
@@ -299,18 +405,68 @@ void PrintObject::_prepare_infill()
     if (!this->is_printable())
         return;
 
+    // The fill surfaces are prepared again for the layers with modified perimeters and for the layers around them,
+    // which the passes below read: detect_surfaces_type() one layer below and above, discover_vertical_shells()
+    // reach_shells layers below and above and bridge_over_infill() reach_bridges layers below. Each pass processes
+    // the layers read by the following passes, starting from the layers restored to the state after the perimeters
+    // were generated. If a pass propagates the surfaces over any number of layers, the whole object is processed.
+    const size_t num_layers    = this->layers.size();
+    size_t       reach_shells  = 0;
+    size_t       reach_bridges = 0;
+    LayerRange   range_infill(0, num_layers);
+    if (this->_saved_surfaces_valid && this->_prepare_infill_reach(reach_shells, reach_bridges))
+        range_infill = this->_dirty_layers[posPrepareInfill].extended(1 + reach_shells + reach_bridges, num_layers);
+    const LayerRange range_shells   = range_infill.extended(reach_bridges, num_layers);
+    const LayerRange range_surfaces = range_shells.extended(reach_shells, num_layers);
+    const LayerRange range_restored = range_surfaces.extended(1, num_layers);
+    BOOST_LOG_TRIVIAL(debug) << "Preparing fill surfaces of layers " << range_infill.first << " to " << range_infill.last << " out of " << num_layers;
+
+    // The surfaces of the restored layers out of range_infill are calculated from incomplete neighbors,
+    // therefore the final surfaces of these layers are kept and put back at the end.
+    struct PreparedSurfaces {
+        SurfaceCollection   slices;
+        SurfaceCollection   fill_surfaces;
+        Polygons            bridged;
+        PolylineCollection  unsupported_bridge_edges;
+    };
+    std::vector<std::vector<PreparedSurfaces>> kept(range_restored.last - range_restored.first);
+    if (this->_saved_surfaces_valid) {
+        tbb::parallel_for(
+            tbb::blocked_range<size_t>(range_restored.first, range_restored.last),
+            [this, &range_infill, &range_restored, &kept](const tbb::blocked_range<size_t>& range) {
+                for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+                    std::vector<PreparedSurfaces> &kept_layer = kept[layer_idx - range_restored.first];
+                    if (! range_infill.contains(layer_idx))
+                        kept_layer.assign(this->layers[layer_idx]->regions.size(), PreparedSurfaces());
+                    for (size_t region_id = 0; region_id < this->layers[layer_idx]->regions.size(); ++ region_id) {
+                        LayerRegion *layerm = this->layers[layer_idx]->regions[region_id];
+                        if (! kept_layer.empty()) {
+                            kept_layer[region_id].slices                   = std::move(layerm->slices);
+                            kept_layer[region_id].fill_surfaces            = std::move(layerm->fill_surfaces);
+                            kept_layer[region_id].bridged                  = std::move(layerm->bridged);
+                            kept_layer[region_id].unsupported_bridge_edges = std::move(layerm->unsupported_bridge_edges);
+                        }
+                        layerm->slices        = layerm->saved_slices;
+                        layerm->fill_surfaces = layerm->saved_fill_surfaces;
+                        layerm->bridged.clear();
+                        layerm->unsupported_bridge_edges.polylines.clear();
+                    }
+                }
+            });
+    }
+
     // This will assign a type (top/bottom/internal) to $layerm->slices.
     // Then the classifcation of $layerm->slices is transfered onto 
     // the $layerm->fill_surfaces by clipping $layerm->fill_surfaces
     // by the cummulative area of the previous $layerm->fill_surfaces.
-    this->detect_surfaces_type();
+    this->detect_surfaces_type(range_surfaces);
     
     // Decide what surfaces are to be filled.
     // Here the S_TYPE_TOP / S_TYPE_BOTTOMBRIDGE / S_TYPE_BOTTOM infill is turned to just S_TYPE_INTERNAL if zero top / bottom infill layers are configured.
     // Also tiny S_TYPE_INTERNAL surfaces are turned to S_TYPE_INTERNAL_SOLID.
     BOOST_LOG_TRIVIAL(info) << "Preparing fill surfaces...";
-    for (auto *layer : this->layers)
-        for (auto *region : layer->regions)
+    for (size_t layer_idx = range_surfaces.first; layer_idx < range_surfaces.last; ++ layer_idx)
+        for (auto *region : this->layers[layer_idx]->regions)
             region->prepare_fill_surfaces();
 
     // this will detect bridges and reverse bridges
@@ -322,10 +478,10 @@ void PrintObject::_prepare_infill()
     // 3) Clip the internal surfaces by the grown top/bottom surfaces.
     // 4) Merge surfaces with the same style. This will mostly get rid of the overlaps.
     //FIXME This does not likely merge surfaces, which are supported by a material with different colors, but same properties.
-    this->process_external_surfaces();
+    this->process_external_surfaces(range_surfaces);
 
     // Add solid fills to ensure the shell vertical thickness.
-    this->discover_vertical_shells();
+    this->discover_vertical_shells(range_shells);
 
     // Debugging output.
 #ifdef SLIC3R_DEBUG_SLICE_PROCESSING
@@ -344,7 +500,7 @@ void PrintObject::_prepare_infill()
     // and to add a configurable number of solid layers above the BOTTOM / BOTTOMBRIDGE surfaces
     // to close these surfaces reliably.
     //FIXME Vojtech: Is this a good place to add supporting infills below sloping perimeters?
-    this->discover_horizontal_shells();
+    this->discover_horizontal_shells(range_shells);
 
 #ifdef SLIC3R_DEBUG_SLICE_PROCESSING
     for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
@@ -376,7 +532,7 @@ void PrintObject::_prepare_infill()
     
     // the following step needs to be done before combination because it may need
     // to remove only half of the combined infill
-    this->bridge_over_infill();
+    this->bridge_over_infill(range_infill);
 
     // combine fill surfaces to honor the "infill every N layers" option
     this->combine_infill();
@@ -394,6 +550,48 @@ void PrintObject::_prepare_infill()
         layer->export_region_fill_surfaces_to_svg_debug("9_prepare_infill-final");
     } // for each layer
 #endif /* SLIC3R_DEBUG_SLICE_PROCESSING */
+
+    for (size_t layer_idx = range_restored.first; layer_idx < range_restored.last; ++ layer_idx) {
+        std::vector<PreparedSurfaces> &kept_layer = kept[layer_idx - range_restored.first];
+        for (size_t region_id = 0; region_id < kept_layer.size(); ++ region_id) {
+            LayerRegion *layerm = this->layers[layer_idx]->regions[region_id];
+            layerm->slices                   = std::move(kept_layer[region_id].slices);
+            layerm->fill_surfaces            = std::move(kept_layer[region_id].fill_surfaces);
+            layerm->bridged                  = std::move(kept_layer[region_id].bridged);
+            layerm->unsupported_bridge_edges = std::move(kept_layer[region_id].unsupported_bridge_edges);
+        }
+    }
+    this->_dirty_layers[posInfill].merge(range_infill);
+    this->_dirty_layers[posPrepareInfill] = LayerRange();
+}
+
+// Number of the layers around a layer read by the passes of _prepare_infill() processing the layer, see _prepare_infill().
+// Returns false if the fill surfaces are propagated over any number of layers by clip_fill_surfaces(), combine_infill()
+// or discover_horizontal_shells().
+bool PrintObject::_prepare_infill_reach(size_t &reach_shells, size_t &reach_bridges) const
+{
+    reach_shells = 0;
+    double bridge_height = 0.;
+    for (const PrintRegion *region : this->_print->regions) {
+        const PrintRegionConfig &config = region->config;
+        if (config.fill_density.value > 0 && (this->config.infill_only_where_needed.value || config.infill_every_layers.value > 1))
+            return false;
+        int solid_layers = std::max(config.top_solid_layers.value, config.bottom_solid_layers.value);
+        if (config.ensure_vertical_shell_thickness.value)
+            reach_shells = std::max(reach_shells, size_t(std::max(0, solid_layers - 1)));
+        else if (solid_layers > 1)
+            return false;
+        if (config.fill_density.value < 100)
+            bridge_height = std::max(bridge_height, double(region->flow(frSolidInfill, -1, true, false, -1, *this).height));
+    }
+    // Maximum number of the layers below a layer within the bridge flow height.
+    reach_bridges = 0;
+    for (size_t i = 0, j = 0; i < this->layers.size(); ++ i) {
+        while (this->layers[j]->print_z < this->layers[i]->print_z - bridge_height)
+            ++ j;
+        reach_bridges = std::max(reach_bridges, i - j);
+    }
+    return true;
 }
 
 // This function analyzes slices of a region (SurfaceCollection slices).
@@ -405,7 +603,7 @@ void PrintObject::_prepare_infill()
 // stBottom       - Part of a region, which is not supported by the same region, but it is supported either by another region, or by a soluble interface layer.
 // stInternal     - Part of a region, which is supported by the same region type.
 // If a part of a region is of stBottom and stTop, the stBottom wins.
-void PrintObject::detect_surfaces_type()
+void PrintObject::detect_surfaces_type(const LayerRange &layer_range)
 {
     BOOST_LOG_TRIVIAL(info) << "Detecting solid surfaces...";
 
@@ -415,6 +613,7 @@ void PrintObject::detect_surfaces_type()
     // This is useful if one of the parts is to be dissolved, or if it is transparent and the internal shells
     // should be visible.
     bool interface_shells = this->config.interface_shells.value;
+    const LayerRange processed = layer_range.clamped(this->layers.size());
 
     for (int idx_region = 0; idx_region < this->_print->regions.size(); ++ idx_region) {
         BOOST_LOG_TRIVIAL(debug) << "Detecting solid surfaces for region " << idx_region << " in parallel - start";
@@ -430,7 +629,7 @@ void PrintObject::detect_surfaces_type()
             surfaces_new.assign(this->layers.size(), Surfaces());
 
         tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, this->layers.size()),
+            tbb::blocked_range<size_t>(processed.first, processed.last),
             [this, idx_region, interface_shells, &surfaces_new](const tbb::blocked_range<size_t>& range) {
                 // If we have raft layers, consider bottom layer as a bridge just like any other bottom surface lying on the void.
                 SurfaceType surface_type_bottom_1st =
@@ -569,14 +768,14 @@ void PrintObject::detect_surfaces_type()
 
         if (interface_shells) {
             // Move surfaces_new to layerm->slices.surfaces
-            for (size_t idx_layer = 0; idx_layer < this->layers.size(); ++ idx_layer)
+            for (size_t idx_layer = processed.first; idx_layer < processed.last; ++ idx_layer)
                 this->layers[idx_layer]->get_region(idx_region)->slices.surfaces = std::move(surfaces_new[idx_layer]);
         }
 
         BOOST_LOG_TRIVIAL(debug) << "Detecting solid surfaces for region " << idx_region << " - clipping in parallel - start";
         // Fill in layerm->fill_surfaces by trimming the layerm->slices by the cummulative layerm->fill_surfaces.
         tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, this->layers.size()),
+            tbb::blocked_range<size_t>(processed.first, processed.last),
             [this, idx_region, interface_shells, &surfaces_new](const tbb::blocked_range<size_t>& range) {
                 for (size_t idx_layer = range.begin(); idx_layer < range.end(); ++ idx_layer) {
                     LayerRegion *layerm = this->layers[idx_layer]->get_region(idx_region);
@@ -593,16 +792,17 @@ void PrintObject::detect_surfaces_type()
     this->typed_slices = true;
 }
 
-void PrintObject::process_external_surfaces()
+void PrintObject::process_external_surfaces(const LayerRange &layer_range)
 {
     BOOST_LOG_TRIVIAL(info) << "Processing external surfaces...";
+    const LayerRange processed = layer_range.clamped(this->layers.size());
 
     FOREACH_REGION(this->_print, region) {
         int region_id = int(region - this->_print->regions.begin());
         
         BOOST_LOG_TRIVIAL(debug) << "Processing external surfaces for region " << region_id << " in parallel - start";
         tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, this->layers.size()),
+            tbb::blocked_range<size_t>(processed.first, processed.last),
             [this, region_id](const tbb::blocked_range<size_t>& range) {
                 for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
                     // BOOST_LOG_TRIVIAL(trace) << "Processing external surface, layer" << this->layers[layer_idx]->print_z;
@@ -614,11 +814,13 @@ void PrintObject::process_external_surfaces()
     }
 }
 
-void PrintObject::discover_vertical_shells()
+void PrintObject::discover_vertical_shells(const LayerRange &layer_range)
 {
     PROFILE_FUNC();
 
     BOOST_LOG_TRIVIAL(info) << "Discovering vertical shells...";
+    // The layers of layer_range are processed, reading the cached top / bottom surfaces of the layers around them.
+    const LayerRange processed = layer_range.clamped(this->layers.size());
 
     struct DiscoverVerticalShellsCacheEntry
     {
@@ -634,11 +836,13 @@ void PrintObject::discover_vertical_shells()
         // is calculated over all materials.
         // Is the "ensure vertical wall thickness" applicable to any region?
         bool has_extra_layers = false;
+        int  max_extra_layers = 0;
         for (size_t idx_region = 0; idx_region < this->_print->regions.size(); ++ idx_region) {
             const PrintRegion &region = *this->_print->get_region(idx_region);
             if (region.config.ensure_vertical_shell_thickness.value && 
                 (region.config.top_solid_layers.value > 1 || region.config.bottom_solid_layers.value > 1)) {
                 has_extra_layers = true;
+                max_extra_layers = std::max(max_extra_layers, std::max(region.config.top_solid_layers.value, region.config.bottom_solid_layers.value) - 1);
             }
         }
         if (! has_extra_layers)
@@ -647,8 +851,9 @@ void PrintObject::discover_vertical_shells()
         BOOST_LOG_TRIVIAL(debug) << "Discovering vertical shells in parallel - start : cache top / bottom";
         //FIXME Improve the heuristics for a grain size.
         size_t grain_size = std::max(this->layers.size() / 16, size_t(1));
+        const LayerRange cached = processed.extended(size_t(max_extra_layers), this->layers.size());
         tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, this->layers.size(), grain_size),
+            tbb::blocked_range<size_t>(cached.first, cached.last, grain_size),
             [this, &cache_top_botom_regions](const tbb::blocked_range<size_t>& range) {
                 const SurfaceType surfaces_bottom[2] = { stBottom, stBottomBridge };
                 const size_t num_regions = this->_print->regions.size();
@@ -730,8 +935,9 @@ void PrintObject::discover_vertical_shells()
             // This is either a single material print, or a multi-material print and interface_shells are enabled, meaning that the vertical shell thickness
             // is calculated over a single material.
             BOOST_LOG_TRIVIAL(debug) << "Discovering vertical shells for region " << idx_region << " in parallel - start : cache top / bottom";
+            const LayerRange cached = processed.extended(size_t(std::max(n_extra_top_layers, n_extra_bottom_layers)), this->layers.size());
             tbb::parallel_for(
-                tbb::blocked_range<size_t>(0, this->layers.size(), grain_size),
+                tbb::blocked_range<size_t>(cached.first, cached.last, grain_size),
                 [this, idx_region, &cache_top_botom_regions](const tbb::blocked_range<size_t>& range) {
                     const SurfaceType surfaces_bottom[2] = { stBottom, stBottomBridge };
                     for (size_t idx_layer = range.begin(); idx_layer < range.end(); ++ idx_layer) {
@@ -757,7 +963,7 @@ void PrintObject::discover_vertical_shells()
 
         BOOST_LOG_TRIVIAL(debug) << "Discovering vertical shells for region " << idx_region << " in parallel - start : ensure vertical wall thickness";
         tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, this->layers.size(), grain_size),
+            tbb::blocked_range<size_t>(processed.first, processed.last, grain_size),
             [this, idx_region, n_extra_top_layers, n_extra_bottom_layers, &cache_top_botom_regions]
             (const tbb::blocked_range<size_t>& range) {
                 // printf("discover_vertical_shells from %d to %d\n", range.begin(), range.end());
@@ -995,9 +1201,10 @@ void PrintObject::discover_vertical_shells()
 
 /* This method applies bridge flow to the first internal solid layer above
    sparse infill */
-void PrintObject::bridge_over_infill()
+void PrintObject::bridge_over_infill(const LayerRange &layer_range)
 {
     BOOST_LOG_TRIVIAL(info) << "Bridge over infill...";
+    const LayerRange processed = layer_range.clamped(this->layers.size());
 
     FOREACH_REGION(this->_print, region) {
         size_t region_id = region - this->_print->regions.begin();
@@ -1015,11 +1222,11 @@ void PrintObject::bridge_over_infill()
             *this
         );
         
-        FOREACH_LAYER(this, layer_it) {
+        for (size_t layer_idx = processed.first; layer_idx < processed.last; ++ layer_idx) {
             // skip first layer
-            if (layer_it == this->layers.begin()) continue;
+            if (layer_idx == 0) continue;
             
-            Layer* layer        = *layer_it;
+            Layer* layer        = this->layers[layer_idx];
             LayerRegion* layerm = layer->regions[region_id];
             
             // extract the stInternalSolid surfaces that might be transformed into bridges
@@ -1035,7 +1242,7 @@ void PrintObject::bridge_over_infill()
                 
                 // iterate through lower layers spanned by bridge_flow
                 double bottom_z = layer->print_z - bridge_flow.height;
-                for (int i = int(layer_it - this->layers.begin()) - 1; i >= 0; --i) {
+                for (int i = int(layer_idx) - 1; i >= 0; --i) {
                     const Layer* lower_layer = this->layers[i];
                     
                     // stop iterating if layer is lower than bottom_z
@@ -1193,12 +1400,22 @@ void PrintObject::_slice()
 
     SlicingParameters slicing_params = this->slicing_parameters();
 
+    // Object layers (pairs of bottom/top Z coordinate), without the raft.
+    std::vector<coordf_t> object_layers = generate_object_layers(slicing_params, this->layer_height_profile);
+
+    // Try to load the slices of the whole object from the slice cache.
+    bool          use_slice_cache = ! slice_cache_dir().empty();
+    SliceCacheKey slice_cache_key;
+    if (use_slice_cache) {
+        slice_cache_key = this->_slice_cache_key(object_layers);
+        if (this->_load_slices_from_cache(slice_cache_key))
+            return;
+    }
+
     // 1) Initialize layers and their slice heights.
     std::vector<float> slice_zs;
     {
-        this->clear_layers();
-        // Object layers (pairs of bottom/top Z coordinate), without the raft.
-        std::vector<coordf_t> object_layers = generate_object_layers(slicing_params, this->layer_height_profile);
+        this->_keep_previous_layers();
         // Reserve object layers for the raft. Last layer of the raft is the contact layer.
         int id = int(slicing_params.raft_layers());
         slice_zs.reserve(object_layers.size());
@@ -1259,6 +1476,15 @@ void PrintObject::_slice()
             BOOST_LOG_TRIVIAL(debug) << "Slicing modifier volumes - stealing " << region_id << " end";
         }
     }
+
+    // Release the cached slices of volumes, which were removed from the object.
+    for (auto it = this->_volume_slices.begin(); it != this->_volume_slices.end();) {
+        const ModelVolumePtrs &volumes = this->model_object()->volumes;
+        if (std::find(volumes.begin(), volumes.end(), it->first) == volumes.end())
+            it = this->_volume_slices.erase(it);
+        else
+            ++ it;
+    }
     
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - removing top empty layers";
     while (! this->layers.empty()) {
@@ -1316,38 +1542,229 @@ end:
             }
         });
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - make_slices in parallel - end";
+
+    if (use_slice_cache)
+        this->_store_slices_to_cache(slice_cache_key);
+}
+
+// Version of the data hashed by _slice_cache_key() and of the data stored by _store_slices_to_cache().
+static const uint64_t SLICE_CACHE_DATA_VERSION = 1;
+
+SliceCacheKey PrintObject::_slice_cache_key(const std::vector<coordf_t> &object_layers) const
+{
+    SlicingParameters    slicing_params = this->slicing_parameters();
+    const ModelInstance &instance       = *this->model_object()->instances.front();
+    SliceCacheKey key;
+    key.add(SLICE_CACHE_DATA_VERSION);
+    // Layers.
+    key.add(object_layers);
+    key.add(slicing_params.object_print_z_min);
+    key.add(uint64_t(slicing_params.raft_layers()));
+    // Transformation of the volumes, see _slice_region().
+    key.add(instance.rotation);
+    key.add(instance.scaling_factor);
+    key.add(this->model_object()->bounding_box().min.z);
+    key.add(uint64_t(int64_t(this->_copies_shift.x)));
+    key.add(uint64_t(int64_t(this->_copies_shift.y)));
+    // Configuration options applied by _slice().
+    key.add(this->config.xy_size_compensation.value);
+    key.add(this->config.elefant_foot_compensation.value);
+    key.add(uint64_t(this->config.clip_multipart_objects.value));
+    // Assignment of the volumes to the regions and the meshes.
+    key.add(uint64_t(this->print()->regions.size()));
+    key.add(uint64_t(this->region_volumes.size()));
+    for (const std::vector<int> &volumes : this->region_volumes) {
+        key.add(uint64_t(volumes.size()));
+        for (int volume_id : volumes) {
+            const ModelVolume *volume = this->model_object()->volumes[volume_id];
+            key.add(uint64_t(volume->modifier));
+            key.add(uint64_t(volume->mesh.stl.stats.number_of_facets));
+            for (uint32_t i = 0; i < volume->mesh.stl.stats.number_of_facets; ++ i)
+                key.add(volume->mesh.stl.facet_start[i].vertex, sizeof(stl_facet::vertex));
+        }
+    }
+    return key;
+}
+
+// Key of the processed layers: the key of the slices extended by all the configuration the layers may depend on.
+SliceCacheKey PrintObject::_layer_stream_key() const
+{
+    std::vector<coordf_t> layer_height_profile = this->layer_height_profile;
+    this->update_layer_height_profile(layer_height_profile);
+    SliceCacheKey key = this->_slice_cache_key(generate_object_layers(this->slicing_parameters(), layer_height_profile));
+    auto add_config = [&key](const ConfigBase &config) {
+        for (const t_config_option_key &opt_key : config.keys()) {
+            key.add(opt_key);
+            key.add(config.serialize(opt_key));
+        }
+    };
+    add_config(this->print()->config);
+    add_config(this->config);
+    for (const PrintRegion *region : this->print()->regions)
+        add_config(region->config);
+    return key;
+}
+
+bool PrintObject::_load_slices_from_cache(const SliceCacheKey &key)
+{
+    std::string data;
+    if (! load_cached_slices(key, data))
+        return false;
+    LayerPtrs layers;
+    try {
+        BinaryReader reader(data);
+        size_t num_layers  = reader.read_count();
+        size_t num_regions = this->print()->regions.size();
+        layers.reserve(num_layers);
+        for (size_t i_layer = 0; i_layer < num_layers; ++ i_layer) {
+            size_t   id      = size_t(reader.read_varuint());
+            coordf_t height  = reader.read_double();
+            coordf_t print_z = reader.read_double();
+            coordf_t slice_z = reader.read_double();
+            layers.push_back(new Layer(id, this, height, print_z, slice_z));
+            Layer *layer = layers.back();
+            layer->slicing_errors = reader.read_uint8() != 0;
+            if (reader.read_varuint() != num_regions)
+                throw std::runtime_error("Number of regions does not match");
+            for (size_t region_id = 0; region_id < num_regions; ++ region_id) {
+                ExPolygons expolygons;
+                reader.read(expolygons);
+                layer->add_region(this->print()->regions[region_id])->slices.append(std::move(expolygons), stInternal);
+            }
+            reader.read(layer->slices.expolygons);
+        }
+        if (! reader.eof())
+            throw std::runtime_error("Unexpected data at the end");
+    } catch (const std::exception &ex) {
+        BOOST_LOG_TRIVIAL(warning) << "Failed to load the cached slices " << key.to_string() << ": " << ex.what();
+        for (Layer *layer : layers)
+            delete layer;
+        return false;
+    }
+    this->_keep_previous_layers();
+    this->layers = std::move(layers);
+    for (size_t i_layer = 0; i_layer < this->layers.size(); ++ i_layer) {
+        this->layers[i_layer]->lower_layer = (i_layer == 0) ? nullptr : this->layers[i_layer - 1];
+        this->layers[i_layer]->upper_layer = (i_layer + 1 == this->layers.size()) ? nullptr : this->layers[i_layer + 1];
+    }
+    this->typed_slices = false;
+    return true;
+}
+
+void PrintObject::_store_slices_to_cache(const SliceCacheKey &key) const
+{
+    std::string  data;
+    BinaryWriter writer(data);
+    writer.write_varuint(this->layers.size());
+    for (const Layer *layer : this->layers) {
+        writer.write_varuint(layer->id());
+        writer.write_double(layer->height);
+        writer.write_double(layer->print_z);
+        writer.write_double(layer->slice_z);
+        writer.write_uint8(layer->slicing_errors ? 1 : 0);
+        writer.write_varuint(layer->regions.size());
+        for (const LayerRegion *layerm : layer->regions)
+            writer.write(to_expolygons(layerm->slices.surfaces));
+        writer.write(layer->slices.expolygons);
+    }
+    store_cached_slices(key, data);
 }
 
 std::vector<ExPolygons> PrintObject::_slice_region(size_t region_id, const std::vector<float> &z, bool modifier)
 {
     std::vector<ExPolygons> layers;
     if (region_id < this->region_volumes.size()) {
-        std::vector<int> &volumes = this->region_volumes[region_id];
-        if (! volumes.empty()) {
-            // Compose mesh.
-            //FIXME better to perform slicing over each volume separately and then to use a Boolean operation to merge them.
-            TriangleMesh mesh;
-            for (int volume_id : volumes) {
-                ModelVolume *volume = this->model_object()->volumes[volume_id];
-                if (volume->modifier == modifier)
-                    mesh.merge(volume->mesh);
-            }
-            if (mesh.stl.stats.number_of_facets > 0) {
-                // transform mesh
-                // we ignore the per-instance transformations currently and only 
-                // consider the first one
-                this->model_object()->instances.front()->transform_mesh(&mesh, true);
-                // align mesh to Z = 0 (it should be already aligned actually) and apply XY shift
-                mesh.translate(- float(unscale(this->_copies_shift.x)), - float(unscale(this->_copies_shift.y)), -float(this->model_object()->bounding_box().min.z));
-                // perform actual slicing
-                TriangleMeshSlicer mslicer(&mesh);
-                mslicer.slice(z, &layers);
-            }
+        // We ignore the per-instance transformations currently and only consider the first one.
+        // The instance only rotates around the Z axis and scales uniformly, therefore the volumes are sliced
+        // in their own coordinate system and the transformation is applied to the slices.
+        const ModelInstance &instance = *this->model_object()->instances.front();
+        // Slicing planes in the coordinate system of the volumes. The transformed object is aligned to Z = 0.
+        std::vector<float> z_volume(z.size(), 0.f);
+        double z_min = this->model_object()->bounding_box().min.z;
+        for (size_t i = 0; i < z.size(); ++ i)
+            z_volume[i] = float((double(z[i]) + z_min) / instance.scaling_factor);
+        // Slice each volume separately, the slices of an unchanged volume are reused from the previous run.
+        std::vector<const std::vector<ExPolygons>*> volume_slices;
+        for (int volume_id : this->region_volumes[region_id]) {
+            const ModelVolume *volume = this->model_object()->volumes[volume_id];
+            if (volume->modifier == modifier && volume->mesh.stl.stats.number_of_facets > 0)
+                volume_slices.emplace_back(&this->_slice_volume(volume, z_volume));
+        }
+        if (! volume_slices.empty()) {
+            layers.assign(z.size(), ExPolygons());
+            tbb::parallel_for(
+                tbb::blocked_range<size_t>(0, z.size()),
+                [this, &instance, &volume_slices, &layers](const tbb::blocked_range<size_t>& range) {
+                    for (size_t layer_id = range.begin(); layer_id < range.end(); ++ layer_id) {
+                        ExPolygons &out = layers[layer_id];
+                        if (volume_slices.size() == 1) {
+                            out = (*volume_slices.front())[layer_id];
+                        } else {
+                            // Merge the overlapping volumes.
+                            Polygons polygons;
+                            for (const std::vector<ExPolygons> *slices : volume_slices)
+                                polygons_append(polygons, to_polygons((*slices)[layer_id]));
+                            out = union_ex(polygons);
+                        }
+                        // Transform the slices by the instance, then align the object with the origin and apply XY shift.
+                        for (ExPolygon &expoly : out) {
+                            if (instance.rotation != 0.)
+                                expoly.rotate(instance.rotation);
+                            if (instance.scaling_factor != 1.)
+                                expoly.scale(instance.scaling_factor);
+                            expoly.translate(- double(this->_copies_shift.x), - double(this->_copies_shift.y));
+                        }
+                    }
+                });
         }
     }
     return layers;
 }
 
+// Slice a single volume by planes given in the coordinate system of the volume.
+// The result is cached while the hash of the mesh does not change, only the new slicing planes are sliced after the planes change.
+const std::vector<ExPolygons>& PrintObject::_slice_volume(const ModelVolume *volume, const std::vector<float> &z)
+{
+    // The mesh may have been modified without invalidate_modified_modifiers() being called,
+    // or the volume may have been released and another volume allocated at the same address.
+    uint64_t      hash     = mesh_hash(volume->mesh);
+    auto          inserted = this->_volume_slices.insert(std::make_pair(volume, VolumeSlices()));
+    VolumeSlices &cached   = inserted.first->second;
+    if (inserted.second || cached.mesh_hash != hash) {
+        cached.mesh      = volume->mesh;
+        cached.mesh_hash = hash;
+        cached.z.clear();
+        cached.slices.clear();
+    }
+    if (cached.z != z || cached.slices.size() != z.size()) {
+        // Reuse the slices at the planes sliced before. Both the old and the new planes are sorted.
+        std::vector<ExPolygons> slices(z.size());
+        std::vector<float>      z_new;
+        std::vector<size_t>     idx_new;
+        for (size_t i = 0, j = 0; i < z.size(); ++ i) {
+            while (j < cached.z.size() && cached.z[j] < z[i])
+                ++ j;
+            if (j < cached.z.size() && cached.z[j] == z[i] && j < cached.slices.size()) {
+                slices[i] = std::move(cached.slices[j]);
+            } else {
+                z_new.push_back(z[i]);
+                idx_new.push_back(i);
+            }
+        }
+        if (! z_new.empty()) {
+            BOOST_LOG_TRIVIAL(debug) << "Slicing objects - slicing volume " << volume->name << " at " << z_new.size() << " of " << z.size() << " planes";
+            std::vector<ExPolygons> slices_new;
+            TriangleMeshSlicer mslicer(&cached.mesh);
+            mslicer.slice(z_new, &slices_new);
+            for (size_t i = 0; i < idx_new.size(); ++ i)
+                slices[idx_new[i]] = std::move(slices_new[i]);
+        }
+        cached.z      = z;
+        cached.slices = std::move(slices);
+    }
+    return cached.slices;
+}
+
 std::string PrintObject::_fix_slicing_errors()
 {
     // Collect layers with slicing errors.
@@ -1448,6 +1865,81 @@ void PrintObject::_simplify_slices(double distance)
     BOOST_LOG_TRIVIAL(debug) << "Slicing objects - siplifying slices in parallel - end";
 }
 
+// Called by _slice() before the layers are replaced. The layers processed by _make_perimeters() are kept
+// for the next run of _make_perimeters() to take over the layers, whose slices were not modified.
+void PrintObject::_keep_previous_layers()
+{
+    LayerPtrs &released = this->_saved_surfaces_valid ? this->_previous_layers : this->layers;
+    for (Layer *l : released)
+        delete l;
+    released.clear();
+    if (this->_saved_surfaces_valid)
+        std::swap(this->layers, this->_previous_layers);
+    this->_saved_surfaces_valid = false;
+    if (this->_previous_layers.empty())
+        this->_dirty_layers[posPerimeters] = LayerRange::all();
+}
+
+static bool same_expolygons(const ExPolygon &expoly1, const ExPolygon &expoly2)
+{
+    if (expoly1.contour.points != expoly2.contour.points || expoly1.holes.size() != expoly2.holes.size())
+        return false;
+    for (size_t i = 0; i < expoly1.holes.size(); ++ i)
+        if (expoly1.holes[i].points != expoly2.holes[i].points)
+            return false;
+    return true;
+}
+
+// Replace the new layers by the previous layers with the same Z and the same slices, including their perimeters,
+// fill surfaces and fills. The region slices of the new layers are compared against the slices saved by _make_perimeters(),
+// as the slices of the previous layers were split into types. Returns the range of the layers, which were not taken over.
+LayerRange PrintObject::_take_over_previous_layers()
+{
+    LayerRange sliced;
+    size_t     idx_previous = 0;
+    size_t     num_taken_over = 0;
+    for (size_t idx_layer = 0; idx_layer < this->layers.size(); ++ idx_layer) {
+        Layer *layer = this->layers[idx_layer];
+        // Both the new and the previous layers are sorted by print_z.
+        while (idx_previous < this->_previous_layers.size() && this->_previous_layers[idx_previous]->print_z < layer->print_z)
+            ++ idx_previous;
+        Layer *previous = (idx_previous < this->_previous_layers.size()) ? this->_previous_layers[idx_previous] : nullptr;
+        bool   same     = previous != nullptr && previous->id() == layer->id() && previous->print_z == layer->print_z &&
+            previous->height == layer->height && previous->slice_z == layer->slice_z &&
+            previous->slicing_errors == layer->slicing_errors && previous->regions.size() == layer->regions.size() &&
+            previous->slices.expolygons.size() == layer->slices.expolygons.size();
+        for (size_t i = 0; same && i < layer->slices.expolygons.size(); ++ i)
+            same = same_expolygons(previous->slices.expolygons[i], layer->slices.expolygons[i]);
+        for (size_t region_id = 0; same && region_id < layer->regions.size(); ++ region_id) {
+            const Surfaces &saved  = previous->regions[region_id]->saved_slices.surfaces;
+            const Surfaces &slices = layer->regions[region_id]->slices.surfaces;
+            same = saved.size() == slices.size();
+            for (size_t i = 0; same && i < slices.size(); ++ i)
+                same = same_expolygons(saved[i].expolygon, slices[i].expolygon);
+        }
+        if (same) {
+            this->layers[idx_layer] = previous;
+            this->_previous_layers[idx_previous ++] = nullptr;
+            delete layer;
+            ++ num_taken_over;
+        } else {
+            for (LayerRegion *layerm : layer->regions)
+                layerm->saved_slices = layerm->slices;
+            sliced.merge(LayerRange(idx_layer, idx_layer + 1));
+        }
+    }
+    for (Layer *l : this->_previous_layers)
+        delete l;
+    this->_previous_layers.clear();
+    for (size_t idx_layer = 0; idx_layer < this->layers.size(); ++ idx_layer) {
+        this->layers[idx_layer]->lower_layer = (idx_layer == 0) ? nullptr : this->layers[idx_layer - 1];
+        this->layers[idx_layer]->upper_layer = (idx_layer + 1 == this->layers.size()) ? nullptr : this->layers[idx_layer + 1];
+    }
+    this->_saved_surfaces_valid = true;
+    BOOST_LOG_TRIVIAL(debug) << "Took over " << num_taken_over << " unmodified layers out of " << this->layers.size();
+    return sliced;
+}
+
 void PrintObject::_make_perimeters()
 {
     if (!this->is_printable())
@@ -1457,14 +1949,33 @@ void PrintObject::_make_perimeters()
     this->state.set_started(posPerimeters);
 
     BOOST_LOG_TRIVIAL(info) << "Generating perimeters...";
-    
-    // merge slices if they were split into types
-    if (this->typed_slices) {
+
+    // Take over the layers of the previous slicing with unmodified slices. The perimeters of a layer depend on the slices
+    // of the layer below (overhangs) and of the layer above (extra perimeters), therefore the neighbors of the layers
+    // sliced anew are recalculated as well.
+    if (! this->_previous_layers.empty())
+        this->_dirty_layers[posPerimeters].merge(this->_take_over_previous_layers().extended(1, this->layers.size()));
+    const LayerRange dirty = this->_dirty_layers[posPerimeters].clamped(this->layers.size());
+    BOOST_LOG_TRIVIAL(debug) << "Generating perimeters of layers " << dirty.first << " to " << dirty.last << " out of " << this->layers.size();
+
+    // Restore the slices saved before they were split into types, or merge them if they were not saved.
+    if (this->_saved_surfaces_valid) {
+        for (size_t layer_idx = dirty.first; layer_idx < dirty.last; ++ layer_idx)
+            for (LayerRegion *layerm : this->layers[layer_idx]->regions) {
+                layerm->slices = layerm->saved_slices;
+                for (Surface &surface : layerm->slices.surfaces)
+                    surface.extra_perimeters = 0;
+                layerm->fill_surfaces.clear();
+                layerm->fill_expolygons.clear();
+            }
+    } else if (this->typed_slices) {
         FOREACH_LAYER(this, layer_it)
             (*layer_it)->merge_slices();
+    }
+    if (dirty.covers(this->layers.size()))
         this->typed_slices = false;
+    if (! dirty.empty())
         this->state.invalidate(posPrepareInfill);
-    }
     
     // compare each layer to the one below, and mark those slices needing
     // one additional inner perimeter, like the top of domed objects-
@@ -1485,12 +1996,13 @@ void PrintObject::_make_perimeters()
         
         BOOST_LOG_TRIVIAL(debug) << "Generating extra perimeters for region " << region_id << " in parallel - start";
         tbb::parallel_for(
-            tbb::blocked_range<size_t>(0, this->layers.size() - 1),
+            tbb::blocked_range<size_t>(dirty.first, std::max(dirty.first, std::min(dirty.last, this->layers.size() - 1))),
             [this, &region, region_id](const tbb::blocked_range<size_t>& range) {
                 for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
                     LayerRegion &layerm                     = *this->layers[layer_idx]->regions[region_id];
                     const LayerRegion &upper_layerm         = *this->layers[layer_idx+1]->regions[region_id];
-                    const Polygons upper_layerm_polygons    = upper_layerm.slices;
+                    // The upper layer may be out of the recalculated layers, with its slices split into types.
+                    const Polygons upper_layerm_polygons    = this->_saved_surfaces_valid ? upper_layerm.saved_slices : upper_layerm.slices;
                     // Filter upper layer polygons in intersection_ppl by their bounding boxes?
                     // my $upper_layerm_poly_bboxes= [ map $_->bounding_box, @{$upper_layerm_polygons} ];
                     const double total_loop_length      = total_length(upper_layerm_polygons);
@@ -1541,13 +2053,23 @@ void PrintObject::_make_perimeters()
 
     BOOST_LOG_TRIVIAL(debug) << "Generating perimeters in parallel - start";
     tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, this->layers.size()),
+        tbb::blocked_range<size_t>(dirty.first, dirty.last),
         [this](const tbb::blocked_range<size_t>& range) {
-            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx)
-                this->layers[layer_idx]->make_perimeters();
+            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+                Layer *layer = this->layers[layer_idx];
+                layer->make_perimeters();
+                // Save the surfaces for _prepare_infill() and for the next run of this step.
+                for (LayerRegion *layerm : layer->regions) {
+                    layerm->saved_slices        = layerm->slices;
+                    layerm->saved_fill_surfaces = layerm->fill_surfaces;
+                }
+            }
         }
     );
     BOOST_LOG_TRIVIAL(debug) << "Generating perimeters in parallel - end";
+    this->_saved_surfaces_valid = true;
+    this->_dirty_layers[posPrepareInfill].merge(dirty);
+    this->_dirty_layers[posPerimeters] = LayerRange();
 
     /*
         simplify slices (both layer and region slices),
@@ -1567,9 +2089,11 @@ void PrintObject::_infill()
     if (this->state.is_done(posInfill)) return;
     this->state.set_started(posInfill);
     
-    BOOST_LOG_TRIVIAL(debug) << "Filling layers in parallel - start";
+    // Only the layers with modified fill surfaces are filled again.
+    const LayerRange dirty = this->_dirty_layers[posInfill].clamped(this->layers.size());
+    BOOST_LOG_TRIVIAL(debug) << "Filling layers " << dirty.first << " to " << dirty.last << " in parallel - start";
     tbb::parallel_for(
-        tbb::blocked_range<size_t>(0, this->layers.size()),
+        tbb::blocked_range<size_t>(dirty.first, dirty.last),
         [this](const tbb::blocked_range<size_t>& range) {
             for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx)
                 this->layers[layer_idx]->make_fills();
@@ -1581,6 +2105,7 @@ void PrintObject::_infill()
     ### $_->fill_surfaces->clear for map @{$_->regions}, @{$object->layers};
     */
     
+    this->_dirty_layers[posInfill] = LayerRange();
     this->state.set_done(posInfill);
 }
 
@@ -1670,12 +2195,13 @@ void PrintObject::clip_fill_surfaces()
     }
 }
 
-void PrintObject::discover_horizontal_shells()
+void PrintObject::discover_horizontal_shells(const LayerRange &layer_range)
 {
     BOOST_LOG_TRIVIAL(trace) << "discover_horizontal_shells()";
+    const LayerRange processed = layer_range.clamped(this->layers.size());
     
     for (size_t region_id = 0; region_id < this->print()->regions.size(); ++ region_id) {
-        for (int i = 0; i < int(this->layers.size()); ++ i) {
+        for (int i = int(processed.first); i < int(processed.last); ++ i) {
             LayerRegion       *layerm = this->layers[i]->regions[region_id];
             PrintRegionConfig &region_config = layerm->region()->config;
             if (region_config.solid_infill_every_layers.value > 0 && region_config.fill_density.value > 0 &&
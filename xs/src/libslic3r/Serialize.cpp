@@ -0,0 +1,267 @@
+#include "Serialize.hpp"
+
+#include <memory>
+#include <stdexcept>
+
+namespace Slic3r {
+
+// Tags of the ExtrusionEntity types, see BinaryWriter::write_extrusion_entity().
+enum ExtrusionEntityTag {
+    eetPath,
+    eetMultiPath,
+    eetLoop,
+    eetCollection,
+};
+
+// Maximum nesting level of ExtrusionEntityCollections accepted by BinaryReader.
+static const unsigned int MAX_COLLECTION_DEPTH = 64;
+
+void BinaryWriter::write(const Points &points)
+{
+    this->write_varuint(points.size());
+    Point prev(0, 0);
+    for (const Point &pt : points) {
+        this->write_varint(int64_t(pt.x) - int64_t(prev.x));
+        this->write_varint(int64_t(pt.y) - int64_t(prev.y));
+        prev = pt;
+    }
+}
+
+void BinaryWriter::write(const Polygons &polygons)
+{
+    this->write_varuint(polygons.size());
+    for (const Polygon &polygon : polygons)
+        this->write(polygon);
+}
+
+void BinaryWriter::write(const ExPolygon &expolygon)
+{
+    this->write(expolygon.contour);
+    this->write(expolygon.holes);
+}
+
+void BinaryWriter::write(const ExPolygons &expolygons)
+{
+    this->write_varuint(expolygons.size());
+    for (const ExPolygon &expolygon : expolygons)
+        this->write(expolygon);
+}
+
+void BinaryWriter::write(const Polylines &polylines)
+{
+    this->write_varuint(polylines.size());
+    for (const Polyline &polyline : polylines)
+        this->write(polyline);
+}
+
+void BinaryWriter::write(const Surface &surface)
+{
+    this->write_uint8(uint8_t(surface.surface_type));
+    this->write(surface.expolygon);
+    this->write_double(surface.thickness);
+    this->write_varuint(surface.thickness_layers);
+    this->write_double(surface.bridge_angle);
+    this->write_varuint(surface.extra_perimeters);
+}
+
+void BinaryWriter::write(const Surfaces &surfaces)
+{
+    this->write_varuint(surfaces.size());
+    for (const Surface &surface : surfaces)
+        this->write(surface);
+}
+
+void BinaryWriter::write(const ExtrusionPath &path)
+{
+    this->write_uint8(uint8_t(path.role()));
+    this->write(path.polyline);
+    this->write_double(path.mm3_per_mm);
+    this->write_float(path.width);
+    this->write_float(path.height);
+    this->write_float(path.feedrate);
+    this->write_varuint(path.extruder_id);
+}
+
+void BinaryWriter::write(const ExtrusionPaths &paths)
+{
+    this->write_varuint(paths.size());
+    for (const ExtrusionPath &path : paths)
+        this->write(path);
+}
+
+void BinaryWriter::write(const ExtrusionEntityCollection &collection)
+{
+    this->write_uint8(collection.no_sort ? 1 : 0);
+    this->write_varuint(collection.orig_indices.size());
+    for (size_t idx : collection.orig_indices)
+        this->write_varuint(idx);
+    this->write_varuint(collection.entities.size());
+    for (const ExtrusionEntity *entity : collection.entities)
+        this->write_extrusion_entity(*entity);
+}
+
+void BinaryWriter::write_extrusion_entity(const ExtrusionEntity &entity)
+{
+    if (const ExtrusionPath *path = dynamic_cast<const ExtrusionPath*>(&entity)) {
+        this->write_uint8(eetPath);
+        this->write(*path);
+    } else if (const ExtrusionMultiPath *multipath = dynamic_cast<const ExtrusionMultiPath*>(&entity)) {
+        this->write_uint8(eetMultiPath);
+        this->write(multipath->paths);
+    } else if (const ExtrusionLoop *loop = dynamic_cast<const ExtrusionLoop*>(&entity)) {
+        this->write_uint8(eetLoop);
+        this->write_uint8(uint8_t(loop->loop_role()));
+        this->write(loop->paths);
+    } else if (const ExtrusionEntityCollection *collection = dynamic_cast<const ExtrusionEntityCollection*>(&entity)) {
+        this->write_uint8(eetCollection);
+        this->write(*collection);
+    } else
+        throw std::runtime_error("BinaryWriter: Unknown type of ExtrusionEntity");
+}
+
+void BinaryReader::throw_truncated()
+{
+    throw std::runtime_error("Binary data truncated or corrupted");
+}
+
+void BinaryReader::read(Points &points)
+{
+    // Each point occupies at least two bytes.
+    points.assign(this->read_count(2), Point());
+    Point prev(0, 0);
+    for (Point &pt : points) {
+        pt.x = coord_t(int64_t(prev.x) + this->read_varint());
+        pt.y = coord_t(int64_t(prev.y) + this->read_varint());
+        prev = pt;
+    }
+}
+
+void BinaryReader::read(Polygons &polygons)
+{
+    polygons.assign(this->read_count(), Polygon());
+    for (Polygon &polygon : polygons)
+        this->read(polygon);
+}
+
+void BinaryReader::read(ExPolygon &expolygon)
+{
+    this->read(expolygon.contour);
+    this->read(expolygon.holes);
+}
+
+void BinaryReader::read(ExPolygons &expolygons)
+{
+    // Each expolygon occupies at least two bytes.
+    expolygons.assign(this->read_count(2), ExPolygon());
+    for (ExPolygon &expolygon : expolygons)
+        this->read(expolygon);
+}
+
+void BinaryReader::read(Polylines &polylines)
+{
+    polylines.assign(this->read_count(), Polyline());
+    for (Polyline &polyline : polylines)
+        this->read(polyline);
+}
+
+void BinaryReader::read(Surface &surface)
+{
+    uint8_t surface_type = this->read_uint8();
+    if (surface_type >= stCount)
+        throw_truncated();
+    surface.surface_type     = SurfaceType(surface_type);
+    this->read(surface.expolygon);
+    surface.thickness        = this->read_double();
+    surface.thickness_layers = (unsigned short)this->read_varuint();
+    surface.bridge_angle     = this->read_double();
+    surface.extra_perimeters = (unsigned short)this->read_varuint();
+}
+
+void BinaryReader::read(Surfaces &surfaces)
+{
+    // Each surface occupies at least 21 bytes: the type, an empty contour and holes, two doubles and two varuints.
+    size_t count = this->read_count(21);
+    surfaces.clear();
+    surfaces.reserve(count);
+    for (size_t i = 0; i < count; ++ i) {
+        surfaces.emplace_back(stInternal, ExPolygon());
+        this->read(surfaces.back());
+    }
+}
+
+void BinaryReader::read(ExtrusionPath &path)
+{
+    uint8_t role = this->read_uint8();
+    if (role > erMixed)
+        throw_truncated();
+    path = ExtrusionPath(ExtrusionRole(role));
+    this->read(path.polyline);
+    path.mm3_per_mm  = this->read_double();
+    path.width       = this->read_float();
+    path.height      = this->read_float();
+    path.feedrate    = this->read_float();
+    path.extruder_id = (unsigned int)this->read_varuint();
+}
+
+void BinaryReader::read(ExtrusionPaths &paths)
+{
+    // Each path occupies at least 23 bytes: the role, an empty polyline, a double, three floats and a varuint.
+    paths.assign(this->read_count(23), ExtrusionPath(erNone));
+    for (ExtrusionPath &path : paths)
+        this->read(path);
+}
+
+void BinaryReader::read(ExtrusionEntityCollection &collection)
+{
+    if (++ m_depth > MAX_COLLECTION_DEPTH)
+        throw_truncated();
+    collection.clear();
+    collection.no_sort = this->read_uint8() != 0;
+    collection.orig_indices.assign(this->read_count(), 0);
+    for (size_t &idx : collection.orig_indices)
+        idx = size_t(this->read_varuint());
+    // Each entity occupies at least two bytes.
+    size_t count = this->read_count(2);
+    collection.entities.reserve(count);
+    for (size_t i = 0; i < count; ++ i)
+        collection.entities.push_back(this->read_extrusion_entity());
+    -- m_depth;
+}
+
+ExtrusionEntity* BinaryReader::read_extrusion_entity()
+{
+    switch (this->read_uint8()) {
+    case eetPath:
+    {
+        std::unique_ptr<ExtrusionPath> path(new ExtrusionPath(erNone));
+        this->read(*path);
+        return path.release();
+    }
+    case eetMultiPath:
+    {
+        std::unique_ptr<ExtrusionMultiPath> multipath(new ExtrusionMultiPath());
+        this->read(multipath->paths);
+        return multipath.release();
+    }
+    case eetLoop:
+    {
+        uint8_t loop_role = this->read_uint8();
+        if (loop_role > elrSkirt)
+            throw_truncated();
+        std::unique_ptr<ExtrusionLoop> loop(new ExtrusionLoop(ExtrusionLoopRole(loop_role)));
+        this->read(loop->paths);
+        return loop.release();
+    }
+    case eetCollection:
+    {
+        std::unique_ptr<ExtrusionEntityCollection> collection(new ExtrusionEntityCollection());
+        this->read(*collection);
+        return collection.release();
+    }
+    default:
+        throw_truncated();
+    }
+    return nullptr;
+}
+
+} // namespace Slic3r
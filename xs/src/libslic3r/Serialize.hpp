@@ -0,0 +1,132 @@
+#ifndef slic3r_Serialize_hpp_
+#define slic3r_Serialize_hpp_
+
+#include "libslic3r.h"
+#include <cstring>
+#include <string>
+#include "ExPolygon.hpp"
+#include "ExtrusionEntityCollection.hpp"
+#include "Point.hpp"
+#include "Polygon.hpp"
+#include "Polyline.hpp"
+#include "Surface.hpp"
+
+namespace Slic3r {
+
+// Compact binary serialization of the geometric data.
+// Integers are stored as variable length integers (7 bits per byte, little endian), signed integers are zigzag encoded,
+// the points of a polygon are stored as differences to the previous point, floating point values are stored verbatim.
+class BinaryWriter
+{
+public:
+    explicit BinaryWriter(std::string &out) : m_out(out) {}
+
+    void write_varuint(uint64_t value) {
+        while (value >= 0x80) {
+            m_out.push_back(char((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        m_out.push_back(char(value));
+    }
+    void write_varint(int64_t value) { this->write_varuint((uint64_t(value) << 1) ^ uint64_t(value >> 63)); }
+    void write_uint8(uint8_t value) { m_out.push_back(char(value)); }
+    // Stored in the byte order of the machine, all the supported platforms are little endian.
+    void write_double(double value) { this->write_bytes(&value, sizeof(value)); }
+    void write_float(float value) { this->write_bytes(&value, sizeof(value)); }
+    void write_bytes(const void *data, size_t size) { m_out.append((const char*)data, size); }
+
+    void write(const Points &points);
+    void write(const Polygon &polygon) { this->write(polygon.points); }
+    void write(const Polygons &polygons);
+    void write(const ExPolygon &expolygon);
+    void write(const ExPolygons &expolygons);
+    void write(const Polyline &polyline) { this->write(polyline.points); }
+    void write(const Polylines &polylines);
+    void write(const Surface &surface);
+    void write(const Surfaces &surfaces);
+    void write(const ExtrusionPath &path);
+    void write(const ExtrusionPaths &paths);
+    void write(const ExtrusionEntityCollection &collection);
+    // Any ExtrusionEntity, prefixed with a tag of its type.
+    void write_extrusion_entity(const ExtrusionEntity &entity);
+
+    std::string&        data()       { return m_out; }
+    const std::string&  data() const { return m_out; }
+
+private:
+    std::string &m_out;
+};
+
+// Reader of the data written by BinaryWriter. The reader does not own the data, it may read directly
+// from a memory mapped file. Throws std::runtime_error if the data is truncated.
+class BinaryReader
+{
+public:
+    BinaryReader(const char *begin, const char *end) : m_ptr(begin), m_end(end), m_depth(0) {}
+    explicit BinaryReader(const std::string &data) : m_ptr(data.data()), m_end(data.data() + data.size()), m_depth(0) {}
+
+    uint64_t read_varuint() {
+        uint64_t value = 0;
+        for (unsigned int shift = 0;; shift += 7) {
+            if (m_ptr == m_end || shift > 63)
+                throw_truncated();
+            uint8_t c = uint8_t(*m_ptr ++);
+            value |= uint64_t(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return value;
+        }
+    }
+    int64_t  read_varint() { uint64_t v = this->read_varuint(); return int64_t(v >> 1) ^ - int64_t(v & 1); }
+    uint8_t  read_uint8() { if (m_ptr == m_end) throw_truncated(); return uint8_t(*m_ptr ++); }
+    double   read_double() { double value; this->read_bytes(&value, sizeof(value)); return value; }
+    float    read_float() { float value; this->read_bytes(&value, sizeof(value)); return value; }
+    void     read_bytes(void *data, size_t size) {
+        if (size_t(m_end - m_ptr) < size)
+            throw_truncated();
+        memcpy(data, m_ptr, size);
+        m_ptr += size;
+    }
+    void     skip(size_t size) {
+        if (size_t(m_end - m_ptr) < size)
+            throw_truncated();
+        m_ptr += size;
+    }
+    // Number of elements of a container to be read. Each element occupies at least min_element_size bytes,
+    // so that a corrupted count does not allocate a huge amount of memory.
+    size_t   read_count(size_t min_element_size = 1) {
+        uint64_t count = this->read_varuint();
+        if (count > uint64_t(m_end - m_ptr) / min_element_size)
+            throw_truncated();
+        return size_t(count);
+    }
+
+    void read(Points &points);
+    void read(Polygon &polygon) { this->read(polygon.points); }
+    void read(Polygons &polygons);
+    void read(ExPolygon &expolygon);
+    void read(ExPolygons &expolygons);
+    void read(Polyline &polyline) { this->read(polyline.points); }
+    void read(Polylines &polylines);
+    void read(Surface &surface);
+    void read(Surfaces &surfaces);
+    void read(ExtrusionPath &path);
+    void read(ExtrusionPaths &paths);
+    void read(ExtrusionEntityCollection &collection);
+    // Returns a new ExtrusionEntity written by BinaryWriter::write_extrusion_entity(), owned by the caller.
+    ExtrusionEntity* read_extrusion_entity();
+
+    bool        eof() const { return m_ptr == m_end; }
+    const char* position() const { return m_ptr; }
+
+private:
+    static void throw_truncated();
+
+    const char *m_ptr;
+    const char *m_end;
+    // Nesting level of the ExtrusionEntityCollections being read, limited to not overflow the stack on corrupted data.
+    unsigned int m_depth;
+};
+
+} // namespace Slic3r
+
+#endif /* slic3r_Serialize_hpp_ */
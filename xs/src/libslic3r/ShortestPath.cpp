@@ -0,0 +1,184 @@
+#include "ShortestPath.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+namespace Slic3r {
+
+NearestEndPointLookup::NearestEndPointLookup(const Points &end_points, size_t end_points_per_item) :
+    m_end_points(end_points),
+    m_end_points_per_item(std::max<size_t>(1, end_points_per_item)),
+    m_item_removed(end_points.size() / m_end_points_per_item, false),
+    m_num_items_remaining(end_points.size() / m_end_points_per_item),
+    m_cell_size(1),
+    m_cols(0),
+    m_rows(0),
+    m_num_items_in_grid(0)
+{
+    assert(end_points.size() % m_end_points_per_item == 0);
+    this->build_grid();
+}
+
+void NearestEndPointLookup::build_grid()
+{
+    m_num_items_in_grid = m_num_items_remaining;
+    m_cell_start.clear();
+    m_cell_data.clear();
+    if (m_num_items_remaining == 0)
+        return;
+
+    Point pmin( std::numeric_limits<coord_t>::max(),  std::numeric_limits<coord_t>::max());
+    Point pmax(-std::numeric_limits<coord_t>::max(), -std::numeric_limits<coord_t>::max());
+    for (size_t i = 0; i < m_end_points.size(); ++ i)
+        if (! m_item_removed[i / m_end_points_per_item]) {
+            const Point &pt = m_end_points[i];
+            pmin.x = std::min(pmin.x, pt.x);
+            pmin.y = std::min(pmin.y, pt.y);
+            pmax.x = std::max(pmax.x, pt.x);
+            pmax.y = std::max(pmax.y, pt.y);
+        }
+    m_grid_min = pmin;
+
+    // Around two end points per cell for uniformly distributed points. The cells are enlarged for points spread
+    // along a line, so that the number of cells stays proportional to the number of points.
+    size_t  num_points = m_num_items_remaining * m_end_points_per_item;
+    int64_t width      = int64_t(pmax.x) - int64_t(pmin.x) + 1;
+    int64_t height     = int64_t(pmax.y) - int64_t(pmin.y) + 1;
+    double  cell_size  = std::sqrt(2. * double(width) * double(height) / double(num_points));
+    cell_size  = std::max(cell_size, double(std::max(width, height)) / double(num_points));
+    m_cell_size = std::max<int64_t>(1, int64_t(std::ceil(cell_size)));
+    m_cols      = (width  + m_cell_size - 1) / m_cell_size;
+    m_rows      = (height + m_cell_size - 1) / m_cell_size;
+
+    // Counting sort of the end points into the cells.
+    m_cell_start.assign(size_t(m_cols * m_rows + 1), 0);
+    for (size_t i = 0; i < m_end_points.size(); ++ i)
+        if (! m_item_removed[i / m_end_points_per_item]) {
+            const Point &pt = m_end_points[i];
+            ++ m_cell_start[size_t(((int64_t(pt.y) - pmin.y) / m_cell_size) * m_cols + (int64_t(pt.x) - pmin.x) / m_cell_size) + 1];
+        }
+    for (size_t i = 1; i < m_cell_start.size(); ++ i)
+        m_cell_start[i] += m_cell_start[i - 1];
+    m_cell_data.assign(num_points, 0);
+    std::vector<size_t> cell_end(m_cell_start.begin(), m_cell_start.end() - 1);
+    for (size_t i = 0; i < m_end_points.size(); ++ i)
+        if (! m_item_removed[i / m_end_points_per_item]) {
+            const Point &pt = m_end_points[i];
+            m_cell_data[cell_end[size_t(((int64_t(pt.y) - pmin.y) / m_cell_size) * m_cols + (int64_t(pt.x) - pmin.x) / m_cell_size)] ++] = i;
+        }
+}
+
+void NearestEndPointLookup::search_cell(int64_t col, int64_t row, const Point &pt, size_t &idx_min, double &dist_min) const
+{
+    if (col < 0 || col >= m_cols || row < 0 || row >= m_rows)
+        return;
+    size_t cell = size_t(row * m_cols + col);
+    for (size_t i = m_cell_start[cell]; i < m_cell_start[cell + 1]; ++ i) {
+        size_t idx = m_cell_data[i];
+        if (m_item_removed[idx / m_end_points_per_item])
+            continue;
+        const Point &pt2 = m_end_points[idx];
+        // Same arithmetic as Point::nearest_point_index().
+        double d = sqr<double>(pt.x - pt2.x) + sqr<double>(pt.y - pt2.y);
+        // Point::nearest_point_index() stops at the first point at a zero distance,
+        // otherwise it picks the last one of the points at the minimum distance.
+        if (idx_min == size_t(-1) || d < dist_min || (d == dist_min && (d < EPSILON ? idx < idx_min : idx > idx_min))) {
+            idx_min  = idx;
+            dist_min = d;
+        }
+    }
+}
+
+size_t NearestEndPointLookup::pop_nearest(const Point &pt)
+{
+    assert(! this->empty());
+    if (m_num_items_in_grid > 64 && m_num_items_remaining * 4 < m_num_items_in_grid)
+        // Most of the cells are empty, shrink the grid to the remaining end points.
+        this->build_grid();
+
+    // Cell of pt, which may be outside of the grid.
+    auto    floor_div = [](int64_t a, int64_t b) { return (a >= 0) ? a / b : - ((- a + b - 1) / b); };
+    int64_t col = floor_div(int64_t(pt.x) - m_grid_min.x, m_cell_size);
+    int64_t row = floor_div(int64_t(pt.y) - m_grid_min.y, m_cell_size);
+    // Skip the rings not touching the grid.
+    int64_t r = std::max(std::max<int64_t>(0, std::max(- col, col - (m_cols - 1))), std::max(- row, row - (m_rows - 1)));
+
+    size_t  idx_min  = size_t(-1);
+    double  dist_min = std::numeric_limits<double>::max();
+    for (;; ++ r) {
+        if (r == 0)
+            this->search_cell(col, row, pt, idx_min, dist_min);
+        else {
+            int64_t col_min = std::max<int64_t>(col - r, 0);
+            int64_t col_max = std::min<int64_t>(col + r, m_cols - 1);
+            for (int64_t c = col_min; c <= col_max; ++ c) {
+                this->search_cell(c, row - r, pt, idx_min, dist_min);
+                this->search_cell(c, row + r, pt, idx_min, dist_min);
+            }
+            int64_t row_min = std::max<int64_t>(row - r + 1, 0);
+            int64_t row_max = std::min<int64_t>(row + r - 1, m_rows - 1);
+            for (int64_t rw = row_min; rw <= row_max; ++ rw) {
+                this->search_cell(col - r, rw, pt, idx_min, dist_min);
+                this->search_cell(col + r, rw, pt, idx_min, dist_min);
+            }
+        }
+        if (col - r <= 0 && col + r >= m_cols - 1 && row - r <= 0 && row + r >= m_rows - 1)
+            // The whole grid was searched.
+            break;
+        if (idx_min != size_t(-1)) {
+            // All the end points not searched yet are at least this far from pt.
+            int64_t dist_outside = std::min(
+                std::min(int64_t(pt.x) - (m_grid_min.x + (col - r) * m_cell_size), m_grid_min.x + (col + r + 1) * m_cell_size - int64_t(pt.x)),
+                std::min(int64_t(pt.y) - (m_grid_min.y + (row - r) * m_cell_size), m_grid_min.y + (row + r + 1) * m_cell_size - int64_t(pt.y)));
+            // Another end point at the same distance may win the tie, therefore the strict comparison.
+            if (dist_min < sqr(double(dist_outside)))
+                break;
+        }
+    }
+
+    assert(idx_min != size_t(-1));
+    m_item_removed[idx_min / m_end_points_per_item] = true;
+    -- m_num_items_remaining;
+    return idx_min;
+}
+
+void improve_chain_2opt(std::vector<ChainItem> &chain, const Point &start_point, double time_limit)
+{
+    if (chain.empty() || time_limit <= 0.)
+        return;
+
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point deadline = clock::now() + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(time_limit));
+
+    for (bool improved = true; improved;) {
+        improved = false;
+        for (size_t i = 0; i < chain.size(); ++ i) {
+            if (clock::now() > deadline)
+                return;
+            const Point &prev = (i == 0) ? start_point : chain[i - 1].last_point;
+            // Reverse the sub-chain chain[i..j], it must not contain an item, which cannot be reversed.
+            for (size_t j = i; j < chain.size() && chain[j].can_reverse; ++ j) {
+                double dist_old = prev.distance_to(chain[i].first_point);
+                double dist_new = prev.distance_to(chain[j].last_point);
+                if (j + 1 < chain.size()) {
+                    const Point &next = chain[j + 1].first_point;
+                    dist_old += chain[j].last_point.distance_to(next);
+                    dist_new += chain[i].first_point.distance_to(next);
+                }
+                if (dist_new + SCALED_EPSILON < dist_old) {
+                    std::reverse(chain.begin() + i, chain.begin() + j + 1);
+                    for (size_t k = i; k <= j; ++ k) {
+                        std::swap(chain[k].first_point, chain[k].last_point);
+                        chain[k].reversed = ! chain[k].reversed;
+                    }
+                    improved = true;
+                }
+            }
+        }
+    }
+}
+
+} // namespace Slic3r
@@ -0,0 +1,74 @@
+// Ordering of items (points, extrusion paths) to shorten the travel moves between them.
+
+#ifndef slic3r_ShortestPath_hpp_
+#define slic3r_ShortestPath_hpp_
+
+#include "libslic3r.h"
+#include "Point.hpp"
+
+#include <vector>
+
+namespace Slic3r {
+
+// Lookup of the end point closest to a query point for the greedy nearest neighbor chaining.
+// Each item has end_points_per_item consecutive end points (a path has two, its first and its last point),
+// an item is removed from the lookup once one of its end points is picked.
+// The end points are binned into a regular grid, the grid cells are searched in rings around the query point.
+// The end point returned is the one Point::nearest_point_index() would return for the list of the end points
+// of the remaining items: the first end point at a zero distance, otherwise the last one of the closest end points.
+// Therefore the chaining produces the same order as the former O(n^2) search.
+class NearestEndPointLookup
+{
+public:
+    NearestEndPointLookup(const Points &end_points, size_t end_points_per_item);
+
+    bool   empty() const { return m_num_items_remaining == 0; }
+    // Find the end point closest to pt, remove its item from the lookup and return the index of the end point.
+    // Must not be called on an empty lookup.
+    size_t pop_nearest(const Point &pt);
+
+private:
+    // Bin the end points of the remaining items into a grid spanning their bounding box.
+    void   build_grid();
+    void   search_cell(int64_t col, int64_t row, const Point &pt, size_t &idx_min, double &dist_min) const;
+
+    const Points           &m_end_points;
+    size_t                  m_end_points_per_item;
+    std::vector<bool>       m_item_removed;
+    size_t                  m_num_items_remaining;
+
+    // Grid of end point indices in a compressed form: the end points of cell i are
+    // m_cell_data[m_cell_start[i] .. m_cell_start[i + 1]), the entries of the removed items are skipped.
+    Point                   m_grid_min;
+    int64_t                 m_cell_size;
+    int64_t                 m_cols;
+    int64_t                 m_rows;
+    std::vector<size_t>     m_cell_start;
+    std::vector<size_t>     m_cell_data;
+    // Number of items binned into the grid, the grid is rebuilt once most of them were removed.
+    size_t                  m_num_items_in_grid;
+};
+
+// Item of a chain to be improved by improve_chain_2opt().
+struct ChainItem
+{
+    ChainItem(const Point &first_point, const Point &last_point, bool can_reverse, size_t idx) :
+        first_point(first_point), last_point(last_point), can_reverse(can_reverse), reversed(false), idx(idx) {}
+
+    Point   first_point;
+    Point   last_point;
+    bool    can_reverse;
+    // Set if the item was reversed by the improvement, first_point and last_point are swapped already.
+    bool    reversed;
+    // Index of the item in the source container.
+    size_t  idx;
+};
+
+// Improve a chain of items starting at start_point with 2-opt moves: a sub-chain of reversible items
+// is reversed together with its items, if that shortens the travel from start_point over all the items.
+// Stops at a local optimum or after time_limit seconds, whichever comes first.
+void improve_chain_2opt(std::vector<ChainItem> &chain, const Point &start_point, double time_limit);
+
+} // namespace Slic3r
+
+#endif /* slic3r_ShortestPath_hpp_ */
@@ -0,0 +1,114 @@
+#include "SliceCache.hpp"
+
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+#include <iterator>
+
+#include <boost/filesystem.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/nowide/fstream.hpp>
+
+namespace Slic3r {
+
+static std::string g_slice_cache_dir;
+
+void set_slice_cache_dir(const std::string &dir)
+{
+    g_slice_cache_dir = dir;
+}
+
+const std::string& slice_cache_dir()
+{
+    return g_slice_cache_dir;
+}
+
+// Header of a cache file: magic, format version, the digest of the key the data was stored with.
+static const char     SLICE_CACHE_MAGIC[8] = { 'S', 'L', 'I', 'C', 'E', 'S', 'C', 'F' };
+static const uint32_t SLICE_CACHE_VERSION  = 2;
+static const size_t   SLICE_CACHE_HEADER_SIZE = sizeof(SLICE_CACHE_MAGIC) + sizeof(uint32_t) + SliceCacheKey::DIGEST_SIZE;
+
+std::string SliceCacheKey::digest() const
+{
+    // Finishing the digest modifies the state, finish a copy, so that more data may be added to this key.
+    boost::uuids::detail::sha1 sha1 = m_sha1;
+    boost::uuids::detail::sha1::digest_type words;
+    sha1.get_digest(words);
+    std::string out;
+    out.reserve(DIGEST_SIZE);
+    for (unsigned int word : words)
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out += char((word >> shift) & 0x0ff);
+    return out;
+}
+
+std::string SliceCacheKey::to_string() const
+{
+    static const char hex[] = "0123456789abcdef";
+    std::string out;
+    for (char c : this->digest()) {
+        out += hex[(unsigned char)c >> 4];
+        out += hex[(unsigned char)c & 0x0f];
+    }
+    return out;
+}
+
+static boost::filesystem::path slice_cache_path(const SliceCacheKey &key)
+{
+    return boost::filesystem::path(g_slice_cache_dir) / (key.to_string() + ".slices");
+}
+
+bool load_cached_slices(const SliceCacheKey &key, std::string &data)
+{
+    if (g_slice_cache_dir.empty())
+        return false;
+    boost::filesystem::path path = slice_cache_path(key);
+    boost::nowide::ifstream file(path.string(), std::ios::in | std::ios::binary);
+    if (! file.good())
+        return false;
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    uint32_t version = 0;
+    if (data.size() >= SLICE_CACHE_HEADER_SIZE)
+        memcpy(&version, data.data() + sizeof(SLICE_CACHE_MAGIC), sizeof(version));
+    // The full digest is compared, not just the file name.
+    if (data.size() < SLICE_CACHE_HEADER_SIZE || memcmp(data.data(), SLICE_CACHE_MAGIC, sizeof(SLICE_CACHE_MAGIC)) != 0 ||
+        version != SLICE_CACHE_VERSION || data.compare(sizeof(SLICE_CACHE_MAGIC) + sizeof(version), SliceCacheKey::DIGEST_SIZE, key.digest()) != 0) {
+        BOOST_LOG_TRIVIAL(warning) << "Ignoring invalid slice cache file " << path.string();
+        data.clear();
+        return false;
+    }
+    data.erase(0, SLICE_CACHE_HEADER_SIZE);
+    BOOST_LOG_TRIVIAL(debug) << "Loaded slices from the cache file " << path.string();
+    return true;
+}
+
+void store_cached_slices(const SliceCacheKey &key, const std::string &data)
+{
+    if (g_slice_cache_dir.empty())
+        return;
+    boost::filesystem::path path = slice_cache_path(key);
+    // Write into a temporary file first, so that a concurrently running slicer never reads a partially written file.
+    boost::filesystem::path path_tmp = path.parent_path() / boost::filesystem::unique_path("%%%%-%%%%-%%%%-%%%%.tmp");
+    try {
+        boost::filesystem::create_directories(path.parent_path());
+        {
+            boost::nowide::ofstream file(path_tmp.string(), std::ios::out | std::ios::binary | std::ios::trunc);
+            file.write(SLICE_CACHE_MAGIC, sizeof(SLICE_CACHE_MAGIC));
+            file.write((const char*)&SLICE_CACHE_VERSION, sizeof(SLICE_CACHE_VERSION));
+            std::string digest = key.digest();
+            file.write(digest.data(), digest.size());
+            file.write(data.data(), data.size());
+            file.close();
+            if (file.fail())
+                throw std::runtime_error("Failed writing " + path_tmp.string());
+        }
+        boost::filesystem::rename(path_tmp, path);
+        BOOST_LOG_TRIVIAL(debug) << "Stored slices to the cache file " << path.string();
+    } catch (const std::exception &ex) {
+        boost::system::error_code ec;
+        boost::filesystem::remove(path_tmp, ec);
+        BOOST_LOG_TRIVIAL(warning) << "Failed to store slices to the cache file " << path.string() << ": " << ex.what();
+    }
+}
+
+} // namespace Slic3r
@@ -0,0 +1,49 @@
+#ifndef slic3r_SliceCache_hpp_
+#define slic3r_SliceCache_hpp_
+
+#include "libslic3r.h"
+#include <string>
+#include <vector>
+
+#include <boost/uuid/detail/sha1.hpp>
+
+namespace Slic3r {
+
+// Set a directory to store the slices of the print objects in, so that an object with the same meshes
+// sliced with the same parameters is not sliced again. The cache is disabled if the directory is empty.
+void set_slice_cache_dir(const std::string &dir);
+// Return a full path to the slice cache directory.
+const std::string& slice_cache_dir();
+
+// SHA-1 digest of all the data the slices of a PrintObject depend on: the meshes, the transformation,
+// the Z ranges of the layers and the configuration options applied by PrintObject::_slice().
+class SliceCacheKey
+{
+public:
+    static const size_t DIGEST_SIZE = 20;
+
+    void add(const void *data, size_t size) { m_sha1.process_bytes(data, size); }
+    void add(double value) { this->add(&value, sizeof(value)); }
+    void add(uint64_t value) { this->add(&value, sizeof(value)); }
+    void add(const std::vector<double> &values) { this->add(uint64_t(values.size())); this->add(values.data(), values.size() * sizeof(double)); }
+    void add(const std::string &value) { this->add(uint64_t(value.size())); this->add(value.data(), value.size()); }
+
+    // Digest of the data added so far, DIGEST_SIZE bytes.
+    std::string digest() const;
+    // File name of the cached slices, the digest in hexadecimal.
+    std::string to_string() const;
+    bool operator==(const SliceCacheKey &rhs) const { return this->digest() == rhs.digest(); }
+    bool operator!=(const SliceCacheKey &rhs) const { return ! (*this == rhs); }
+
+private:
+    boost::uuids::detail::sha1 m_sha1;
+};
+
+// Load the serialized slices stored under the key. Returns false if the cache is disabled or if there are no valid slices stored.
+bool load_cached_slices(const SliceCacheKey &key, std::string &data);
+// Store the serialized slices under the key. Failures are logged and otherwise ignored.
+void store_cached_slices(const SliceCacheKey &key, const std::string &data);
+
+} // namespace Slic3r
+
+#endif /* slic3r_SliceCache_hpp_ */
@@ -14,7 +14,6 @@
 
 #include <tbb/parallel_for.h>
 #include <tbb/atomic.h>
-#include <tbb/spin_mutex.h>
 #include <tbb/task_group.h>
 
 // #define SLIC3R_DEBUG
@@ -184,27 +183,66 @@ PrintObjectSupportMaterial::PrintObjectSupportMaterial(const PrintObject *object
     }
 }
 
-// Using the std::deque as an allocator.
-inline PrintObjectSupportMaterial::MyLayer& layer_allocate(
-    std::deque<PrintObjectSupportMaterial::MyLayer> &layer_storage, 
-    PrintObjectSupportMaterial::SupporLayerType      layer_type)
-{ 
-    layer_storage.push_back(PrintObjectSupportMaterial::MyLayer());
-    layer_storage.back().layer_type = layer_type;
-    return layer_storage.back();
+PrintObjectSupportMaterial::MyLayer& PrintObjectSupportMaterial::MyLayerStorage::allocate(SupporLayerType layer_type)
+{
+    // Chunk chunk_idx holds the layers [chunk_size(chunk_idx) - chunk_size(0), 2 * chunk_size(chunk_idx) - chunk_size(0)).
+    size_t idx       = m_size ++ + chunk_size(0);
+    size_t chunk_idx = 0;
+    while (idx >= chunk_size(chunk_idx + 1))
+        ++ chunk_idx;
+    assert(chunk_idx < NUM_CHUNKS);
+    MyLayer *chunk = m_chunks[chunk_idx].load();
+    if (chunk == nullptr) {
+        // The first thread to touch this chunk allocates it, the others throw their allocation away.
+        MyLayer *chunk_new = new MyLayer[chunk_size(chunk_idx)];
+        if (m_chunks[chunk_idx].compare_exchange_strong(chunk, chunk_new))
+            chunk = chunk_new;
+        else
+            delete [] chunk_new;
+    }
+    MyLayer &layer = chunk[idx - chunk_size(chunk_idx)];
+    layer.layer_type = layer_type;
+    return layer;
+}
+
+void PrintObjectSupportMaterial::MyLayerStorage::clear()
+{
+    for (auto &chunk : m_chunks) {
+        delete [] chunk.load();
+        chunk = nullptr;
+    }
+    m_size = 0;
 }
 
-inline PrintObjectSupportMaterial::MyLayer& layer_allocate(
-    std::deque<PrintObjectSupportMaterial::MyLayer> &layer_storage,
-    tbb::spin_mutex                                 &layer_storage_mutex,
-    PrintObjectSupportMaterial::SupporLayerType      layer_type)
-{ 
-    layer_storage_mutex.lock();
-    layer_storage.push_back(PrintObjectSupportMaterial::MyLayer());
-    PrintObjectSupportMaterial::MyLayer *layer_new = &layer_storage.back();
-    layer_storage_mutex.unlock();
-    layer_new->layer_type = layer_type;
-    return *layer_new;
+size_t PrintObjectSupportMaterial::MyLayerStorage::memory_used() const
+{
+    auto polygons_memory = [](const Polygons &polygons) {
+        size_t out = polygons.capacity() * sizeof(Polygon);
+        for (const Polygon &polygon : polygons)
+            out += polygon.points.capacity() * sizeof(Point);
+        return out;
+    };
+    // Only the layers handed out by allocate() are counted, not the unused tail of the last chunk.
+    size_t out  = 0;
+    size_t size = m_size;
+    for (size_t chunk_idx = 0; chunk_idx < NUM_CHUNKS; ++ chunk_idx) {
+        // Index of the first layer of this chunk, see allocate().
+        size_t first = chunk_size(chunk_idx) - chunk_size(0);
+        const MyLayer *chunk = m_chunks[chunk_idx].load();
+        if (first >= size || chunk == nullptr)
+            break;
+        size_t num_layers = std::min(chunk_size(chunk_idx), size - first);
+        out += num_layers * sizeof(MyLayer);
+        for (size_t i = 0; i < num_layers; ++ i) {
+            const MyLayer &layer = chunk[i];
+            out += polygons_memory(layer.polygons);
+            if (layer.contact_polygons != nullptr)
+                out += sizeof(Polygons) + polygons_memory(*layer.contact_polygons);
+            if (layer.overhang_polygons != nullptr)
+                out += sizeof(Polygons) + polygons_memory(*layer.overhang_polygons);
+        }
+    }
+    return out;
 }
 
 inline void layers_append(PrintObjectSupportMaterial::MyLayersPtr &dst, const PrintObjectSupportMaterial::MyLayersPtr &src)
@@ -228,7 +266,7 @@ void PrintObjectSupportMaterial::generate(PrintObject &object)
     for (size_t i = 0; i < object.layer_count(); ++ i)
         max_object_layer_height = std::max(max_object_layer_height, object.layers[i]->height);
 
-    // Layer instances will be allocated by std::deque and they will be kept until the end of this function call.
+    // Layer instances will be allocated by the layer_storage and they will be kept until the end of this function call.
     // The layers will be referenced by various LayersPtr (of type std::vector<Layer*>)
     MyLayerStorage layer_storage;
 
@@ -412,7 +450,9 @@ void PrintObjectSupportMaterial::generate(PrintObject &object)
     }
 #endif /* SLIC3R_DEBUG */
 
-    BOOST_LOG_TRIVIAL(info) << "Support generator - End";
+    // All the support layers are released at once with the layer_storage.
+    BOOST_LOG_TRIVIAL(info) << "Support generator - End, " << layer_storage.size() << " support layers allocated, memory used by the support layers: " 
+        << layer_storage.memory_used() / 1024 << "kB";
 }
 
 // Collect all polygons of all regions in a layer with a given surface type.
@@ -681,9 +721,8 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::top_contact_
     // So layer_id == 0 means first object layer and layer->id == 0 means first print layer if there are no explicit raft layers.
     size_t num_layers = this->has_support() ? object.layer_count() : 1;
     contact_out.assign(num_layers, nullptr);
-    tbb::spin_mutex layer_storage_mutex;
     tbb::parallel_for(tbb::blocked_range<size_t>(this->has_raft() ? 0 : 1, num_layers),
-        [this, &object, &buildplate_covered, threshold_rad, &layer_storage, &layer_storage_mutex, &contact_out](const tbb::blocked_range<size_t>& range) {
+        [this, &object, &buildplate_covered, threshold_rad, &layer_storage, &contact_out](const tbb::blocked_range<size_t>& range) {
             for (size_t layer_id = range.begin(); layer_id < range.end(); ++ layer_id) 
             {
                 const Layer &layer = *object.layers[layer_id];
@@ -882,7 +921,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::top_contact_
                 // now apply the contact areas to the layer were they need to be made
                 if (! contact_polygons.empty()) {
                     // get the average nozzle diameter used on this layer
-                    MyLayer     &new_layer = layer_allocate(layer_storage, layer_storage_mutex, sltTopContact);
+                    MyLayer     &new_layer = layer_storage.allocate(sltTopContact);
                     new_layer.idx_object_layer_above = layer_id;
                     if (m_slicing_params.soluble_interface) {
                         // Align the contact surface height with a layer immediately below the supported layer.
@@ -966,9 +1005,28 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::top_contact_
     return contact_out;
 }
 
+// Support grid of a single object layer, from which the layer support areas are extracted
+// asynchronously to the top-down sweep of bottom_contact_layers_and_layer_support_areas().
+struct LayerSupportGridPattern
+{
+    LayerSupportGridPattern(Polygons &&projection, const Polygons &trimming, coordf_t support_spacing, coordf_t support_angle) :
+        projection(std::move(projection)), pattern(this->projection, trimming, support_spacing, support_angle) {}
+
+    // Cleaned up projection of the contact areas, referenced by pattern.
+    Polygons            projection;
+    SupportGridPattern  pattern;
+};
+
 // Generate bottom contact layers supporting the top contact layers.
 // For a soluble interface material synchronize the layer heights with the object, 
 // otherwise set the layer height to a bridging flow of a support interface nozzle.
+//
+// Only the projection of the contact areas is carried from layer to layer, therefore the layers are swept top-down
+// sequentially with just the projection being calculated on the sweep. All the work not depending on the projection
+// of the layer above is moved out of the sweep: the trimming polygons, the top surfaces and the contact projections
+// are calculated in parallel in advance, while the layer support areas and the bottom contact layers are generated
+// by tasks spawned from the sweep. The trimming of the support areas by the bottom contacts is done in parallel
+// once the sweep finishes, in the same order as if it was done sequentially.
 PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::bottom_contact_layers_and_layer_support_areas(
     const PrintObject &object, const MyLayersPtr &top_contacts, MyLayerStorage &layer_storage,
     std::vector<Polygons> &layer_support_areas) const
@@ -987,7 +1045,54 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::bottom_conta
 
     if (! top_contacts.empty()) 
     {
-        // There is some support to be built, if there are non-empty top surfaces detected.
+        BOOST_LOG_TRIVIAL(debug) << "PrintObjectSupportMaterial::bottom_contact_layers() in parallel - start";
+        // Number of object layers, which may receive a projection of some contact area.
+        size_t num_layers = 0;
+        while (num_layers + 1 < object.total_layer_count() && object.get_layer(int(num_layers))->print_z <= top_contacts.back()->print_z)
+            ++ num_layers;
+        // Polygons to trim the projection with, one per object layer.
+        std::vector<Polygons> layer_trimming(num_layers);
+        // Top surfaces of the object layers, to be used to stop the surface volume from growing down.
+        std::vector<Polygons> layer_top(num_layers);
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, num_layers),
+            [this, &object, &layer_trimming, &layer_top](const tbb::blocked_range<size_t>& range) {
+                for (size_t layer_id = range.begin(); layer_id < range.end(); ++ layer_id) {
+                    const Layer &layer = *object.get_layer(int(layer_id));
+                    // Remove the areas that touched from the projection that will continue on next, lower, top surfaces.
+        //            Polygons trimming = union_(to_polygons(layer.slices.expolygons), touching, true);
+                    layer_trimming[layer_id] = offset(layer.slices.expolygons, float(SCALED_EPSILON));
+                    if (! m_object_config->support_material_buildplate_only)
+                        layer_top[layer_id] = collect_region_slices_by_type(layer, stTop);
+                }
+            });
+        // Projections of the contact areas, one per top contact layer.
+        std::vector<Polygons> contact_projections(top_contacts.size());
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, top_contacts.size()),
+            [&top_contacts, &contact_projections](const tbb::blocked_range<size_t>& range) {
+                for (size_t contact_idx = range.begin(); contact_idx < range.end(); ++ contact_idx) {
+                    Polygons polygons_new;
+                    // Contact surfaces are expanded away from the object, trimmed by the object.
+                    // Use a slight positive offset to overlap the touching regions.
+#if 0
+                    // Merge and collect the contact polygons. The contact polygons are inflated, but not extended into a grid form.
+                    polygons_append(polygons_new, offset(*top_contacts[contact_idx]->contact_polygons, SCALED_EPSILON));
+#else
+                    // Consume the contact_polygons. The contact polygons are already expanded into a grid form.
+                    polygons_append(polygons_new, std::move(*top_contacts[contact_idx]->contact_polygons));
+#endif
+                    // These are the overhang surfaces. They are touching the object and they are not expanded away from the object.
+                    // Use a slight positive offset to overlap the touching regions.
+                    polygons_append(polygons_new, offset(*top_contacts[contact_idx]->overhang_polygons, float(SCALED_EPSILON)));
+                    contact_projections[contact_idx] = union_(polygons_new);
+                }
+            });
+
+        // Bottom contact layers and the areas trimming the support areas above them, one per object layer.
+        MyLayersPtr           layer_bottom_contacts(num_layers, nullptr);
+        std::vector<Polygons> layer_touching(num_layers);
+        // Tasks generating the layer support areas and the bottom contact layers.
+        tbb::task_group       task_group;
+
         // Sum of unsupported contact areas above the current layer.print_z.
         Polygons  projection;
         // Last top contact layer visited when collecting the projection of contact areas.
@@ -996,39 +1101,25 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::bottom_conta
             BOOST_LOG_TRIVIAL(trace) << "Support generator - bottom_contact_layers - layer " << layer_id;
             const Layer &layer = *object.get_layer(layer_id);
             // Collect projections of all contact areas above or at the same level as this top surface.
-            for (; contact_idx >= 0 && top_contacts[contact_idx]->print_z >= layer.print_z; -- contact_idx) {
-                Polygons polygons_new;
-                // Contact surfaces are expanded away from the object, trimmed by the object.
-                // Use a slight positive offset to overlap the touching regions.
-#if 0
-                // Merge and collect the contact polygons. The contact polygons are inflated, but not extended into a grid form.
-                polygons_append(polygons_new, offset(*top_contacts[contact_idx]->contact_polygons, SCALED_EPSILON));
-#else
-                // Consume the contact_polygons. The contact polygons are already expanded into a grid form.
-                polygons_append(polygons_new, std::move(*top_contacts[contact_idx]->contact_polygons));
-#endif
-                // These are the overhang surfaces. They are touching the object and they are not expanded away from the object.
-                // Use a slight positive offset to overlap the touching regions.
-                polygons_append(polygons_new, offset(*top_contacts[contact_idx]->overhang_polygons, float(SCALED_EPSILON)));
-                polygons_append(projection, union_(polygons_new));
-            }
+            for (; contact_idx >= 0 && top_contacts[contact_idx]->print_z >= layer.print_z; -- contact_idx)
+                polygons_append(projection, std::move(contact_projections[contact_idx]));
             if (projection.empty())
                 continue;
-            Polygons projection_raw = union_(projection);
+            assert(layer_id < int(num_layers));
+            std::shared_ptr<Polygons> projection_raw = std::make_shared<Polygons>(union_(projection));
 
-            // Top surfaces of this layer, to be used to stop the surface volume from growing down.
-            tbb::task_group task_group;
-            if (! m_object_config->support_material_buildplate_only)
-                task_group.run([this, &object, &top_contacts, contact_idx, &layer, layer_id, &layer_storage, &layer_support_areas, &bottom_contacts, &projection_raw] {
-                    Polygons top = collect_region_slices_by_type(layer, stTop);
+            const Polygons &top = layer_top[layer_id];
+            if (! top.empty())
+                task_group.run([this, &object, &top_contacts, contact_idx, &layer, layer_id, &top, projection_raw, 
+                    &layer_storage, &layer_bottom_contacts, &layer_touching] {
         #ifdef SLIC3R_DEBUG
                     {
-                        BoundingBox bbox = get_extents(projection_raw);
+                        BoundingBox bbox = get_extents(*projection_raw);
                         bbox.merge(get_extents(top));
                         ::Slic3r::SVG svg(debug_out_path("support-bottom-layers-raw-%d-%lf.svg", iRun, layer.print_z), bbox);
                         svg.draw(union_ex(top, false), "blue", 0.5f);
-                        svg.draw(union_ex(projection_raw, true), "red", 0.5f);
-                        svg.draw_outline(union_ex(projection_raw, true), "red", "blue", scale_(0.1f));
+                        svg.draw(union_ex(*projection_raw, true), "red", 0.5f);
+                        svg.draw_outline(union_ex(*projection_raw, true), "red", "blue", scale_(0.1f));
                         svg.draw(layer.slices.expolygons, "green", 0.5f);
                     }
         #endif /* SLIC3R_DEBUG */
@@ -1037,154 +1128,158 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::bottom_conta
                     // top surfaces above layer.print_z falls onto this top surface. 
                     // Touching are the contact surfaces supported exclusively by this top surfaces.
                     // Don't use a safety offset as it has been applied during insertion of polygons.
-                    if (! top.empty()) {
-                        Polygons touching = intersection(top, projection_raw, false);
-                        if (! touching.empty()) {
-                            // Allocate a new bottom contact layer.
-                            MyLayer &layer_new = layer_allocate(layer_storage, sltBottomContact);
-                            bottom_contacts.push_back(&layer_new);
-                            // Grow top surfaces so that interface and support generation are generated
-                            // with some spacing from object - it looks we don't need the actual
-                            // top shapes so this can be done here
-                            layer_new.height  = m_slicing_params.soluble_interface ? 
-                                // Align the interface layer with the object's layer height.
-                                object.layers[layer_id + 1]->height :
-                                // Place a bridge flow interface layer over the top surface.
-                                m_support_material_interface_flow.nozzle_diameter;
-                            layer_new.print_z = m_slicing_params.soluble_interface ? object.layers[layer_id + 1]->print_z :
-                                layer.print_z + layer_new.height + m_object_config->support_material_contact_distance.value;
-                            layer_new.bottom_z = layer.print_z;
-                            layer_new.idx_object_layer_below = layer_id;
-                            layer_new.bridging = ! m_slicing_params.soluble_interface;
-                            //FIXME how much to inflate the top surface?
-                            layer_new.polygons = offset(touching, float(m_support_material_flow.scaled_width()), SUPPORT_SURFACES_OFFSET_PARAMETERS);
-                            if (! m_slicing_params.soluble_interface) {
-                                // Walk the top surfaces, snap the top of the new bottom surface to the closest top of the top surface,
-                                // so there will be no support surfaces generated with thickness lower than m_support_layer_height_min.
-                                for (size_t top_idx = size_t(std::max<int>(0, contact_idx)); 
-                                    top_idx < top_contacts.size() && top_contacts[top_idx]->print_z < layer_new.print_z + this->m_support_layer_height_min; 
-                                    ++ top_idx) {
-                                    if (top_contacts[top_idx]->print_z > layer_new.print_z - this->m_support_layer_height_min) {
-                                        // A top layer has been found, which is close to the new bottom layer.
-                                        coordf_t diff = layer_new.print_z - top_contacts[top_idx]->print_z;
-                                        assert(std::abs(diff) <= this->m_support_layer_height_min);
-                                        if (diff > 0.) {
-                                            // The top contact layer is below this layer. Make the bridging layer thinner to align with the existing top layer.
-                                            assert(diff < layer_new.height + EPSILON);
-                                            assert(layer_new.height - diff >= this->m_support_layer_height_min - EPSILON);
-                                            layer_new.print_z  = top_contacts[top_idx]->print_z;
-                                            layer_new.height  -= diff;
-                                        } else {
-                                            // The top contact layer is above this layer. One may either make this layer thicker or thinner.
-                                            // By making the layer thicker, one will decrease the number of discrete layers with the price of extruding a bit too thick bridges.
-                                            // By making the layer thinner, one adds one more discrete layer.
-                                            layer_new.print_z  = top_contacts[top_idx]->print_z;
-                                            layer_new.height  -= diff;
-                                        }
-                                        break;
+                    Polygons touching = intersection(top, *projection_raw, false);
+                    if (! touching.empty()) {
+                        // Allocate a new bottom contact layer.
+                        MyLayer &layer_new = layer_storage.allocate(sltBottomContact);
+                        layer_bottom_contacts[layer_id] = &layer_new;
+                        // Grow top surfaces so that interface and support generation are generated
+                        // with some spacing from object - it looks we don't need the actual
+                        // top shapes so this can be done here
+                        layer_new.height  = m_slicing_params.soluble_interface ? 
+                            // Align the interface layer with the object's layer height.
+                            object.layers[layer_id + 1]->height :
+                            // Place a bridge flow interface layer over the top surface.
+                            m_support_material_interface_flow.nozzle_diameter;
+                        layer_new.print_z = m_slicing_params.soluble_interface ? object.layers[layer_id + 1]->print_z :
+                            layer.print_z + layer_new.height + m_object_config->support_material_contact_distance.value;
+                        layer_new.bottom_z = layer.print_z;
+                        layer_new.idx_object_layer_below = layer_id;
+                        layer_new.bridging = ! m_slicing_params.soluble_interface;
+                        //FIXME how much to inflate the top surface?
+                        layer_new.polygons = offset(touching, float(m_support_material_flow.scaled_width()), SUPPORT_SURFACES_OFFSET_PARAMETERS);
+                        if (! m_slicing_params.soluble_interface) {
+                            // Walk the top surfaces, snap the top of the new bottom surface to the closest top of the top surface,
+                            // so there will be no support surfaces generated with thickness lower than m_support_layer_height_min.
+                            for (size_t top_idx = size_t(std::max<int>(0, contact_idx)); 
+                                top_idx < top_contacts.size() && top_contacts[top_idx]->print_z < layer_new.print_z + this->m_support_layer_height_min; 
+                                ++ top_idx) {
+                                if (top_contacts[top_idx]->print_z > layer_new.print_z - this->m_support_layer_height_min) {
+                                    // A top layer has been found, which is close to the new bottom layer.
+                                    coordf_t diff = layer_new.print_z - top_contacts[top_idx]->print_z;
+                                    assert(std::abs(diff) <= this->m_support_layer_height_min);
+                                    if (diff > 0.) {
+                                        // The top contact layer is below this layer. Make the bridging layer thinner to align with the existing top layer.
+                                        assert(diff < layer_new.height + EPSILON);
+                                        assert(layer_new.height - diff >= this->m_support_layer_height_min - EPSILON);
+                                        layer_new.print_z  = top_contacts[top_idx]->print_z;
+                                        layer_new.height  -= diff;
+                                    } else {
+                                        // The top contact layer is above this layer. One may either make this layer thicker or thinner.
+                                        // By making the layer thicker, one will decrease the number of discrete layers with the price of extruding a bit too thick bridges.
+                                        // By making the layer thinner, one adds one more discrete layer.
+                                        layer_new.print_z  = top_contacts[top_idx]->print_z;
+                                        layer_new.height  -= diff;
                                     }
-                                }
-                            }
-                #ifdef SLIC3R_DEBUG
-                            Slic3r::SVG::export_expolygons(
-                                debug_out_path("support-bottom-contacts-%d-%lf.svg", iRun, layer_new.print_z),
-                                union_ex(layer_new.polygons, false));
-                #endif /* SLIC3R_DEBUG */
-                            // Trim the already created base layers above the current layer intersecting with the new bottom contacts layer.
-                            touching = offset(touching, float(SCALED_EPSILON));
-                            for (int layer_id_above = layer_id + 1; layer_id_above < int(object.total_layer_count()); ++ layer_id_above) {
-                                const Layer &layer_above = *object.layers[layer_id_above];
-                                if (layer_above.print_z > layer_new.print_z + EPSILON)
-                                    break; 
-                                if (! layer_support_areas[layer_id_above].empty()) {
-#ifdef SLIC3R_DEBUG
-                                    {
-                                        BoundingBox bbox = get_extents(touching);
-                                        bbox.merge(get_extents(layer_support_areas[layer_id_above]));
-                                        ::Slic3r::SVG svg(debug_out_path("support-support-areas-raw-before-trimming-%d-with-%f-%lf.svg", iRun, layer.print_z, layer_above.print_z), bbox);
-                                        svg.draw(union_ex(touching, false), "blue", 0.5f);
-                                        svg.draw(union_ex(layer_support_areas[layer_id_above], true), "red", 0.5f);
-                                        svg.draw_outline(union_ex(layer_support_areas[layer_id_above], true), "red", "blue", scale_(0.1f));
-                                    }
-#endif /* SLIC3R_DEBUG */
-                                    layer_support_areas[layer_id_above] = diff(layer_support_areas[layer_id_above], touching);
-#ifdef SLIC3R_DEBUG
-                                    Slic3r::SVG::export_expolygons(
-                                        debug_out_path("support-support-areas-raw-after-trimming-%d-with-%f-%lf.svg", iRun, layer.print_z, layer_above.print_z),
-                                        union_ex(layer_support_areas[layer_id_above], false));
-#endif /* SLIC3R_DEBUG */
+                                    break;
                                 }
                             }
                         }
-                    } // ! top.empty()
+            #ifdef SLIC3R_DEBUG
+                        Slic3r::SVG::export_expolygons(
+                            debug_out_path("support-bottom-contacts-%d-%lf.svg", iRun, layer_new.print_z),
+                            union_ex(layer_new.polygons, false));
+            #endif /* SLIC3R_DEBUG */
+                        // The already created base layers above the current layer intersecting with the new bottom contacts layer
+                        // will be trimmed once all the support areas are extracted.
+                        layer_touching[layer_id] = offset(touching, float(SCALED_EPSILON));
+                    }
                 });
 
-            Polygons &layer_support_area = layer_support_areas[layer_id];
-            task_group.run([this, &projection, &projection_raw, &layer, &layer_support_area, layer_id] {
-                // Remove the areas that touched from the projection that will continue on next, lower, top surfaces.
-    //            Polygons trimming = union_(to_polygons(layer.slices.expolygons), touching, true);
-                Polygons trimming = offset(layer.slices.expolygons, float(SCALED_EPSILON));
-                projection = diff(projection_raw, trimming, false);
+            // Remove the areas that touched from the projection that will continue on next, lower, top surfaces.
+            const Polygons &trimming = layer_trimming[layer_id];
+            projection = diff(*projection_raw, trimming, false);
+#ifdef SLIC3R_DEBUG
+            {
+                BoundingBox bbox = get_extents(*projection_raw);
+                bbox.merge(get_extents(trimming));
+                ::Slic3r::SVG svg(debug_out_path("support-support-areas-raw-%d-%lf.svg", iRun, layer.print_z), bbox);
+                svg.draw(union_ex(trimming, false), "blue", 0.5f);
+                svg.draw(union_ex(projection, true), "red", 0.5f);
+                svg.draw_outline(union_ex(projection, true), "red", "blue", scale_(0.1f));
+            }
+#endif /* SLIC3R_DEBUG */
+            remove_sticks(projection);
+            remove_degenerate(projection);
     #ifdef SLIC3R_DEBUG
-                {
-                    BoundingBox bbox = get_extents(projection_raw);
-                    bbox.merge(get_extents(trimming));
-                    ::Slic3r::SVG svg(debug_out_path("support-support-areas-raw-%d-%lf.svg", iRun, layer.print_z), bbox);
-                    svg.draw(union_ex(trimming, false), "blue", 0.5f);
-                    svg.draw(union_ex(projection, true), "red", 0.5f);
-                    svg.draw_outline(union_ex(projection, true), "red", "blue", scale_(0.1f));
-                }
+            Slic3r::SVG::export_expolygons(
+                debug_out_path("support-support-areas-raw-cleaned-%d-%lf.svg", iRun, layer.print_z),
+                union_ex(projection, false));
     #endif /* SLIC3R_DEBUG */
-                remove_sticks(projection);
-                remove_degenerate(projection);
-        #ifdef SLIC3R_DEBUG
+            std::shared_ptr<LayerSupportGridPattern> support_grid = std::make_shared<LayerSupportGridPattern>(
+                // Support islands, to be stretched into a grid.
+                std::move(projection), 
+                // Trimming polygons, to trim the stretched support islands.
+                trimming,
+                // How much to offset the extracted contour outside of the grid.
+                m_object_config->support_material_spacing.value + m_support_material_flow.spacing(),
+                Geometry::deg2rad(m_object_config->support_material_angle.value));
+            // 1) Cache the slice of a support volume. The support volume is expanded by 1/2 of support material flow spacing
+            // to allow a placement of suppot zig-zag snake along the grid lines.
+            Polygons &layer_support_area = layer_support_areas[layer_id];
+            task_group.run([this, support_grid, &layer_support_area
+    #ifdef SLIC3R_DEBUG 
+                , &layer
+    #endif /* SLIC3R_DEBUG */
+                ] {
+                layer_support_area = support_grid->pattern.extract_support(m_support_material_flow.scaled_spacing()/2 + 25);
+    #ifdef SLIC3R_DEBUG
                 Slic3r::SVG::export_expolygons(
-                    debug_out_path("support-support-areas-raw-cleaned-%d-%lf.svg", iRun, layer.print_z),
-                    union_ex(projection, false));
-        #endif /* SLIC3R_DEBUG */
-                SupportGridPattern support_grid_pattern(
-                    // Support islands, to be stretched into a grid.
-                    projection, 
-                    // Trimming polygons, to trim the stretched support islands.
-                    trimming,
-                    // How much to offset the extracted contour outside of the grid.
-                    m_object_config->support_material_spacing.value + m_support_material_flow.spacing(),
-                    Geometry::deg2rad(m_object_config->support_material_angle.value));
-                tbb::task_group task_group_inner;
-                // 1) Cache the slice of a support volume. The support volume is expanded by 1/2 of support material flow spacing
-                // to allow a placement of suppot zig-zag snake along the grid lines.
-                task_group_inner.run([this, &support_grid_pattern, &layer_support_area
-        #ifdef SLIC3R_DEBUG 
-                    , &layer
-        #endif /* SLIC3R_DEBUG */
-                    ] {
-                    layer_support_area = support_grid_pattern.extract_support(m_support_material_flow.scaled_spacing()/2 + 25);
-        #ifdef SLIC3R_DEBUG
-                    Slic3r::SVG::export_expolygons(
-                        debug_out_path("support-layer_support_area-gridded-%d-%lf.svg", iRun, layer.print_z),
-                        union_ex(layer_support_area, false));
-        #endif /* SLIC3R_DEBUG */
-                });
-                // 2) Support polygons will be projected down. To keep the interface and base layers from growing, return a contour a tiny bit smaller than the grid cells.
-                Polygons projection_new;
-                task_group_inner.run([&projection_new, &support_grid_pattern
-        #ifdef SLIC3R_DEBUG 
-                    , &layer
-        #endif /* SLIC3R_DEBUG */
-                    ] {
-                    projection_new = support_grid_pattern.extract_support(-5);
-        #ifdef SLIC3R_DEBUG
-                    Slic3r::SVG::export_expolygons(
-                        debug_out_path("support-projection_new-gridded-%d-%lf.svg", iRun, layer.print_z),
-                        union_ex(projection_new, false));
-        #endif /* SLIC3R_DEBUG */
-                });
-                task_group_inner.wait();
-                projection = std::move(projection_new);
+                    debug_out_path("support-layer_support_area-gridded-%d-%lf.svg", iRun, layer.print_z),
+                    union_ex(layer_support_area, false));
+    #endif /* SLIC3R_DEBUG */
             });
-            task_group.wait();
+            // 2) Support polygons will be projected down. To keep the interface and base layers from growing, return a contour a tiny bit smaller than the grid cells.
+            projection = support_grid->pattern.extract_support(-5);
+    #ifdef SLIC3R_DEBUG
+            Slic3r::SVG::export_expolygons(
+                debug_out_path("support-projection_new-gridded-%d-%lf.svg", iRun, layer.print_z),
+                union_ex(projection, false));
+    #endif /* SLIC3R_DEBUG */
         }
-        std::reverse(bottom_contacts.begin(), bottom_contacts.end());
+        task_group.wait();
+
+        // Trim the base layers above the bottom contact layers intersecting with the bottom contacts. For each base layer,
+        // the bottom contacts are applied top-down, the same order a sequential sweep would apply them.
+        coordf_t max_bottom_contact_height = 0.;
+        for (size_t layer_id = 0; layer_id < num_layers; ++ layer_id)
+            if (layer_bottom_contacts[layer_id] != nullptr) {
+                bottom_contacts.push_back(layer_bottom_contacts[layer_id]);
+                max_bottom_contact_height = std::max(max_bottom_contact_height, layer_bottom_contacts[layer_id]->print_z - object.layers[layer_id]->print_z);
+            }
+        tbb::parallel_for(tbb::blocked_range<size_t>(1, object.total_layer_count()),
+            [&object, &layer_bottom_contacts, &layer_touching, &layer_support_areas, max_bottom_contact_height](const tbb::blocked_range<size_t>& range) {
+                for (size_t layer_id_above = range.begin(); layer_id_above < range.end(); ++ layer_id_above) {
+                    const Layer &layer_above = *object.layers[layer_id_above];
+                    for (int layer_id = int(std::min(layer_id_above, layer_bottom_contacts.size())) - 1; layer_id >= 0; -- layer_id) {
+                        const Layer   &layer     = *object.layers[layer_id];
+                        if (layer.print_z + max_bottom_contact_height + EPSILON < layer_above.print_z)
+                            break;
+                        const MyLayer *layer_new = layer_bottom_contacts[layer_id];
+                        if (layer_new == nullptr || layer_above.print_z > layer_new->print_z + EPSILON || layer_support_areas[layer_id_above].empty())
+                            continue;
+                        const Polygons &touching = layer_touching[layer_id];
+#ifdef SLIC3R_DEBUG
+                        {
+                            BoundingBox bbox = get_extents(touching);
+                            bbox.merge(get_extents(layer_support_areas[layer_id_above]));
+                            ::Slic3r::SVG svg(debug_out_path("support-support-areas-raw-before-trimming-%d-with-%f-%lf.svg", iRun, layer.print_z, layer_above.print_z), bbox);
+                            svg.draw(union_ex(touching, false), "blue", 0.5f);
+                            svg.draw(union_ex(layer_support_areas[layer_id_above], true), "red", 0.5f);
+                            svg.draw_outline(union_ex(layer_support_areas[layer_id_above], true), "red", "blue", scale_(0.1f));
+                        }
+#endif /* SLIC3R_DEBUG */
+                        layer_support_areas[layer_id_above] = diff(layer_support_areas[layer_id_above], touching);
+#ifdef SLIC3R_DEBUG
+                        Slic3r::SVG::export_expolygons(
+                            debug_out_path("support-support-areas-raw-after-trimming-%d-with-%f-%lf.svg", iRun, layer.print_z, layer_above.print_z),
+                            union_ex(layer_support_areas[layer_id_above], false));
+#endif /* SLIC3R_DEBUG */
+                    }
+                }
+            });
+        BOOST_LOG_TRIVIAL(debug) << "PrintObjectSupportMaterial::bottom_contact_layers() in parallel - end";
+
         trim_support_layers_by_object(object, bottom_contacts, m_slicing_params.soluble_interface ? 0. : m_support_layer_height_min, 0., m_gap_xy);
     } // ! top_contacts.empty()
 
@@ -1346,7 +1441,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::raft_and_int
             assert(extr2->bottom_z == m_slicing_params.first_print_layer_height);
             assert(extr2->print_z >= m_slicing_params.first_print_layer_height + this->m_support_layer_height_min - EPSILON);
             if (intermediate_layers.empty() || intermediate_layers.back()->print_z < m_slicing_params.first_print_layer_height) {
-                MyLayer &layer_new = layer_allocate(layer_storage, sltIntermediate);
+                MyLayer &layer_new = layer_storage.allocate(sltIntermediate);
                 layer_new.bottom_z = 0.;
                 layer_new.print_z  = m_slicing_params.first_print_layer_height;
                 layer_new.height   = m_slicing_params.first_print_layer_height;
@@ -1368,7 +1463,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::raft_and_int
             // At this point only layers above first_print_layer_heigth + EPSILON are expected as the other cases were captured earlier.
             assert(extr2z >= m_slicing_params.first_print_layer_height + EPSILON);
             // Generate a new intermediate layer.
-            MyLayer &layer_new = layer_allocate(layer_storage, sltIntermediate);
+            MyLayer &layer_new = layer_storage.allocate(sltIntermediate);
             layer_new.bottom_z = 0.;
             layer_new.print_z  = extr1z = m_slicing_params.first_print_layer_height;
             layer_new.height   = extr1z;
@@ -1388,7 +1483,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::raft_and_int
                 ++ idx_layer_object;
             if (idx_layer_object == 0 && extr1z == m_slicing_params.raft_interface_top_z) {
                 // Insert one base support layer below the object.
-                MyLayer &layer_new = layer_allocate(layer_storage, sltIntermediate);
+                MyLayer &layer_new = layer_storage.allocate(sltIntermediate);
                 layer_new.print_z  = m_slicing_params.object_print_z_min;
                 layer_new.bottom_z = m_slicing_params.raft_interface_top_z;
                 layer_new.height   = layer_new.print_z - layer_new.bottom_z;
@@ -1396,7 +1491,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::raft_and_int
             }
             // Emit all intermediate support layers synchronized with object layers up to extr2z.
             for (; idx_layer_object < object.layers.size() && object.layers[idx_layer_object]->print_z < extr2z + EPSILON; ++ idx_layer_object) {
-                MyLayer &layer_new = layer_allocate(layer_storage, sltIntermediate);
+                MyLayer &layer_new = layer_storage.allocate(sltIntermediate);
                 layer_new.print_z  = object.layers[idx_layer_object]->print_z;
                 layer_new.height   = object.layers[idx_layer_object]->height;
                 layer_new.bottom_z = (idx_layer_object > 0) ? object.layers[idx_layer_object - 1]->print_z : (layer_new.print_z - layer_new.height);
@@ -1414,7 +1509,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::raft_and_int
                 // between the 1st intermediate layer print_z and extr1->print_z is not too small.
                 assert(extr1->bottom_z + this->m_support_layer_height_min < extr1->print_z + EPSILON);
                 // Generate the first intermediate layer.
-                MyLayer &layer_new = layer_allocate(layer_storage, sltIntermediate);
+                MyLayer &layer_new = layer_storage.allocate(sltIntermediate);
                 layer_new.bottom_z = extr1->bottom_z;
                 layer_new.print_z  = extr1z = extr1->print_z;
                 layer_new.height   = extr1->height;
@@ -1438,7 +1533,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::raft_and_int
             coordf_t extr2z_large_steps = extr2z;
             // Take the largest allowed step in the Z axis until extr2z_large_steps is reached.
             for (size_t i = 0; i < n_layers_extra; ++ i) {
-                MyLayer &layer_new = layer_allocate(layer_storage, sltIntermediate);
+                MyLayer &layer_new = layer_storage.allocate(sltIntermediate);
                 if (i + 1 == n_layers_extra) {
                     // Last intermediate layer added. Align the last entered layer with extr2z_large_steps exactly.
                     layer_new.bottom_z = (i == 0) ? extr1z : intermediate_layers.back()->print_z;
@@ -1731,7 +1826,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::generate_raf
         // Do not add the raft contact layer, only add the raft layers below the contact layer.
         // Insert the 1st layer.
         {
-            MyLayer &new_layer = layer_allocate(layer_storage, (m_slicing_params.base_raft_layers > 0) ? sltRaftBase : sltRaftInterface);
+            MyLayer &new_layer = layer_storage.allocate((m_slicing_params.base_raft_layers > 0) ? sltRaftBase : sltRaftInterface);
             raft_layers.push_back(&new_layer);
             new_layer.print_z = m_slicing_params.first_print_layer_height;
             new_layer.height  = m_slicing_params.first_print_layer_height;
@@ -1741,7 +1836,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::generate_raf
         // Insert the base layers.
         for (size_t i = 1; i < m_slicing_params.base_raft_layers; ++ i) {
             coordf_t print_z = raft_layers.back()->print_z;
-            MyLayer &new_layer  = layer_allocate(layer_storage, sltRaftBase);
+            MyLayer &new_layer  = layer_storage.allocate(sltRaftBase);
             raft_layers.push_back(&new_layer);
             new_layer.print_z  = print_z + m_slicing_params.base_raft_layer_height;
             new_layer.height   = m_slicing_params.base_raft_layer_height;
@@ -1751,7 +1846,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::generate_raf
         // Insert the interface layers.
         for (size_t i = 1; i < m_slicing_params.interface_raft_layers; ++ i) {
             coordf_t print_z = raft_layers.back()->print_z;
-            MyLayer &new_layer = layer_allocate(layer_storage, sltRaftInterface);
+            MyLayer &new_layer = layer_storage.allocate(sltRaftInterface);
             raft_layers.push_back(&new_layer);
             new_layer.print_z = print_z + m_slicing_params.interface_raft_layer_height;
             new_layer.height  = m_slicing_params.interface_raft_layer_height;
@@ -1787,9 +1882,8 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::generate_int
         // For all intermediate layers, collect top contact surfaces, which are not further than support_material_interface_layers.
         BOOST_LOG_TRIVIAL(debug) << "PrintObjectSupportMaterial::generate_interface_layers() in parallel - start";
         interface_layers.assign(intermediate_layers.size(), nullptr);
-        tbb::spin_mutex layer_storage_mutex;
         tbb::parallel_for(tbb::blocked_range<size_t>(0, intermediate_layers.size()),
-            [this, &bottom_contacts, &top_contacts, &intermediate_layers, &layer_storage, &layer_storage_mutex, &interface_layers](const tbb::blocked_range<size_t>& range) {
+            [this, &bottom_contacts, &top_contacts, &intermediate_layers, &layer_storage, &interface_layers](const tbb::blocked_range<size_t>& range) {
                 // Index of the first top contact layer intersecting the current intermediate layer.
                 size_t idx_top_contact_first = size_t(-1);
                 // Index of the first bottom contact layer intersecting the current intermediate layer.
@@ -1824,7 +1918,7 @@ PrintObjectSupportMaterial::MyLayersPtr PrintObjectSupportMaterial::generate_int
                         continue;
 
                     // Insert a new layer into top_interface_layers.
-                    MyLayer &layer_new = layer_allocate(layer_storage, layer_storage_mutex,
+                    MyLayer &layer_new = layer_storage.allocate(
                         polygons_top_contact_projected.empty() ? sltBottomInterface : sltTopInterface);
                     layer_new.print_z    = intermediate_layer.print_z;
                     layer_new.bottom_z   = intermediate_layer.bottom_z;
@@ -5,6 +5,8 @@
 #include "PrintConfig.hpp"
 #include "Slicing.hpp"
 
+#include <atomic>
+
 namespace Slic3r {
 
 class PrintObject;
@@ -123,10 +125,40 @@ public:
     	Polygons *overhang_polygons;
 	};
 
-	// Layers are allocated and owned by a deque. Once a layer is allocated, it is maintained
-	// up to the end of a generate() method. The layer storage may be replaced by an allocator class in the future, 
-	// which would allocate layers by multiple chunks.
-	typedef std::deque<MyLayer> 				MyLayerStorage;
+	// Layers are allocated and owned by a MyLayerStorage. Once a layer is allocated, it is maintained
+	// up to the end of a generate() method, then all the layers are released at once.
+	// The layers are allocated by chunks of exponentially growing size, the address of a layer never changes.
+	// The allocation is lock free, so that the layers may be allocated from parallel loops without serializing them.
+	class MyLayerStorage
+	{
+	public:
+		MyLayerStorage() : m_size(0) { for (auto &chunk : m_chunks) chunk = nullptr; }
+		~MyLayerStorage() { this->clear(); }
+
+		// Thread safe.
+		MyLayer& 	allocate(SupporLayerType layer_type);
+		// Release all the layers. Not thread safe.
+		void 		clear();
+		// Number of layers allocated. Not thread safe.
+		size_t 		size() const { return m_size; }
+		// Memory occupied by the allocated layers including their polygons, in bytes. Not thread safe.
+		size_t 		memory_used() const;
+
+	private:
+		MyLayerStorage(const MyLayerStorage&) = delete;
+		MyLayerStorage& operator=(const MyLayerStorage&) = delete;
+
+		enum {
+			// Size of the first chunk, the following chunks double in size.
+			FIRST_CHUNK_LOG2 = 6,
+			NUM_CHUNKS 		 = 32,
+		};
+		static size_t 			chunk_size(size_t chunk_idx) { return size_t(1) << (chunk_idx + FIRST_CHUNK_LOG2); }
+
+		std::atomic<size_t> 	m_size;
+		std::atomic<MyLayer*> 	m_chunks[NUM_CHUNKS];
+	};
+
 	typedef std::vector<MyLayer*> 				MyLayersPtr;
 
 public:
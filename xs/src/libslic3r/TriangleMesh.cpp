@@ -14,6 +14,7 @@
 #include <boost/log/trivial.hpp>
 
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
 
 #if 0
     #define DEBUG
@@ -101,6 +102,7 @@ TriangleMesh& TriangleMesh::operator=(const TriangleMesh &other)
     stl_close(&this->stl);
     this->stl       = other.stl;
     this->repaired  = other.repaired;
+    this->m_z_index = other.m_z_index;
     this->stl.heads = nullptr;
     this->stl.tail  = nullptr;
     this->stl.error = other.stl.error;
@@ -134,6 +136,7 @@ TriangleMesh::swap(TriangleMesh &other)
 {
     std::swap(this->stl,      other.stl);
     std::swap(this->repaired, other.repaired);
+    std::swap(this->m_z_index, other.m_z_index);
 }
 
 TriangleMesh::~TriangleMesh() {
@@ -143,6 +146,7 @@ TriangleMesh::~TriangleMesh() {
 void
 TriangleMesh::ReadSTLFile(const char* input_file) {
     stl_open(&stl, input_file);
+    this->invalidate_z_index();
 }
 
 void
@@ -165,9 +169,14 @@ TriangleMesh::repair() {
     if (this->stl.stats.number_of_facets == 0) return;
 
     BOOST_LOG_TRIVIAL(debug) << "TriangleMesh::repair() started";
+
+    // Repair may remove or add facets.
+    stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
     
-    // checking exact
+    // checking exact, degenerate facets are removed
     stl_check_facets_exact(&stl);
+    this->invalidate_z_index();
     stl.stats.facets_w_1_bad_edge = (stl.stats.connected_facets_2_edge - stl.stats.connected_facets_3_edge);
     stl.stats.facets_w_2_bad_edge = (stl.stats.connected_facets_1_edge - stl.stats.connected_facets_2_edge);
     stl.stats.facets_w_3_bad_edge = (stl.stats.number_of_facets - stl.stats.connected_facets_1_edge);
@@ -229,8 +238,9 @@ float TriangleMesh::volume()
 
 void TriangleMesh::check_topology()
 {
-    // checking exact
+    // checking exact, degenerate facets are removed
     stl_check_facets_exact(&stl);
+    this->invalidate_z_index();
     stl.stats.facets_w_1_bad_edge = (stl.stats.connected_facets_2_edge - stl.stats.connected_facets_3_edge);
     stl.stats.facets_w_2_bad_edge = (stl.stats.connected_facets_1_edge - stl.stats.connected_facets_2_edge);
     stl.stats.facets_w_3_bad_edge = (stl.stats.number_of_facets - stl.stats.connected_facets_1_edge);
@@ -290,7 +300,8 @@ TriangleMesh::facets_count() const
 
 void
 TriangleMesh::WriteOBJFile(char* output_file) {
-    stl_generate_shared_vertices(&stl);
+    if (this->stl.v_shared == NULL)
+        stl_generate_shared_vertices(&stl);
     stl_write_obj(&stl, output_file);
 }
 
@@ -298,6 +309,7 @@ void TriangleMesh::scale(float factor)
 {
     stl_scale(&(this->stl), factor);
     stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
 }
 
 void TriangleMesh::scale(const Pointf3 &versor)
@@ -308,6 +320,7 @@ void TriangleMesh::scale(const Pointf3 &versor)
     fversor[2] = versor.z;
     stl_scale_versor(&this->stl, fversor);
     stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
 }
 
 void TriangleMesh::translate(float x, float y, float z)
@@ -316,6 +329,7 @@ void TriangleMesh::translate(float x, float y, float z)
         return;
     stl_translate_relative(&(this->stl), x, y, z);
     stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
 }
 
 void TriangleMesh::rotate(float angle, const Axis &axis)
@@ -334,6 +348,7 @@ void TriangleMesh::rotate(float angle, const Axis &axis)
         stl_rotate_z(&(this->stl), angle);
     }
     stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
 }
 
 void TriangleMesh::rotate_x(float angle)
@@ -361,6 +376,7 @@ void TriangleMesh::mirror(const Axis &axis)
         stl_mirror_xy(&this->stl);
     }
     stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
 }
 
 void TriangleMesh::mirror_x()
@@ -385,6 +401,7 @@ void TriangleMesh::transform(const float* matrix3x4)
 
     stl_transform(&stl, const_cast<float*>(matrix3x4));
     stl_invalidate_shared_vertices(&stl);
+    this->invalidate_z_index();
 }
 
 void TriangleMesh::align_to_origin()
@@ -534,6 +551,7 @@ TriangleMesh::merge(const TriangleMesh &mesh)
     // reset stats and metadata
     int number_of_facets = this->stl.stats.number_of_facets;
     stl_invalidate_shared_vertices(&this->stl);
+    this->invalidate_z_index();
     this->repaired = false;
     
     // update facet count and allocate more memory
@@ -610,11 +628,48 @@ TriangleMesh::require_shared_vertices()
     BOOST_LOG_TRIVIAL(trace) << "TriangleMeshSlicer::require_shared_vertices - end";
 }
 
+void TriangleMesh::require_z_index()
+{
+    if (m_z_index)
+        return;
+    BOOST_LOG_TRIVIAL(trace) << "TriangleMeshSlicer::require_z_index - start";
+    const size_t num_facets = size_t(this->stl.stats.number_of_facets);
+    std::vector<std::pair<float, int>> sorted(num_facets);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, num_facets),
+        [this, &sorted](const tbb::blocked_range<size_t>& range) {
+            for (size_t facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx) {
+                const stl_facet &facet = this->stl.facet_start[facet_idx];
+                sorted[facet_idx] = std::make_pair(fminf(facet.vertex[0].z, fminf(facet.vertex[1].z, facet.vertex[2].z)), int(facet_idx));
+            }
+        });
+    // Pairs compare by the facet index for equal Z, the resulting order is deterministic.
+    tbb::parallel_sort(sorted.begin(), sorted.end());
+    FacetsZIndex *index = new FacetsZIndex();
+    index->facets.assign(num_facets, 0);
+    index->min_z .assign(num_facets, 0.f);
+    index->max_z .assign(num_facets, 0.f);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, num_facets),
+        [this, &sorted, index](const tbb::blocked_range<size_t>& range) {
+            for (size_t i = range.begin(); i < range.end(); ++ i) {
+                const stl_facet &facet = this->stl.facet_start[sorted[i].second];
+                index->facets[i] = sorted[i].second;
+                index->min_z[i]  = sorted[i].first;
+                index->max_z[i]  = fmaxf(facet.vertex[0].z, fmaxf(facet.vertex[1].z, facet.vertex[2].z));
+            }
+        });
+    m_z_index.reset(index);
+    BOOST_LOG_TRIVIAL(trace) << "TriangleMeshSlicer::require_z_index - end";
+}
+
 
 TriangleMeshSlicer::TriangleMeshSlicer(TriangleMesh* _mesh) : 
     mesh(_mesh)
 {
     _mesh->require_shared_vertices();
+    _mesh->require_z_index();
+    this->z_index = _mesh->m_z_index;
     facets_edges.assign(_mesh->stl.stats.number_of_facets * 3, -1);
     v_scaled_shared.assign(_mesh->stl.v_shared, _mesh->stl.v_shared + _mesh->stl.stats.shared_vertices);
     // Scale the copied vertices.
@@ -729,17 +784,75 @@ TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<Polygons>* la
     */
     
     BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_do";
+    // The facets are traversed in the order of the Z index and split into fixed chunks, each chunk collects 
+    // its intersection lines into a private buffer without any locking. The buffers are merged into the per layer lists
+    // in the order of the Z index, therefore the slices do not depend on the thread scheduling and they are reproducible.
+    // As the facets are sorted by their minimum Z, the first slicing plane of a facet is found by advancing
+    // a cursor over z instead of a binary search, and the facets not crossing any plane are skipped
+    // by comparing the packed min / max Z values without touching the facets themselves.
+    const FacetsZIndex &index = *this->z_index;
+    const size_t num_facets = index.facets.size();
+    const size_t chunk_size = std::max<size_t>(4096, (num_facets + 255) / 256);
+    const size_t num_chunks = (num_facets + chunk_size - 1) / chunk_size;
+    std::vector<LayerIntersectionLines> chunk_lines(num_chunks);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, num_chunks),
+        [&chunk_lines, &index, chunk_size, num_facets, &z, this](const tbb::blocked_range<size_t>& range) {
+            for (size_t chunk_idx = range.begin(); chunk_idx < range.end(); ++ chunk_idx) {
+                LayerIntersectionLines &out = chunk_lines[chunk_idx];
+                size_t i     = chunk_idx * chunk_size;
+                size_t i_end = std::min(num_facets, i + chunk_size);
+                // First layer whose slice_z is >= min_z of the first facet of this chunk.
+                std::vector<float>::const_iterator min_layer = std::lower_bound(z.begin(), z.end(), index.min_z[i]);
+                for (; i < i_end; ++ i) {
+                    const float min_z = index.min_z[i];
+                    while (min_layer != z.end() && *min_layer < min_z)
+                        ++ min_layer;
+                    if (min_layer == z.end())
+                        // This facet and all the following facets are above the last slicing plane.
+                        break;
+                    const float max_z = index.max_z[i];
+                    if (*min_layer <= max_z)
+                        this->_slice_do(index.facets[i], min_z, max_z, min_layer, &out, z);
+                }
+                // Group the lines by layer, keep the facet order inside a layer.
+                std::stable_sort(out.begin(), out.end(), 
+                    [](const LayerIntersectionLine &l1, const LayerIntersectionLine &l2) { return l1.first < l2.first; });
+            }
+        }
+    );
+
+    // Concatenate the chunks layer by layer.
+    BOOST_LOG_TRIVIAL(debug) << "TriangleMeshSlicer::_slice_do - merge";
     std::vector<IntersectionLines> lines(z.size());
-    {
-        boost::mutex lines_mutex;
-        tbb::parallel_for(
-            tbb::blocked_range<int>(0,this->mesh->stl.stats.number_of_facets),
-            [&lines, &lines_mutex, &z, this](const tbb::blocked_range<int>& range) {
-                for (int facet_idx = range.begin(); facet_idx < range.end(); ++ facet_idx)
-                    this->_slice_do(facet_idx, &lines, &lines_mutex, z);
+    tbb::parallel_for(
+        tbb::blocked_range<size_t>(0, z.size()),
+        [&chunk_lines, &lines](const tbb::blocked_range<size_t>& range) {
+            auto lower = [](const LayerIntersectionLine &l, size_t layer_idx) { return l.first < layer_idx; };
+            auto upper = [](size_t layer_idx, const LayerIntersectionLine &l) { return layer_idx < l.first; };
+            std::vector<std::pair<LayerIntersectionLines::const_iterator, LayerIntersectionLines::const_iterator>> spans;
+            spans.reserve(chunk_lines.size());
+            for (size_t layer_idx = range.begin(); layer_idx < range.end(); ++ layer_idx) {
+                spans.clear();
+                size_t num_lines = 0;
+                for (const LayerIntersectionLines &chunk : chunk_lines) {
+                    auto begin = std::lower_bound(chunk.begin(), chunk.end(), layer_idx, lower);
+                    auto end   = std::upper_bound(begin, chunk.end(), layer_idx, upper);
+                    if (begin != end) {
+                        spans.emplace_back(begin, end);
+                        num_lines += end - begin;
+                    }
+                }
+                IntersectionLines &layer_lines = lines[layer_idx];
+                layer_lines.reserve(num_lines);
+                for (const auto &span : spans)
+                    for (auto it = span.first; it != span.second; ++ it)
+                        layer_lines.emplace_back(it->second);
             }
-        );
-    }
+        }
+    );
+    chunk_lines.clear();
+    chunk_lines.shrink_to_fit();
     
     // v_scaled_shared could be freed here
     
@@ -772,15 +885,12 @@ TriangleMeshSlicer::slice(const std::vector<float> &z, std::vector<Polygons>* la
 #endif
 }
 
-void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, 
-    const std::vector<float> &z) const
+// Slice a single facet by the planes starting with min_layer, which is the first plane with slice_z >= min_z.
+void TriangleMeshSlicer::_slice_do(size_t facet_idx, float min_z, float max_z, std::vector<float>::const_iterator min_layer, 
+    LayerIntersectionLines* lines, const std::vector<float> &z) const
 {
     const stl_facet &facet = this->mesh->stl.facet_start[facet_idx];
     
-    // find facet extents
-    const float min_z = fminf(facet.vertex[0].z, fminf(facet.vertex[1].z, facet.vertex[2].z));
-    const float max_z = fmaxf(facet.vertex[0].z, fmaxf(facet.vertex[1].z, facet.vertex[2].z));
-    
     #ifdef SLIC3R_DEBUG
     printf("\n==> FACET %d (%f,%f,%f - %f,%f,%f - %f,%f,%f):\n", facet_idx,
         facet.vertex[0].x, facet.vertex[0].y, facet.vertex[0].z,
@@ -790,9 +900,7 @@ void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLin
     #endif
     
     // find layer extents
-    std::vector<float>::const_iterator min_layer, max_layer;
-    min_layer = std::lower_bound(z.begin(), z.end(), min_z); // first layer whose slice_z is >= min_z
-    max_layer = std::upper_bound(z.begin() + (min_layer - z.begin()), z.end(), max_z) - 1; // last layer whose slice_z is <= max_z
+    std::vector<float>::const_iterator max_layer = std::upper_bound(min_layer, z.end(), max_z) - 1; // last layer whose slice_z is <= max_z
     #ifdef SLIC3R_DEBUG
     printf("layers: min = %d, max = %d\n", (int)(min_layer - z.begin()), (int)(max_layer - z.begin()));
     #endif
@@ -801,7 +909,6 @@ void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLin
         std::vector<float>::size_type layer_idx = it - z.begin();
         IntersectionLine il;
         if (this->slice_facet(*it / SCALING_FACTOR, facet, facet_idx, min_z, max_z, &il)) {
-            boost::lock_guard<boost::mutex> l(*lines_mutex);
             if (il.edge_type == feHorizontal) {
                 // Insert all three edges of the face.
                 const int *vertices = this->mesh->stl.v_indices[facet_idx].vertex;
@@ -819,10 +926,10 @@ void TriangleMeshSlicer::_slice_do(size_t facet_idx, std::vector<IntersectionLin
                     il.b.y    = b->y;
                     il.a_id   = a_id;
                     il.b_id   = b_id;
-                    (*lines)[layer_idx].push_back(il);
+                    lines->emplace_back(layer_idx, il);
                 }
             } else
-                (*lines)[layer_idx].push_back(il);
+                lines->emplace_back(layer_idx, il);
         }
     }
 }
@@ -1529,6 +1636,8 @@ void TriangleMeshSlicer::cut(float z, TriangleMesh* upper, TriangleMesh* lower)
     // Update the bounding box / sphere of the new meshes.
     stl_get_size(&upper->stl);
     stl_get_size(&lower->stl);
+    upper->invalidate_z_index();
+    lower->invalidate_z_index();
 }
 
 // Generate the vertex list for a cube solid of arbitrary size in X/Y/Z.
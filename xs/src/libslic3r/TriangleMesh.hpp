@@ -3,6 +3,7 @@
 
 #include "libslic3r.h"
 #include <admesh/stl.h>
+#include <memory>
 #include <vector>
 #include <boost/thread.hpp>
 #include "BoundingBox.hpp"
@@ -17,6 +18,18 @@ class TriangleMesh;
 class TriangleMeshSlicer;
 typedef std::vector<TriangleMesh*> TriangleMeshPtrs;
 
+// Facets of a mesh sorted by their minimum Z coordinate, so that the slicer only needs to touch
+// the facets crossed by the slicing planes. Built on demand by TriangleMeshSlicer, shared by the copies
+// of a mesh and dropped by invalidate_z_index() whenever the facets are modified.
+struct FacetsZIndex
+{
+    // Facet indices sorted by their minimum Z, ties sorted by the facet index.
+    std::vector<int>    facets;
+    // Minimum and maximum Z of this->facets[i].
+    std::vector<float>  min_z;
+    std::vector<float>  max_z;
+};
+
 class TriangleMesh
 {
 public:
@@ -66,11 +79,17 @@ public:
     // Count disconnected triangle patches.
     size_t number_of_patches() const;
 
+    // Drop the cached FacetsZIndex. To be called by the code modifying the facets of stl directly.
+    void invalidate_z_index() { m_z_index.reset(); }
+
     stl_file stl;
     bool repaired;
     
 private:
     void require_shared_vertices();
+    void require_z_index();
+    // Cached FacetsZIndex, reset whenever the facets change.
+    std::shared_ptr<const FacetsZIndex> m_z_index;
     friend class TriangleMeshSlicer;
 };
 
@@ -126,6 +145,9 @@ public:
 };
 typedef std::vector<IntersectionLine> IntersectionLines;
 typedef std::vector<IntersectionLine*> IntersectionLinePtrs;
+// Intersection line tagged with the index of the slicing plane it was produced by.
+typedef std::pair<size_t, IntersectionLine> LayerIntersectionLine;
+typedef std::vector<LayerIntersectionLine> LayerIntersectionLines;
 
 class TriangleMeshSlicer
 {
@@ -143,8 +165,11 @@ private:
     std::vector<int>         facets_edges;
     // Scaled copy of this->mesh->stl.v_shared
     std::vector<stl_vertex>  v_scaled_shared;
+    // Facets sorted by Z, shared with this->mesh.
+    std::shared_ptr<const FacetsZIndex> z_index;
 
-    void _slice_do(size_t facet_idx, std::vector<IntersectionLines>* lines, boost::mutex* lines_mutex, const std::vector<float> &z) const;
+    void _slice_do(size_t facet_idx, float min_z, float max_z, std::vector<float>::const_iterator min_layer, 
+        LayerIntersectionLines* lines, const std::vector<float> &z) const;
     void make_loops(std::vector<IntersectionLine> &lines, Polygons* loops) const;
     void make_expolygons(const Polygons &loops, ExPolygons* slices) const;
     void make_expolygons_simple(std::vector<IntersectionLine> &lines, ExPolygons* slices) const;
@@ -17,6 +17,7 @@ REGISTER_CLASS(CoolingBuffer, "GCode::CoolingBuffer");
 REGISTER_CLASS(GCode, "GCode");
 REGISTER_CLASS(GCodePreviewData, "GCode::PreviewData");
 REGISTER_CLASS(GCodeSender, "GCode::Sender");
+REGISTER_CLASS(GCodeTimeEstimator, "GCode::TimeEstimator");
 REGISTER_CLASS(Layer, "Layer");
 REGISTER_CLASS(SupportLayer, "Layer::Support");
 REGISTER_CLASS(LayerRegion, "Layer::Region");
@@ -4,7 +4,7 @@ use strict;
 use warnings;
 
 use Slic3r::XS;
-use Test::More tests => 49;
+use Test::More tests => 52;
 
 is Slic3r::TriangleMesh::hello_world(), 'Hello world!',
     'hello world';
@@ -88,6 +88,20 @@ my $cube = {
     }
 }
 
+{
+    # Reload a sliced mesh, the slicing index of the previous facets has to be dropped.
+    my $m = Slic3r::TriangleMesh->new;
+    $m->ReadFromPerl([ map [ $_->[0], $_->[1], $_->[2] + 20 ], @{$cube->{vertices}} ], $cube->{facets});
+    $m->repair;
+    my $result = $m->slice([ 10, 30 ]);
+    is scalar(@{$result->[0]}), 0, 'no polygon below the lifted cube';
+    $m->ReadFromPerl($cube->{vertices}, $cube->{facets});
+    $m->repair;
+    $result = $m->slice([ 10, 30 ]);
+    is scalar(@{$result->[0]}), 1, 'reloaded mesh is sliced';
+    is scalar(@{$result->[1]}), 0, 'no polygon above the reloaded cube';
+}
+
 {
     my $m = Slic3r::TriangleMesh->new;
     $m->ReadFromPerl(
@@ -4,7 +4,7 @@ use strict;
 use warnings;
 
 use Slic3r::XS;
-use Test::More tests => 18;
+use Test::More tests => 30;
 
 my $points = [
     [100, 100],
@@ -94,4 +94,90 @@ is scalar(@{$collection->[1]}), 1, 'appended collection was duplicated';
     ok $coll2->clone->no_sort, 'no_sort is kept after clone';
 }
 
+# Random paths and loops, every fifth item is a loop.
+sub random_collection {
+    my ($num_items, $range) = @_;
+    return Slic3r::ExtrusionPath::Collection->new(map {
+        my @points = map [ int(rand($range)), int(rand($range)) ], 1 .. 3;
+        ($_ % 5 == 0)
+            ? Slic3r::ExtrusionLoop->new_from_paths(Slic3r::ExtrusionPath->new(
+                polyline => Slic3r::Polygon->new(@points)->split_at_first_point, role => 0, mm3_per_mm => 1))
+            : Slic3r::ExtrusionPath->new(polyline => Slic3r::Polyline->new(@points), role => 0, mm3_per_mm => 1);
+    } 1 .. $num_items);
+}
+
+sub entity_points {
+    my ($entity) = @_;
+    return $entity->isa('Slic3r::ExtrusionLoop') ? $entity->polygon->pp : $entity->polyline->pp;
+}
+
+# The former chaining: a linear search for the closest end point of all the remaining items.
+sub greedy_chain {
+    my ($collection, $start, $no_reverse) = @_;
+    my @entities = map $_->clone, @$collection;
+    my @chain;
+    while (@entities) {
+        my @end_points = map { ($_->first_point, ($no_reverse || $_->isa('Slic3r::ExtrusionLoop')) ? $_->first_point : $_->last_point) } @entities;
+        my $idx = $start->nearest_point_index(\@end_points);
+        my ($entity) = splice @entities, int($idx / 2), 1;
+        $entity->reverse if $idx % 2 && ! $no_reverse && ! $entity->isa('Slic3r::ExtrusionLoop');
+        push @chain, entity_points($entity);
+        $start = $entity->last_point;
+    }
+    return \@chain;
+}
+
+{
+    srand(1);
+    # A coarse grid produces many end points at equal distances.
+    foreach my $range (10, 1000000) {
+        my $collection = random_collection(200, $range);
+        my $start = Slic3r::Point->new(int(rand($range)), int(rand($range)));
+        foreach my $no_reverse (0, 1) {
+            is_deeply
+                [ map entity_points($_), @{$collection->chained_path_from($start, $no_reverse)} ],
+                greedy_chain($collection, $start, $no_reverse),
+                "chained_path_from matches the greedy search, range $range, no_reverse $no_reverse";
+        }
+        is_deeply
+            [ map entity_points($_), @{$collection->chained_path(0)} ],
+            greedy_chain($collection, $collection->[0]->first_point, 0),
+            "chained_path matches the greedy search, range $range";
+    }
+}
+
+{
+    my $travel_length = sub {
+        my ($chain, $start) = @_;
+        my $length = 0;
+        foreach my $entity (@$chain) {
+            $length += $start->distance_to($entity->first_point);
+            $start = $entity->last_point;
+        }
+        return $length;
+    };
+    my $key = sub { join ';', map { join ',', @$_ } @{$_[0]} };
+
+    srand(2);
+    my $collection = random_collection(300, 1000000);
+    my $start = Slic3r::Point->new(0, 0);
+    my %forward  = map { $key->(entity_points($_)) => 1 } @$collection;
+    my %reversed = map { $key->([ reverse @{entity_points($_)} ]) => 1 } grep ! $_->isa('Slic3r::ExtrusionLoop'), @$collection;
+    foreach my $no_reverse (0, 1) {
+        my $greedy   = $collection->chained_path_from($start, $no_reverse);
+        my $improved = $collection->chained_path_from($start, $no_reverse, Slic3r::ExtrusionPath::EXTR_ROLE_MIXED, 1.);
+        ok $travel_length->($improved, $start) <= $travel_length->($greedy, $start) + 1e-3,
+            "2-opt does not increase the travel length, no_reverse $no_reverse";
+        is_deeply
+            [ sort map { my $k = $key->(entity_points($_)); $forward{$k} ? $k : $key->([ reverse @{entity_points($_)} ]) } @$improved ],
+            [ sort keys %forward ],
+            "2-opt keeps all the items, no_reverse $no_reverse";
+        is scalar(grep {
+                my $k = $key->(entity_points($_));
+                ! ($forward{$k} || (! $no_reverse && ! $_->isa('Slic3r::ExtrusionLoop') && $reversed{$k}));
+            } @$improved), 0,
+            "2-opt reverses only the reversible items, no_reverse $no_reverse";
+    }
+}
+
 __END__
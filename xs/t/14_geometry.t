@@ -4,7 +4,7 @@ use strict;
 use warnings;
 
 use Slic3r::XS;
-use Test::More tests => 9;
+use Test::More tests => 17;
 
 use constant PI => 4 * atan2(1, 1);
 
@@ -37,4 +37,50 @@ use constant PI => 4 * atan2(1, 1);
     is scalar(@$positions), 4, 'arrange() returns expected number of positions';
 }
 
+# The former chaining: a linear search for the closest of all the remaining points.
+sub greedy_chain {
+    my ($points, $start) = @_;
+    my @remaining = 0 .. $#$points;
+    my @order;
+    while (@remaining) {
+        my $i = $start->nearest_point_index([ @$points[@remaining] ]);
+        push @order, $remaining[$i];
+        $start = $points->[$remaining[$i]];
+        splice @remaining, $i, 1;
+    }
+    return \@order;
+}
+
+{
+    srand(1);
+    # A coarse grid produces many points at equal distances.
+    foreach my $range (10, 1000, 100000000) {
+        my @points = map Slic3r::Point->new(int(rand($range)), int(rand($range))), 1 .. 500;
+        my $start = Slic3r::Point->new(int(rand($range)), int(rand($range)));
+        is_deeply Slic3r::Geometry::chained_path_from(\@points, $start), greedy_chain(\@points, $start),
+            "chained_path_from matches the greedy search, range $range";
+        is_deeply Slic3r::Geometry::chained_path(\@points), greedy_chain(\@points, $points[0]),
+            "chained_path matches the greedy search, range $range";
+    }
+}
+
+{
+    srand(2);
+    my @points = map Slic3r::Point->new(int(rand(1000000)), int(rand(1000000))), 1 .. 500;
+    my $start = Slic3r::Point->new(0, 0);
+    my $travel_length = sub {
+        my ($order) = @_;
+        my ($length, $last) = (0, $start);
+        foreach my $i (@$order) {
+            $length += $last->distance_to($points[$i]);
+            $last = $points[$i];
+        }
+        return $length;
+    };
+    my $improved = Slic3r::Geometry::chained_path_from(\@points, $start, 1.);
+    is_deeply [ sort { $a <=> $b } @$improved ], [ 0 .. $#points ], '2-opt keeps all the points';
+    ok $travel_length->($improved) <= $travel_length->(Slic3r::Geometry::chained_path_from(\@points, $start)) + 1e-3,
+        '2-opt does not increase the travel length';
+}
+
 __END__
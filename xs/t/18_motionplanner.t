@@ -9,7 +9,7 @@ BEGIN {
 }
 
 use Slic3r::XS;
-use Test::More tests => 20;
+use Test::More tests => 33;
 
 my $square = Slic3r::Polygon->new(  # ccw
     [100, 100],
@@ -40,6 +40,31 @@ my $expolygon = Slic3r::ExPolygon->new($square, $hole_in_square);
     ok $path->first_point->coincides_with($from), 'first path point coincides with initial point';
     ok $path->last_point->coincides_with($to), 'last path point coincides with destination point';
     ok $expolygon->contains_polyline($path), 'path is fully contained in expolygon';
+    
+    my $path2 = $mp->shortest_path($from, $to);
+    is scalar(@$path2), scalar(@$path), 'repeated travel returns the same number of points';
+    ok $path2->length == $path->length, 'repeated travel returns the same path';
+}
+
+{
+    my $mp = Slic3r::MotionPlanner->new([ $expolygon ]);
+    
+    # Travels around the hole with the lengths of the routes planned between the graph nodes
+    # closest to the end points, before the end points were connected into the graph.
+    foreach my $travel (
+        [ [120, 120], [180, 180], 117.517 ],
+        [ [150, 120], [150, 180], 108.297 ],
+        [ [110, 150], [190, 150], 116.029 ],
+        [ [120, 180], [180, 120], 117.517 ],
+        [ [145, 110], [155, 190], 131.621 ],
+    ) {
+        my ($from, $to) = map Slic3r::Point->new(@$_), @$travel[0,1];
+        $_->scale(1/0.000001) for $from, $to;
+        my $path = $mp->shortest_path($from, $to);
+        is scalar(grep !$expolygon->contains_line($_), @{$path->lines}), 0,
+            'every segment of the path is contained in expolygon';
+        ok $path->length * 0.000001 <= $travel->[2], 'path is not longer than the path between the closest nodes';
+    }
 }
 
 {
@@ -56,6 +81,7 @@ my $expolygon = Slic3r::ExPolygon->new($square, $hole_in_square);
     ok $path->first_point->coincides_with($from), 'first path point coincides with initial point';
     ok $path->last_point->coincides_with($to), 'last path point coincides with destination point';
     is scalar(@{ Slic3r::Geometry::Clipper::intersection_pl([$path], [@$expolygon]) }), 0, 'path has no intersection with expolygon';
+    ok $path->length * 0.000001 <= 226.810, 'path is not longer than the path between the closest nodes';
 }
 
 {
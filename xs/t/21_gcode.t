@@ -4,7 +4,7 @@ use strict;
 use warnings;
 
 use Slic3r::XS;
-use Test::More tests => 2;
+use Test::More tests => 4;
 
 {
     my $gcodegen = Slic3r::GCode->new;
@@ -14,4 +14,30 @@ use Test::More tests => 2;
     is_deeply $gcodegen->origin->pp, [15,5], 'origin returns reference to point';
 }
 
+{
+    # The G-code numbers used to be formatted by std::ostream, which formats by the printf conversions:
+    # %.<precision>f with std::fixed << std::setprecision(precision), %g with the default formatting.
+    my $negative_zero = -1e-300 * 1e-300;
+    my @values = (0, $negative_zero, -1e-7, 0.0005, 0.0015, 0.0125, 1.0005, 2.5, 1.1, 40, 2400, 2400.5,
+        1234567.891, 999999.4, 999999.5, 123456.5, 100000, 1e-5, 1e12, 1e15, -1e20, 1.5e300);
+    srand(1);
+    for (1 .. 2000) {
+        my $value = (rand(2) - 1) * 10 ** (rand(20) - 7);
+        # Rounding ties of the decimal digits.
+        push @values, $value, (int(rand(100000000)) + 0.5) / 10 ** int(rand(7));
+    }
+    my @fixed_mismatches;
+    foreach my $value (@values) {
+        foreach my $precision (0 .. 6) {
+            my $expected = sprintf "%.${precision}f", $value;
+            my $formatted = Slic3r::GCode::format_fixed($value, $precision);
+            push @fixed_mismatches, "$formatted <> $expected" if $formatted ne $expected;
+        }
+    }
+    is_deeply \@fixed_mismatches, [], 'format_fixed matches the fixed stream format';
+    my @general_mismatches = grep { $_->[0] ne $_->[1] }
+        map [ Slic3r::GCode::format_general($_), sprintf("%g", $_) ], @values;
+    is_deeply \@general_mismatches, [], 'format_general matches the default stream format';
+}
+
 __END__
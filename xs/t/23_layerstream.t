@@ -0,0 +1,124 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Cwd qw(abs_path);
+use Slic3r::XS;
+use Test::More tests => 10;
+
+my $path = abs_path($0) . '.layers.temp';
+
+# Print of a single 20mm cube, processed up to the infill by the XS methods.
+sub init_print {
+    my ($model, %params) = @_;
+
+    my $config = Slic3r::Config::new_from_defaults;
+    $config->set($_, $params{$_}) for keys %params;
+    my $print = Slic3r::Print->new;
+    $print->apply_config($config);
+    $print->add_model_object($_) for @{$model->objects};
+    $print->apply_config($config);
+    return $print;
+}
+
+sub process {
+    my ($object) = @_;
+
+    $object->_slice;
+    $object->_fix_slicing_errors;
+    $object->set_step_done(Slic3r::Print::State::STEP_SLICE());
+    $object->_make_perimeters;
+    $object->_prepare_infill;
+    $object->set_step_done(Slic3r::Print::State::STEP_PREPARE_INFILL());
+    $object->_infill;
+}
+
+sub extrusions_to_string {
+    my ($collection) = @_;
+    return join ' ', map { join ',', map { join ':', @$_ } @{$_->pp} } @{$collection->polygons_covered_by_width};
+}
+
+# Slices, perimeters and fills of all the layers of an object.
+sub dump_layers {
+    my ($object) = @_;
+
+    my @layers;
+    for my $i (0 .. $object->layer_count - 1) {
+        my $layer = $object->get_layer($i);
+        my @regions;
+        for my $region_id (0 .. $layer->region_count - 1) {
+            my $layerm = $layer->get_region($region_id);
+            push @regions, {
+                slices      => [ map { [ $_->surface_type, $_->expolygon->pp ] } @{$layerm->slices} ],
+                perimeters  => extrusions_to_string($layerm->perimeters),
+                fills       => extrusions_to_string($layerm->fills),
+            };
+        }
+        push @layers, {
+            id      => $layer->id,
+            print_z => $layer->print_z,
+            slices  => $layer->slices->pp,
+            regions => \@regions,
+        };
+    }
+    return \@layers;
+}
+
+my $model = Slic3r::Model->new;
+{
+    my $object = $model->_add_object;
+    $object->_add_volume(Slic3r::TriangleMesh::cube(20, 20, 20));
+    $object->_add_instance->set_offset(Slic3r::Pointf->new(100, 100));
+}
+
+{
+    my $print = init_print($model);
+    my $object = $print->get_object(0);
+    process($object);
+    ok $object->layer_count > 0, 'object processed';
+    my $expected = dump_layers($object);
+    $object->save_layers($path);
+    ok -s $path, 'layers saved';
+
+    my $print2 = init_print($model);
+    my $object2 = $print2->get_object(0);
+    $object2->load_layers($path);
+    is $object2->layer_count, $object->layer_count, 'same number of layers loaded';
+    ok $object2->step_done(Slic3r::Print::State::STEP_INFILL()), 'steps marked done after loading';
+    is_deeply dump_layers($object2), $expected, 'loaded layers match the saved layers';
+}
+
+{
+    my $print = init_print($model, perimeters => 5);
+    my $object = $print->get_object(0);
+    eval { $object->load_layers($path) };
+    like $@, qr/different object or configuration/, 'layers of a different configuration are rejected';
+    is $object->layer_count, 0, 'no layers left after a failed load';
+    ok ! $object->step_done(Slic3r::Print::State::STEP_SLICE()), 'steps not done after a failed load';
+}
+
+{
+    my $model2 = Slic3r::Model->new;
+    my $object = $model2->_add_object;
+    $object->_add_volume(Slic3r::TriangleMesh::cube(20, 20, 10));
+    $object->_add_instance->set_offset(Slic3r::Pointf->new(100, 100));
+    my $print = init_print($model2);
+    eval { $print->get_object(0)->load_layers($path) };
+    like $@, qr/different object or configuration/, 'layers of a different object are rejected';
+}
+
+{
+    # Truncate the stream to a part of its header.
+    open my $fh, '+<', $path or die "Cannot open $path: $!";
+    binmode $fh;
+    truncate $fh, 10;
+    close $fh;
+    my $print = init_print($model);
+    eval { $print->get_object(0)->load_layers($path) };
+    like $@, qr/Not a layer stream/, 'truncated header is rejected';
+}
+
+unlink $path;
+
+__END__
@@ -0,0 +1,112 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Cwd qw(abs_path);
+use Slic3r::XS;
+use Test::More tests => 10;
+
+use constant PI => 4 * atan2(1, 1);
+
+my $path = abs_path($0) . '.temp';
+
+# Torus of 2 * $n * $m facets. If $skip is set, every $skip-th facet is left out to make holes,
+# and a degenerate facet and a duplicate facet sharing its edges with the torus are added.
+sub torus {
+    my ($n, $m, $skip) = @_;
+
+    my @vertices;
+    for my $i (0 .. $n - 1) {
+        for my $j (0 .. $m - 1) {
+            my ($u, $v) = (2 * PI * $i / $n, 2 * PI * $j / $m);
+            push @vertices, [ (30 + 10 * cos($v)) * cos($u), (30 + 10 * cos($v)) * sin($u), 10 * sin($v) ];
+        }
+    }
+    my @facets;
+    for my $i (0 .. $n - 1) {
+        for my $j (0 .. $m - 1) {
+            my @quad = ($i * $m + $j, (($i + 1) % $n) * $m + $j,
+                (($i + 1) % $n) * $m + ($j + 1) % $m, $i * $m + ($j + 1) % $m);
+            push @facets, [ @quad[0, 1, 2] ], [ @quad[0, 2, 3] ];
+        }
+    }
+    if ($skip) {
+        @facets = @facets[ grep { $_ % $skip } 0 .. $#facets ];
+        push @facets, [ @{$facets[5]}[0, 0, 1] ], [ @{$facets[100]} ];
+    }
+    my $mesh = Slic3r::TriangleMesh->new;
+    $mesh->ReadFromPerl(\@vertices, \@facets);
+    return $mesh;
+}
+
+# Neighbors, shared vertices and statistics of a repaired mesh.
+sub topology {
+    my ($mesh) = @_;
+    $mesh->repair;
+    return {
+        neighbors   => $mesh->neighbors,
+        facets      => $mesh->facets,
+        vertices    => $mesh->vertices,
+        stats       => $mesh->stats,
+    };
+}
+
+# The edges of the closed torus are all matched exactly, holes of the other torus are filled by repair().
+foreach my $skip (0, 97) {
+    Slic3r::TriangleMesh::set_parallel(1);
+    my $sequential = topology(torus(300, 120, $skip));
+    Slic3r::TriangleMesh::set_parallel(2);
+    my $parallel = topology(torus(300, 120, $skip));
+    Slic3r::TriangleMesh::set_parallel(0);
+    ok $sequential->{stats}{number_of_facets} > 65536, 'mesh above the parallel threshold';
+    is_deeply $parallel, $sequential, $skip ? 'parallel repair of a defective mesh matches the sequential one' :
+        'parallel repair matches the sequential one';
+}
+
+{
+    my $mesh = torus(300, 120);
+    $mesh->repair;
+    $mesh->write_binary("$path.binary.stl");
+    $mesh->write_ascii("$path.ascii.stl");
+
+    my $read = sub {
+        my ($file, $mode) = @_;
+        Slic3r::TriangleMesh::set_parallel($mode);
+        my $mesh = Slic3r::TriangleMesh->new;
+        $mesh->ReadSTLFile($file);
+        Slic3r::TriangleMesh::set_parallel(0);
+        return $mesh;
+    };
+    my $binary = topology($read->("$path.binary.stl", 0));
+    # 2 * 300 * 120 facets, the ASCII STL is parsed by several tasks.
+    is $binary->{stats}{number_of_facets}, $mesh->facets_count, 'binary STL read';
+    is_deeply topology($read->("$path.ascii.stl", 0)), $binary, 'ASCII STL parsed in parallel matches the binary STL';
+    is_deeply topology($read->("$path.ascii.stl", 1)), $binary, 'ASCII STL parsed sequentially matches the binary STL';
+    unlink "$path.binary.stl", "$path.ascii.stl";
+}
+
+{
+    my $write_ascii = sub {
+        my ($coordinate) = @_;
+        open my $fh, '>', "$path.ascii.stl" or die "Cannot open $path.ascii.stl: $!";
+        print $fh "solid test\n";
+        for my $z (0 .. 3) {
+            print $fh "facet normal 0 0 1\nouter loop\n";
+            print $fh "vertex 0 0 $z\nvertex $coordinate 0 $z\nvertex 0 1 $z\n";
+            print $fh "endloop\nendfacet\n";
+        }
+        print $fh "endsolid test\n";
+        close $fh;
+    };
+    $write_ascii->('1.5');
+    ok Slic3r::Model->load_stl("$path.ascii.stl", 'test'), 'ASCII STL loaded';
+    my $mesh = Slic3r::TriangleMesh->new;
+    $mesh->ReadSTLFile("$path.ascii.stl");
+    is_deeply $mesh->bb3, [ 0, 0, 1.5, 1, 0, 3 ], 'ASCII STL coordinates parsed';
+    $write_ascii->('1.5abc');
+    ok ! Slic3r::Model->load_stl("$path.ascii.stl", 'test'), 'number followed by garbage is rejected';
+    unlink "$path.ascii.stl";
+}
+
+__END__
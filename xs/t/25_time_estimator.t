@@ -0,0 +1,114 @@
+#!/usr/bin/perl
+
+use strict;
+use warnings;
+
+use Cwd qw(abs_path);
+use Slic3r::XS;
+use Test::More tests => 11;
+
+my $path = abs_path($0) . '.temp';
+
+# 50 layers of 200 extrusions each, alternating long moves reaching the nominal speed and short moves not reaching it,
+# so that the parallel planner splits the blocks into several ranges. The gcode ends with a long slow extrusion
+# not terminated by a newline. Returns the gcode and the ids of the last G1 line of each layer.
+sub gcode {
+    my ($acceleration) = @_;
+
+    my $gcode = "G21\nG90\nM83\nM204 S$acceleration\n";
+    my $g1_line_id = 0;
+    my @layer_ends;
+    for my $layer (0 .. 49) {
+        $gcode .= sprintf "G1 Z%.3f F7800\n", 0.2 * ($layer + 1);
+        ++ $g1_line_id;
+        for my $i (0 .. 199) {
+            my $x = 50 + (($i % 2) ? 40 : 0) + ($i % 7);
+            my $y = 50 + 0.2 * $i + (($i % 5 == 0) ? 30 : 0);
+            $gcode .= sprintf "G1 X%.3f Y%.3f E0.50000 F%d\n", $x, $y, ($i % 3 == 0) ? 7800 : 1800;
+            ++ $g1_line_id;
+        }
+        push @layer_ends, $g1_line_id;
+    }
+    $gcode .= "G1 X150.000 Y150.000 E5.00000 F60";
+    return ($gcode, \@layer_ends);
+}
+
+sub write_file {
+    my ($file, $content) = @_;
+    open my $fh, '>', $file or die "Cannot write $file: $!";
+    binmode $fh;
+    print $fh $content;
+    close $fh;
+}
+
+sub read_file {
+    my ($file) = @_;
+    open my $fh, '<', $file or die "Cannot read $file: $!";
+    binmode $fh;
+    local $/;
+    my $content = <$fh>;
+    close $fh;
+    return $content;
+}
+
+{
+    my ($gcode, $layer_ends) = gcode(1000);
+    my $g1_lines = $layer_ends->[-1] + 1;
+
+    my $parallel = Slic3r::GCode::TimeEstimator->new;
+    ok $parallel->get_parallel_planner, 'the blocks are planned in parallel by default';
+    $parallel->calculate_time_from_text($gcode);
+
+    my $serial = Slic3r::GCode::TimeEstimator->new;
+    $serial->set_parallel_planner(0);
+    $serial->calculate_time_from_text($gcode);
+
+    ok $g1_lines > 4096, 'the gcode has more blocks than a single planner range';
+    ok $serial->get_time > 0, 'time is estimated';
+    is $parallel->get_time, $serial->get_time, 'total time of the parallel planner matches the serial planner';
+    is_deeply [ map $parallel->get_elapsed_time($_), @$layer_ends ], [ map $serial->get_elapsed_time($_), @$layer_ends ],
+        'per layer times of the parallel planner match the serial planner';
+    is_deeply [ map $parallel->get_elapsed_time($_), 1 .. $g1_lines ], [ map $serial->get_elapsed_time($_), 1 .. $g1_lines ],
+        'elapsed times of all extruding moves of the parallel planner match the serial planner';
+}
+
+{
+    my ($gcode) = gcode(1000);
+    my $normal = Slic3r::GCode::TimeEstimator->new;
+    $normal->calculate_time_from_text($gcode);
+    # lower acceleration in the silent mode
+    my $silent = Slic3r::GCode::TimeEstimator->new(1);
+    $silent->calculate_time_from_text((gcode(250))[0]);
+
+    # the remaining times used to be placed by processing the file once per mode, the normal mode first
+    write_file($path, $gcode);
+    Slic3r::GCode::TimeEstimator::post_process_remaining_times($path, 60, [ $normal ]);
+    Slic3r::GCode::TimeEstimator::post_process_remaining_times($path, 60, [ $silent ]);
+    my $two_passes = read_file($path);
+
+    write_file($path, $gcode);
+    Slic3r::GCode::TimeEstimator::post_process_remaining_times($path, 60, [ $silent, $normal ]);
+    my $single_pass = read_file($path);
+    unlink $path;
+
+    is $single_pass, $two_passes, 'remaining times placed in a single pass match the remaining times placed once per mode';
+    ok $single_pass =~ /^M73 P\d+ R\d+$/m && $single_pass =~ /^M73 Q\d+ S\d+$/m, 'remaining times of both modes are placed';
+
+    (my $stripped = $single_pass) =~ s/^M73 .*\n//mg;
+    is $stripped, "$gcode\n", 'remaining times are placed on their own lines';
+
+    my ($misplaced, $misordered) = (0, 0);
+    my ($previous, $previous_g1) = ('', '');
+    for my $line (split /\n/, $single_pass) {
+        if ($line =~ /^M73 /) {
+            ++ $misplaced if $previous !~ /^M73 / && $previous !~ /^G1 .*E/;
+            ++ $misordered if $line =~ /^M73 Q/ && $previous =~ /^M73 P/;
+        }
+        $previous = $line;
+    }
+    ok !$misplaced && !$misordered, 'remaining times follow the extruding moves, the silent mode first';
+
+    like $single_pass, qr/ F60\nM73 Q100 S0\nM73 P100 R0\n\z/, 'remaining times are placed after the last line not terminated by a newline';
+}
+
+__END__